@@ -0,0 +1,175 @@
+// Measures how long selecting the final submissions holds the row lock taken by
+// submission::update_final_lock() when several judge workers select finals
+// concurrently, for the selection engine (update_final()) and for the previous
+// multi-query implementation. It needs a Sim database (configured in
+// .db.config in the working directory) with some submissions: the finals of
+// the existing (owner, problem, contest problem) triples are selected in
+// transactions that are rolled back, so nothing is changed.
+//
+// Usage: final_selection_benchmark [SELECTIONS_PER_WORKER]  (default: 1000)
+
+#include "legacy_final_selection.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <sim/submission.hh>
+#include <thread>
+#include <unistd.h>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+using std::vector;
+
+namespace {
+
+struct Triple {
+	uint64_t owner;
+	uint64_t problem_id;
+	std::optional<uint64_t> contest_problem_id;
+};
+
+vector<Triple> load_triples(MySQL::Connection& mysql) {
+	auto stmt = mysql.prepare("SELECT owner, problem_id, contest_problem_id "
+	                          "FROM submissions WHERE owner IS NOT NULL "
+	                          "GROUP BY owner, problem_id, contest_problem_id "
+	                          "LIMIT 10000");
+	stmt.bind_and_execute();
+	uint64_t owner;
+	uint64_t problem_id;
+	MySQL::Optional<uint64_t> contest_problem_id;
+	stmt.res_bind_all(owner, problem_id, contest_problem_id);
+
+	vector<Triple> triples;
+	while (stmt.next()) {
+		auto& triple = triples.emplace_back(Triple {owner, problem_id, {}});
+		if (contest_problem_id.has_value())
+			triple.contest_problem_id = contest_problem_id.value();
+	}
+
+	return triples;
+}
+
+struct Times {
+	vector<microseconds> waits; // For the lock
+	vector<microseconds> holds; // Of the lock
+};
+
+template <class UpdateFinal>
+Times run_worker(const vector<Triple>& triples, size_t worker_no,
+                 size_t selections_no, UpdateFinal&& update_final) {
+	auto mysql = MySQL::make_conn_with_credential_file(".db.config");
+	Times times;
+	times.waits.reserve(selections_no);
+	times.holds.reserve(selections_no);
+	for (size_t i = 0; i < selections_no; ++i) {
+		// Neighbouring workers select the same triples from time to time
+		auto& triple = triples[(worker_no * 7 + i) % triples.size()];
+		auto begin = steady_clock::now();
+		steady_clock::time_point locked;
+		{
+			auto transaction = mysql.start_transaction();
+			submission::update_final_lock(mysql, triple.owner,
+			                              triple.problem_id);
+			locked = steady_clock::now();
+			update_final(mysql, triple);
+			// The transaction is rolled back here
+		}
+		auto end = steady_clock::now();
+		times.waits.emplace_back(duration_cast<microseconds>(locked - begin));
+		times.holds.emplace_back(duration_cast<microseconds>(end - locked));
+	}
+
+	return times;
+}
+
+int64_t percentile(vector<microseconds>& v, double p) {
+	if (v.empty())
+		return 0;
+
+	size_t pos = std::min(v.size() - 1, size_t(v.size() * p));
+	std::nth_element(v.begin(), v.begin() + pos, v.end());
+	return v[pos].count();
+}
+
+template <class UpdateFinal>
+void benchmark(const char* name, const vector<Triple>& triples,
+               size_t workers_no, size_t selections_no,
+               UpdateFinal&& update_final) {
+	vector<Times> times(workers_no);
+	vector<std::thread> workers;
+	auto begin = steady_clock::now();
+	for (size_t i = 0; i < workers_no; ++i) {
+		workers.emplace_back([&, i] {
+			try {
+				times[i] = run_worker(triples, i, selections_no, update_final);
+			} catch (const std::exception& e) {
+				fprintf(stderr, "Worker failed: %s\n", e.what());
+				exit(1);
+			}
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	auto duration = steady_clock::now() - begin;
+
+	Times all;
+	for (auto& t : times) {
+		all.waits.insert(all.waits.end(), t.waits.begin(), t.waits.end());
+		all.holds.insert(all.holds.end(), t.holds.begin(), t.holds.end());
+	}
+
+	double seconds =
+	   duration_cast<microseconds>(duration).count() / 1'000'000.0;
+	printf("%-8s %2zu workers: %8.0f selections/s   lock held [us]:"
+	       " p50 %6" PRIi64 "  p99 %6" PRIi64 "  max %6" PRIi64
+	       "   waited [us]: p50 %6" PRIi64 "  p99 %6" PRIi64 "\n",
+	       name, workers_no, all.holds.size() / seconds,
+	       percentile(all.holds, 0.5), percentile(all.holds, 0.99),
+	       percentile(all.holds, 1), percentile(all.waits, 0.5),
+	       percentile(all.waits, 0.99));
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	size_t selections_no =
+	   (argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000);
+
+	if (access(".db.config", R_OK) != 0) {
+		fprintf(stderr, "No .db.config in the working directory, skipping\n");
+		return 0;
+	}
+
+	vector<Triple> triples;
+	try {
+		auto mysql = MySQL::make_conn_with_credential_file(".db.config");
+		triples = load_triples(mysql);
+	} catch (const std::exception& e) {
+		fprintf(stderr, "Failed to load the submissions: %s\n", e.what());
+		return 1;
+	}
+
+	if (triples.empty()) {
+		fprintf(stderr, "There are no submissions, skipping\n");
+		return 0;
+	}
+
+	printf("%zu (owner, problem, contest problem) triples\n", triples.size());
+	for (size_t workers_no : {1, 2, 4, 8}) {
+		benchmark("legacy", triples, workers_no, selections_no,
+		          [](MySQL::Connection& mysql, const Triple& t) {
+			          legacy::update_final(mysql, t.owner, t.problem_id,
+			                               t.contest_problem_id);
+		          });
+		benchmark("engine", triples, workers_no, selections_no,
+		          [](MySQL::Connection& mysql, const Triple& t) {
+			          submission::update_final(mysql, t.owner, t.problem_id,
+			                                   t.contest_problem_id, false);
+		          });
+	}
+}
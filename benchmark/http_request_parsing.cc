@@ -0,0 +1,251 @@
+// Compares the throughput of Connection::get_request() on in-memory requests
+// (as the web server's workers parse them) against the previous parser that
+// built every header line character by character and then split it into
+// newly allocated strings.
+//
+// Usage: http_request_parsing_benchmark [RECORDED_TRAFFIC_FILE]
+//   The file contains raw requests one after another (e.g. the client side of
+//   TCP streams dumped with tcpflow), every one with a Content-Length header
+//   if it has content. Without the file, a built-in sample of requests that
+//   browsers send to Sim is used.
+
+#include "../src/web_interface/connection.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <simlib/file_contents.hh>
+
+using server::Connection;
+using server::HttpRequest;
+using std::string;
+using std::vector;
+
+namespace {
+
+constexpr char COOKIE[] =
+   "Cookie: _ga=GA1.1.1234567890.1700000000; "
+   "csrf_token=Zr4uKq3cXbVb1hQ7TfJk0pM9sLw2yN6e; "
+   "session=TcV8nR2qW5xY7zA1bC3dE4fG6hJ9kL0m; "
+   "prefs=theme%3Ddark%26lang%3Den\r\n";
+
+constexpr char BROWSER_HEADERS[] =
+   "Host: sim.example.com\r\n"
+   "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, "
+   "like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+   "Accept-Encoding: gzip, deflate, br\r\n"
+   "Accept-Language: en-US,en;q=0.9,pl;q=0.8\r\n"
+   "Connection: keep-alive\r\n";
+
+vector<string> sample_requests() {
+	vector<string> res;
+	auto get = [&](StringView target, StringView accept, StringView extra) {
+		res.emplace_back(concat_tostr(
+		   "GET ", target, " HTTP/1.1\r\n", BROWSER_HEADERS, "Accept: ", accept,
+		   "\r\nReferer: https://sim.example.com/c/c12\r\n", COOKIE, extra,
+		   "\r\n"));
+	};
+	auto post = [&](StringView target, StringView content) {
+		res.emplace_back(concat_tostr(
+		   "POST ", target, " HTTP/1.1\r\n", BROWSER_HEADERS,
+		   "Accept: */*\r\nOrigin: https://sim.example.com\r\n"
+		   "X-Requested-With: XMLHttpRequest\r\n"
+		   "Content-Type: application/x-www-form-urlencoded; charset=UTF-8\r\n"
+		   "Referer: https://sim.example.com/c/c12\r\n",
+		   COOKIE, "Content-Length: ", content.size(), "\r\n\r\n", content));
+	};
+
+	get("/c/c12/ranking", "text/html,application/xhtml+xml,*/*;q=0.8",
+	    "Upgrade-Insecure-Requests: 1\r\n");
+	get("/kit/styles.css?1700000000", "text/css,*/*;q=0.1",
+	    "If-Modified-Since: Tue, 14 Nov 2023 22:13:20 GMT\r\n");
+	get("/kit/scripts.js?1700000000", "*/*",
+	    "If-None-Match: \"1f2e3d-4c5b-17a9b8c7d6e5f4\"\r\n");
+	get("/s/123456", "text/html,application/xhtml+xml,*/*;q=0.8", "");
+	post("/api/submissions/=123456/id%3E123400",
+	     "csrf_token=Zr4uKq3cXbVb1hQ7TfJk0pM9sLw2yN6e");
+	post("/api/contest/c12", "csrf_token=Zr4uKq3cXbVb1hQ7TfJk0pM9sLw2yN6e");
+	post("/api/user/42/edit",
+	     "csrf_token=Zr4uKq3cXbVb1hQ7TfJk0pM9sLw2yN6e&username=alice"
+	     "&first_name=Alice&last_name=Liddell&email=alice%40example.com");
+	return res;
+}
+
+// Splits the recorded traffic into requests
+vector<string> load_requests(const string& file) {
+	string data = get_file_contents(file);
+	vector<string> res;
+	for (size_t beg = 0; beg < data.size();) {
+		while (data.compare(beg, 2, "\r\n") == 0)
+			beg += 2;
+
+		size_t head_end = data.find("\r\n\r\n", beg);
+		if (head_end == string::npos)
+			break;
+
+		head_end += 4;
+		size_t content_len = 0;
+		StringView head(data.data() + beg, head_end - beg);
+		for (size_t pos = 0; (pos = head.find("\r\n", pos)) != StringView::npos;
+		     pos += 2) {
+			constexpr char cl_header[] = "\r\nContent-Length:";
+			constexpr size_t cl_header_len = sizeof(cl_header) - 1;
+			if (head.size() - pos > cl_header_len and
+			    strncasecmp(head.data() + pos, cl_header, cl_header_len) == 0) {
+				content_len =
+				   strtoull(head.data() + pos + cl_header_len, nullptr, 10);
+			}
+		}
+
+		size_t end = std::min(head_end + content_len, data.size());
+		res.emplace_back(data, beg, end - beg);
+		beg = end;
+	}
+
+	return res;
+}
+
+// The parser replaced by the current one (the same as in Connection, but
+// reading from a string)
+class LegacyParser {
+	StringView input_;
+	size_t pos_ = 0;
+
+	int get_char() {
+		return (pos_ < input_.size() ? (unsigned char)input_[pos_++] : -1);
+	}
+
+	string get_header_line() {
+		string line;
+		int c;
+		while ((c = get_char()) != -1) {
+			if (c == '\n' && line.size() && line.back() == '\r') {
+				line.pop_back();
+				break;
+			}
+			line += c;
+		}
+		return line;
+	}
+
+	static std::pair<string, string> parse_header_line(const string& header) {
+		size_t beg = header.find(':');
+		string name = header.substr(0, beg);
+		size_t end = header.size();
+		while (is_space(header[end - 1]))
+			--end;
+		while (++beg < header.size() && is_space(header[beg])) {
+		}
+		return {name, header.substr(beg, end - beg)};
+	}
+
+public:
+	explicit LegacyParser(StringView input) : input_(input) {}
+
+	HttpRequest get_request() {
+		HttpRequest req;
+		string request_line = get_header_line();
+		while (request_line.empty() and pos_ < input_.size())
+			request_line = get_header_line();
+
+		size_t sp1 = request_line.find(' ');
+		size_t sp2 = request_line.find(' ', sp1 + 1);
+		req.method = (request_line.compare(0, sp1, "POST") == 0
+		                 ? HttpRequest::POST
+		                 : HttpRequest::GET);
+		req.target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+		req.http_version = request_line.substr(sp2 + 1);
+
+		req.headers["Content-Length"] = '0';
+		string header;
+		while ((header = get_header_line()).size()) {
+			auto hdr = parse_header_line(header);
+			req.headers[hdr.first] = hdr.second;
+		}
+
+		size_t left =
+		   str2num<size_t>(req.headers["Content-Length"]).value_or(0);
+		if (req.method == HttpRequest::POST) {
+			auto limited_get_char = [&] {
+				return (left == 0 ? -1 : (--left, get_char()));
+			};
+			for (int c = '\0'; c != -1;) {
+				string field_name, field_content;
+				bool is_name = true;
+				while ((c = limited_get_char()) != -1) {
+					if (c == '&')
+						break;
+					if (is_name && c == '=')
+						is_name = false;
+					else if (is_name)
+						field_name += c;
+					else
+						field_content += c;
+				}
+				req.form_data[decode_uri(field_name).to_string()] =
+				   decode_uri(field_content).to_string();
+			}
+		}
+		return req;
+	}
+};
+
+template <class Func>
+void measure(const char* name, const vector<string>& requests, Func&& func) {
+	size_t bytes = 0;
+	for (auto& req : requests)
+		bytes += req.size();
+
+	constexpr size_t MIN_REQUESTS = 200'000;
+	size_t rounds = std::max<size_t>(MIN_REQUESTS / requests.size(), 1);
+	size_t host_len_sum = 0; // Prevents optimizing the parsing away
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < rounds; ++i) {
+		for (auto& raw : requests) {
+			HttpRequest req = func(raw);
+			host_len_sum += req.headers.get("Host").size();
+		}
+	}
+	double seconds = std::chrono::duration<double>(
+	                    std::chrono::steady_clock::now() - start)
+	                    .count();
+
+	static volatile size_t sink;
+	sink = host_len_sum;
+	printf("    %-20s %10.0f requests/s %8.1f MiB/s\n", name,
+	       rounds * requests.size() / seconds,
+	       rounds * bytes / seconds / (1 << 20));
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	vector<string> requests =
+	   (argc > 1 ? load_requests(argv[1]) : sample_requests());
+	if (requests.empty()) {
+		fprintf(stderr, "No requests to parse\n");
+		return 1;
+	}
+
+	size_t bytes = 0;
+	for (auto& req : requests)
+		bytes += req.size();
+	printf("%zu requests, %.0f bytes per request on average:\n",
+	       requests.size(), double(bytes) / requests.size());
+
+	measure("legacy", requests,
+	        [](const string& raw) { return LegacyParser(raw).get_request(); });
+	measure("Connection", requests, [](const string& raw) {
+		Connection::Output out;
+		Connection conn(raw, out);
+		HttpRequest req = conn.get_request();
+		if (conn.state() != Connection::OK) {
+			fprintf(stderr, "Failed to parse the request:\n%s\n%s\n",
+			        raw.c_str(), out.data.c_str());
+			exit(1);
+		}
+		return req;
+	});
+
+	return 0;
+}
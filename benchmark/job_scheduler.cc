@@ -0,0 +1,142 @@
+// Compares enqueue and dispatch throughput of the job server's JobScheduler
+// against the previous std::map / std::set based implementation.
+//
+// Usage: job_scheduler_benchmark [JOBS_NO]...  (default: 10000 100000 1000000)
+
+#include "legacy_job_scheduler.hh"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace {
+
+struct QueuedJob {
+	enum Kind { JUDGE, PROBLEM, OTHER } kind;
+	JobScheduler::Job job;
+	uint64_t problem_id;
+};
+
+// Resembles a queue filled by mass rejudges: mostly judge jobs spread over
+// many problems, a few problem jobs (that lock their problems) and other jobs
+std::vector<QueuedJob> generate_jobs(size_t jobs_no) {
+	std::mt19937_64 gen(jobs_no);
+	size_t problems_no = std::max<size_t>(jobs_no / 100, 1);
+	std::uniform_int_distribution<uint64_t> problem(1, problems_no);
+	std::uniform_int_distribution<uint> priority(0, 4);
+	std::uniform_int_distribution<int> kind(0, 99);
+
+	std::vector<QueuedJob> jobs;
+	jobs.reserve(jobs_no);
+	for (uint64_t id = 1; id <= jobs_no; ++id) {
+		int k = kind(gen);
+		uint prio = priority(gen) * 10;
+		if (k < 95)
+			jobs.push_back({QueuedJob::JUDGE, {id, prio, false}, problem(gen)});
+		else if (k < 97)
+			jobs.push_back({QueuedJob::PROBLEM, {id, prio, true}, problem(gen)});
+		else
+			jobs.push_back({QueuedJob::OTHER, {id, prio, false}, 0});
+	}
+
+	return jobs;
+}
+
+struct Result {
+	double enqueue_seconds;
+	double dispatch_seconds;
+	uint64_t order_hash; // Checksum of the order of dispatched jobs
+};
+
+template <class Scheduler>
+Result run(const std::vector<QueuedJob>& jobs) {
+	using std::chrono::steady_clock;
+
+	Scheduler scheduler;
+	auto start = steady_clock::now();
+	for (auto& qj : jobs) {
+		switch (qj.kind) {
+		case QueuedJob::JUDGE:
+			scheduler.add_judge_job(qj.job, qj.problem_id);
+			break;
+		case QueuedJob::PROBLEM:
+			scheduler.add_problem_job(qj.job, qj.problem_id);
+			break;
+		case QueuedJob::OTHER: scheduler.add_other_job(qj.job); break;
+		}
+	}
+	auto enqueued = steady_clock::now();
+
+	// Dispatch the way sync_and_assign_jobs() does, with a job that locks its
+	// problem finishing right after it is passed
+	uint64_t order_hash = 0;
+	for (;;) {
+		auto problem_job = scheduler.best_problem_job();
+		auto other_job = scheduler.best_other_job();
+		auto judge_job = scheduler.best_judge_job();
+
+		JobScheduler::Job best = JobScheduler::Job::least();
+		int idx = -1;
+		if (problem_job.ok() and problem_job.job < best)
+			best = problem_job.job, idx = 0;
+		if (other_job.ok() and other_job.job < best)
+			best = other_job.job, idx = 1;
+		if (judge_job.ok() and judge_job.job < best)
+			best = judge_job.job, idx = 2;
+
+		if (idx == -1)
+			break;
+
+		order_hash = order_hash * 1000003 + best.id;
+		if (idx == 0) {
+			problem_job.was_passed();
+			scheduler.unlock_problem(problem_job.problem_id);
+		} else if (idx == 1) {
+			other_job.was_passed();
+		} else {
+			judge_job.was_passed();
+		}
+	}
+	auto dispatched = steady_clock::now();
+
+	using seconds = std::chrono::duration<double>;
+	return {seconds(enqueued - start).count(),
+	        seconds(dispatched - enqueued).count(), order_hash};
+}
+
+void print(const char* name, size_t jobs_no, const Result& res) {
+	printf("  %-8s enqueue: %8.3f ms (%6.2f M jobs/s)"
+	       "   dispatch: %8.3f ms (%6.2f M jobs/s)\n",
+	       name, res.enqueue_seconds * 1e3,
+	       jobs_no / res.enqueue_seconds / 1e6, res.dispatch_seconds * 1e3,
+	       jobs_no / res.dispatch_seconds / 1e6);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	std::vector<size_t> sizes;
+	for (int i = 1; i < argc; ++i)
+		sizes.emplace_back(strtoull(argv[i], nullptr, 10));
+	if (sizes.empty())
+		sizes = {10'000, 100'000, 1'000'000};
+
+	int rc = 0;
+	for (size_t jobs_no : sizes) {
+		auto jobs = generate_jobs(jobs_no);
+		printf("%zu jobs:\n", jobs_no);
+		auto legacy = run<LegacyJobScheduler>(jobs);
+		print("legacy", jobs_no, legacy);
+		auto flat = run<JobScheduler>(jobs);
+		print("flat", jobs_no, flat);
+
+		if (legacy.order_hash != flat.order_hash) {
+			printf("  ERROR: jobs were dispatched in different orders\n");
+			rc = 1;
+		}
+	}
+
+	return rc;
+}
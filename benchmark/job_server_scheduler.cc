@@ -0,0 +1,261 @@
+// Drives the job server's intake and dispatch path (JobsQueue, assign_jobs(),
+// WorkersPool, EventsQueue) with an in-memory stand-in for the jobs table and
+// no-op job handlers. Reports dispatch latency (from a job becoming PENDING to
+// its handler being called), throughput and contention on the locks of the
+// workers pools and wake-ups of the events loop for different mixes of jobs.
+//
+// Usage: job_server_scheduler_benchmark [JOBS_NO]  (default: 100000)
+
+#include "../src/job_server/jobs_queue.hh"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <poll.h>
+#include <random>
+#include <set>
+#include <sim/jobs.hh>
+
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+// Thread-safe replacement of the jobs table
+class InMemoryJobsSource : public JobsSource {
+	struct StoredJob {
+		JobType type;
+		uint priority;
+		std::optional<uint64_t> aux_id;
+		std::string info;
+		std::optional<Submission> submission;
+	};
+
+	std::mutex mtx_;
+	std::vector<StoredJob> jobs_; // jobs_[id - 1]
+	// (-priority, id) of the PENDING and not noticed jobs
+	std::set<std::pair<int64_t, uint64_t>> pending_;
+
+public:
+	uint64_t add_job(JobType type, uint priority,
+	                 std::optional<uint64_t> aux_id, std::string info,
+	                 std::optional<Submission> submission = std::nullopt) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		jobs_.push_back(
+		   {type, priority, aux_id, std::move(info), submission});
+		uint64_t id = jobs_.size();
+		pending_.emplace(-int64_t(priority), id);
+		return id;
+	}
+
+	void fetch_pending_jobs(
+	   uint limit,
+	   const std::function<void(const PendingJob&)>& callback) override {
+		std::lock_guard<std::mutex> lock(mtx_);
+		for (auto it = pending_.begin(); limit > 0 and it != pending_.end();
+		     ++it, --limit) {
+			auto& job = jobs_[it->second - 1];
+			callback({it->second, job.type, job.priority, job.aux_id, job.info,
+			          job.submission});
+		}
+	}
+
+	void mark_as_noticed(const std::vector<uint64_t>& job_ids) override {
+		std::lock_guard<std::mutex> lock(mtx_);
+		for (uint64_t id : job_ids)
+			pending_.erase({-int64_t(jobs_[id - 1].priority), id});
+	}
+};
+
+struct Scenario {
+	const char* name;
+	uint judge_percent;
+	uint problem_percent; // The rest are other jobs
+	uint64_t problems_no;
+	uint judge_workers_no;
+	uint local_workers_no;
+	uint in_flight; // Maximum number of PENDING jobs not yet handled
+};
+
+// State of the scenario being run, the workers pools and the job handlers
+// access it the way the job server accesses its globals
+struct State {
+	InMemoryJobsSource source;
+	JobsQueue jobs_queue {source};
+	WorkersPool* local_workers;
+	WorkersPool* judge_workers;
+	WorkersPool* remote_judge_workers;
+
+	std::vector<steady_clock::time_point> pending_since;
+	std::vector<nanoseconds> latency;
+	std::atomic<uint64_t> jobs_started {0};
+	uint64_t jobs_exited = 0; // Touched only by the events loop
+
+	explicit State(size_t jobs_no) : pending_since(jobs_no), latency(jobs_no) {}
+};
+
+State* state;
+
+void sync_and_assign_jobs() {
+	state->jobs_queue.sync_with_db();
+	assign_jobs(state->jobs_queue, *state->local_workers,
+	            *state->judge_workers, *state->remote_judge_workers);
+}
+
+void process_job(const WorkersPool::NextJob& job) {
+	auto& st = *state;
+	st.latency[job.id - 1] = steady_clock::now() - st.pending_since[job.id - 1];
+	st.jobs_started.fetch_add(1, std::memory_order_release);
+	// Same exit procedures as in the job server
+	EventsQueue::register_event([job, &st] {
+		if (job.locked_its_problem)
+			st.jobs_queue.unlock_problem(job.problem_id);
+		st.jobs_queue.mark_db_as_changed();
+		++st.jobs_exited;
+	});
+}
+
+void produce_jobs(const Scenario& sc, size_t jobs_no) {
+	auto& st = *state;
+	std::mt19937_64 gen(jobs_no);
+	std::uniform_int_distribution<uint64_t> problem(1, sc.problems_no);
+	std::uniform_int_distribution<uint> priority(0, 4);
+	std::uniform_int_distribution<uint> kind(0, 99);
+	std::uniform_int_distribution<uint64_t> contest(0, 20);
+	std::uniform_int_distribution<uint64_t> user(1, 500);
+
+	for (uint64_t added = 0; added < jobs_no;) {
+		while (added - st.jobs_started.load(std::memory_order_acquire) >=
+		       sc.in_flight) {
+			std::this_thread::yield();
+		}
+
+		// The job handlers (e.g. rejudge) add jobs in small bursts
+		for (int i = 0; i < 8 and added < jobs_no; ++i, ++added) {
+			uint k = kind(gen);
+			uint prio = priority(gen) * 10;
+			// pending_since is set before the job becomes visible
+			st.pending_since[added] = steady_clock::now();
+			if (k < sc.judge_percent) {
+				uint64_t contest_id = contest(gen);
+				JobsSource::Submission submission {
+				   user(gen),
+				   (contest_id == 0 ? std::nullopt
+				                    : std::optional<uint64_t>(contest_id)),
+				   contest_id % 2 == 1};
+				st.source.add_job((prio < 20 ? JobType::REJUDGE_SUBMISSION
+				                             : JobType::JUDGE_SUBMISSION),
+				                  prio, std::nullopt,
+				                  jobs::dump_string(std::to_string(problem(gen))),
+				                  submission);
+			} else if (k < sc.judge_percent + sc.problem_percent) {
+				st.source.add_job(JobType::EDIT_PROBLEM, prio, problem(gen), {});
+			} else {
+				st.source.add_job(JobType::DELETE_FILE, prio, std::nullopt, {});
+			}
+		}
+
+		// Same as a notification from the notify file
+		EventsQueue::register_event([&st] {
+			st.jobs_queue.mark_db_as_changed();
+			sync_and_assign_jobs();
+		});
+	}
+}
+
+void run_events_loop(size_t jobs_no) {
+	pollfd pfd = {EventsQueue::get_notifier_fd(), POLLIN, 0};
+	while (state->jobs_exited < jobs_no) {
+		int rc = poll(&pfd, 1, 100);
+		if (rc == -1 and errno != EINTR)
+			THROW("poll() failed", errmsg());
+
+		EventsQueue::reset_notifier();
+		EventsQueue::process_events();
+	}
+}
+
+void print_lock_stats(const char* name, const InstrumentedMutex::Stats& st) {
+	printf("    %-28s %10" PRIu64 " acquisitions, %5.2f%% contended,"
+	       " %9.3f ms waited\n",
+	       name, st.acquisitions,
+	       st.contended_acquisitions * 100.0 /
+	          std::max<uint64_t>(st.acquisitions, 1),
+	       st.wait_time.count() / 1e6);
+}
+
+void run(const Scenario& sc, size_t jobs_no) {
+	state = new State(jobs_no); // Leaked - detached workers may still use it
+	auto& st = *state;
+	auto idle_callback = [] { sync_and_assign_jobs(); };
+	// Workers of the previous scenarios stay idle forever, so the pools are
+	// leaked too
+	st.local_workers = new WorkersPool(process_job, idle_callback, nullptr);
+	st.judge_workers = new WorkersPool(process_job, idle_callback, nullptr);
+	st.remote_judge_workers =
+	   new WorkersPool(process_job, idle_callback, nullptr);
+	for (uint i = 0; i < sc.local_workers_no; ++i)
+		st.local_workers->spawn_worker();
+	for (uint i = 0; i < sc.judge_workers_no; ++i)
+		st.judge_workers->spawn_worker();
+
+	auto events_before = EventsQueue::stats();
+	auto start = steady_clock::now();
+	std::thread producer(produce_jobs, std::cref(sc), jobs_no);
+	run_events_loop(jobs_no);
+	auto end = steady_clock::now();
+	producer.join();
+	auto events = EventsQueue::stats();
+	events.events_processed -= events_before.events_processed;
+	events.notifications -= events_before.notifications;
+
+	auto& lat = st.latency;
+	std::sort(lat.begin(), lat.end());
+	auto percentile = [&](double p) {
+		return lat[std::min<size_t>(lat.size() * p, lat.size() - 1)].count() /
+		       1e3;
+	};
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	printf("%s (%u%% judge, %u%% problem, %u%% other jobs on %" PRIu64
+	       " problems), %zu jobs, %u judge + %u local workers:\n",
+	       sc.name, sc.judge_percent, sc.problem_percent,
+	       100 - sc.judge_percent - sc.problem_percent, sc.problems_no,
+	       jobs_no, sc.judge_workers_no, sc.local_workers_no);
+	printf("    throughput: %.0f jobs/s\n", jobs_no / seconds);
+	printf("    dispatch latency: p50 %.1f us, p90 %.1f us, p99 %.1f us,"
+	       " max %.1f us\n",
+	       percentile(0.5), percentile(0.9), percentile(0.99),
+	       lat.back().count() / 1e3);
+	printf("    events queue: %" PRIu64 " events, %" PRIu64
+	       " notifier writes (%.1f events per wake-up)\n",
+	       events.events_processed, events.notifications,
+	       events.events_processed /
+	          std::max<double>(events.notifications, 1));
+	print_lock_stats("local WorkersPool::mtx_", st.local_workers->lock_stats());
+	print_lock_stats("judge WorkersPool::mtx_", st.judge_workers->lock_stats());
+	print_lock_stats("remote WorkersPool::mtx_",
+	                 st.remote_judge_workers->lock_stats());
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	size_t jobs_no = (argc > 1 ? strtoull(argv[1], nullptr, 10) : 100'000);
+	if (jobs_no == 0)
+		return 0;
+
+	EventsQueue::set_notifier_fd();
+
+	const Scenario scenarios[] = {
+	   {"judge only", 100, 0, 1000, 8, 2, 64},
+	   {"mixed", 80, 10, 1000, 8, 4, 64},
+	   {"problem heavy", 40, 40, 20, 8, 4, 64},
+	   {"many workers", 80, 10, 1000, 64, 16, 512},
+	};
+	for (auto& sc : scenarios)
+		run(sc, jobs_no);
+
+	return 0;
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "../src/job_server/job_scheduler.hh"
+
+#include <map>
+#include <set>
+
+/**
+ * The job server's scheduler as it was before JobScheduler: node-based
+ * std::map / std::set queues rekeyed with extract() on every change of a
+ * problem's best job. It is kept only as the baseline for the benchmark and as
+ * the reference implementation in the tests, so it exposes the same interface
+ * as JobScheduler.
+ */
+class LegacyJobScheduler {
+public:
+	using Job = JobScheduler::Job;
+
+private:
+	struct ProblemJobs {
+		uint64_t problem_id;
+		std::set<Job> jobs;
+	};
+
+	struct ProblemInfo {
+		Job its_best_job;
+		uint locks_no = 0;
+	};
+
+	struct JobCategory {
+		// Strong assumption: any job must belong to AT MOST one problem
+		std::map<uint64_t, ProblemInfo> problem_info;
+		std::map<Job, ProblemJobs>
+		   queue; // (best problem's job => all jobs of the problem)
+		std::map<int64_t, ProblemJobs>
+		   locked_problems; // (problem_id  => (locks, problem's jobs))
+	} judge_jobs, problem_jobs; // (judge jobs - they need judge machines)
+
+	std::set<Job> other_jobs;
+
+	static void queue_job(JobCategory& job_category, Job curr_job,
+	                      uint64_t problem_id) {
+		auto it = job_category.problem_info.find(problem_id);
+		if (it != job_category.problem_info.end()) {
+			ProblemInfo& pinfo = it->second;
+			Job best_job = pinfo.its_best_job;
+			// Get the problem's jobs (the problem may be locked)
+			auto& pjobs = (pinfo.locks_no > 0
+			                  ? job_category.locked_problems[problem_id]
+			                  : job_category.queue[best_job]);
+			// Ensure field 'problem_id' is set properly (in case of element
+			// creation this line is necessary)
+			pjobs.problem_id = problem_id;
+			// Add job to queue
+			pjobs.jobs.emplace(curr_job);
+			// Alter the problem's best job
+			if (curr_job < best_job) {
+				pinfo.its_best_job = curr_job;
+				// Update queue (rekey ProblemJobs)
+				if (pinfo.locks_no == 0) {
+					auto nh = job_category.queue.extract(best_job);
+					nh.key() = curr_job;
+					job_category.queue.insert(std::move(nh));
+				}
+			}
+
+		} else {
+			job_category.problem_info[problem_id] = {curr_job, 0};
+			// Add job to the queue (first one to this problem)
+			auto& pjobs = job_category.queue[curr_job];
+			pjobs.problem_id = problem_id;
+			pjobs.jobs.emplace(curr_job);
+		}
+	}
+
+public:
+	void add_judge_job(Job job, uint64_t problem_id) {
+		queue_job(judge_jobs, job, problem_id);
+	}
+
+	void add_problem_job(Job job, uint64_t problem_id) {
+		queue_job(problem_jobs, job, problem_id);
+	}
+
+	void add_other_job(Job job) { other_jobs.insert(job); }
+
+	void lock_problem(uint64_t pid) {
+		auto lock_impl = [&pid](auto& job_category) {
+			auto it = job_category.problem_info.find(pid);
+			if (it == job_category.problem_info.end()) {
+				it = job_category.problem_info
+				        .try_emplace(pid, ProblemInfo {Job::least(), 0})
+				        .first;
+			}
+
+			auto& pinfo = it->second;
+			if (++pinfo.locks_no == 1) {
+				auto pj = job_category.queue.find(pinfo.its_best_job);
+				if (pj != job_category.queue.end()) {
+					job_category.locked_problems.try_emplace(
+					   pid, std::move(pj->second));
+					job_category.queue.erase(pj->first);
+				}
+			}
+		};
+
+		lock_impl(judge_jobs);
+		lock_impl(problem_jobs);
+	}
+
+	void unlock_problem(uint64_t pid) {
+		auto unlock_impl = [&pid](auto& job_category) {
+			auto it = job_category.problem_info.find(pid);
+			if (it == job_category.problem_info.end())
+				THROW("BUG: unlocking problem that is not locked!");
+
+			auto& pinfo = it->second;
+			if (--pinfo.locks_no == 0) {
+				auto pl = job_category.locked_problems.find(pid);
+				if (pl != job_category.locked_problems.end()) {
+					job_category.queue.try_emplace(pinfo.its_best_job,
+					                               std::move(pl->second));
+					job_category.locked_problems.erase(pl->first);
+				} else {
+					job_category.problem_info.erase(pid);
+				}
+			}
+		};
+
+		unlock_impl(judge_jobs);
+		unlock_impl(problem_jobs);
+	}
+
+	class JobHolder {
+		LegacyJobScheduler* jobs_queue;
+		JobCategory* job_category;
+
+	public:
+		Job job = Job::least();
+		uint64_t problem_id = 0;
+
+		JobHolder(LegacyJobScheduler& jq, JobCategory& jc)
+		   : jobs_queue(&jq), job_category(&jc) {}
+
+		JobHolder(LegacyJobScheduler& jq, JobCategory& jc, Job j, uint64_t pid)
+		   : jobs_queue(&jq), job_category(&jc), job(j), problem_id(pid) {}
+
+		operator Job() const noexcept { return job; }
+
+		bool ok() const noexcept { return not(job == Job::least()); }
+
+		void was_passed() const {
+			auto it = job_category->problem_info.find(problem_id);
+			if (it == job_category->problem_info.end())
+				return; // There is no such problem
+
+			auto& pinfo = it->second;
+			Job best_job = pinfo.its_best_job;
+			auto& pjobs = (pinfo.locks_no > 0
+			                  ? job_category->locked_problems[problem_id]
+			                  : job_category->queue[best_job]);
+
+			if (not pjobs.jobs.erase(job)) {
+				THROW("Job erasion did not take place since the erased job was "
+				      "not found");
+			}
+
+			if (pjobs.jobs.empty()) {
+				// That was the last job of it's problem
+				if (pinfo.locks_no == 0) {
+					job_category->queue.erase(best_job);
+					job_category->problem_info.erase(problem_id);
+				} else { // Problem is locked
+					job_category->locked_problems.erase(problem_id);
+					pinfo.its_best_job = Job::least();
+				}
+
+			} else {
+				// The best job of the extracted job's problem changed
+				Job new_best = *pjobs.jobs.begin();
+				pinfo.its_best_job = new_best;
+				// Update queue (rekey ProblemJobs)
+				if (pinfo.locks_no == 0) {
+					auto nh = job_category->queue.extract(best_job);
+					nh.key() = new_best;
+					job_category->queue.insert(std::move(nh));
+				}
+			}
+
+			if (job.locks_problem)
+				jobs_queue->lock_problem(problem_id);
+		}
+	};
+
+private:
+	JobHolder best_job(JobCategory& job_category) {
+		if (job_category.queue.empty())
+			return {*this, job_category}; // No one left
+
+		auto it = job_category.queue.begin();
+		return {*this, job_category, it->first, it->second.problem_id};
+	}
+
+public:
+	JobHolder best_judge_job() { return best_job(judge_jobs); }
+
+	JobHolder best_problem_job() { return best_job(problem_jobs); }
+
+	class OtherJobHolder {
+		std::set<Job>* oj;
+
+	public:
+		Job job = Job::least();
+
+		OtherJobHolder(std::set<Job>& o) : oj(&o) {}
+
+		OtherJobHolder(std::set<Job>& o, Job j) : oj(&o), job(j) {}
+
+		operator Job() const noexcept { return job; }
+
+		bool ok() const noexcept { return not(job == Job::least()); }
+
+		void was_passed() const { oj->erase(job); }
+	};
+
+	OtherJobHolder best_other_job() {
+		if (other_jobs.empty())
+			return {other_jobs}; // No one left
+
+		return {other_jobs, *other_jobs.begin()};
+	}
+};
@@ -0,0 +1,174 @@
+// Compares the throughput of parsing a multipart/form-data upload (a large
+// file and a few text fields) by MultipartFormDataParser, fed with the whole
+// content or in blocks, against the previous byte-at-a-time KMP parser that
+// wrote files with putc(3).
+//
+// Usage: multipart_form_data_parser_benchmark [FILE_SIZE_MIB]  (default: 64)
+
+#include "../src/web_interface/multipart_form_data_parser.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <simlib/file_manip.hh>
+#include <unistd.h>
+
+using server::HttpRequest;
+using server::MultipartFormDataParser;
+using std::string;
+
+namespace {
+
+constexpr char BOUNDARY[] = "----WebKitFormBoundaryePkpFF7tjBAqx29L";
+
+string generate_content(size_t file_size) {
+	std::mt19937_64 gen(file_size);
+	string file(file_size, '\0');
+	for (size_t i = 0; i + 8 <= file_size; i += 8) {
+		uint64_t x = gen();
+		memcpy(file.data() + i, &x, 8);
+	}
+
+	string res;
+	for (auto name : {"language", "problem", "contest"}) {
+		back_insert(res, "--", BOUNDARY,
+		            "\r\nContent-Disposition: form-data; name=\"", name,
+		            "\"\r\n\r\n", name, "-value\r\n");
+	}
+	back_insert(res, "--", BOUNDARY,
+	            "\r\nContent-Disposition: form-data; name=\"solution\";"
+	            " filename=\"a.cpp\"\r\n"
+	            "Content-Type: application/octet-stream\r\n\r\n",
+	            file, "\r\n--", BOUNDARY, "--\r\n");
+	return res;
+}
+
+// The parser replaced by MultipartFormDataParser (trimmed to the parts that
+// matter for the performance)
+void legacy_parse(StringView content, HttpRequest::Form& form) {
+	string boundary = concat_tostr("\r\n--", BOUNDARY);
+	std::vector<size_t> p(boundary.size());
+	for (size_t i = 1, k = 0; i < boundary.size(); ++i) {
+		while (k > 0 and boundary[k] != boundary[i])
+			k = p[k - 1];
+		if (boundary[k] == boundary[i])
+			++k;
+		p[i] = k;
+	}
+
+	FILE* file = nullptr;
+	string field_name, field_content;
+	bool first_boundary = true;
+	size_t k = 2, pos = 0;
+	auto get_char = [&]() -> int {
+		return (pos < content.size() ? (unsigned char)content[pos++] : -1);
+	};
+	for (int c; (c = get_char()) != -1;) {
+		while (k > 0 and boundary[k] != c)
+			k = p[k - 1];
+		if (boundary[k] == c)
+			++k;
+		if (k < boundary.size()) {
+			if (file)
+				putc(c, file);
+			else
+				field_content += c;
+			continue;
+		}
+
+		if (not first_boundary) {
+			if (file) {
+				fflush(file);
+				ftruncate(fileno(file), ftell(file) - boundary.size() + 1);
+				fclose(file);
+				file = nullptr;
+			} else {
+				field_content.erase(field_content.size() - boundary.size() + 1);
+				form[field_name] = field_content;
+			}
+		}
+		first_boundary = false;
+		(void)get_char();
+		(void)get_char();
+		// Headers
+		for (;;) {
+			string header;
+			while ((c = get_char()) != -1) {
+				if (c == '\n' and not header.empty() and
+				    header.back() == '\r') {
+					header.pop_back();
+					break;
+				}
+				header += c;
+			}
+			if (header.empty())
+				break;
+
+			auto name_pos = header.find("name=\"");
+			field_name = header.substr(name_pos + 6,
+			                           header.find('"', name_pos + 6) -
+			                              name_pos - 6);
+			if (header.find("filename=") != string::npos) {
+				char tmp_filename[] = "/tmp/sim-server-tmp.XXXXXX";
+				file = fdopen(mkstemp(tmp_filename), "w");
+				form.files[field_name] = tmp_filename;
+			}
+		}
+		field_content.clear();
+		k = p[k - 1];
+	}
+	if (file)
+		fclose(file);
+}
+
+template <class Func>
+void measure(const char* name, size_t bytes, Func&& func) {
+	constexpr int ROUNDS = 3;
+	double best = 1e100;
+	for (int i = 0; i < ROUNDS; ++i) {
+		HttpRequest::Form form; // Removes the uploaded files
+		auto start = std::chrono::steady_clock::now();
+		func(form);
+		best = std::min(best, std::chrono::duration<double>(
+		                         std::chrono::steady_clock::now() - start)
+		                         .count());
+		if (form.files.size() != 1 or form.get("contest") != "contest-value") {
+			fprintf(stderr, "%s: parsing failed\n", name);
+			exit(1);
+		}
+	}
+	printf("    %-42s %8.1f MiB/s\n", name, bytes / best / (1 << 20));
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	size_t file_size = (argc > 1 ? strtoull(argv[1], nullptr, 10) : 64) << 20;
+	string content = generate_content(file_size);
+	string dir = "/tmp/";
+
+	printf("multipart/form-data content of %zu bytes:\n", content.size());
+	measure("legacy (KMP, putc)", content.size(),
+	        [&](HttpRequest::Form& form) { legacy_parse(content, form); });
+
+	for (size_t block_size : {content.size(), size_t(1 << 16), size_t(4096)}) {
+		string name = (block_size == content.size()
+		                  ? string("MultipartFormDataParser (whole)")
+		                  : concat_tostr("MultipartFormDataParser (",
+		                                 block_size, " B blocks)"));
+		measure(name.c_str(), content.size(), [&](HttpRequest::Form& form) {
+			MultipartFormDataParser parser(BOUNDARY, form, dir, 8192, 1 << 20);
+			StringView data = content;
+			while (not data.empty()) {
+				parser.feed(data.substr(0, block_size));
+				data.remove_prefix(std::min(block_size, data.size()));
+			}
+			if (parser.finish() != MultipartFormDataParser::Status::FINISHED)
+				form.other.clear(); // Reported by measure()
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+// Measures how much bandwidth the response compression saves and how much
+// time it costs: the static assets (compressed once at the server start, at
+// the best level) and a large API response (compressed on every request, at
+// the fast level).
+//
+// Usage: response_compression_benchmark [STATIC_KIT_DIR]
+//   (default: src/static/kit/)
+
+#include "../src/web_interface/compression.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <simlib/file_contents.hh>
+#include <vector>
+
+using server::CompressionLevel;
+using server::ContentCoding;
+using std::string;
+
+namespace {
+
+// Resembles the API response with a contest ranking
+string ranking_response(size_t rows) {
+	string res = "[\n[\"id\",\"name\",\"score\",\"problems\"]";
+	for (size_t i = 0; i < rows; ++i) {
+		back_insert(res, ",\n[", 1000 + i * 7, ",\"", "Participant ", i % 613,
+		            ' ', i * 7919 % 1000, "\",", (rows - i) * 3, ",[");
+		for (size_t p = 0; p < 8; ++p) {
+			back_insert(res, (p ? "," : ""), '[', 100000 + i * 8 + p, ",\"",
+			            ((i + p) % 3 ? "OK" : "WA"), "\",",
+			            (i * 13 + p * 7) % 101, ']');
+		}
+		res += "]]";
+	}
+	res += "\n]";
+	return res;
+}
+
+void measure(const char* name, const string& data, CompressionLevel level) {
+	printf("  %s: %zu bytes\n", name, data.size());
+	for (auto coding : {ContentCoding::GZIP, ContentCoding::BROTLI}) {
+		double best = 1e100;
+		string compressed;
+		try {
+			for (int i = 0; i < 3; ++i) {
+				using std::chrono::steady_clock;
+				auto start = steady_clock::now();
+				compressed = server::compress(data, coding, level);
+				best = std::min(best, std::chrono::duration<double>(
+				                         steady_clock::now() - start)
+				                         .count());
+			}
+		} catch (const std::exception&) {
+			printf("    %-4s not supported\n", content_coding_name(coding));
+			continue;
+		}
+
+		printf("    %-4s %10zu bytes (%5.1f%%) %8.1f ms %8.1f MiB/s\n",
+		       content_coding_name(coding), compressed.size(),
+		       100.0 * compressed.size() / data.size(), best * 1000,
+		       data.size() / best / (1 << 20));
+	}
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	string dir = (argc > 1 ? argv[1] : "src/static/kit/");
+	if (dir.back() != '/')
+		dir += '/';
+
+	printf("Static assets (compressed once, at the best level):\n");
+	for (auto name : {"jquery.js", "scripts.js", "styles.css"}) {
+		string data;
+		try {
+			data = get_file_contents(dir + name);
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s\n", e.what());
+			return 1;
+		}
+		measure(name, data, CompressionLevel::BEST);
+	}
+
+	printf("API responses (compressed on every request, at the fast "
+	       "level):\n");
+	measure("ranking (1000 rows)", ranking_response(1000),
+	        CompressionLevel::FAST);
+	measure("ranking (10000 rows)", ranking_response(10000),
+	        CompressionLevel::FAST);
+	return 0;
+}
@@ -0,0 +1,110 @@
+// Compares the dumped submission reports (sim/submission_report.hh) with the
+// pre-rendered HTML reports stored by the older versions of Sim: the sizes of
+// both encodings and how fast the reports are dumped, rendered and converted
+// from HTML, for reports of different numbers of tests.
+//
+// Usage: submission_report_benchmark [ITERATIONS]  (default: 2000)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sim/submission_report.hh>
+
+using sim::JudgeReport;
+using std::string;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+JudgeReport make_report(size_t groups_no, size_t tests_per_group) {
+	using Test = JudgeReport::Test;
+
+	JudgeReport report;
+	for (size_t i = 1; i <= groups_no; ++i) {
+		auto& group = report.groups.emplace_back();
+		group.max_score = 100 / groups_no;
+		group.score = (i % 3 == 0 ? 0 : group.max_score);
+		for (size_t j = 0; j < tests_per_group; ++j) {
+			auto name = concat_tostr(i, char('a' + j % 26));
+			if (i % 3 == 0 and j == 0) {
+				group.tests.emplace_back(std::move(name), Test::WA,
+				                         milliseconds(37 * j + 11),
+				                         milliseconds(1000), (3 + j) << 20,
+				                         256 << 20,
+				                         "Line 1: read '42', expected '7'");
+			} else if (i % 3 == 0) {
+				group.tests.emplace_back(std::move(name), Test::SKIPPED,
+				                         milliseconds(0), milliseconds(1000), 0,
+				                         256 << 20, "");
+			} else {
+				group.tests.emplace_back(std::move(name), Test::OK,
+				                         milliseconds(37 * j + 11),
+				                         milliseconds(1000), (3 + j) << 20,
+				                         256 << 20, "");
+			}
+		}
+	}
+
+	return report;
+}
+
+template <class Func>
+double per_second(size_t iterations, Func&& func) {
+	auto begin = steady_clock::now();
+	for (size_t i = 0; i < iterations; ++i)
+		func();
+
+	auto us = duration_cast<microseconds>(steady_clock::now() - begin).count();
+	return iterations * 1e6 / std::max<int64_t>(us, 1);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	size_t iterations = (argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000);
+
+	printf("%6s %9s %9s %6s %10s %10s %10s %10s\n", "tests", "html [B]",
+	       "dump [B]", "ratio", "dump/s", "to_html/s", "to_json/s",
+	       "convert/s");
+	using Shape = std::pair<size_t, size_t>; // (groups, tests per group)
+	for (auto [groups_no, tests_per_group] :
+	     {Shape {5, 2}, Shape {10, 3}, Shape {20, 5}, Shape {50, 8},
+	      Shape {100, 10}}) {
+		auto report = make_report(groups_no, tests_per_group);
+		string dumped = sim::submission_report::dump(report, true, false);
+		string html = sim::submission_report::to_html(dumped);
+
+		// The reports have to survive the conversion unchanged
+		auto converted = sim::submission_report::from_legacy_html(html);
+		if (not converted or
+		    sim::submission_report::to_html(*converted) != html) {
+			fprintf(stderr, "Converting the HTML report failed\n");
+			return 1;
+		}
+
+		size_t sink = 0;
+		double dumps = per_second(iterations, [&] {
+			sink += sim::submission_report::dump(report, true, false).size();
+		});
+		double htmls = per_second(iterations, [&] {
+			sink += sim::submission_report::to_html(dumped).size();
+		});
+		double jsons = per_second(iterations, [&] {
+			sink += sim::submission_report::to_json(dumped).size();
+		});
+		double conversions = per_second(iterations, [&] {
+			sink += sim::submission_report::from_legacy_html(html)->size();
+		});
+
+		printf("%6zu %9zu %9zu %5.1fx %10.0f %10.0f %10.0f %10.0f\n",
+		       groups_no * tests_per_group, html.size(), dumped.size(),
+		       double(html.size()) / dumped.size(), dumps, htmls, jsons,
+		       conversions);
+		if (sink == 0)
+			return 1; // Keeps the results alive
+	}
+}
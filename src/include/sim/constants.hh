@@ -305,6 +305,15 @@ auto internal_file_path(T file_id) {
 	return concat<64>(INTERNAL_FILES_DIR, file_id);
 }
 
+// Files uploaded by the web server before they are moved to the internal files
+// (has to be on the same filesystem as them)
+constexpr const char UPLOADS_DIR[] = "cache/uploads/";
+
+// Compiled solutions cache (used by the job server)
+constexpr const char COMPILED_SOLUTIONS_CACHE_DIR[] =
+   "cache/compiled_solutions/";
+constexpr uint64_t COMPILED_SOLUTIONS_CACHE_MAX_SIZE = 1 << 30; // 1 GiB
+
 // Jobs
 constexpr uint JOB_LOG_VIEW_MAX_LENGTH = 128 << 10; // 128 KiB
 
@@ -320,6 +329,8 @@ constexpr uint LOGS_OTHER_CHUNK_MAX_LEN = 128 << 10; // 128 KiB
 // API
 constexpr uint API_FIRST_QUERY_ROWS_LIMIT = 50;
 constexpr uint API_OTHER_QUERY_ROWS_LIMIT = 200;
+// Streamed (and exported) lists are fetched in batches of that many rows
+constexpr uint API_LIST_BATCH_ROWS = 1000;
 
 // Job server notifying file
 constexpr const char JOB_SERVER_NOTIFYING_FILE[] = ".job-server.notify";
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mysql.hh"
+
+/*
+ * The contest rankings are materialized in the table contest_ranking_entries:
+ * it holds a row for every (contest problem, owner) pair with the owner's
+ * final and initial final submissions (the columns are NULL if the owner no
+ * longer has a final submission, so that the change is still visible). Every
+ * change of an entry stamps it with the next version of the contest's ranking
+ * (table contest_rankings). The version row stays locked until the
+ * transaction commits, so the versions become visible in order and a reader
+ * that knows the version V only needs the entries with version > V to be
+ * up to date.
+ *
+ * Changes that are not reflected in the entries (e.g. renamed or deleted
+ * users, edited contest rounds) bump reset_version, which tells the readers to
+ * load the whole ranking again.
+ */
+namespace sim::contest_ranking {
+
+/// Sets the entry of @p owner in the contest problem @p contest_problem_id to
+/// the final submission @p final_id and the initial final submission
+/// @p initial_final_id. Has to be called in a transaction.
+void update_entry(MySQL::Connection& mysql, uint64_t owner,
+                  uint64_t contest_problem_id, uint64_t final_id,
+                  uint64_t initial_final_id);
+
+/// Marks that @p owner has no final submission in the contest problem
+/// @p contest_problem_id. Has to be called in a transaction.
+void remove_entry(MySQL::Connection& mysql, uint64_t owner,
+                  uint64_t contest_problem_id);
+
+/// Makes the readers load the whole ranking of the contest @p contest_id
+void invalidate(MySQL::Connection& mysql, uint64_t contest_id);
+
+/// Invalidates the rankings of all the contests in which the user @p user_id
+/// has entries. Has to be called before the user is deleted.
+void invalidate_user(MySQL::Connection& mysql, uint64_t user_id);
+
+/// Recreates the entries of the contest problem @p contest_problem_id from
+/// its final submissions (e.g. after they were selected in bulk) and
+/// invalidates the contest's ranking. Has to be called in a transaction.
+void rebuild_contest_problem(MySQL::Connection& mysql,
+                             uint64_t contest_problem_id);
+
+/// Recreates all the entries from the final submissions (e.g. after the table
+/// has been created by sim-upgrader) and invalidates all the rankings. Has to
+/// be called in a transaction.
+void rebuild(MySQL::Connection& mysql);
+
+} // namespace sim::contest_ranking
@@ -41,6 +41,15 @@ inline void append_dumped(std::string& buff, StringView str) {
 	buff += str;
 }
 
+/// Extracts the string dumped with append_dumped() from @p dumped_str (e.g. as
+/// the value of a dumped std::optional<std::string>)
+inline void extract_dumped(std::string& str, StringView& dumped_str) {
+	uint32_t size;
+	extract_dumped(size, dumped_str);
+	throw_assert(dumped_str.size() >= size);
+	str = dumped_str.extract_prefix(size).to_string();
+}
+
 template <class Rep, class Period>
 inline void append_dumped(std::string& buff,
                          const std::chrono::duration<Rep, Period>& dur) {
@@ -87,10 +96,9 @@ inline std::string dump_string(StringView str) {
 }
 
 inline std::string extract_dumped_string(StringView& dumped_str) {
-	uint32_t size;
-	extract_dumped(size, dumped_str);
-	throw_assert(dumped_str.size() >= size);
-	return dumped_str.extract_prefix(size).to_string();
+	std::string res;
+	extract_dumped(res, dumped_str);
+	return res;
 }
 
 inline std::string extract_dumped_string(StringView&& dumped_str) {
@@ -107,6 +115,7 @@ struct AddProblemInfo {
 	bool ignore_simfile = false;
 	bool seek_for_new_tests = false;
 	bool reset_scoring = false;
+	bool stop_group_on_failure = false;
 	sim::Problem::Type problem_type = sim::Problem::Type::PRIVATE;
 	enum Stage : uint8_t {
 		FIRST = 0,
@@ -118,10 +127,11 @@ struct AddProblemInfo {
 	AddProblemInfo(const std::string& n, const std::string& l,
 	               std::optional<uint64_t> ml,
 	               std::optional<std::chrono::nanoseconds> gtl, bool rtl,
-	               bool is, bool sfnt, bool rs, sim::Problem::Type pt)
+	               bool is, bool sfnt, bool rs, bool sgof,
+	               sim::Problem::Type pt)
 	   : name(n), label(l), memory_limit(ml), global_time_limit(gtl),
 	     reset_time_limits(rtl), ignore_simfile(is), seek_for_new_tests(sfnt),
-	     reset_scoring(rs), problem_type(pt) {}
+	     reset_scoring(rs), stop_group_on_failure(sgof), problem_type(pt) {}
 
 	AddProblemInfo(StringView str) {
 		name = extract_dumped_string(str);
@@ -134,6 +144,7 @@ struct AddProblemInfo {
 		ignore_simfile = (mask & 2);
 		seek_for_new_tests = (mask & 4);
 		reset_scoring = (mask & 8);
+		stop_group_on_failure = (mask & 16);
 
 		problem_type = EnumVal<sim::Problem::Type>(
 		   extract_dumped_int<std::underlying_type_t<sim::Problem::Type>>(str));
@@ -150,7 +161,8 @@ struct AddProblemInfo {
 
 		uint8_t mask = reset_time_limits | (int(ignore_simfile) << 1) |
 		               (int(seek_for_new_tests) << 2) |
-		               (int(reset_scoring) << 3);
+		               (int(reset_scoring) << 3) |
+		               (int(stop_group_on_failure) << 4);
 		append_dumped(res, mask);
 
 		append_dumped(res, EnumVal(problem_type).int_val());
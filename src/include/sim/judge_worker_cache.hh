@@ -0,0 +1,115 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <simlib/sim/judge_worker.hh>
+#include <vector>
+
+/**
+ * LRU cache of JudgeWorkers with a problem package loaded and the checker
+ * compiled. It lets consecutive judgings of the same problem skip unpacking
+ * the package and compiling the checker. A cached JudgeWorker may be used by
+ * one judging at a time, so every judging thread should have its own cache.
+ */
+class JudgeWorkerCache {
+	struct Entry {
+		uint64_t package_file_id;
+		std::string version; // Entry is stale if the version changes
+		std::shared_ptr<sim::JudgeWorker> jworker;
+		// Judge workers of the shards of the tests (for parallel judging)
+		std::vector<std::shared_ptr<sim::JudgeWorker>> shard_jworkers;
+	};
+
+	size_t max_size_;
+	std::list<Entry> entries_; // The most recently used entry goes first
+	uint64_t hits_ = 0;
+	uint64_t misses_ = 0;
+
+public:
+	explicit JudgeWorkerCache(size_t max_size) : max_size_(max_size) {}
+
+	/**
+	 * @brief Returns the cached JudgeWorker with package @p package_file_id
+	 *   loaded
+	 *
+	 * @param package_file_id id of the problem package's internal file
+	 * @param version version of the problem (e.g. its last edit time) -
+	 *   entries with a different version are dropped
+	 *
+	 * @return the cached JudgeWorker or nullptr on miss
+	 */
+	std::shared_ptr<sim::JudgeWorker> get(uint64_t package_file_id,
+	                                      StringView version) {
+		for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+			if (it->package_file_id != package_file_id)
+				continue;
+
+			if (it->version != version) {
+				entries_.erase(it);
+				break;
+			}
+
+			entries_.splice(entries_.begin(), entries_, it);
+			++hits_;
+			return it->jworker;
+		}
+
+		++misses_;
+		return nullptr;
+	}
+
+	/// Caches @p jworker that has the package @p package_file_id loaded and the
+	/// checker compiled
+	void put(uint64_t package_file_id, StringView version,
+	         std::shared_ptr<sim::JudgeWorker> jworker) {
+		if (max_size_ == 0)
+			return;
+
+		entries_.remove_if(
+		   [&](const Entry& e) { return e.package_file_id == package_file_id; });
+		entries_.push_front({package_file_id, version.to_string(),
+		                     std::move(jworker), {}});
+		if (entries_.size() > max_size_)
+			entries_.pop_back();
+	}
+
+	/**
+	 * @brief Returns the judge workers that judge the shards of the tests of
+	 *   the cached package @p package_file_id
+	 * @details They have the package (limited to their shards) loaded and the
+	 *   checker compiled. Unlike get(), it does not affect the LRU order nor
+	 *   the statistics.
+	 *
+	 * @return the judge workers set by set_shard_jworkers() or an empty
+	 *   vector if there are none or the package is not cached
+	 */
+	std::vector<std::shared_ptr<sim::JudgeWorker>>
+	shard_jworkers(uint64_t package_file_id, StringView version) const {
+		for (auto& entry : entries_) {
+			if (entry.package_file_id == package_file_id and
+			    entry.version == version) {
+				return entry.shard_jworkers;
+			}
+		}
+
+		return {};
+	}
+
+	/// Caches @p shard_jworkers along with the judge worker of the package
+	/// @p package_file_id, no-op if the package is not cached
+	void set_shard_jworkers(
+	   uint64_t package_file_id, StringView version,
+	   std::vector<std::shared_ptr<sim::JudgeWorker>> shard_jworkers) {
+		for (auto& entry : entries_) {
+			if (entry.package_file_id == package_file_id and
+			    entry.version == version) {
+				entry.shard_jworkers = std::move(shard_jworkers);
+				return;
+			}
+		}
+	}
+
+	uint64_t hits() const noexcept { return hits_; }
+
+	uint64_t misses() const noexcept { return misses_; }
+};
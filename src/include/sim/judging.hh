@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+#include <simlib/sim/judge_worker.hh>
+
+namespace sim {
+
+/**
+ * @brief Judges like @p jworker.judge() but stops judging a group at its first
+ *   failed test
+ * @details The remaining tests of the failed group are reported as SKIPPED
+ *   and the group's score is 0. To be able to stop without interrupting
+ *   JudgeWorker::judge(), the tests are judged one at a time: the Simfile of
+ *   @p jworker is narrowed to the judged test (and restored afterwards).
+ *   Used by both the job server and the remote judge workers, so that the
+ *   policy does not depend on where the submission is judged.
+ */
+JudgeReport judge_stopping_on_group_failure(
+   JudgeWorker& jworker, bool final, JudgeLogger& logger,
+   const std::function<void(const JudgeReport&)>& partial_report_callback);
+
+} // namespace sim
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "mysql.hh"
+#include "submission_report.hh"
+
+/*
+ * While a submission is being judged, its progress is kept in the table
+ * submission_judging_progress as the partial judge report dumped with
+ * submission_report::dump(). The record is cheap to overwrite after every
+ * judged test, so the job server writes the submission's reports and the job
+ * log only at group boundaries and the web interface polls the record for the
+ * live progress.
+ * The row is removed once the submission's reports are complete.
+ */
+namespace sim::judging_progress {
+
+/// Returns the number of groups of @p report that have no SKIPPED test i.e.
+/// groups that have been judged completely (if @p report is partial)
+size_t judged_groups(const JudgeReport& report) noexcept;
+
+/// Stores @p partial_report as the progress of the initial (@p final ==
+/// false) or final judging of the submission @p submission_id
+void update(MySQL::Connection& mysql, uint64_t submission_id, bool final,
+            const JudgeReport& partial_report);
+
+/// Removes the progress of judging the submission @p submission_id
+void clear(MySQL::Connection& mysql, uint64_t submission_id);
+
+} // namespace sim::judging_progress
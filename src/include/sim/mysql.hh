@@ -1,6 +1,12 @@
 #pragma once
 
+#include <exception>
+#include <list>
+#include <map>
+#include <optional>
 #include <simlib/mysql.hh>
+#include <string>
+#include <utility>
 
 namespace MySQL {
 
@@ -20,4 +26,214 @@ namespace MySQL {
  */
 Connection make_conn_with_credential_file(FilePath filename);
 
+/**
+ * Prepared statements of a connection reused by their SQL text, so that
+ * preparing a statement that was prepared before costs neither a round trip
+ * nor parsing. The least recently used statements are closed if there are
+ * more than max_size of them.
+ *
+ * A statement is reserved while a Handle to it exists; if the same SQL is
+ * prepared again meanwhile (e.g. by a recursive call), the new handle gets a
+ * fresh statement that is closed with the handle. A cached statement keeps
+ * the bindings of its previous user, so the parameters and results have to
+ * be bound anew (as they are after every prepare()).
+ *
+ * If an exception is thrown while a handle to a cached statement exists (e.g.
+ * its execution failed), the statement and all the other unused ones are
+ * closed: the failure may mean that the connection was lost and reconnected,
+ * after which the server no longer knows the prepared statements.
+ */
+template <class ConnectionT>
+class BasicStatementsCache {
+public:
+	using Statement = decltype(
+	   std::declval<ConnectionT&>().prepare(std::declval<StringView>()));
+
+	static constexpr size_t DEFAULT_MAX_SIZE = 64;
+
+private:
+	struct Entry {
+		std::string sql;
+		Statement stmt;
+		bool in_use = false;
+	};
+
+	ConnectionT& conn_;
+	size_t max_size_;
+	std::list<Entry> entries_; // The most recently used first
+	std::map<std::string, typename std::list<Entry>::iterator, std::less<>>
+	   entries_by_sql_;
+	uint64_t hits_ = 0;
+	uint64_t misses_ = 0;
+
+	// Closes the least recently used statement that is not in use, returns
+	// whether there was such statement
+	bool evict() noexcept {
+		for (auto it = entries_.end(); it != entries_.begin();) {
+			if (not(--it)->in_use) {
+				entries_by_sql_.erase(it->sql);
+				entries_.erase(it);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Closes the statement of @p entry (that failed) and all the statements
+	// that are not in use
+	void discard(Entry& entry) noexcept {
+		auto it = entries_by_sql_.find(entry.sql);
+		auto entry_it = it->second;
+		entries_by_sql_.erase(it);
+		entries_.erase(entry_it);
+		clear();
+	}
+
+public:
+	class Handle {
+		BasicStatementsCache* cache_ = nullptr;
+		Entry* entry_ = nullptr; // Set iff the statement is cached
+		std::optional<Statement> uncached_;
+		// Exceptions in flight when the handle was created
+		int uncaught_exceptions_ = std::uncaught_exceptions();
+
+		friend class BasicStatementsCache;
+
+		Handle(BasicStatementsCache& cache, Entry& entry) noexcept
+		   : cache_(&cache), entry_(&entry) {
+			entry_->in_use = true;
+		}
+
+		explicit Handle(Statement&& stmt) : uncached_(std::move(stmt)) {}
+
+		void release() noexcept {
+			if (entry_) {
+				if (std::uncaught_exceptions() > uncaught_exceptions_)
+					cache_->discard(*entry_);
+				else
+					entry_->in_use = false;
+
+				entry_ = nullptr;
+			}
+			uncached_.reset();
+		}
+
+	public:
+		Handle(const Handle&) = delete;
+		Handle& operator=(const Handle&) = delete;
+
+		Handle(Handle&& other) noexcept
+		   : cache_(other.cache_), entry_(std::exchange(other.entry_, nullptr)),
+		     uncached_(std::move(other.uncached_)),
+		     uncaught_exceptions_(other.uncaught_exceptions_) {
+			other.uncached_.reset();
+		}
+
+		Handle& operator=(Handle&& other) noexcept {
+			if (this != &other) {
+				release();
+				cache_ = other.cache_;
+				entry_ = std::exchange(other.entry_, nullptr);
+				uncaught_exceptions_ = other.uncaught_exceptions_;
+				if (other.uncached_) {
+					uncached_.emplace(std::move(*other.uncached_));
+					other.uncached_.reset();
+				}
+			}
+			return *this;
+		}
+
+		~Handle() { release(); }
+
+		Statement& operator*() noexcept {
+			return (entry_ ? entry_->stmt : *uncached_);
+		}
+
+		Statement* operator->() noexcept { return &**this; }
+
+		bool is_cached() const noexcept { return entry_ != nullptr; }
+	};
+
+	explicit BasicStatementsCache(ConnectionT& conn,
+	                              size_t max_size = DEFAULT_MAX_SIZE)
+	   : conn_(conn), max_size_(max_size) {}
+
+	BasicStatementsCache(const BasicStatementsCache&) = delete;
+	BasicStatementsCache& operator=(const BasicStatementsCache&) = delete;
+
+	/// Returns the statement prepared from @p sql
+	Handle prepare(StringView sql) {
+		auto it = entries_by_sql_.find(sql);
+		if (it != entries_by_sql_.end() and not it->second->in_use) {
+			++hits_;
+			entries_.splice(entries_.begin(), entries_, it->second);
+			return Handle(*this, *it->second);
+		}
+
+		++misses_;
+		auto stmt = conn_.prepare(sql);
+		if (it != entries_by_sql_.end() or
+		    (entries_.size() >= max_size_ and not evict())) {
+			return Handle(std::move(stmt));
+		}
+
+		entries_.push_front(Entry {sql.to_string(), std::move(stmt)});
+		entries_by_sql_.emplace(entries_.front().sql, entries_.begin());
+		return Handle(*this, entries_.front());
+	}
+
+	/// Closes all the statements that are not in use, e.g. after reconnecting
+	void clear() noexcept {
+		while (evict()) {
+		}
+	}
+
+	size_t size() const noexcept { return entries_.size(); }
+
+	uint64_t hits() const noexcept { return hits_; }
+
+	uint64_t misses() const noexcept { return misses_; }
+};
+
+using StatementsCache = BasicStatementsCache<Connection>;
+
+/// Returns the statements cache of @p conn. A connection is used by one
+/// thread at a time, so each thread keeps the caches of the connections it
+/// uses (destroyed at the thread exit, unless dropped earlier). A connection
+/// destroyed or replaced (e.g. by reconnecting) before that has to drop its
+/// cache, see CachedStatementsConnection.
+StatementsCache& statements_cache(Connection& conn);
+
+/// Destroys the statements cache of @p conn (if the current thread has one),
+/// closing its statements
+void drop_statements_cache(const Connection& conn) noexcept;
+
+/// Connection that drops its statements cache when it is destroyed or
+/// replaced, so that a connection created later at the same address does not
+/// get the stale cache. It has to be destroyed by the thread that used it.
+class CachedStatementsConnection : public Connection {
+public:
+	CachedStatementsConnection() { (void)statements_cache(*this); }
+
+	CachedStatementsConnection(Connection&& conn)
+	   : Connection(std::move(conn)) {
+		// The thread's caches are created before the connection, so that
+		// they are destroyed after it
+		(void)statements_cache(*this);
+	}
+
+	CachedStatementsConnection(const CachedStatementsConnection&) = delete;
+	CachedStatementsConnection&
+	operator=(const CachedStatementsConnection&) = delete;
+
+	CachedStatementsConnection& operator=(Connection&& conn) {
+		drop_statements_cache(*this);
+		Connection::operator=(std::move(conn));
+		return *this;
+	}
+
+	~CachedStatementsConnection() { drop_statements_cache(*this); }
+};
+
 } // namespace MySQL
@@ -23,6 +23,8 @@ struct Problem {
 	std::optional<decltype(User::id)> owner;
 	DatetimeField added;
 	DatetimeField last_edit;
+	// Whether judging of a test group stops at its first failed test
+	bool stop_group_on_failure;
 };
 
 } // namespace sim
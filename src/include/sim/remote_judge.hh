@@ -0,0 +1,168 @@
+#pragma once
+
+#include "jobs.hh"
+
+#include <netinet/in.h>
+#include <simlib/sim/judge_worker.hh>
+#include <stdexcept>
+
+/**
+ * Protocol spoken between the job server and remote judge workers
+ * (sim-judge-worker).
+ *
+ * A remote judge worker connects over TCP to the job server and sends HELLO.
+ * Afterwards the job server sends it JOBs one at a time. While judging a job,
+ * the worker requests the files it needs (only the files of the job it
+ * currently handles are served), reports the compilation results and streams
+ * the partial and complete judge reports back. Every message sent by the
+ * worker during a job is a heartbeat: if the job server does not hear from
+ * the worker for LEASE_DURATION, the lease expires, the connection is dropped
+ * and the job is returned to the queue.
+ *
+ * Every message is a frame: 4-byte payload size, 1-byte type and the payload
+ * serialized with jobs::append_dumped(). All the worker's messages, except
+ * HELLO, begin with the id of the job they refer to, so that messages that
+ * belong to an abandoned job can be recognized and ignored.
+ */
+namespace remote_judge {
+
+constexpr uint32_t PROTOCOL_VERSION = 2;
+constexpr std::chrono::seconds LEASE_DURATION {20};
+constexpr std::chrono::seconds HEARTBEAT_INTERVAL {5};
+constexpr std::chrono::seconds HELLO_TIMEOUT {5};
+constexpr size_t FILE_CHUNK_SIZE = 1 << 20; // 1 MiB
+constexpr uint32_t MAX_MESSAGE_SIZE = 64 << 20; // 64 MiB
+
+enum class MessageType : uint8_t {
+	// Worker -> job server
+	HELLO = 1, // protocol version, token
+	HEARTBEAT = 2, // job id
+	FILE_REQUEST = 3, // job id, file id
+	COMPILATION_RESULT = 4, // job id, optional compilation errors
+	CHECKER_COMPILATION_RESULT = 5, // job id, optional compilation errors
+	JUDGE_REPORT = 6, // job id, final, partial, judge report
+	JUDGE_ERROR = 7, // job id, error description
+	// Job server -> worker
+	JOB = 64, // JobDescription
+	FILE_CHUNK = 65, // file id, data (an empty chunk ends the file)
+	FILE_UNAVAILABLE = 66, // file id
+};
+
+struct Message {
+	MessageType type;
+	std::string payload;
+};
+
+/// Thrown if the peer disconnected, timed out or violated the protocol
+class ConnectionLost : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+/// Thrown if the peer sent a malformed or truncated message. Such a peer cannot
+/// be trusted with the job any more, so its job is returned to the queue as if
+/// the connection was lost.
+class ProtocolError : public ConnectionLost {
+public:
+	using ConnectionLost::ConnectionLost;
+};
+
+/**
+ * @brief Parses the payload of a message received from the peer
+ * @details Parsing a malformed payload fails (e.g. on throw_assert() in
+ *   jobs::extract_dumped()) with an error that would be taken for an error of
+ *   the job, so such errors are turned into ProtocolError.
+ *
+ * @param parse extracts the values from the payload, should do nothing else
+ *
+ * @return the value returned by @p parse
+ */
+template <class Func>
+decltype(auto) parse_payload(Func&& parse) {
+	try {
+		return parse();
+	} catch (const ConnectionLost&) {
+		throw;
+	} catch (const std::exception& e) {
+		throw ProtocolError(concat_tostr("Malformed message: ", e.what()));
+	}
+}
+
+/// Sends a message through the socket @p fd, throws ConnectionLost on error
+void send_message(int fd, MessageType type, StringView payload);
+
+/**
+ * @brief Receives a message from the socket @p fd
+ *
+ * @param fd socket to read from
+ * @param timeout maximum time to wait for the whole message
+ *
+ * @return the received message or std::nullopt if @p timeout expired before
+ *   any byte of the message arrived
+ *
+ * @errors If the connection is closed, broken or a part of the message does
+ *   not arrive in time ConnectionLost is thrown
+ */
+std::optional<Message> receive_message(int fd,
+                                       std::chrono::milliseconds timeout);
+
+/// Compares the token @p received from a peer with the @p expected one in time
+/// that depends only on their lengths, so that the time does not reveal how
+/// long a matching prefix the peer guessed
+bool tokens_equal(StringView received, StringView expected) noexcept;
+
+/// Parses address in format "IPv4:port" ("*" as IPv4 means any address)
+sockaddr_in parse_address(StringView address);
+
+struct JobDescription {
+	uint64_t job_id;
+	uint64_t submission_id;
+	uint64_t solution_file_id;
+	uint64_t problem_file_id;
+	sim::SolutionLanguage language;
+	// The problem's policy of stopping the judging of a test group at its
+	// first failed test
+	bool stop_group_on_failure;
+
+	JobDescription(uint64_t jid, uint64_t sid, uint64_t sfid, uint64_t pfid,
+	               sim::SolutionLanguage lang, bool stop_on_failure)
+	   : job_id(jid), submission_id(sid), solution_file_id(sfid),
+	     problem_file_id(pfid), language(lang),
+	     stop_group_on_failure(stop_on_failure) {}
+
+	/// Parses the payload of the JOB message, throws ProtocolError if it is
+	/// malformed
+	JobDescription(StringView str) {
+		parse_payload([&] {
+			using jobs::extract_dumped;
+			extract_dumped(job_id, str);
+			extract_dumped(submission_id, str);
+			extract_dumped(solution_file_id, str);
+			extract_dumped(problem_file_id, str);
+			std::underlying_type_t<sim::SolutionLanguage> lang;
+			extract_dumped(lang, str);
+			language = sim::SolutionLanguage(lang);
+			extract_dumped(stop_group_on_failure, str);
+		});
+	}
+
+	std::string dump() const {
+		using jobs::append_dumped;
+		std::string res;
+		append_dumped(res, job_id);
+		append_dumped(res, submission_id);
+		append_dumped(res, solution_file_id);
+		append_dumped(res, problem_file_id);
+		append_dumped(
+		   res, static_cast<std::underlying_type_t<sim::SolutionLanguage>>(
+		           language));
+		append_dumped(res, stop_group_on_failure);
+		return res;
+	}
+};
+
+void append_dumped(std::string& buff, const sim::JudgeReport& report);
+
+void extract_dumped(sim::JudgeReport& report, StringView& dumped_str);
+
+} // namespace remote_judge
@@ -1,9 +1,42 @@
 #pragma once
 
+#include <functional>
+#include <optional>
+#include <sim/constants.hh>
+#include <sim/contest_problem.hh>
 #include <simlib/mysql.hh>
+#include <vector>
 
 namespace submission {
 
+/// What selecting the final submissions needs to know about a final candidate
+struct FinalCandidate {
+	uint64_t id;
+	int64_t score;
+	SubmissionStatus initial_status;
+	SubmissionStatus full_status;
+};
+
+/// Returns the id of the problem final submission among @p candidates (the
+/// final candidates of an owner in a problem): the one with the highest score,
+/// then with the best full status, then the latest one. Returns std::nullopt
+/// if there are no candidates.
+std::optional<uint64_t>
+select_problem_final(const std::vector<FinalCandidate>& candidates) noexcept;
+
+struct ContestFinals {
+	uint64_t final_id;
+	uint64_t initial_final_id; // The final as seen before the full results
+};
+
+/// Returns the contest final and initial final submissions among
+/// @p candidates (the final candidates of an owner in a contest problem) or
+/// std::nullopt if there are no candidates
+std::optional<ContestFinals> select_contest_finals(
+   const std::vector<FinalCandidate>& candidates,
+   sim::ContestProblem::FinalSubmissionSelectingMethod final_selecting_method,
+   sim::ContestProblem::ScoreRevealingMode score_revealing) noexcept;
+
 // Have to be called in a transaction before update_final() is called with
 // make_transaction == false, in order to avoid deadlocks; It does not have to
 // be freed.
@@ -11,9 +44,42 @@ void update_final_lock(MySQL::Connection& mysql,
                        std::optional<uint64_t> submission_owner,
                        uint64_t problem_id);
 
+/// Selects anew the problem final submission of @p submission_owner in the
+/// problem @p problem_id and (if set) the contest final and initial final
+/// submissions in the contest problem @p contest_problem_id. The submissions
+/// are read in one query and only the flags that changed are written.
 void update_final(MySQL::Connection& mysql,
                   std::optional<uint64_t> submission_owner, uint64_t problem_id,
                   std::optional<uint64_t> contest_problem_id,
                   bool make_transaction = true);
 
+struct BulkReselectionStats {
+	uint64_t owners = 0; // Owners whose finals were selected
+	uint64_t changed_submissions = 0; // Submissions whose flags changed
+};
+
+/// Called by the bulk reselection after every batch of updates with the
+/// number of the flags updated so far and of all the flags to update
+using BulkReselectionProgress = std::function<void(uint64_t, uint64_t)>;
+
+/// Selects anew the problem final submissions of all the owners in the problem
+/// @p problem_id: the submissions are read in one query, the finals are
+/// selected as by update_final() and the flags that changed are written in
+/// batches. Has to be called in a transaction; locks the rows that
+/// update_final_lock() locks for every owner in the problem, which serializes
+/// it with update_final_lock().
+BulkReselectionStats
+reselect_problem_finals(MySQL::Connection& mysql, uint64_t problem_id,
+                        const BulkReselectionProgress& progress = {});
+
+/// Selects anew the contest final and initial final submissions of all the
+/// owners in the contest problem @p contest_problem_id, like
+/// reselect_problem_finals(), and rebuilds the contest problem's ranking
+/// entries if any final changed. Has to be called in a transaction; locks the
+/// same rows as reselect_problem_finals() does for the contest problem's
+/// problem.
+BulkReselectionStats
+reselect_contest_finals(MySQL::Connection& mysql, uint64_t contest_problem_id,
+                        const BulkReselectionProgress& progress = {});
+
 } // namespace submission
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "jobs.hh"
+
+#include <simlib/sim/judge_worker.hh>
+
+/*
+ * The reports of a submission (submissions.initial_report and final_report)
+ * are stored in a compact binary encoding, once per judging phase, and are
+ * rendered to HTML or JSON only when they are viewed. A dumped report begins
+ * with MAGIC followed by a flags byte (FINAL, PARTIAL, COMPILATION_ERRORS).
+ * Compilation errors are stored as a single string. Otherwise the groups
+ * (score, max score and the number of tests) are followed by the tests stored
+ * column by column: names, statuses, runtimes and time limits (in
+ * milliseconds), memory consumptions and memory limits (in KiB) and indexes
+ * to the table of the distinct comments. An empty report means that there is
+ * no report.
+ *
+ * Reports stored by older versions of Sim are pre-rendered HTML, they are
+ * rendered as they are until sim-upgrader converts them (see
+ * from_legacy_html()).
+ */
+namespace sim::submission_report {
+
+constexpr StringView MAGIC = {"\0SR\1", 4};
+
+enum Flags : uint8_t {
+	FINAL = 1,
+	PARTIAL = 2, // SKIPPED tests are still pending
+	COMPILATION_ERRORS = 4,
+};
+
+struct Report {
+	bool final = false;
+	bool partial = false;
+	std::optional<std::string> compilation_errors;
+	JudgeReport judge_report; // Its judge log is always empty
+};
+
+/// Returns the dumped report of judging the initial (@p final == false) or
+/// final tests, the judge log of @p report is omitted
+std::string dump(const JudgeReport& report, bool final, bool partial);
+
+/// Returns the dumped report of the compilation errors @p errors
+std::string dump_compilation_errors(StringView errors);
+
+/// Returns true iff @p record is a dumped report, i.e. is neither empty nor
+/// a pre-rendered HTML report
+inline bool is_dumped(StringView record) noexcept {
+	return has_prefix(record, MAGIC);
+}
+
+/// Inverse of dump() and dump_compilation_errors()
+Report extract(StringView record);
+
+/// Renders @p record as HTML, an HTML (legacy) report is returned unchanged
+std::string to_html(StringView record);
+
+/// Renders @p record as JSON: null for no report,
+/// {"compilation_errors":"..."}, {"html":"..."} for an HTML (legacy) report,
+/// or {"final":..,"partial":..,"groups":[[score,max_score,[test,...]],...]}
+/// where test is [name,status,runtime,time_limit,memory,memory_limit,comment]
+/// (times in milliseconds, memory in KiB)
+std::string to_json(StringView record);
+
+/// Converts the HTML report @p html (as rendered by older versions of Sim) to
+/// a dumped report, returns std::nullopt if @p html cannot be parsed
+std::optional<std::string> from_legacy_html(StringView html);
+
+} // namespace sim::submission_report
@@ -0,0 +1,283 @@
+#include "compiled_solutions_cache.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <dirent.h>
+#include <mutex>
+#include <sim/constants.hh>
+#include <simlib/enum_val.hh>
+#include <simlib/file_contents.hh>
+#include <simlib/file_manip.hh>
+#include <simlib/sha.hh>
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace compiled_solutions_cache {
+
+namespace {
+
+std::atomic<uint64_t> hits_ {0};
+std::atomic<uint64_t> misses_ {0};
+
+std::mutex size_mtx;
+std::optional<uint64_t> cache_size; // Lazily computed total size of entries
+
+constexpr const char BINARY_SUFFIX[] = ".bin";
+constexpr const char ERRORS_SUFFIX[] = ".err";
+
+// Identity of the compiler binary: it changes if the compiler is upgraded
+std::string compiler_identity(StringView compiler) {
+	STACK_UNWINDING_MARK;
+
+	const char* path_env = getenv("PATH");
+	StringView path_var = (path_env ? path_env : "/usr/bin:/bin");
+	while (not path_var.empty()) {
+		StringView dir = path_var.extract_prefix(
+		   std::min(path_var.find(':'), path_var.size()));
+		path_var.remove_prefix(path_var.empty() ? 0 : 1);
+
+		auto path = concat_tostr(dir, '/', compiler);
+		struct stat64 st;
+		if (stat64(path.c_str(), &st) == 0) {
+			return concat_tostr(path, ':', st.st_ino, ':', st.st_size, ':',
+			                    st.st_mtime);
+		}
+	}
+
+	return compiler.to_string(); // Not found - it will fail to compile anyway
+}
+
+StringView compiler_of(sim::SolutionLanguage lang) {
+	using SL = sim::SolutionLanguage;
+	switch (lang) {
+	case SL::C11: return "gcc";
+	case SL::CPP11:
+	case SL::CPP14:
+	case SL::CPP17: return "g++";
+	case SL::PASCAL: return "fpc";
+	case SL::UNKNOWN: break;
+	}
+
+	THROW("Invalid language: ", (int)EnumVal(lang).int_val());
+}
+
+void ensure_cache_dir_exists() {
+	// Sim instances installed before the cache was introduced lack it
+	for (StringView dir : {"cache/", COMPILED_SOLUTIONS_CACHE_DIR}) {
+		if (mkdir(dir.to_string().c_str(), S_IRWXU) and errno != EEXIST)
+			THROW("mkdir(", dir, ')', errmsg());
+	}
+}
+
+uint64_t file_size_or_zero(const std::string& path) {
+	struct stat64 st;
+	return (stat64(path.c_str(), &st) == 0 ? st.st_size : 0);
+}
+
+// Removes the least recently used entries until the cache fits its limit.
+// Has to be called with size_mtx locked.
+void shrink_cache() {
+	STACK_UNWINDING_MARK;
+
+	struct File {
+		time_t mtime;
+		uint64_t size;
+		std::string path;
+	};
+	std::vector<File> files;
+	uint64_t total_size = 0;
+
+	DIR* dir = opendir(COMPILED_SOLUTIONS_CACHE_DIR);
+	if (dir == nullptr)
+		THROW("opendir(", COMPILED_SOLUTIONS_CACHE_DIR, ')', errmsg());
+
+	while (dirent* file = readdir(dir)) {
+		StringView name = file->d_name;
+		if (not has_suffix(name, BINARY_SUFFIX) and
+		    not has_suffix(name, ERRORS_SUFFIX)) {
+			continue; // Skip "." and ".." and temporary files
+		}
+
+		auto path = concat_tostr(COMPILED_SOLUTIONS_CACHE_DIR, name);
+		struct stat64 st;
+		if (stat64(path.c_str(), &st) == 0) {
+			files.push_back({st.st_mtime, (uint64_t)st.st_size, path});
+			total_size += st.st_size;
+		}
+	}
+	closedir(dir);
+
+	if (total_size > COMPILED_SOLUTIONS_CACHE_MAX_SIZE) {
+		std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+			return a.mtime < b.mtime;
+		});
+		// Evict to 90% of the limit, so that eviction does not happen on every
+		// store
+		for (auto& file : files) {
+			if (total_size <= COMPILED_SOLUTIONS_CACHE_MAX_SIZE / 10 * 9)
+				break;
+
+			if (unlink(file.path.c_str()) == 0)
+				total_size -= file.size;
+		}
+	}
+
+	cache_size = total_size;
+}
+
+// Whether the (lowercased) @p line is an error located in the source, as
+// reported by gcc ("file:line[:column]: [fatal ]error: ...") or fpc
+// ("file(line,column) error: ..." or "... fatal: ...")
+bool is_located_error(StringView line) {
+	auto skip_number = [](StringView& str) {
+		size_t len = 0;
+		while (len < str.size() and is_digit(str[len]))
+			++len;
+		str.remove_prefix(len);
+		return len > 0;
+	};
+	auto is_error = [](StringView str) {
+		return has_prefix(str, "error:") or has_prefix(str, "fatal error:") or
+		       has_prefix(str, "fatal:");
+	};
+
+	// The file name may contain the separators too, so every one is tried
+	for (size_t pos = line.find(':'); pos != StringView::npos;
+	     pos = line.find(':', pos + 1)) {
+		StringView rest = line.substr(pos + 1);
+		if (pos == 0 or not skip_number(rest))
+			continue;
+
+		if (rest.size() > 1 and rest[0] == ':' and is_digit(rest[1])) {
+			rest.remove_prefix(1);
+			skip_number(rest);
+		}
+		if (has_prefix(rest, ": ") and is_error(rest.substr(2)))
+			return true;
+	}
+
+	for (size_t pos = line.find('('); pos != StringView::npos;
+	     pos = line.find('(', pos + 1)) {
+		StringView rest = line.substr(pos + 1);
+		if (pos == 0 or not skip_number(rest) or not has_prefix(rest, ","))
+			continue;
+
+		rest.remove_prefix(1);
+		if (skip_number(rest) and has_prefix(rest, ") ") and
+		    is_error(rest.substr(2))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // anonymous namespace
+
+bool is_compiler_diagnostic(StringView compilation_errors,
+                            std::chrono::nanoseconds compilation_time,
+                            std::chrono::nanoseconds time_limit) {
+	if (compilation_time >= time_limit)
+		return false;
+
+	std::string errors = compilation_errors.to_string();
+	std::transform(errors.begin(), errors.end(), errors.begin(), ::tolower);
+	auto contains = [&errors](StringView str) {
+		return errors.find(str.data(), 0, str.size()) != std::string::npos;
+	};
+
+	// The compiler (or the sandbox) was killed, ran out of resources or could
+	// not run its subprocesses
+	for (StringView str :
+	     {"time limit", "internal compiler error", "killed", "signal",
+	      "cannot execute", "out of memory", "memory exhausted",
+	      "cannot allocate memory", "proot"}) {
+		if (contains(str))
+			return false;
+	}
+
+	// Anything else (e.g. a bare "error:" printed by a failing wrapper) is
+	// not known to be deterministic
+	StringView rest = errors;
+	while (not rest.empty()) {
+		size_t eol = rest.find('\n');
+		if (is_located_error(rest.substr(0, eol)))
+			return true;
+
+		rest.remove_prefix(eol == StringView::npos ? rest.size() : eol + 1);
+	}
+
+	return false;
+}
+
+std::string key(FilePath source_path, sim::SolutionLanguage lang) {
+	STACK_UNWINDING_MARK;
+
+	return concat_tostr(sha3_512(intentional_unsafe_string_view(
+	   concat(get_file_contents(source_path), '\0', EnumVal(lang).int_val(),
+	          '\0', compiler_identity(compiler_of(lang))))));
+}
+
+std::optional<CompilationResult> load(const std::string& key,
+                                      sim::JudgeWorker& jworker) {
+	STACK_UNWINDING_MARK;
+
+	auto binary_path = concat_tostr(COMPILED_SOLUTIONS_CACHE_DIR, key,
+	                                 BINARY_SUFFIX);
+	auto errors_path = concat_tostr(COMPILED_SOLUTIONS_CACHE_DIR, key,
+	                                ERRORS_SUFFIX);
+	// Updating mtime marks the entry as recently used
+	if (utime(binary_path.c_str(), nullptr) == 0) {
+		jworker.load_compiled_solution(binary_path);
+		++hits_;
+		return CompilationResult {std::nullopt};
+	}
+
+	if (utime(errors_path.c_str(), nullptr) == 0) {
+		++hits_;
+		return CompilationResult {get_file_contents(errors_path)};
+	}
+
+	++misses_;
+	return std::nullopt;
+}
+
+void store(const std::string& key, sim::JudgeWorker& jworker,
+           const CompilationResult& result) {
+	STACK_UNWINDING_MARK;
+
+	ensure_cache_dir_exists();
+
+	auto path = concat_tostr(COMPILED_SOLUTIONS_CACHE_DIR, key,
+	                         (result.compilation_errors ? ERRORS_SUFFIX
+	                                                    : BINARY_SUFFIX));
+	// Write to a temporary file and rename it, so that concurrent readers
+	// never see a partially written entry
+	auto tmp_path = concat_tostr(path, ".tmp.", getpid(), '.', pthread_self());
+	FileRemover tmp_remover(tmp_path);
+	if (result.compilation_errors)
+		put_file_contents(tmp_path, *result.compilation_errors);
+	else
+		jworker.save_compiled_solution(tmp_path);
+
+	if (rename(tmp_path.c_str(), path.c_str()))
+		THROW("rename(", tmp_path, ", ", path, ')', errmsg());
+
+	tmp_remover.cancel();
+
+	std::lock_guard<std::mutex> lock(size_mtx);
+	if (not cache_size) {
+		shrink_cache(); // Computes the size
+	} else {
+		*cache_size += file_size_or_zero(path);
+		if (*cache_size > COMPILED_SOLUTIONS_CACHE_MAX_SIZE)
+			shrink_cache();
+	}
+}
+
+uint64_t hits() noexcept { return hits_; }
+
+uint64_t misses() noexcept { return misses_; }
+
+} // namespace compiled_solutions_cache
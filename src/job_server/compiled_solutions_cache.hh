@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <simlib/sim/judge_worker.hh>
+
+/**
+ * On-disk cache of solution compilation results (the compiled solution or the
+ * compilation errors), shared by all the judge workers of the job server.
+ * Entries are addressed by the hash of the solution's source, its language and
+ * the identity of the compiler, so that rejudging a submission does not compile
+ * it again. The cache is bounded by COMPILED_SOLUTIONS_CACHE_MAX_SIZE, the
+ * least recently used entries are evicted first.
+ */
+namespace compiled_solutions_cache {
+
+struct CompilationResult {
+	// Iff compilation failed, compilation errors are set
+	std::optional<std::string> compilation_errors;
+};
+
+/// Returns the cache key of compiling @p source_path in language @p lang
+std::string key(FilePath source_path, sim::SolutionLanguage lang);
+
+/**
+ * @brief Looks up the compilation result of @p key
+ * @details On hit, if the compilation succeeded, the compiled solution is
+ *   loaded into @p jworker
+ *
+ * @return the cached compilation result or std::nullopt on miss
+ */
+std::optional<CompilationResult> load(const std::string& key,
+                                      sim::JudgeWorker& jworker);
+
+/**
+ * @brief Checks whether the failed compilation that took @p compilation_time
+ *   and reported @p compilation_errors may be cached
+ * @details Only the diagnostics of the compiler are deterministic. Hitting the
+ *   compilation time limit, the compiler being killed by a signal or failing to
+ *   run at all depend on the load of the machine and must not be cached. So
+ *   the errors have to contain an error located in the source, in the format
+ *   of gcc ("file:line:column: error: ...") or fpc ("file(line,column) Error:
+ *   ...").
+ */
+bool is_compiler_diagnostic(StringView compilation_errors,
+                            std::chrono::nanoseconds compilation_time,
+                            std::chrono::nanoseconds time_limit);
+
+/// Stores the compilation result of @p key - if the compilation succeeded,
+/// the solution compiled by @p jworker is saved. Failed compilations should be
+/// stored only if is_compiler_diagnostic() holds for them.
+void store(const std::string& key, sim::JudgeWorker& jworker,
+           const CompilationResult& result);
+
+uint64_t hits() noexcept;
+
+uint64_t misses() noexcept;
+
+} // namespace compiled_solutions_cache
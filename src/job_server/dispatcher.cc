@@ -17,6 +17,7 @@
 #include "job_handlers/reupload_problem__judge_main_solution.hh"
 #include "main.hh"
 
+#include <sim/remote_judge.hh>
 #include <thread>
 
 void job_dispatcher(uint64_t job_id, JobType jtype,
@@ -130,6 +131,11 @@ void job_dispatcher(uint64_t job_id, JobType jtype,
 			                     job_handler->get_log(), job_id);
 		}
 
+	} catch (const remote_judge::ConnectionLost&) {
+		// The remote judge worker is gone - its thread will end and the job
+		// will be restarted
+		throw;
+
 	} catch (const std::exception& e) {
 		ERRLOG_CATCH(e);
 		auto transaction = mysql.start_transaction();
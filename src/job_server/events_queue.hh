@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <simlib/debug.hh>
+#include <sys/eventfd.h>
+#include <type_traits>
+
+// Queue of events processed by the job server's events loop (the only thread
+// that touches the jobs queue). Registering an event wakes up the loop through
+// the notifier eventfd.
+//
+// The queue is an intrusive multi-producer single-consumer list (Dmitry
+// Vyukov's algorithm): producers only exchange the head pointer, so workers
+// never block each other nor the events loop. The notifier is written only
+// once per drain of the queue - by the first producer that sees it unarmed.
+class EventsQueue {
+	class Event {
+		friend class EventsQueue;
+		std::atomic<Event*> next_ {nullptr};
+
+	public:
+		virtual void operator()() {}
+
+		virtual ~Event() = default;
+	};
+
+	template <class Func>
+	class EventImpl final : public Event {
+		Func func_;
+
+	public:
+		explicit EventImpl(Func&& func) : func_(std::move(func)) {}
+
+		explicit EventImpl(const Func& func) : func_(func) {}
+
+		void operator()() override { func_(); }
+	};
+
+	std::atomic<Event*> head_; // The most recently registered event
+	Event* tail_; // Touched only by the consumer
+	Event stub_;
+	std::atomic<bool> notified_ {false}; // Whether the notifier is armed
+	std::atomic<int> notifier_fd_ {-1};
+	std::atomic<uint64_t> notifications_ {0};
+	uint64_t events_processed_ = 0; // Touched only by the consumer
+
+	EventsQueue() : head_(&stub_), tail_(&stub_) {}
+
+	static EventsQueue& events_queue() {
+		static EventsQueue eq;
+		return eq;
+	}
+
+	void push(Event* ev) noexcept {
+		ev->next_.store(nullptr, std::memory_order_relaxed);
+		Event* prev = head_.exchange(ev);
+		// Between the exchange and this store the queue looks empty to the
+		// consumer, but the notification below is still to come
+		prev->next_.store(ev);
+	}
+
+	// Returns nullptr if the queue is empty or a producer is in the middle of
+	// pushing (it will notify the consumer after it finishes)
+	Event* pop() noexcept {
+		Event* tail = tail_;
+		Event* next = tail->next_.load();
+		if (tail == &stub_) {
+			if (next == nullptr)
+				return nullptr;
+
+			tail_ = tail = next;
+			next = next->next_.load();
+		}
+
+		if (next) {
+			tail_ = next;
+			return tail;
+		}
+
+		if (tail != head_.load())
+			return nullptr;
+
+		// tail is the last event; the stub is pushed so that tail can be
+		// unlinked
+		push(&stub_);
+		next = tail->next_.load();
+		if (next) {
+			tail_ = next;
+			return tail;
+		}
+
+		return nullptr;
+	}
+
+	void notify() noexcept {
+		if (notified_.exchange(true))
+			return; // The consumer has not drained the queue yet
+
+		notifications_.fetch_add(1, std::memory_order_relaxed);
+		eventfd_write(notifier_fd_.load(), 1);
+	}
+
+public:
+	EventsQueue(const EventsQueue&) = delete;
+	EventsQueue& operator=(const EventsQueue&) = delete;
+
+	~EventsQueue() {
+		while (Event* ev = pop())
+			delete ev;
+	}
+
+	/// Has to be called from the events loop's thread
+	static int set_notifier_fd() {
+		STACK_UNWINDING_MARK;
+		auto& eq = events_queue();
+		int fd = eq.notifier_fd_.load();
+		if (fd != -1)
+			return fd;
+
+		if ((fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+			THROW("eventfd() failed", errmsg());
+
+		eq.notifier_fd_.store(fd);
+		// Events registered in the meantime might have armed the notifier
+		eventfd_write(fd, 1);
+		return fd;
+	}
+
+	static int get_notifier_fd() { return events_queue().notifier_fd_.load(); }
+
+	static void reset_notifier() {
+		eventfd_t x;
+		eventfd_read(events_queue().notifier_fd_.load(), &x);
+	}
+
+	/// Thread-safe, does not block. @p ev may be move-only.
+	template <class Callable>
+	static void register_event(Callable&& ev) {
+		STACK_UNWINDING_MARK;
+		auto& eq = events_queue();
+		eq.push(new EventImpl<std::decay_t<Callable>>(
+		   std::forward<Callable>(ev)));
+		eq.notify();
+	}
+
+	/// Processes all the registered events (including the ones registered by
+	/// the processed events). Has to be called from the events loop's thread.
+	/// Return value - a bool denoting whether any event processing took place
+	static bool process_events() {
+		STACK_UNWINDING_MARK;
+
+		auto& eq = events_queue();
+		// Disarm before draining: an event pushed from now on notifies again
+		eq.notified_.store(false);
+		bool processed = false;
+		while (Event* ev = eq.pop()) {
+			std::unique_ptr<Event> ev_ptr(ev);
+			++eq.events_processed_;
+			processed = true;
+			try {
+				(*ev)();
+			} catch (...) {
+				eq.notify(); // Remaining events must not wait for a new one
+				throw;
+			}
+		}
+
+		return processed;
+	}
+
+	struct Stats {
+		uint64_t events_processed;
+		uint64_t notifications; // Writes to the notifier
+	};
+
+	/// Has to be called from the events loop's thread
+	static Stats stats() noexcept {
+		auto& eq = events_queue();
+		return {eq.events_processed_,
+		        eq.notifications_.load(std::memory_order_relaxed)};
+	}
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * std::mutex that counts how often it is contended and how long threads wait
+ * for it. An uncontended lock() costs one try_lock() more than std::mutex, so
+ * it is suitable for the job server's hot paths.
+ */
+class InstrumentedMutex {
+	std::mutex mtx_;
+	std::atomic<uint64_t> acquisitions_ {0};
+	std::atomic<uint64_t> contended_acquisitions_ {0};
+	std::atomic<uint64_t> wait_ns_ {0};
+
+public:
+	struct Stats {
+		uint64_t acquisitions;
+		uint64_t contended_acquisitions;
+		std::chrono::nanoseconds wait_time; // Total
+	};
+
+	void lock() {
+		acquisitions_.fetch_add(1, std::memory_order_relaxed);
+		if (mtx_.try_lock())
+			return;
+
+		auto start = std::chrono::steady_clock::now();
+		mtx_.lock();
+		auto waited = std::chrono::steady_clock::now() - start;
+		contended_acquisitions_.fetch_add(1, std::memory_order_relaxed);
+		wait_ns_.fetch_add(
+		   std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+		   std::memory_order_relaxed);
+	}
+
+	bool try_lock() {
+		if (not mtx_.try_lock())
+			return false;
+
+		acquisitions_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void unlock() { mtx_.unlock(); }
+
+	Stats stats() const noexcept {
+		return {acquisitions_.load(std::memory_order_relaxed),
+		        contended_acquisitions_.load(std::memory_order_relaxed),
+		        std::chrono::nanoseconds(wait_ns_.load(std::memory_order_relaxed))};
+	}
+
+	void reset_stats() noexcept {
+		acquisitions_ = 0;
+		contended_acquisitions_ = 0;
+		wait_ns_ = 0;
+	}
+};
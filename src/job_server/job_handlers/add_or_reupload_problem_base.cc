@@ -220,12 +220,14 @@ void AddOrReuploadProblemBase::add_problem_to_db() {
 	open_package();
 
 	auto stmt = mysql.prepare("INSERT INTO problems(file_id, type, name, label,"
-	                          " simfile, owner, added, last_edit) "
-	                          "VALUES(?,?,?,?,?,?,?,?)");
+	                          " simfile, owner, added, last_edit,"
+	                          " stop_group_on_failure) "
+	                          "VALUES(?,?,?,?,?,?,?,?,?)");
 	stmt.bind_and_execute(tmp_file_id_.value(),
 	                      decltype(Problem::type)(info_.problem_type),
 	                      simfile_.name, simfile_.label, simfile_str_,
-	                      job_creator_, current_date_, current_date_);
+	                      job_creator_, current_date_, current_date_,
+	                      info_.stop_group_on_failure);
 
 	tmp_file_id_ = std::nullopt;
 	problem_id_ = stmt.insert_id();
@@ -251,12 +253,13 @@ void AddOrReuploadProblemBase::replace_problem_in_db() {
 	// Update problem
 	auto stmt = mysql.prepare("UPDATE problems "
 	                          "SET file_id=?, type=?, name=?, label=?,"
-	                          " simfile=?, last_edit=? "
+	                          " simfile=?, last_edit=?, stop_group_on_failure=? "
 	                          "WHERE id=?");
 	stmt.bind_and_execute(tmp_file_id_.value(),
 	                      decltype(Problem::type)(info_.problem_type),
 	                      simfile_.name, simfile_.label, simfile_str_,
-	                      current_date_, problem_id_.value());
+	                      current_date_, info_.stop_group_on_failure,
+	                      problem_id_.value());
 
 	tmp_file_id_ = std::nullopt;
 
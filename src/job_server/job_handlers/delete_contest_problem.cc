@@ -2,6 +2,7 @@
 #include "../main.hh"
 
 #include <sim/constants.hh>
+#include <sim/contest_ranking.hh>
 
 namespace job_handlers {
 
@@ -11,6 +12,7 @@ void DeleteContestProblem::run() {
 	auto transaction = mysql.start_transaction();
 
 	// Log some info about the deleted contest problem
+	uint64_t contest_id;
 	{
 		auto stmt =
 		   mysql.prepare("SELECT c.name, c.id, r.name, r.id, cp.name, p.name,"
@@ -21,8 +23,8 @@ void DeleteContestProblem::run() {
 		                 "JOIN problems p ON p.id=cp.problem_id "
 		                 "WHERE cp.id=?");
 		stmt.bind_and_execute(contest_problem_id_);
-		InplaceBuff<32> cname, cid, rname, rid, cpname, pname, pid;
-		stmt.res_bind_all(cname, cid, rname, rid, cpname, pname, pid);
+		InplaceBuff<32> cname, rname, rid, cpname, pname, pid;
+		stmt.res_bind_all(cname, contest_id, rname, rid, cpname, pname, pid);
 		if (not stmt.next()) {
 			return set_failure(
 			   "Contest problem with id: ", contest_problem_id_,
@@ -30,7 +32,7 @@ void DeleteContestProblem::run() {
 			   " former).");
 		}
 
-		job_log("Contest: ", cname, " (", cid, ')');
+		job_log("Contest: ", cname, " (", contest_id, ')');
 		job_log("Contest round: ", rname, " (", rid, ')');
 		job_log("Contest problem: ", cpname, " (", contest_problem_id_, ')');
 		job_log("Attached problem: ", pname, " (", pid, ')');
@@ -50,6 +52,7 @@ void DeleteContestProblem::run() {
 	// foreign key constrains)
 	mysql.prepare("DELETE FROM contest_problems WHERE id=?")
 	   .bind_and_execute(contest_problem_id_);
+	sim::contest_ranking::invalidate(mysql, contest_id);
 
 	job_done();
 
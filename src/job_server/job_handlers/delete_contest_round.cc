@@ -2,6 +2,7 @@
 #include "../main.hh"
 
 #include <sim/constants.hh>
+#include <sim/contest_ranking.hh>
 
 namespace job_handlers {
 
@@ -11,21 +12,22 @@ void DeleteContestRound::run() {
 	auto transaction = mysql.start_transaction();
 
 	// Log some info about the deleted contest round
+	uint64_t contest_id;
 	{
 		auto stmt = mysql.prepare("SELECT c.name, c.id, r.name"
 		                          " FROM contest_rounds r"
 		                          " JOIN contests c ON c.id=r.contest_id"
 		                          " WHERE r.id=?");
 		stmt.bind_and_execute(contest_round_id_);
-		InplaceBuff<32> cname, cid, rname;
-		stmt.res_bind_all(cname, cid, rname);
+		InplaceBuff<32> cname, rname;
+		stmt.res_bind_all(cname, contest_id, rname);
 		if (not stmt.next()) {
 			return set_failure("Contest round with id: ", contest_round_id_,
 			                   " does not exist or the contest hierarchy is "
 			                   "broken (likely the former).");
 		}
 
-		job_log("Contest: ", cname, " (", cid, ')');
+		job_log("Contest: ", cname, " (", contest_id, ')');
 		job_log("Contest round: ", rname, " (", contest_round_id_, ')');
 	}
 
@@ -43,6 +45,7 @@ void DeleteContestRound::run() {
 	// foreign key constrains)
 	mysql.prepare("DELETE FROM contest_rounds WHERE id=?")
 	   .bind_and_execute(contest_round_id_);
+	sim::contest_ranking::invalidate(mysql, contest_id);
 
 	job_done();
 
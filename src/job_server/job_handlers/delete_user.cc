@@ -3,6 +3,7 @@
 #include "../main.hh"
 
 #include <sim/constants.hh>
+#include <sim/contest_ranking.hh>
 #include <sim/user.hh>
 
 using sim::User;
@@ -45,6 +46,7 @@ void DeleteUser::run() {
 
 	// Delete user (all necessary actions will take place thanks to foreign key
 	// constrains)
+	sim::contest_ranking::invalidate_user(mysql, user_id_);
 	mysql.prepare("DELETE FROM users WHERE id=?").bind_and_execute(user_id_);
 
 	job_done();
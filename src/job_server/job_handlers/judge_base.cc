@@ -1,138 +1,346 @@
 #include "judge_base.hh"
+#include "../compiled_solutions_cache.hh"
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sched.h>
 #include <sim/constants.hh>
+#include <sim/judge_worker_cache.hh>
+#include <sim/judging.hh>
 #include <simlib/enum_val.hh>
+#include <simlib/file_manip.hh>
+#include <thread>
 
 namespace job_handlers {
 
-JudgeBase::JudgeBase() {
-	jworker_.checker_time_limit = CHECKER_TIME_LIMIT;
-	jworker_.checker_memory_limit = CHECKER_MEMORY_LIMIT;
-	jworker_.score_cut_lambda = SCORE_CUT_LAMBDA;
+static std::shared_ptr<sim::JudgeWorker> new_judge_worker() {
+	auto jworker = std::make_shared<sim::JudgeWorker>();
+	jworker->checker_time_limit = CHECKER_TIME_LIMIT;
+	jworker->checker_memory_limit = CHECKER_MEMORY_LIMIT;
+	jworker->score_cut_lambda = SCORE_CUT_LAMBDA;
+	return jworker;
 }
 
-sim::SolutionLanguage JudgeBase::to_sol_lang(SubmissionLanguage lang) {
-	STACK_UNWINDING_MARK;
+// Judge workers are cached per thread, as each of them can serve only one job
+// at a time
+static JudgeWorkerCache& judge_worker_cache() {
+	constexpr size_t JUDGE_WORKER_CACHE_SIZE = 4;
+	static thread_local JudgeWorkerCache cache(JUDGE_WORKER_CACHE_SIZE);
+	return cache;
+}
 
-	switch (lang) {
-	case SubmissionLanguage::C11: return sim::SolutionLanguage::C11;
-	case SubmissionLanguage::CPP11: return sim::SolutionLanguage::CPP11;
-	case SubmissionLanguage::CPP14: return sim::SolutionLanguage::CPP14;
-	case SubmissionLanguage::CPP17: return sim::SolutionLanguage::CPP17;
-	case SubmissionLanguage::PASCAL: return sim::SolutionLanguage::PASCAL;
+// Splits the tests into at most @p shards_no shards of similar total time
+// limit. A test group longer than a shard should be is split into consecutive
+// parts, otherwise a single long group would keep the other shards idle. The
+// parts are assigned, the longest first, to the least loaded shard. Every shard
+// is returned as the test groups (or their parts) it judges.
+static std::vector<decltype(sim::Simfile::tgroups)>
+split_into_shards(const sim::Simfile& simfile, size_t shards_no) {
+	using std::chrono::nanoseconds;
+
+	nanoseconds total_time_limit {0};
+	for (auto& tgroup : simfile.tgroups)
+		for (auto& test : tgroup.tests)
+			total_time_limit += test.time_limit;
+
+	const nanoseconds shard_time_limit = total_time_limit / shards_no;
+
+	struct Part {
+		nanoseconds time_limit;
+		size_t group;
+		size_t begin, end; // Range of the group's tests
+	};
+	std::vector<Part> parts;
+	for (size_t i = 0; i < simfile.tgroups.size(); ++i) {
+		auto& tests = simfile.tgroups[i].tests;
+		nanoseconds group_time_limit {0};
+		for (auto& test : tests)
+			group_time_limit += test.time_limit;
+
+		size_t parts_no = 1;
+		if (shard_time_limit.count() > 0 and
+		    group_time_limit > shard_time_limit) {
+			parts_no = std::min<size_t>(
+			   tests.size(),
+			   (group_time_limit + shard_time_limit - nanoseconds(1)) /
+			      shard_time_limit);
+		}
+
+		// The k-th part ends where the time limits of the group's tests sum up
+		// to k/parts_no of the group's total
+		size_t begin = 0, parts_done = 0;
+		nanoseconds prefix_time_limit {0}, part_begin_time_limit {0};
+		for (size_t j = 0; j < tests.size(); ++j) {
+			prefix_time_limit += tests[j].time_limit;
+			if (j + 1 < tests.size() and
+			    prefix_time_limit * parts_no <
+			       group_time_limit * (parts_done + 1)) {
+				continue;
+			}
+
+			parts.push_back(
+			   {prefix_time_limit - part_begin_time_limit, i, begin, j + 1});
+			begin = j + 1;
+			part_begin_time_limit = prefix_time_limit;
+			++parts_done;
+		}
 	}
 
-	THROW("Invalid Language: ", (int)EnumVal(lang).int_val());
-}
+	std::stable_sort(parts.begin(), parts.end(), [](auto& a, auto& b) {
+		return a.time_limit > b.time_limit;
+	});
 
-InplaceBuff<65536> JudgeBase::construct_report(const sim::JudgeReport& jr,
-                                               bool final) {
-	STACK_UNWINDING_MARK;
+	std::vector<std::vector<const Part*>> shards(shards_no);
+	std::vector<nanoseconds> load(shards_no, nanoseconds(0));
+	for (auto& part : parts) {
+		size_t k = std::min_element(load.begin(), load.end()) - load.begin();
+		load[k] += part.time_limit;
+		shards[k].emplace_back(&part);
+	}
 
-	using sim::JudgeReport;
+	std::vector<decltype(sim::Simfile::tgroups)> res;
+	for (auto& shard : shards) {
+		if (shard.empty())
+			continue;
+
+		// Keep the order of the tests within each shard
+		std::sort(shard.begin(), shard.end(), [](auto* a, auto* b) {
+			return std::pair(a->group, a->begin) <
+			       std::pair(b->group, b->begin);
+		});
+
+		auto& tgroups = res.emplace_back();
+		for (auto* part : shard) {
+			auto& tgroup = tgroups.emplace_back(simfile.tgroups[part->group]);
+			auto& tests = simfile.tgroups[part->group].tests;
+			tgroup.tests.assign(tests.begin() + part->begin,
+			                    tests.begin() + part->end);
+		}
+	}
 
-	InplaceBuff<65536> report;
-	if (jr.groups.empty())
-		return report;
-
-	// clang-format off
-	report.append("<h2>", (final ? "Final" : "Initial"),
-	                  " testing report</h2>"
-	              "<table class=\"table\">"
-	                  "<thead>"
-	                      "<tr>"
-	                          "<th class=\"test\">Test</th>"
-	                          "<th class=\"result\">Result</th>"
-	                          "<th class=\"time\">Time [s]</th>"
-	                          "<th class=\"memory\">Memory [KiB]</th>"
-	                          "<th class=\"points\">Score</th>"
-	                      "</tr>"
-	                  "</thead>"
-	                  "<tbody>");
-	// clang-format on
-
-	auto append_normal_columns = [&](const JudgeReport::Test& test) {
-		STACK_UNWINDING_MARK;
-
-		auto as_td_string = [](JudgeReport::Test::Status s) {
-			switch (s) {
-			case JudgeReport::Test::OK:
-				return "<td class=\"status green\">OK</td>";
-			case JudgeReport::Test::WA:
-				return "<td class=\"status red\">Wrong answer</td>";
-			case JudgeReport::Test::TLE:
-				return "<td class=\"status yellow\">Time limit exceeded</td>";
-			case JudgeReport::Test::MLE:
-				return "<td class=\"status yellow\">Memory limit exceeded</td>";
-			case JudgeReport::Test::RTE:
-				return "<td class=\"status intense-red\">Runtime error</td>";
-			case JudgeReport::Test::CHECKER_ERROR:
-				return "<td class=\"status blue\">Checker error</td>";
-			case JudgeReport::Test::SKIPPED:
-				return "<td class=\"status\">Pending</td>";
+	return res;
+}
+
+// CPUs the judging threads are pinned to, shared by all the judgings of the
+// job server, so that no two judging threads use the same CPU at a time
+class CpusPool {
+	std::mutex mtx_;
+	std::condition_variable cv_;
+	std::vector<int> free_cpus_;
+	std::optional<size_t> cpus_no_; // Lazily initialized
+
+public:
+	// Blocks until some CPU is free, returns -1 if there are no CPUs to pin to
+	int acquire() {
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (not cpus_no_) {
+			cpu_set_t allowed;
+			if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+				errlog("sched_getaffinity()", errmsg());
+				CPU_ZERO(&allowed);
 			}
 
-			throw_assert(false); // We shouldn't get here
-		};
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+				if (CPU_ISSET(cpu, &allowed))
+					free_cpus_.emplace_back(cpu);
 
-		report.append("<td>", html_escape(test.name), "</td>",
-		              as_td_string(test.status), "<td>");
+			cpus_no_ = free_cpus_.size();
+		}
 
-		if (test.status == JudgeReport::Test::SKIPPED)
-			report.append('?');
-		else
-			report.append(to_string(floor_to_10ms(test.runtime), false));
+		if (*cpus_no_ == 0)
+			return -1;
+
+		cv_.wait(lock, [&] { return not free_cpus_.empty(); });
+		int cpu = free_cpus_.back();
+		free_cpus_.pop_back();
+		return cpu;
+	}
+
+	void release(int cpu) {
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			free_cpus_.emplace_back(cpu);
+		}
+		cv_.notify_one();
+	}
+};
+
+static CpusPool cpus_pool;
 
-		report.append(" / ", to_string(floor_to_10ms(test.time_limit), false),
-		              "</td><td>");
+// Pins the current thread (and the sandboxed processes it will spawn) to a CPU
+// from cpus_pool for the guard's lifetime. The thread's previous affinity is
+// restored afterwards, as the thread goes on to do other work.
+class PinnedToCpu {
+	int cpu_;
+	bool restore_affinity_ = false;
+	cpu_set_t prev_affinity_;
 
-		if (test.status == JudgeReport::Test::SKIPPED)
-			report.append('?');
+public:
+	PinnedToCpu() : cpu_(cpus_pool.acquire()) {
+		if (cpu_ < 0)
+			return;
+
+		if (sched_getaffinity(0, sizeof(prev_affinity_), &prev_affinity_))
+			errlog("sched_getaffinity()", errmsg());
 		else
-			report.append(test.memory_consumed >> 10);
+			restore_affinity_ = true;
 
-		report.append(" / ", test.memory_limit >> 10, "</td>");
-	};
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu_, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			errlog("sched_setaffinity()", errmsg());
+	}
 
-	bool there_are_comments = false;
-	for (auto&& group : jr.groups) {
-		throw_assert(group.tests.size() > 0);
-		// First row
-		report.append("<tr>");
-		append_normal_columns(group.tests[0]);
-		report.append("<td class=\"groupscore\" rowspan=\"", group.tests.size(),
-		              "\">", group.score, " / ", group.max_score, "</td></tr>");
-		// Other rows
-		std::for_each(group.tests.begin() + 1, group.tests.end(),
-		              [&](const JudgeReport::Test& test) {
-			              report.append("<tr>");
-			              append_normal_columns(test);
-			              report.append("</tr>");
-		              });
+	PinnedToCpu(const PinnedToCpu&) = delete;
+	PinnedToCpu& operator=(const PinnedToCpu&) = delete;
 
-		for (auto&& test : group.tests)
-			there_are_comments |= !test.comment.empty();
+	~PinnedToCpu() {
+		if (cpu_ < 0)
+			return;
+
+		if (restore_affinity_ and
+		    sched_setaffinity(0, sizeof(prev_affinity_), &prev_affinity_)) {
+			errlog("sched_setaffinity()", errmsg());
+		}
+
+		cpus_pool.release(cpu_);
+	}
+};
+
+// Threads that judge the shards, shared by all the judgings of the job server
+// and kept for the following ones. A new thread is spawned only if all the
+// threads are busy, so there are never more of them than shards judged at a
+// time.
+class ShardThreadsPool {
+	std::mutex mtx_;
+	std::condition_variable cv_;
+	std::deque<std::function<void()>> tasks_;
+	size_t idle_threads_ = 0;
+	bool stopping_ = false;
+	std::vector<std::thread> threads_;
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mtx_);
+		for (;;) {
+			++idle_threads_;
+			cv_.wait(lock, [&] { return stopping_ or not tasks_.empty(); });
+			--idle_threads_;
+			if (tasks_.empty())
+				return; // Stopping
+
+			auto task = std::move(tasks_.front());
+			tasks_.pop_front();
+			lock.unlock();
+			task(); // Tasks do not throw
+			lock.lock();
+		}
+	}
+
+public:
+	ShardThreadsPool() = default;
+
+	ShardThreadsPool(const ShardThreadsPool&) = delete;
+	ShardThreadsPool& operator=(const ShardThreadsPool&) = delete;
+
+	~ShardThreadsPool() {
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			stopping_ = true;
+		}
+		cv_.notify_all();
+		for (auto& thread : threads_)
+			thread.join();
+	}
+
+	// Runs @p task on some thread of the pool, @p task must not throw
+	void run(std::function<void()> task) {
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			tasks_.emplace_back(std::move(task));
+			if (idle_threads_ < tasks_.size())
+				threads_.emplace_back([this] { work(); });
+		}
+		cv_.notify_one();
 	}
+};
+
+static ShardThreadsPool shard_threads_pool;
+
+// Merges the reports of the shards in the order of the groups and their tests
+// in @p simfile. A group split between shards scores the lowest score of its
+// parts (the highest one if the group's score is negative), as the score of a
+// group is determined by its worst test. Tests of a partially reported group
+// that have not been reported yet are reported as SKIPPED. Judge logs are not
+// merged.
+static sim::JudgeReport
+merge_reports(const sim::Simfile& simfile,
+              const std::vector<sim::JudgeReport>& reports) {
+	using sim::JudgeReport;
 
-	report.append("</tbody></table>");
+	// Test name -> (the test's report, report of the group (part) it is in)
+	std::map<StringView,
+	         std::pair<const JudgeReport::Test*, const JudgeReport::Group*>>
+	   tests;
+	for (auto& rep : reports)
+		for (auto& group : rep.groups)
+			for (auto& test : group.tests)
+				tests.emplace(test.name, std::pair(&test, &group));
+
+	JudgeReport res;
+	for (auto& tgroup : simfile.tgroups) {
+		JudgeReport::Group group;
+		std::vector<const JudgeReport::Group*> parts;
+		for (auto& test : tgroup.tests) {
+			auto it = tests.find(test.name);
+			if (it == tests.end()) {
+				group.tests.emplace_back(test.name, JudgeReport::Test::SKIPPED,
+				                         std::chrono::nanoseconds(0),
+				                         test.time_limit, 0, test.memory_limit,
+				                         "");
+				continue;
+			}
 
-	// Tests comments
-	if (there_are_comments) {
-		report.append("<ul class=\"tests-comments\">");
-		for (auto&& group : jr.groups) {
-			for (auto&& test : group.tests) {
-				if (test.comment.size()) {
-					report.append("<li><span class=\"test-id\">",
-					              html_escape(test.name), "</span>",
-					              html_escape(test.comment), "</li>");
-				}
+			auto& [test_rep, part] = it->second;
+			group.tests.emplace_back(*test_rep);
+			if (std::find(parts.begin(), parts.end(), part) != parts.end())
+				continue;
+
+			if (parts.empty()) {
+				group.score = part->score;
+				group.max_score = part->max_score;
+			} else {
+				group.score = (group.max_score >= 0
+				                  ? std::min(group.score, part->score)
+				                  : std::max(group.score, part->score));
 			}
+			parts.emplace_back(part);
 		}
 
-		report.append("</ul>");
+		// The group does not belong to this judging or is not reported yet
+		if (not parts.empty())
+			res.groups.emplace_back(std::move(group));
 	}
 
-	return report;
+	return res;
+}
+
+JudgeBase::JudgeBase() : jworker_(new_judge_worker()) {}
+
+sim::SolutionLanguage JudgeBase::to_sol_lang(SubmissionLanguage lang) {
+	STACK_UNWINDING_MARK;
+
+	switch (lang) {
+	case SubmissionLanguage::C11: return sim::SolutionLanguage::C11;
+	case SubmissionLanguage::CPP11: return sim::SolutionLanguage::CPP11;
+	case SubmissionLanguage::CPP14: return sim::SolutionLanguage::CPP14;
+	case SubmissionLanguage::CPP17: return sim::SolutionLanguage::CPP17;
+	case SubmissionLanguage::PASCAL: return sim::SolutionLanguage::PASCAL;
+	}
+
+	THROW("Invalid Language: ", (int)EnumVal(lang).int_val());
 }
 
 SubmissionStatus JudgeBase::calc_status(const sim::JudgeReport& jr) {
@@ -169,10 +377,31 @@ void JudgeBase::load_problem_package(FilePath problem_pkg_path) {
 
 	auto tmplog = job_log("Loading problem package...");
 	tmplog.flush_no_nl();
-	jworker_.load_package(problem_pkg_path, std::nullopt);
+	jworker_->load_package(problem_pkg_path, std::nullopt);
+	package_path_ = problem_pkg_path.to_str();
 	tmplog(" done.");
 }
 
+void JudgeBase::load_problem_package(uint64_t package_file_id,
+                                     StringView problem_version) {
+	STACK_UNWINDING_MARK;
+	if (failed())
+		return;
+
+	auto& cache = judge_worker_cache();
+	cache_key_.emplace(package_file_id, problem_version.to_string());
+	if (auto jworker = cache.get(package_file_id, problem_version)) {
+		jworker_ = std::move(jworker);
+		checker_is_compiled_ = true;
+		package_path_ = internal_file_path(package_file_id);
+		job_log("Using cached problem package and checker (cache hits: ",
+		        cache.hits(), ", misses: ", cache.misses(), ')');
+		return;
+	}
+
+	load_problem_package(internal_file_path(package_file_id));
+}
+
 template <class MethodPtr>
 std::optional<std::string>
 JudgeBase::compile_solution_impl(FilePath solution_path,
@@ -186,7 +415,7 @@ JudgeBase::compile_solution_impl(FilePath solution_path,
 	tmplog.flush_no_nl();
 
 	std::string compilation_errors;
-	if ((jworker_.*compile_method)(
+	if (((*jworker_).*compile_method)(
 	       solution_path, lang, SOLUTION_COMPILATION_TIME_LIMIT,
 	       &compilation_errors, COMPILATION_ERRORS_MAX_LENGTH, PROOT_PATH)) {
 		tmplog(" failed:\n", compilation_errors);
@@ -201,8 +430,51 @@ std::optional<std::string>
 JudgeBase::compile_solution(FilePath solution_path,
                             sim::SolutionLanguage lang) {
 	STACK_UNWINDING_MARK;
-	return compile_solution_impl(solution_path, lang,
-	                             &sim::JudgeWorker::compile_solution);
+	if (failed())
+		return std::nullopt;
+
+	namespace csc = compiled_solutions_cache;
+	// Errors of the cache must not fail the judging
+	std::string key;
+	try {
+		key = csc::key(solution_path, lang);
+		if (auto res = csc::load(key, *jworker_)) {
+			auto tmplog = job_log("Compiling solution... cached (hits: ",
+			                      csc::hits(), ", misses: ", csc::misses(), ')');
+			if (res->compilation_errors)
+				tmplog("\nCompilation failed:\n", *res->compilation_errors);
+
+			return res->compilation_errors;
+		}
+	} catch (const std::exception& e) {
+		ERRLOG_CATCH(e);
+	}
+
+	auto compilation_begin = std::chrono::steady_clock::now();
+	auto compilation_errors = compile_solution_impl(
+	   solution_path, lang, &sim::JudgeWorker::compile_solution);
+	auto compilation_time =
+	   std::chrono::steady_clock::now() - compilation_begin;
+
+	// Only the deterministic results are cached, otherwise e.g. a compilation
+	// that timed out on an overloaded machine would fail forever
+	if (compilation_errors and
+	    not csc::is_compiler_diagnostic(*compilation_errors, compilation_time,
+	                                    SOLUTION_COMPILATION_TIME_LIMIT)) {
+		key.clear();
+	}
+
+	if (not key.empty()) {
+		try {
+			csc::store(key, *jworker_, {compilation_errors});
+			job_log("Compiled solution cached (hits: ", csc::hits(),
+			        ", misses: ", csc::misses(), ')');
+		} catch (const std::exception& e) {
+			ERRLOG_CATCH(e);
+		}
+	}
+
+	return compilation_errors;
 }
 
 std::optional<std::string>
@@ -215,22 +487,208 @@ JudgeBase::compile_solution_from_problem_package(FilePath solution_path,
 
 std::optional<std::string> JudgeBase::compile_checker() {
 	STACK_UNWINDING_MARK;
-	if (failed())
+	if (failed() or checker_is_compiled_)
 		return std::nullopt;
 
 	auto tmplog = job_log("Compiling checker...");
 	tmplog.flush_no_nl();
 
 	std::string compilation_errors;
-	if (jworker_.compile_checker(SOLUTION_COMPILATION_TIME_LIMIT,
-	                             &compilation_errors,
-	                             COMPILATION_ERRORS_MAX_LENGTH, PROOT_PATH)) {
+	if (jworker_->compile_checker(SOLUTION_COMPILATION_TIME_LIMIT,
+	                              &compilation_errors,
+	                              COMPILATION_ERRORS_MAX_LENGTH, PROOT_PATH)) {
 		tmplog(" failed:\n", compilation_errors);
 		return compilation_errors;
 	}
 
 	tmplog(" done.");
+	checker_is_compiled_ = true;
+	if (cache_key_) {
+		judge_worker_cache().put(cache_key_->first, cache_key_->second,
+		                         jworker_);
+	}
+
 	return std::nullopt;
 }
 
+void JudgeBase::prepare_jworker_template() {
+	STACK_UNWINDING_MARK;
+
+	auto tmp_prefix =
+	   concat_tostr("/tmp/sim-judge-worker.", getpid(), '.', pthread_self());
+	auto solution_path = concat_tostr(tmp_prefix, ".solution");
+	auto checker_path = concat_tostr(tmp_prefix, ".checker");
+	jworker_template_.reset(new JudgeWorkerTemplate {
+	   jworker_->simfile(), solution_path, checker_path,
+	   FileRemover(solution_path), FileRemover(checker_path)});
+
+	// Everything is needed as the Simfile will be dumped
+	jworker_template_->simfile.load_all();
+	jworker_->save_compiled_solution(solution_path);
+	jworker_->save_compiled_checker(checker_path);
+}
+
+std::shared_ptr<sim::JudgeWorker>
+JudgeBase::new_judge_worker_with(const TestGroups& tgroups) const {
+	STACK_UNWINDING_MARK;
+
+	sim::Simfile simfile = jworker_template_->simfile;
+	simfile.tgroups = tgroups;
+
+	auto jworker = new_judge_worker();
+	jworker->load_package(package_path_, simfile.dump());
+	jworker->load_compiled_solution(jworker_template_->solution_path);
+	jworker->load_compiled_checker(jworker_template_->checker_path);
+	return jworker;
+}
+
+void JudgeBase::prepare_shard_jworkers(size_t shards_no) {
+	STACK_UNWINDING_MARK;
+
+	auto& simfile = jworker_template_->simfile;
+	auto shards = split_into_shards(simfile, shards_no);
+	// Cached judge workers only need the currently judged solution
+	if (cache_key_) {
+		shard_jworkers_ = judge_worker_cache().shard_jworkers(
+		   cache_key_->first, cache_key_->second);
+		if (shard_jworkers_.size() == shards.size()) {
+			for (auto& jworker : shard_jworkers_) {
+				jworker->load_compiled_solution(
+				   jworker_template_->solution_path);
+			}
+
+			job_log("Using cached judge workers for parallel judging");
+			return;
+		}
+	}
+
+	auto tmplog = job_log("Preparing ", shards.size(),
+	                      " judge workers for parallel judging...");
+	tmplog.flush_no_nl();
+
+	shard_jworkers_.clear();
+	for (auto& tgroups : shards)
+		shard_jworkers_.emplace_back(new_judge_worker_with(tgroups));
+
+	tmplog(" done.");
+	if (cache_key_) {
+		judge_worker_cache().set_shard_jworkers(
+		   cache_key_->first, cache_key_->second, shard_jworkers_);
+	}
+}
+
+sim::JudgeReport
+JudgeBase::judge(bool final, sim::JudgeLogger& logger,
+                 const std::function<void(const sim::JudgeReport&)>&
+                    partial_report_callback) {
+	STACK_UNWINDING_MARK;
+
+	size_t tests_no = 0;
+	for (auto& tgroup : jworker_->simfile().tgroups)
+		tests_no += tgroup.tests.size();
+
+	size_t shards_no = std::min(parallel_tests_, tests_no);
+	if (package_path_.empty() or shards_no < 2) {
+		PinnedToCpu pinned; // Until the judging ends
+		if (stop_group_on_failure_) {
+			return sim::judge_stopping_on_group_failure(
+			   *jworker_, final, logger, partial_report_callback);
+		}
+
+		return jworker_->judge(final, logger, partial_report_callback);
+	}
+
+	if (not jworker_template_)
+		prepare_jworker_template();
+
+	auto& simfile = jworker_template_->simfile;
+	if (shard_jworkers_.empty())
+		prepare_shard_jworkers(shards_no);
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::vector<sim::JudgeReport> reports(shard_jworkers_.size());
+	std::vector<std::exception_ptr> errors(shard_jworkers_.size());
+	size_t shards_done = 0;
+	bool partial_report_changed = false;
+
+	for (size_t i = 0; i < shard_jworkers_.size(); ++i) {
+		shard_threads_pool.run([&, i] {
+			try {
+				PinnedToCpu pinned; // Until the shard is judged
+				sim::VerboseJudgeLogger shard_logger(true);
+				auto shard_partial_report_callback =
+				   [&](const sim::JudgeReport& partial) {
+					   std::lock_guard<std::mutex> lock(mtx);
+					   reports[i] = partial;
+					   partial_report_changed = true;
+					   cv.notify_one();
+				   };
+				auto rep =
+				   (stop_group_on_failure_
+				       ? sim::judge_stopping_on_group_failure(
+				            *shard_jworkers_[i], final, shard_logger,
+				            shard_partial_report_callback)
+				       : shard_jworkers_[i]->judge(
+				            final, shard_logger, shard_partial_report_callback));
+
+				std::lock_guard<std::mutex> lock(mtx);
+				reports[i] = std::move(rep);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mtx);
+				errors[i] = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(mtx);
+			++shards_done;
+			cv.notify_one();
+		});
+	}
+
+	// Partial reports are delivered from the current thread, as the callback
+	// may use the thread's MySQL connection
+	std::exception_ptr callback_error;
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		for (;;) {
+			cv.wait(lock, [&] {
+				return partial_report_changed or
+				       shards_done == shard_jworkers_.size();
+			});
+			if (shards_done == shard_jworkers_.size())
+				break;
+
+			partial_report_changed = false;
+			if (not partial_report_callback or callback_error)
+				continue;
+
+			auto partial = merge_reports(simfile, reports);
+			lock.unlock();
+			try {
+				partial_report_callback(partial);
+			} catch (...) {
+				callback_error = std::current_exception();
+			}
+			lock.lock();
+		}
+	}
+
+	for (auto& error : errors)
+		if (error)
+			std::rethrow_exception(error);
+
+	if (callback_error)
+		std::rethrow_exception(callback_error);
+
+	auto res = merge_reports(simfile, reports);
+	for (size_t i = 0; i < reports.size(); ++i) {
+		if (not reports[i].judge_log.empty()) {
+			back_insert(res.judge_log, "Shard ", i + 1, ":\n",
+			            reports[i].judge_log);
+		}
+	}
+
+	return res;
+}
+
 } // namespace job_handlers
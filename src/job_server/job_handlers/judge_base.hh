@@ -2,27 +2,78 @@
 
 #include "job_handler.hh"
 
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <sim/constants.hh>
+#include <simlib/file_manip.hh>
 #include <simlib/sim/judge_worker.hh>
 
 namespace job_handlers {
 
 class JudgeBase : virtual public JobHandler {
 protected:
-	sim::JudgeWorker jworker_;
+	std::shared_ptr<sim::JudgeWorker> jworker_;
 
 	JudgeBase();
 
 	static sim::SolutionLanguage to_sol_lang(SubmissionLanguage lang);
 
-	// Creates an xml report from JudgeReport
-	InplaceBuff<65536> construct_report(const sim::JudgeReport& jr, bool final);
-
 	// Returns OK or the first encountered error status
 	SubmissionStatus calc_status(const sim::JudgeReport& jr);
 
 	void load_problem_package(FilePath problem_pkg_path);
 
+	/**
+	 * @brief Loads the problem package of internal file @p package_file_id
+	 * @details Uses the current thread's cache of judge workers: on hit, the
+	 *   cached judge worker with the package loaded and the checker compiled
+	 *   is used (compile_checker() becomes no-op), on miss the judge worker is
+	 *   cached after successful checker compilation.
+	 *
+	 * @param package_file_id id of the problem package's internal file
+	 * @param problem_version the problem's last edit time - the cached judge
+	 *   worker is dropped if it changes
+	 */
+	void load_problem_package(uint64_t package_file_id,
+	                          StringView problem_version);
+
+private:
+	// Number of shards the tests of one judging are split into (see judge())
+	static inline size_t parallel_tests_ = 1;
+
+	// Set iff the package was loaded through the cache: (package id, version)
+	std::optional<std::pair<uint64_t, std::string>> cache_key_;
+	bool checker_is_compiled_ = false;
+	std::string package_path_;
+
+	using TestGroups = decltype(sim::Simfile::tgroups);
+
+	// What is needed to create judge workers that judge only some of the test
+	// groups: the fully loaded Simfile and the solution and the checker
+	// compiled by jworker_
+	struct JudgeWorkerTemplate {
+		sim::Simfile simfile;
+		std::string solution_path;
+		std::string checker_path;
+		FileRemover solution_remover;
+		FileRemover checker_remover;
+	};
+	std::unique_ptr<JudgeWorkerTemplate> jworker_template_;
+	// Judge workers that judge the shards of tests, prepared (or taken from
+	// the cache of judge workers, along with jworker_) by the first parallel
+	// judge()
+	std::vector<std::shared_ptr<sim::JudgeWorker>> shard_jworkers_;
+	bool stop_group_on_failure_ = false;
+
+	void prepare_jworker_template();
+
+	// Has to be called after prepare_jworker_template(), it is thread-safe
+	std::shared_ptr<sim::JudgeWorker>
+	new_judge_worker_with(const TestGroups& tgroups) const;
+
+	void prepare_shard_jworkers(size_t shards_no);
+
 private:
 	// Iff compilation failed, compilation errors are returned
 	template <class MethodPtr>
@@ -42,7 +93,41 @@ protected:
 
 	std::optional<std::string> compile_checker();
 
+	/// Enables the problem's policy of stopping the judging of a test group at
+	/// its first failed test (as the group's score is 0 from that moment on)
+	void set_stop_group_on_failure(bool stop) noexcept {
+		stop_group_on_failure_ = stop;
+	}
+
+	/**
+	 * @brief Judges the compiled solution on the initial or the final tests
+	 * @details The judging runs pinned to a CPU that no other judging thread
+	 *   uses meanwhile (it waits for a free CPU). If parallel judging is
+	 *   enabled (see set_parallel_tests()), the tests are split into shards
+	 *   judged simultaneously, each by a separate judge worker on a pooled
+	 *   thread pinned to its own CPU; test groups longer than a shard should
+	 *   be are split too. Every test is still judged alone in its own sandbox,
+	 *   so its runtime is measured as usual. The reports of the shards are
+	 *   merged in the order of the tests in the Simfile, so the result does
+	 *   not depend on the shards' timing.
+	 *   If set_stop_group_on_failure() was enabled, the remaining tests of a
+	 *   failed group are not run and are reported as SKIPPED (only within the
+	 *   failed part if the group is split between shards).
+	 *   @p partial_report_callback is always called from the current thread.
+	 */
+	sim::JudgeReport
+	judge(bool final, sim::JudgeLogger& logger,
+	      const std::function<void(const sim::JudgeReport&)>&
+	         partial_report_callback = {});
+
 public:
+	/// Sets into how many shards (at most), judged in parallel, the tests of a
+	/// single judging are split; 1 disables parallel judging. Has to be called
+	/// before any judging starts.
+	static void set_parallel_tests(size_t shards_no) noexcept {
+		parallel_tests_ = std::max<size_t>(shards_no, 1);
+	}
+
 	virtual ~JudgeBase() = default;
 };
 
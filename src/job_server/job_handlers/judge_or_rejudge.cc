@@ -1,29 +1,38 @@
 #include "judge_or_rejudge.hh"
 #include "../main.hh"
+#include "../remote_judge_connection.hh"
 
+#include <sim/judging_progress.hh>
+#include <sim/mysql.hh>
 #include <sim/submission.hh>
+#include <sim/submission_report.hh>
 
 namespace job_handlers {
 
 void JudgeOrRejudge::run() {
 	STACK_UNWINDING_MARK;
 
+	// The same statements are used for every judged submission
+	auto& stmts = MySQL::statements_cache(mysql);
 	// Gather the needed information about the submission
-	auto stmt = mysql.prepare("SELECT s.file_id, s.language, s.owner,"
+	auto stmt = stmts.prepare("SELECT s.file_id, s.language, s.owner,"
 	                          " s.contest_problem_id, s.problem_id,"
-	                          " s.last_judgment, p.file_id, p.last_edit "
+	                          " s.last_judgment, p.file_id, p.last_edit,"
+	                          " p.stop_group_on_failure "
 	                          "FROM submissions s, problems p "
 	                          "WHERE p.id=problem_id AND s.id=?");
-	stmt.bind_and_execute(submission_id_);
+	stmt->bind_and_execute(submission_id_);
 	uint64_t submission_file_id, problem_file_id;
 	uint64_t problem_id;
 	MySQL::Optional<uint64_t> sowner, contest_problem_id;
 	InplaceBuff<64> last_judgment, p_last_edit;
 	EnumVal<SubmissionLanguage> lang;
-	stmt.res_bind_all(submission_file_id, lang, sowner, contest_problem_id,
-	                  problem_id, last_judgment, problem_file_id, p_last_edit);
+	bool stop_group_on_failure;
+	stmt->res_bind_all(submission_file_id, lang, sowner, contest_problem_id,
+	                   problem_id, last_judgment, problem_file_id, p_last_edit,
+	                   stop_group_on_failure);
 	// If the submission doesn't exist (probably was removed)
-	if (not stmt.next()) {
+	if (not stmt->next()) {
 		return set_failure("Failed the job of judging the submission ",
 		                   submission_id_,
 		                   ", since there is no such submission.");
@@ -41,9 +50,21 @@ void JudgeOrRejudge::run() {
 
 	std::string judging_began = mysql_date();
 
-	job_log("Judging submission ", submission_id_, " (problem: ", problem_id,
-	        ')');
-	load_problem_package(internal_file_path(problem_file_id));
+	// Submissions may be judged by a remote judge worker, in such case only the
+	// results of the judging are processed here
+	auto* remote = RemoteJudgeConnection::current();
+	if (remote) {
+		job_log("Judging submission ", submission_id_, " (problem: ",
+		        problem_id, ") on remote judge worker ", remote->peer());
+		remote->start_job({job_id_, submission_id_, submission_file_id,
+		                   problem_file_id, to_sol_lang(lang),
+		                   stop_group_on_failure});
+	} else {
+		job_log("Judging submission ", submission_id_, " (problem: ",
+		        problem_id, ')');
+		load_problem_package(problem_file_id, p_last_edit);
+		set_stop_group_on_failure(stop_group_on_failure);
+	}
 
 	auto update_submission = [&](SubmissionStatus initial_status,
 	                             SubmissionStatus full_status,
@@ -55,26 +76,26 @@ void JudgeOrRejudge::run() {
 
 			using ST = SubmissionType;
 			// Get the submission's ACTUAL type
-			stmt = mysql.prepare("SELECT type FROM submissions WHERE id=?");
-			stmt.bind_and_execute(submission_id_);
+			stmt = stmts.prepare("SELECT type FROM submissions WHERE id=?");
+			stmt->bind_and_execute(submission_id_);
 			EnumVal<ST> stype;
-			stmt.res_bind_all(stype);
-			if (not stmt.next())
+			stmt->res_bind_all(stype);
+			if (not stmt->next())
 				return; // Ignore errors (deleted submission)
 
 			// Update submission
-			stmt = mysql.prepare("UPDATE submissions "
+			stmt = stmts.prepare("UPDATE submissions "
 			                     "SET final_candidate=?, initial_status=?,"
 			                     " full_status=?, score=?, last_judgment=?,"
 			                     " initial_report=?, final_report=? "
 			                     "WHERE id=?");
 
 			if (is_fatal(full_status)) {
-				stmt.bind_and_execute(
+				stmt->bind_and_execute(
 				   false, (uint)initial_status, (uint)full_status, nullptr,
 				   judging_began, initial_report, final_report, submission_id_);
 			} else {
-				stmt.bind_and_execute(
+				stmt->bind_and_execute(
 				   (stype == ST::NORMAL and score.has_value()),
 				   (uint)initial_status, (uint)full_status, score,
 				   judging_began, initial_report, final_report, submission_id_);
@@ -83,25 +104,41 @@ void JudgeOrRejudge::run() {
 			submission::update_final(mysql, sowner, problem_id,
 			                         contest_problem_id, false);
 
+			// The reports are complete, so the progress is no longer needed
+			if (full_status != SubmissionStatus::PENDING)
+				sim::judging_progress::clear(mysql, submission_id_);
+
 			transaction.commit();
 		}
 	};
 
-	auto compilation_errors = compile_solution(
-	   internal_file_path(submission_file_id), to_sol_lang(lang));
+	auto compilation_errors =
+	   (remote ? remote->await_compilation_result()
+	           : compile_solution(internal_file_path(submission_file_id),
+	                              to_sol_lang(lang)));
+	if (remote) {
+		job_log("Compiling solution... ",
+		        (compilation_errors ? "failed:\n" : "done."),
+		        compilation_errors.value_or(""));
+	}
 	if (compilation_errors.has_value()) {
 		update_submission(SubmissionStatus::COMPILATION_ERROR,
 		                  SubmissionStatus::COMPILATION_ERROR, std::nullopt,
-		                  concat("<pre class=\"compilation-errors\">",
-		                         html_escape(compilation_errors.value()),
-		                         "</pre>"),
+		                  sim::submission_report::dump_compilation_errors(
+		                     compilation_errors.value()),
 		                  "");
 
 		return job_done();
 	}
 
 	// Compile checker
-	compilation_errors = compile_checker();
+	compilation_errors =
+	   (remote ? remote->await_checker_compilation_result() : compile_checker());
+	if (remote) {
+		job_log("Compiling checker... ",
+		        (compilation_errors ? "failed:\n" : "done."),
+		        compilation_errors.value_or(""));
+	}
 	if (compilation_errors.has_value()) {
 		errlog("Job ", job_id_, " (submission ", submission_id_, ", problem ",
 		       problem_id, "): Checker compilation failed");
@@ -113,11 +150,26 @@ void JudgeOrRejudge::run() {
 	}
 
 	auto send_judge_report = [&, initial_status = SubmissionStatus::OK,
-	                          initial_report = InplaceBuff<1 << 16>(),
-	                          initial_score =
-	                             (int64_t)0](const sim::JudgeReport& jreport,
-	                                         bool final, bool partial) mutable {
-		auto rep = construct_report(jreport, final);
+	                          initial_report = std::string(),
+	                          initial_score = (int64_t)0,
+	                          judged_groups =
+	                             (size_t)0](const sim::JudgeReport& jreport,
+	                                        bool final, bool partial) mutable {
+		if (partial) {
+			// Every judged test only updates the compact progress record, the
+			// reports and the job log are rewritten once a group is complete
+			sim::judging_progress::update(mysql, submission_id_, final,
+			                              jreport);
+			auto groups = sim::judging_progress::judged_groups(jreport);
+			if (groups == judged_groups)
+				return;
+
+			judged_groups = groups;
+		} else {
+			judged_groups = 0; // The next phase is tracked from scratch
+		}
+
+		auto rep = sim::submission_report::dump(jreport, final, partial);
 		auto status = calc_status(jreport);
 		// Count score
 		int64_t score = 0;
@@ -130,8 +182,8 @@ void JudgeOrRejudge::run() {
 		        " (problem ", problem_id, ")\n", (partial ? "Partial j" : "J"),
 		        "udge report: ", jreport.judge_log);
 
-		stmt = mysql.prepare("UPDATE jobs SET data=? WHERE id=?");
-		stmt.bind_and_execute(get_log(), job_id_);
+		stmt = stmts.prepare("UPDATE jobs SET data=? WHERE id=?");
+		stmt->bind_and_execute(get_log(), job_id_);
 		if (partial)
 			job_log_holder_.size = job_log_len;
 
@@ -157,17 +209,21 @@ void JudgeOrRejudge::run() {
 	try {
 		// Judge
 		sim::VerboseJudgeLogger logger(true);
-
-		sim::JudgeReport initial_jrep =
-		   jworker_.judge(false, logger, [&](const sim::JudgeReport& partial) {
-			   send_judge_report(partial, false, true);
-		   });
+		auto judge = [&](bool final) {
+			auto partial_report_callback =
+			   [&](const sim::JudgeReport& partial) {
+				   send_judge_report(partial, final, true);
+			   };
+			if (remote)
+				return remote->await_judge_report(final, partial_report_callback);
+
+			return JudgeBase::judge(final, logger, partial_report_callback);
+		};
+
+		sim::JudgeReport initial_jrep = judge(false);
 		send_judge_report(initial_jrep, false, false);
 
-		sim::JudgeReport final_jrep =
-		   jworker_.judge(true, logger, [&](const sim::JudgeReport& partial) {
-			   send_judge_report(partial, true, true);
-		   });
+		sim::JudgeReport final_jrep = judge(true);
 		send_judge_report(final_jrep, true, false);
 
 		// Log checker errors
@@ -198,6 +254,9 @@ void JudgeOrRejudge::run() {
 
 		return job_done();
 
+	} catch (const remote_judge::ConnectionLost&) {
+		throw; // The job will be restarted, as its worker is gone
+
 	} catch (const std::exception& e) {
 		ERRLOG_CATCH(e);
 
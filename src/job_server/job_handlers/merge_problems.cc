@@ -1,7 +1,6 @@
 #include "merge_problems.hh"
 #include "../main.hh"
 
-#include <deque>
 #include <sim/constants.hh>
 #include <sim/submission.hh>
 
@@ -80,22 +79,6 @@ void MergeProblems::run_impl() {
 	   .bind_and_execute(donor_problem_id_,
 	                     EnumVal(SubmissionType::PROBLEM_SOLUTION));
 
-	// Collect update finals
-	struct FTU {
-		MySQL::Optional<uint64_t> owner;
-		MySQL::Optional<uint64_t> contest_problem_id;
-	};
-	std::deque<FTU> finals_to_update;
-	{
-		auto stmt = mysql.prepare("SELECT DISTINCT owner, contest_problem_id "
-		                          "FROM submissions WHERE problem_id=?");
-		stmt.bind_and_execute(donor_problem_id_);
-		FTU ftu_elem;
-		stmt.res_bind_all(ftu_elem.owner, ftu_elem.contest_problem_id);
-		while (stmt.next())
-			finals_to_update.emplace_back(ftu_elem);
-	}
-
 	// Schedule rejudge of the transferred submissions
 	if (info_.rejudge_transferred_submissions) {
 		mysql
@@ -115,13 +98,14 @@ void MergeProblems::run_impl() {
 	mysql.prepare("UPDATE submissions SET problem_id=? WHERE problem_id=?")
 	   .bind_and_execute(info_.target_problem_id, donor_problem_id_);
 
-	// Update finals (both contest and problem finals are being taken care of)
-	for (auto const& ftu_elem : finals_to_update) {
-		submission::update_final_lock(mysql, ftu_elem.owner,
-		                              info_.target_problem_id);
-		submission::update_final(mysql, ftu_elem.owner, info_.target_problem_id,
-		                         ftu_elem.contest_problem_id, false);
-	}
+	// Update finals (the contest finals do not change, as the submissions stay
+	// in their contest problems)
+	auto stats = submission::reselect_problem_finals(
+	   mysql, info_.target_problem_id, [&](uint64_t updated, uint64_t total) {
+		   job_log("Updated ", updated, " of ", total, " final flags");
+	   });
+	job_log("Reselected the final submissions of ", stats.owners,
+	        " users, changed ", stats.changed_submissions, " submissions");
 
 	// Transfer problem tags (duplicates will not be transferred - they will be
 	// deleted on problem deletion)
@@ -5,6 +5,7 @@
 #include <bits/stdint-uintn.h>
 #include <deque>
 #include <sim/constants.hh>
+#include <sim/contest_ranking.hh>
 #include <sim/submission.hh>
 #include <simlib/utilities.hh>
 
@@ -164,6 +165,7 @@ void MergeUsers::run_impl() {
 	   .bind_and_execute(info_.target_user_id, donor_user_id_);
 
 	// Finally, delete the donor user
+	sim::contest_ranking::invalidate_user(mysql, donor_user_id_);
 	mysql.prepare("DELETE FROM users WHERE id=?")
 	   .bind_and_execute(donor_user_id_);
 
@@ -8,23 +8,32 @@ namespace job_handlers {
 void ReselectFinalSubmissionsInContestProblem::run() {
 	STACK_UNWINDING_MARK;
 
+	for (;;) {
+		try {
+			run_impl();
+			break;
+		} catch (const std::exception& e) {
+			if (has_prefix(e.what(), "Deadlock found when trying to get lock; "
+			                         "try restarting transaction")) {
+				continue;
+			}
+
+			throw;
+		}
+	}
+}
+
+void ReselectFinalSubmissionsInContestProblem::run_impl() {
+	STACK_UNWINDING_MARK;
+
 	auto transaction = mysql.start_transaction();
 
-	auto stmt = mysql.prepare(
-	   "SELECT DISTINCT owner, problem_id "
-	   "FROM submissions WHERE contest_problem_id=? AND final_candidate=1 "
-	   "ORDER by id"); // Order is important so that if the two such jobs are
-	                   // running, one would block until the other finishes
-	stmt.bind_and_execute(contest_problem_id_);
-
-	MySQL::Optional<uint64_t> sowner;
-	uint64_t problem_id;
-	stmt.res_bind_all(sowner, problem_id);
-	while (stmt.next()) {
-		submission::update_final_lock(mysql, sowner, problem_id);
-		submission::update_final(mysql, sowner, problem_id, contest_problem_id_,
-		                         false);
-	}
+	auto stats = submission::reselect_contest_finals(
+	   mysql, contest_problem_id_, [&](uint64_t updated, uint64_t total) {
+		   job_log("Updated ", updated, " of ", total, " final flags");
+	   });
+	job_log("Reselected the final submissions of ", stats.owners,
+	        " users, changed ", stats.changed_submissions, " submissions");
 
 	job_done();
 
@@ -13,6 +13,9 @@ public:
 	   : JobHandler(job_id), contest_problem_id_(contest_problem_id) {}
 
 	void run() override final;
+
+private:
+	void run_impl();
 };
 
 } // namespace job_handlers
@@ -13,7 +13,7 @@ void ResetTimeLimitsInProblemPackageBase::reset_package_time_limits(
 
 	load_problem_package(package_path);
 
-	auto& simfile = jworker_.simfile();
+	auto& simfile = jworker_->simfile();
 	simfile
 	   .load_all(); // Everything is needed as we will dump it to Simfile file
 	job_log("Model solution: ", simfile.solutions[0]);
@@ -29,11 +29,13 @@ void ResetTimeLimitsInProblemPackageBase::reset_package_time_limits(
 
 	job_log("Judging...");
 
+	// The time limits are derived from the measured runtimes, so the tests are
+	// judged sequentially (not in parallel shards) and all of them are run
 	sim::VerboseJudgeLogger logger(true);
-	sim::JudgeReport initial_rep = jworker_.judge(false, logger);
+	sim::JudgeReport initial_rep = jworker_->judge(false, logger);
 	job_log("Initial judge report: ", initial_rep.judge_log);
 
-	sim::JudgeReport final_rep = jworker_.judge(true, logger);
+	sim::JudgeReport final_rep = jworker_->judge(true, logger);
 	job_log("Final judge report: ", final_rep.judge_log);
 
 	try {
@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <simlib/debug.hh>
+#include <simlib/logger.hh>
+#include <vector>
+
+/**
+ * Priority scheduler of the job server's pending jobs. Jobs of problem
+ * categories (judge jobs and problem jobs) are grouped by problem: a problem
+ * may be locked (e.g. while it is being reuploaded), which holds back all its
+ * jobs in both categories. Jobs are ordered by priority (higher first), then
+ * by fair share tag (lower first), then by id (lower first).
+ *
+ * It is built only on flat arrays: problems live in a pool of reused slots
+ * (each with a binary heap of its jobs), unlocked problems with jobs form an
+ * indexed binary heap keyed by their best jobs and problem ids are mapped to
+ * slots by an open addressing hash table. Once the arrays have grown, queuing
+ * and passing jobs does not allocate.
+ */
+class JobScheduler {
+public:
+	struct Job {
+		uint64_t id;
+		uint priority;
+		bool locks_problem = false;
+		bool judgeable_remotely = false;
+		// Orders jobs of the same priority (lower first), see JudgeJobsPolicy
+		uint64_t fair_share_tag = 0;
+
+		bool operator<(Job x) const {
+			if (priority != x.priority)
+				return priority > x.priority;
+			if (fair_share_tag != x.fair_share_tag)
+				return fair_share_tag < x.fair_share_tag;
+			return id < x.id;
+		}
+
+		// Consistent with operator<
+		bool operator==(Job x) const {
+			return (id == x.id and priority == x.priority and
+			        fair_share_tag == x.fair_share_tag);
+		}
+
+		constexpr static Job least() noexcept {
+			return {UINT64_MAX, 0, false, false, UINT64_MAX};
+		}
+	};
+
+private:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	// Orders binary heaps so that the best job is on top
+	static bool worse(Job a, Job b) noexcept { return b < a; }
+
+	// Map problem id => problem's slot (open addressing, linear probing)
+	class ProblemIndex {
+		struct Entry {
+			uint64_t problem_id;
+			uint32_t slot = NONE; // NONE marks an empty entry
+		};
+
+		std::vector<Entry> table_ = std::vector<Entry>(16); // size = 2^k
+		size_t size_ = 0;
+
+		size_t home(uint64_t problem_id) const noexcept {
+			uint64_t h = problem_id * 0x9e3779b97f4a7c15ULL;
+			return (h ^ (h >> 32)) & (table_.size() - 1);
+		}
+
+		size_t position(uint64_t problem_id) const noexcept {
+			size_t i = home(problem_id);
+			while (table_[i].slot != NONE and
+			       table_[i].problem_id != problem_id) {
+				i = (i + 1) & (table_.size() - 1);
+			}
+			return i;
+		}
+
+	public:
+		uint32_t find(uint64_t problem_id) const noexcept {
+			return table_[position(problem_id)].slot;
+		}
+
+		// @p problem_id cannot be present in the index
+		void insert(uint64_t problem_id, uint32_t slot) {
+			if ((size_ + 1) * 4 > table_.size() * 3) { // Load factor > 0.75
+				std::vector<Entry> old(table_.size() * 2);
+				old.swap(table_);
+				for (auto& e : old)
+					if (e.slot != NONE)
+						table_[position(e.problem_id)] = e;
+			}
+
+			table_[position(problem_id)] = {problem_id, slot};
+			++size_;
+		}
+
+		void erase(uint64_t problem_id) noexcept {
+			size_t mask = table_.size() - 1;
+			size_t i = position(problem_id);
+			if (table_[i].slot == NONE)
+				return;
+
+			// Backward shift deletion: move back the entries that would become
+			// unreachable
+			table_[i].slot = NONE;
+			for (size_t j = (i + 1) & mask; table_[j].slot != NONE;
+			     j = (j + 1) & mask) {
+				size_t k = home(table_[j].problem_id);
+				bool stays = (i <= j ? (i < k and k <= j) : (i < k or k <= j));
+				if (not stays) {
+					table_[i] = table_[j];
+					table_[j].slot = NONE;
+					i = j;
+				}
+			}
+			--size_;
+		}
+	};
+
+	struct Problem {
+		uint64_t id;
+		uint locks_no;
+		uint32_t queue_pos; // Position in the queue or NONE if not queued
+		std::vector<Job> jobs; // Binary heap (the best job is on top)
+	};
+
+public:
+	class Category {
+		std::vector<Problem> problems_; // Pool of slots
+		std::vector<uint32_t> free_slots_;
+		ProblemIndex index_;
+		// Binary heap of slots of the unlocked problems that have jobs, ordered
+		// by the problems' best jobs
+		std::vector<uint32_t> queue_;
+
+		friend class JobScheduler;
+
+		Job best_job_of(uint32_t slot) const noexcept {
+			return problems_[slot].jobs.front();
+		}
+
+		void place_in_queue(size_t pos, uint32_t slot) noexcept {
+			queue_[pos] = slot;
+			problems_[slot].queue_pos = pos;
+		}
+
+		void sift_up(size_t pos) noexcept {
+			uint32_t slot = queue_[pos];
+			Job job = best_job_of(slot);
+			while (pos > 0) {
+				size_t parent = (pos - 1) / 2;
+				if (not(job < best_job_of(queue_[parent])))
+					break;
+
+				place_in_queue(pos, queue_[parent]);
+				pos = parent;
+			}
+			place_in_queue(pos, slot);
+		}
+
+		void sift_down(size_t pos) noexcept {
+			uint32_t slot = queue_[pos];
+			Job job = best_job_of(slot);
+			for (;;) {
+				size_t child = pos * 2 + 1;
+				if (child >= queue_.size())
+					break;
+
+				if (child + 1 < queue_.size() and
+				    best_job_of(queue_[child + 1]) <
+				       best_job_of(queue_[child])) {
+					++child;
+				}
+
+				if (not(best_job_of(queue_[child]) < job))
+					break;
+
+				place_in_queue(pos, queue_[child]);
+				pos = child;
+			}
+			place_in_queue(pos, slot);
+		}
+
+		void enqueue(uint32_t slot) {
+			queue_.emplace_back(slot);
+			sift_up(queue_.size() - 1);
+		}
+
+		void dequeue(uint32_t slot) noexcept {
+			size_t pos = problems_[slot].queue_pos;
+			problems_[slot].queue_pos = NONE;
+			uint32_t last = queue_.back();
+			queue_.pop_back();
+			if (pos == queue_.size())
+				return; // It was the last element
+
+			place_in_queue(pos, last);
+			sift_up(pos);
+			sift_down(problems_[last].queue_pos);
+		}
+
+		uint32_t find_or_create(uint64_t problem_id) {
+			uint32_t slot = index_.find(problem_id);
+			if (slot != NONE)
+				return slot;
+
+			if (free_slots_.empty()) {
+				slot = problems_.size();
+				problems_.emplace_back();
+			} else {
+				slot = free_slots_.back();
+				free_slots_.pop_back();
+			}
+
+			auto& p = problems_[slot];
+			p.id = problem_id;
+			p.locks_no = 0;
+			p.queue_pos = NONE;
+			p.jobs.clear(); // Capacity is kept for reuse
+			index_.insert(problem_id, slot);
+			return slot;
+		}
+
+		void release(uint32_t slot) {
+			index_.erase(problems_[slot].id);
+			free_slots_.emplace_back(slot);
+		}
+
+		void add(Job job, uint64_t problem_id) {
+			uint32_t slot = find_or_create(problem_id);
+			auto& p = problems_[slot];
+			p.jobs.emplace_back(job);
+			std::push_heap(p.jobs.begin(), p.jobs.end(), worse);
+			if (p.locks_no > 0)
+				return;
+
+			if (p.queue_pos == NONE)
+				enqueue(slot);
+			else if (p.jobs.front() == job)
+				sift_up(p.queue_pos); // The problem's best job changed
+		}
+
+		void lock(uint64_t problem_id) {
+			uint32_t slot = find_or_create(problem_id);
+			auto& p = problems_[slot];
+			if (++p.locks_no == 1 and p.queue_pos != NONE)
+				dequeue(slot);
+		}
+
+		void unlock(uint64_t problem_id) {
+			uint32_t slot = index_.find(problem_id);
+			if (slot == NONE)
+				THROW("BUG: unlocking problem that is not locked!");
+
+			auto& p = problems_[slot];
+			// The problem may be present only because of its jobs
+			if (p.locks_no == 0)
+				THROW("BUG: unlocking problem that is not locked!");
+
+			if (--p.locks_no > 0)
+				return;
+
+			if (p.jobs.empty())
+				release(slot); // Lock-free problem without jobs
+			else
+				enqueue(slot);
+		}
+
+		void remove(Job job, uint64_t problem_id) {
+			uint32_t slot = index_.find(problem_id);
+			if (slot == NONE)
+				return; // There is no such problem
+
+			auto& p = problems_[slot];
+			if (not p.jobs.empty() and p.jobs.front() == job) {
+				std::pop_heap(p.jobs.begin(), p.jobs.end(), worse);
+				p.jobs.pop_back();
+			} else {
+				auto it = std::find(p.jobs.begin(), p.jobs.end(), job);
+				if (it == p.jobs.end()) {
+					THROW("Job erasion did not take place since the erased job "
+					      "was not found");
+				}
+
+				p.jobs.erase(it);
+				std::make_heap(p.jobs.begin(), p.jobs.end(), worse);
+			}
+
+			if (p.jobs.empty()) {
+				// That was the last job of its problem
+				if (p.queue_pos != NONE)
+					dequeue(slot);
+				if (p.locks_no == 0)
+					release(slot);
+
+			} else if (p.queue_pos != NONE) {
+				// The problem's best job could only get worse
+				sift_down(p.queue_pos);
+			}
+		}
+
+		void dump() const {
+			for (auto& p : problems_) {
+				if (index_.find(p.id) != uint32_t(&p - problems_.data()))
+					continue; // Free slot
+
+				auto tmplog = stdlog("   problem ", p.id, ": locks: ",
+				                     p.locks_no, ", queued: ",
+				                     (p.queue_pos != NONE), ", jobs: {");
+				for (auto& job : p.jobs)
+					tmplog(job.id, ' ');
+				tmplog('}');
+			}
+		}
+	};
+
+private:
+	Category judge_jobs_, problem_jobs_;
+	std::vector<Job> other_jobs_; // Binary heap (the best job on top)
+
+public:
+	void dump_queues() const {
+		stdlog("DEBUG: judge_jobs:");
+		judge_jobs_.dump();
+		stdlog("DEBUG: problem_jobs:");
+		problem_jobs_.dump();
+		auto tmplog = stdlog("DEBUG: other_jobs: {");
+		for (auto& job : other_jobs_)
+			tmplog(job.id, ' ');
+		tmplog('}');
+	}
+
+	// Judge jobs need judge workers
+	void add_judge_job(Job job, uint64_t problem_id) {
+		judge_jobs_.add(job, problem_id);
+	}
+
+	void add_problem_job(Job job, uint64_t problem_id) {
+		problem_jobs_.add(job, problem_id);
+	}
+
+	// Other jobs do not have an associated problem
+	void add_other_job(Job job) {
+		other_jobs_.emplace_back(job);
+		std::push_heap(other_jobs_.begin(), other_jobs_.end(), worse);
+	}
+
+	void lock_problem(uint64_t problem_id) {
+		judge_jobs_.lock(problem_id);
+		problem_jobs_.lock(problem_id);
+	}
+
+	void unlock_problem(uint64_t problem_id) {
+		judge_jobs_.unlock(problem_id);
+		problem_jobs_.unlock(problem_id);
+	}
+
+	class JobHolder {
+		JobScheduler* scheduler;
+		Category* category;
+
+	public:
+		Job job =
+		   Job::least(); // If is invalid it will be the last in comparison
+		uint64_t problem_id = 0;
+
+		JobHolder(JobScheduler& js, Category& c)
+		   : scheduler(&js), category(&c) {}
+
+		JobHolder(JobScheduler& js, Category& c, Job j, uint64_t pid)
+		   : scheduler(&js), category(&c), job(j), problem_id(pid) {}
+
+		JobHolder(const JobHolder&) = delete;
+		JobHolder(JobHolder&&) = default;
+		JobHolder& operator=(const JobHolder&) = delete;
+		JobHolder& operator=(JobHolder&&) = default;
+
+		operator Job() const noexcept { return job; }
+
+		bool ok() const noexcept { return not(job == Job::least()); }
+
+		// Removes the job from queue and locks problem if locks_problem is true
+		void was_passed() const {
+			STACK_UNWINDING_MARK;
+			scheduler->pass(*category, job, problem_id);
+		}
+	};
+
+private:
+	void pass(Category& category, Job job, uint64_t problem_id) {
+		category.remove(job, problem_id);
+		if (job.locks_problem)
+			lock_problem(problem_id);
+	}
+
+	JobHolder best_job(Category& category) {
+		if (category.queue_.empty())
+			return {*this, category}; // No one left
+
+		auto& p = category.problems_[category.queue_.front()];
+		return {*this, category, p.jobs.front(), p.id};
+	}
+
+public:
+	JobHolder best_judge_job() { return best_job(judge_jobs_); }
+
+	JobHolder best_problem_job() { return best_job(problem_jobs_); }
+
+	class OtherJobHolder {
+		std::vector<Job>* oj;
+
+	public:
+		Job job =
+		   Job::least(); // If is invalid it will be the last in comparison
+
+		OtherJobHolder(std::vector<Job>& o) : oj(&o) {}
+
+		OtherJobHolder(std::vector<Job>& o, Job j) : oj(&o), job(j) {}
+
+		OtherJobHolder(const OtherJobHolder&) = delete;
+		OtherJobHolder(OtherJobHolder&&) = default;
+		OtherJobHolder& operator=(const OtherJobHolder&) = delete;
+		OtherJobHolder& operator=(OtherJobHolder&&) = default;
+
+		operator Job() const noexcept { return job; }
+
+		bool ok() const noexcept { return not(job == Job::least()); }
+
+		// Removes the job from queue
+		void was_passed() const {
+			if (not oj->empty() and oj->front() == job) {
+				std::pop_heap(oj->begin(), oj->end(), worse);
+				oj->pop_back();
+				return;
+			}
+
+			auto it = std::find(oj->begin(), oj->end(), job);
+			if (it != oj->end()) {
+				oj->erase(it);
+				std::make_heap(oj->begin(), oj->end(), worse);
+			}
+		}
+	};
+
+	OtherJobHolder best_other_job() {
+		if (other_jobs_.empty())
+			return {other_jobs_}; // No one left
+
+		return {other_jobs_, other_jobs_.front()};
+	}
+};
@@ -0,0 +1,233 @@
+#include "jobs_queue.hh"
+
+#include <array>
+#include <sim/jobs.hh>
+#include <simlib/logger.hh>
+
+void JobsQueue::report_stats() {
+	constexpr auto REPORT_INTERVAL = std::chrono::minutes(10);
+	auto now = std::chrono::steady_clock::now();
+	if (now < intake_stats_.last_report + REPORT_INTERVAL)
+		return;
+
+	auto& is = intake_stats_;
+	is.last_report = now;
+	stdlog("Jobs intake: ", is.jobs_claimed, " jobs claimed using ",
+	       is.sql_round_trips, " SQL round trips (",
+	       is.sql_round_trips * 100 / std::max<uint64_t>(is.jobs_claimed, 1),
+	       " per 100 jobs), ", is.syncs_without_sql, " of ", is.syncs,
+	       " syncs did not touch the database");
+
+	using JJP = JudgeJobsPolicy;
+	for (auto cls : {JJP::Class::LIVE_JUDGE, JJP::Class::JUDGE,
+	                 JJP::Class::LIVE_REJUDGE, JJP::Class::REJUDGE}) {
+		auto& ws = judge_jobs_policy_.wait_stats(cls);
+		if (ws.jobs == 0)
+			continue;
+
+		stdlog("Judge jobs queue wait (", JJP::to_string(cls), "): ", ws.jobs,
+		       " jobs, avg: ", ws.total.count() / ws.jobs,
+		       " ms, p50: <= ", ws.quantile(0.5).count(),
+		       " ms, p99: <= ", ws.quantile(0.99).count(),
+		       " ms, max: ", ws.max.count(), " ms");
+	}
+	judge_jobs_policy_.reset_wait_stats();
+}
+
+void JobsQueue::sync_with_db() {
+	STACK_UNWINDING_MARK;
+
+	++intake_stats_.syncs;
+	if (not db_may_have_pending_jobs_) {
+		++intake_stats_.syncs_without_sql;
+		return;
+	}
+	// Reset before querying, so that a failure (exception) in the middle of
+	// the sync does not result in skipping the next one
+	db_may_have_pending_jobs_ = false;
+	try {
+		sync_with_db_impl();
+	} catch (...) {
+		db_may_have_pending_jobs_ = true;
+		throw;
+	}
+
+	report_stats();
+}
+
+void JobsQueue::sync_with_db_impl() {
+	STACK_UNWINDING_MARK;
+
+	// Jobs are claimed in batches: one SELECT and one UPDATE per batch
+	constexpr uint BATCH_SIZE = 256;
+
+	std::vector<uint64_t> claimed_ids;
+	claimed_ids.reserve(BATCH_SIZE);
+	// Add jobs to internal queue
+	using JT = JobType;
+	auto queue_job = [&](const JobsSource::PendingJob& job) {
+		DEBUG_JOB_SERVER(stdlog("DEBUG: Fetched from DB: job ", job.id);)
+		uint64_t jid = job.id;
+		uint priority = job.priority;
+		// Assign job to its category
+		switch (job.type) {
+		case JT::JUDGE_SUBMISSION:
+		case JT::REJUDGE_SUBMISSION: {
+			StringView info = job.info;
+			auto opt = str2num<uint64_t>(intentional_unsafe_string_view(
+			   jobs::extract_dumped_string(info)));
+			if (not opt)
+				THROW("Corrupted job's info field");
+
+			using JJP = JudgeJobsPolicy;
+			bool live = (job.submission and job.submission->in_running_round);
+			auto cls = (job.type == JT::JUDGE_SUBMISSION
+			               ? (live ? JJP::Class::LIVE_JUDGE : JJP::Class::JUDGE)
+			               : (live ? JJP::Class::LIVE_REJUDGE
+			                       : JJP::Class::REJUDGE));
+			uint64_t contest_id = 0, user_id = 0;
+			if (job.submission) {
+				contest_id = job.submission->contest_id.value_or(0);
+				user_id = job.submission->owner.value_or(0);
+			}
+
+			uint64_t tag =
+			   judge_jobs_policy_.job_noticed(jid, cls, contest_id, user_id);
+			add_judge_job({jid, priority, false, true, tag}, opt.value());
+			break;
+		}
+
+		case JT::ADD_PROBLEM__JUDGE_MODEL_SOLUTION:
+			add_judge_job({jid, priority, false}, 0);
+			break;
+
+		case JT::REUPLOAD_PROBLEM__JUDGE_MODEL_SOLUTION:
+			add_judge_job({jid, priority, true}, job.aux_id.value());
+			break;
+
+		// Problem job
+		case JT::REUPLOAD_PROBLEM:
+		case JT::EDIT_PROBLEM:
+		case JT::DELETE_PROBLEM:
+		case JT::MERGE_PROBLEMS:
+		case JT::CHANGE_PROBLEM_STATEMENT:
+		case JT::RESET_PROBLEM_TIME_LIMITS_USING_MODEL_SOLUTION:
+			add_problem_job({jid, priority, true}, job.aux_id.value());
+			break;
+
+		// Other job (local jobs that don't have associated problem)
+		case JT::ADD_PROBLEM:
+		case JT::RESELECT_FINAL_SUBMISSIONS_IN_CONTEST_PROBLEM:
+		case JT::MERGE_USERS:
+		case JT::DELETE_USER:
+		case JT::DELETE_CONTEST:
+		case JT::DELETE_CONTEST_ROUND:
+		case JT::DELETE_CONTEST_PROBLEM:
+		case JT::DELETE_FILE: add_other_job({jid, priority, false}); break;
+		}
+
+		claimed_ids.emplace_back(jid);
+	};
+
+	for (;;) {
+		claimed_ids.clear();
+		source_.fetch_pending_jobs(BATCH_SIZE, queue_job);
+		++intake_stats_.sql_round_trips;
+		if (claimed_ids.empty())
+			break;
+
+		// Mark the whole batch at once
+		source_.mark_as_noticed(claimed_ids);
+		++intake_stats_.sql_round_trips;
+		intake_stats_.jobs_claimed += claimed_ids.size();
+
+		if (claimed_ids.size() < BATCH_SIZE)
+			break; // There are no more pending jobs
+	}
+
+	DEBUG_JOB_SERVER(stdlog(__FILE__ ":", __LINE__, ": ", __FUNCTION__, "()");)
+	DEBUG_JOB_SERVER(dump_queues();)
+}
+
+void assign_jobs(JobsQueue& jobs_queue, WorkersPool& local_workers,
+                 WorkersPool& judge_workers, WorkersPool& remote_judge_workers) {
+	STACK_UNWINDING_MARK;
+
+	auto problem_job = jobs_queue.best_problem_job();
+	auto other_job = jobs_queue.best_other_job();
+	auto judge_job = jobs_queue.best_judge_job();
+
+	struct SItem {
+		bool ok;
+		JobsQueue::Job job;
+	};
+
+	std::array<SItem, 3> selector {{
+	   // (is ok, best job)
+	   {problem_job.ok(), problem_job},
+	   {other_job.ok(), other_job},
+	   {judge_job.ok(), judge_job},
+	}};
+
+	while (selector[0].ok or selector[1].ok or selector[2].ok) {
+		// Select best job
+		auto best_job = JobsQueue::Job::least();
+		uint idx = selector.size();
+		for (uint i = 0; i < selector.size(); ++i)
+			if (selector[i].ok and selector[i].job < best_job) {
+				idx = i;
+				best_job = selector[i].job;
+			}
+
+		DEBUG_JOB_SERVER(stdlog("DEBUG: Got job: {id: ", best_job.id,
+		                        ", pri: ", best_job.priority,
+		                        ", locks: ", best_job.locks_problem, "}"));
+
+		if (idx == 0) { // Problem job
+			if (local_workers.pass_job(best_job.id, problem_job.problem_id,
+			                           best_job.locks_problem)) {
+				problem_job.was_passed();
+			} else
+				selector[0].ok = false; // No more workers available
+
+		} else if (idx == 1) { // Other job
+			if (local_workers.pass_job(best_job.id))
+				other_job.was_passed();
+			else
+				selector[1].ok = false; // No more workers available
+
+		} else if (idx == 2) { // Judge job
+			// Submissions may also be judged by the remote judge workers. If
+			// the best judge job cannot be judged remotely, the remote judge
+			// workers wait for it to be passed to a local judge worker.
+			if (judge_workers.pass_job(best_job.id, judge_job.problem_id,
+			                           best_job.locks_problem) or
+			    (best_job.judgeable_remotely and
+			     remote_judge_workers.pass_job(best_job.id,
+			                                   judge_job.problem_id,
+			                                   best_job.locks_problem))) {
+				judge_job.was_passed();
+				jobs_queue.judge_job_passed(best_job.id);
+			} else
+				selector[2].ok = false; // No more workers available
+
+		} else { // Invalid
+			THROW("Invalid idx: ", idx);
+		}
+
+		// Update selector (all types must be updated because some problem may
+		// become locked causing some jobs to become invalid)
+		if (selector[0].ok) {
+			problem_job = jobs_queue.best_problem_job();
+			selector[0] = {problem_job.ok(), problem_job};
+		}
+		if (selector[1].ok) {
+			other_job = jobs_queue.best_other_job();
+			selector[1] = {other_job.ok(), other_job};
+		}
+		if (selector[2].ok) {
+			judge_job = jobs_queue.best_judge_job();
+			selector[2] = {judge_job.ok(), judge_job};
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "job_scheduler.hh"
+#include "judge_jobs_policy.hh"
+#include "workers_pool.hh"
+
+#include <chrono>
+#include <optional>
+#include <sim/constants.hh>
+
+#if 0
+#define DEBUG_JOB_SERVER(...) __VA_ARGS__
+#else
+#define DEBUG_JOB_SERVER(...)
+#endif
+
+// Source of the pending jobs - in the job server it is the jobs table
+class JobsSource {
+public:
+	// Judged submission of a JUDGE_SUBMISSION or REJUDGE_SUBMISSION job
+	struct Submission {
+		std::optional<uint64_t> owner;
+		std::optional<uint64_t> contest_id;
+		bool in_running_round;
+	};
+
+	struct PendingJob {
+		uint64_t id;
+		JobType type;
+		uint priority;
+		std::optional<uint64_t> aux_id;
+		StringView info;
+		std::optional<Submission> submission;
+	};
+
+	/// Calls @p callback on at most @p limit best (the highest priority, then
+	/// the lowest id) PENDING jobs
+	virtual void
+	fetch_pending_jobs(uint limit,
+	                   const std::function<void(const PendingJob&)>& callback) = 0;
+
+	/// Marks the jobs @p job_ids as noticed, so that they are not fetched
+	/// again. Jobs that are not PENDING any more are left untouched.
+	virtual void mark_as_noticed(const std::vector<uint64_t>& job_ids) = 0;
+
+	virtual ~JobsSource() = default;
+};
+
+// Pending jobs fetched from the jobs source
+class JobsQueue : public JobScheduler {
+	JobsSource& source_;
+	JudgeJobsPolicy judge_jobs_policy_;
+
+	// Set when the jobs source may contain PENDING jobs that were not fetched
+	// yet; cleared by sync_with_db(). Jobs may appear only after a notify-file
+	// event, a job restart or a job end (handlers may add follow-up jobs), so
+	// every other wake-up can be served without querying the database.
+	bool db_may_have_pending_jobs_ = true;
+
+	struct {
+		uint64_t syncs = 0;
+		uint64_t syncs_without_sql = 0;
+		uint64_t sql_round_trips = 0;
+		uint64_t jobs_claimed = 0;
+		std::chrono::steady_clock::time_point last_report =
+		   std::chrono::steady_clock::now();
+	} intake_stats_;
+
+	void report_stats();
+
+	void sync_with_db_impl();
+
+public:
+	explicit JobsQueue(JobsSource& source) : source_(source) {}
+
+	void mark_db_as_changed() noexcept { db_may_have_pending_jobs_ = true; }
+
+	void sync_with_db();
+
+	/// Has to be called for every passed judge job
+	void judge_job_passed(uint64_t job_id) {
+		judge_jobs_policy_.job_passed(job_id);
+	}
+};
+
+/// Passes the best jobs of @p jobs_queue to the idle workers of the pools
+void assign_jobs(JobsQueue& jobs_queue, WorkersPool& local_workers,
+                 WorkersPool& judge_workers, WorkersPool& remote_judge_workers);
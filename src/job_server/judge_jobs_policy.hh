@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+
+/**
+ * Orders judge jobs of the same priority. Jobs are divided into classes by
+ * their type and by the state of the submission's contest round: submissions
+ * of running rounds go before the others and fresh submissions go before
+ * rejudges (which already have a lower priority by default).
+ *
+ * Within a class jobs are ordered by start-time fair queuing: a flow is
+ * (contest, user) and the contest's share is split equally between its users
+ * that have pending jobs. A contest admits at most one new flow per unit of
+ * virtual time, so that e.g. a rejudge of many users' submissions is spread
+ * over time too. So a mass rejudge of one contest does not starve the other
+ * contests and a user spamming submissions does not delay other users of the
+ * same contest. Submissions outside contests form one "contest".
+ *
+ * The ordering is expressed as JobScheduler::Job::fair_share_tag, so the
+ * scheduler stays oblivious of it. The policy has to be informed about every
+ * passed judge job.
+ */
+class JudgeJobsPolicy {
+public:
+	enum class Class : uint8_t {
+		LIVE_JUDGE = 0,
+		JUDGE = 1,
+		LIVE_REJUDGE = 2,
+		REJUDGE = 3,
+	};
+
+	static constexpr size_t CLASSES_NO = 4;
+
+	static constexpr const char* to_string(Class cls) noexcept {
+		switch (cls) {
+		case Class::LIVE_JUDGE: return "running rounds";
+		case Class::JUDGE: return "other submissions";
+		case Class::LIVE_REJUDGE: return "rejudges in running rounds";
+		case Class::REJUDGE: return "other rejudges";
+		}
+		return "unknown";
+	}
+
+	struct WaitStats {
+		static constexpr size_t BUCKETS_NO = 32;
+
+		uint64_t jobs = 0;
+		std::chrono::milliseconds total {0};
+		std::chrono::milliseconds max {0};
+		// buckets[i] = number of jobs that waited for [2^(i-1), 2^i) ms
+		std::array<uint64_t, BUCKETS_NO> buckets {};
+
+		void add(std::chrono::milliseconds wait) noexcept {
+			++jobs;
+			total += wait;
+			max = std::max(max, wait);
+			size_t i = 0;
+			for (auto x = wait.count(); x > 0 and i + 1 < BUCKETS_NO; x >>= 1)
+				++i;
+			++buckets[i];
+		}
+
+		/// Returns an upper bound of the @p fraction quantile
+		std::chrono::milliseconds quantile(double fraction) const noexcept {
+			uint64_t rank = jobs * fraction;
+			uint64_t seen = 0;
+			for (size_t i = 0; i < BUCKETS_NO; ++i) {
+				seen += buckets[i];
+				if (seen > rank)
+					return std::min(std::chrono::milliseconds((1LL << i) - 1),
+					                max);
+			}
+			return max;
+		}
+	};
+
+private:
+	static constexpr int CLASS_SHIFT = 56;
+	static constexpr uint64_t MAX_VIRTUAL_TIME = (1ULL << CLASS_SHIFT) - 1;
+
+	struct FlowKey {
+		Class cls;
+		uint64_t contest_id;
+		uint64_t user_id;
+
+		bool operator==(const FlowKey& x) const noexcept {
+			return std::tie(cls, contest_id, user_id) ==
+			       std::tie(x.cls, x.contest_id, x.user_id);
+		}
+
+		// Also used for contests (with user_id == 0)
+		struct Hash {
+			size_t operator()(const FlowKey& k) const noexcept {
+				uint64_t h = (k.contest_id * 0x9e3779b97f4a7c15ULL) ^
+				             (k.user_id * 0xc2b2ae3d27d4eb4fULL) ^ uint64_t(k.cls);
+				return h ^ (h >> 29);
+			}
+		};
+	};
+
+	struct Flow {
+		uint64_t finish = 0; // Virtual finish time of the flow's last job
+		uint64_t pending_jobs = 0;
+	};
+
+	struct PendingJob {
+		FlowKey flow;
+		uint64_t start; // Virtual start time
+		std::chrono::steady_clock::time_point noticed;
+	};
+
+	std::array<uint64_t, CLASSES_NO> virtual_time_ {};
+	struct Contest {
+		uint64_t active_flows = 0; // Flows with pending jobs
+		uint64_t next_flow_start = 0; // The earliest start of a new flow
+	};
+
+	// Only the flows with pending jobs
+	std::unordered_map<FlowKey, Flow, FlowKey::Hash> flows_;
+	// (class, contest id, 0) => contest, only the contests with pending jobs
+	std::unordered_map<FlowKey, Contest, FlowKey::Hash> contests_;
+	std::unordered_map<uint64_t, PendingJob> pending_jobs_;
+	std::array<WaitStats, CLASSES_NO> wait_stats_;
+
+	void forget(decltype(pending_jobs_)::iterator it) {
+		auto flow_it = flows_.find(it->second.flow);
+		if (--flow_it->second.pending_jobs == 0) {
+			auto contest_it =
+			   contests_.find({flow_it->first.cls, flow_it->first.contest_id, 0});
+			if (--contest_it->second.active_flows == 0)
+				contests_.erase(contest_it);
+			flows_.erase(flow_it);
+		}
+		pending_jobs_.erase(it);
+	}
+
+public:
+	/// Returns the fair share tag for the new judge job @p job_id
+	uint64_t job_noticed(uint64_t job_id, Class cls, uint64_t contest_id,
+	                     uint64_t user_id) {
+		// The job may be noticed again e.g. after its worker died
+		if (auto it = pending_jobs_.find(job_id); it != pending_jobs_.end())
+			forget(it);
+
+		FlowKey key {cls, contest_id, user_id};
+		auto& flow = flows_[key];
+		auto& contest = contests_[{cls, contest_id, 0}];
+		uint64_t vtime = virtual_time_[static_cast<size_t>(cls)];
+		uint64_t start;
+		if (flow.pending_jobs++ == 0) {
+			++contest.active_flows;
+			start = std::max(vtime, contest.next_flow_start);
+			contest.next_flow_start = start + 1;
+		} else {
+			start = std::max(vtime, flow.finish);
+		}
+		// The contest's share is split between its active users
+		flow.finish = std::min(start + contest.active_flows, MAX_VIRTUAL_TIME);
+		pending_jobs_[job_id] = {key, start, std::chrono::steady_clock::now()};
+
+		return (uint64_t(cls) << CLASS_SHIFT) | start;
+	}
+
+	/// Has to be called for every passed judge job (other jobs are ignored)
+	void job_passed(uint64_t job_id) {
+		auto it = pending_jobs_.find(job_id);
+		if (it == pending_jobs_.end())
+			return;
+
+		auto& pj = it->second;
+		size_t cls = static_cast<size_t>(pj.flow.cls);
+		virtual_time_[cls] = std::max(virtual_time_[cls], pj.start);
+		wait_stats_[cls].add(
+		   std::chrono::duration_cast<std::chrono::milliseconds>(
+		      std::chrono::steady_clock::now() - pj.noticed));
+		forget(it);
+	}
+
+	const WaitStats& wait_stats(Class cls) const noexcept {
+		return wait_stats_[static_cast<size_t>(cls)];
+	}
+
+	void reset_wait_stats() noexcept { wait_stats_ = {}; }
+};
@@ -1,12 +1,17 @@
 #include "dispatcher.hh"
-
+#include "events_queue.hh"
+#include "job_handlers/judge_base.hh"
+#include "jobs_queue.hh"
+#include "remote_judge_connection.hh"
+#include "workers_pool.hh"
+
+#include <algorithm>
+#include <atomic>
 #include <climits>
 #include <cstdint>
-#include <future>
-#include <map>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <poll.h>
-#include <queue>
-#include <set>
 #include <sim/constants.hh>
 #include <sim/jobs.hh>
 #include <sim/mysql.hh>
@@ -14,647 +19,98 @@
 #include <simlib/config_file.hh>
 #include <simlib/file_manip.hh>
 #include <simlib/process.hh>
-#include <simlib/shared_function.hh>
 #include <simlib/time.hh>
 #include <simlib/working_directory.hh>
-#include <sys/eventfd.h>
 #include <sys/inotify.h>
 #include <unistd.h>
 
-#if 0
-#define DEBUG_JOB_SERVER(...) __VA_ARGS__
-#else
-#define DEBUG_JOB_SERVER(...)
-#endif
-
-using std::array;
-using std::function;
-using std::lock_guard;
-using std::map;
-using std::mutex;
-using std::pair;
 using std::string;
 using std::thread;
-using std::vector;
 
-thread_local MySQL::Connection mysql;
+thread_local MySQL::CachedStatementsConnection mysql;
 
 namespace {
 
-class JobsQueue {
-public:
-	struct Job {
-		uint64_t id;
-		uint priority;
-		bool locks_problem = false;
-
-		bool operator<(Job x) const {
-			return (priority == x.priority ? id < x.id : priority > x.priority);
-		}
-
-		bool operator==(Job x) const {
-			return (id == x.id and priority == x.priority);
-		}
-
-		constexpr static Job least() noexcept { return {UINT64_MAX, 0}; }
-	};
-
-private:
-	struct ProblemJobs {
-		uint64_t problem_id;
-		std::set<Job> jobs;
-	};
-
-	struct ProblemInfo {
-		Job its_best_job;
-		uint locks_no = 0;
-	};
-
-	struct {
-		// Strong assumption: any job must belong to AT MOST one problem
-		std::map<uint64_t, ProblemInfo> problem_info;
-		std::map<Job, ProblemJobs>
-		   queue; // (best problem's job => all jobs of the problem)
-		std::map<int64_t, ProblemJobs>
-		   locked_problems; // (problem_id  => (locks, problem's jobs))
-	} judge_jobs, problem_jobs; // (judge jobs - they need judge machines)
-
-	std::set<Job> other_jobs;
-
-	void dump_queues() const {
-		auto impl = [](auto&& job_category) {
-			if (job_category.problem_info.size()) {
-				stdlog("problem_info = {");
-				for (auto&& [prob_id, pinfo] : job_category.problem_info) {
-					stdlog("   ", prob_id, " => {", pinfo.its_best_job.id,
-					       ", ", pinfo.locks_no, "},");
-				}
-				stdlog("}");
-			}
-
-			auto log_problem_jobs = [](auto&& logger, const ProblemJobs& pj) {
-				logger("{", pj.problem_id, ", {");
-				for (auto const& job : pj.jobs) {
-					logger(job.id, " ");
-				}
-				logger("}}");
-			};
-
-			if (job_category.queue.size()) {
-				stdlog("queue = {");
-				for (auto&& [job, problem_jobs] : job_category.queue) {
-					auto tmplog = stdlog("   ", job.id, " => ");
-					log_problem_jobs(tmplog, problem_jobs);
-					tmplog(',');
-				};
-				stdlog("}");
-			}
-
-			if (job_category.locked_problems.size()) {
-				stdlog("locked_problems = {");
-				for (auto&& [prob_id, prob_jobs] : job_category.locked_problems) {
-					auto tmplog = stdlog("   ", prob_id, " => ");
-					log_problem_jobs(tmplog, prob_jobs);
-					tmplog(',');
-				};
-				stdlog("}");
-			}
-		};
-
-		stdlog("DEBUG: judge_jobs:");
-		impl(judge_jobs);
-		stdlog("DEBUG: problem_jobs:");
-		impl(problem_jobs);
-	}
-
-public:
-	void sync_with_db() {
-		STACK_UNWINDING_MARK;
-
-		uint64_t jid;
-		EnumVal<JobType> jtype;
-		MySQL::Optional<uintmax_t> aux_id;
-		uint priority;
-		InplaceBuff<512> info;
-		// Select jobs
-		auto stmt = mysql.prepare("SELECT id, type, priority, aux_id, info "
-		                          "FROM jobs "
-		                          "WHERE status=? "
-		                          "ORDER BY priority DESC, id ASC LIMIT 4");
-		stmt.res_bind_all(jid, jtype, priority, aux_id, info);
-		// Sets job's status to NOTICED_PENDING
-		auto mark_stmt = mysql.prepare("UPDATE jobs SET status=? WHERE id=?");
-		// Add jobs to internal queue
-		using JT = JobType;
-		for (;;) {
-			stmt.bind_and_execute(EnumVal(JobStatus::PENDING));
-			if (not stmt.next())
-				break;
-
-			do {
-				DEBUG_JOB_SERVER(stdlog("DEBUG: Fetched from DB: job ", jid);)
-				auto queue_job = [&jid, &priority](auto& job_category,
-				                                   uint64_t problem_id,
-				                                   bool locks_problem) {
-					auto it = job_category.problem_info.find(problem_id);
-					Job curr_job {jid, priority, locks_problem};
-					if (it != job_category.problem_info.end()) {
-						ProblemInfo& pinfo = it->second;
-						Job best_job = pinfo.its_best_job;
-						// Get the problem's jobs (the problem may be locked)
-						auto& pjobs =
-						   (pinfo.locks_no > 0
-						       ? job_category.locked_problems[problem_id]
-						       : job_category.queue[best_job]);
-						// Ensure field 'problem_id' is set properly (in case of
-						// element creation this line is necessary)
-						pjobs.problem_id = problem_id;
-						// Add job to queue
-						pjobs.jobs.emplace(curr_job);
-						// Alter the problem's best job
-						if (curr_job < best_job) {
-							pinfo.its_best_job = curr_job;
-							// Update queue (rekey ProblemJobs)
-							if (pinfo.locks_no == 0) {
-								auto nh = job_category.queue.extract(best_job);
-								nh.key() = curr_job;
-								job_category.queue.insert(std::move(nh));
-							}
-						}
-
-					} else {
-						job_category.problem_info[problem_id] = {curr_job, 0};
-						// Add job to the queue (first one to this problem)
-						auto& pjobs = job_category.queue[curr_job];
-						pjobs.problem_id = problem_id;
-						pjobs.jobs.emplace(curr_job);
-					}
-				};
-
-				// Assign job to its category
-				switch (jtype) {
-				case JT::JUDGE_SUBMISSION:
-				case JT::REJUDGE_SUBMISSION: {
-					auto opt = str2num<uint64_t>(intentional_unsafe_string_view(
-					   jobs::extract_dumped_string(info)));
-					if (not opt)
-						THROW("Corrupted job's info field");
-
-					queue_job(judge_jobs, opt.value(), false);
-					break;
-				}
-
-				case JT::ADD_PROBLEM__JUDGE_MODEL_SOLUTION:
-					queue_job(judge_jobs, 0, false);
-					break;
-
-				case JT::REUPLOAD_PROBLEM__JUDGE_MODEL_SOLUTION:
-					queue_job(judge_jobs, aux_id.value(), true);
-					break;
-
-				// Problem job
-				case JT::REUPLOAD_PROBLEM:
-				case JT::EDIT_PROBLEM:
-				case JT::DELETE_PROBLEM:
-				case JT::MERGE_PROBLEMS:
-				case JT::CHANGE_PROBLEM_STATEMENT:
-				case JT::RESET_PROBLEM_TIME_LIMITS_USING_MODEL_SOLUTION:
-					queue_job(problem_jobs, aux_id.value(), true);
-					break;
-
-				// Other job (local jobs that don't have associated problem)
-				case JT::ADD_PROBLEM:
-				case JT::RESELECT_FINAL_SUBMISSIONS_IN_CONTEST_PROBLEM:
-				case JT::MERGE_USERS:
-				case JT::DELETE_USER:
-				case JT::DELETE_CONTEST:
-				case JT::DELETE_CONTEST_ROUND:
-				case JT::DELETE_CONTEST_PROBLEM:
-				case JT::DELETE_FILE:
-					other_jobs.insert({jid, priority, false});
-					break;
-				}
-				mark_stmt.bind_and_execute(EnumVal(JobStatus::NOTICED_PENDING),
-				                           jid);
-			} while (stmt.next());
-		}
-
-		DEBUG_JOB_SERVER(
-		   stdlog(__FILE__ ":", __LINE__, ": ", __FUNCTION__, "()");)
-		DEBUG_JOB_SERVER(dump_queues();)
-	}
-
-	void lock_problem(uint64_t pid) {
-		STACK_UNWINDING_MARK;
-		DEBUG_JOB_SERVER(stdlog("DEBUG: Locking problem ", pid, "...");)
-
-		auto lock_impl = [&pid](auto& job_category) {
-			auto it = job_category.problem_info.find(pid);
-			if (it == job_category.problem_info.end()) {
-				it = job_category.problem_info.try_emplace(pid, ProblemInfo{Job::least(), 0}).first;
-			}
-
-			auto& pinfo = it->second;
-			if (++pinfo.locks_no == 1) {
-				auto pj = job_category.queue.find(pinfo.its_best_job);
-				if (pj != job_category.queue.end()) {
-					job_category.locked_problems.try_emplace(pid,
-					                                    std::move(pj->second));
-					job_category.queue.erase(pj->first);
-				}
-			}
-		};
-
-		lock_impl(judge_jobs);
-		lock_impl(problem_jobs);
-
-		DEBUG_JOB_SERVER(
-		   stdlog(__FILE__ ":", __LINE__, ": ", __FUNCTION__, "()");)
-		DEBUG_JOB_SERVER(dump_queues();)
-	}
-
-	void unlock_problem(uint64_t pid) {
-		STACK_UNWINDING_MARK;
-		DEBUG_JOB_SERVER(stdlog("DEBUG: Unlocking problem ", pid, "...");)
-
-		auto unlock_impl = [&pid, this](auto& job_category) {
-			auto it = job_category.problem_info.find(pid);
-			if (it == job_category.problem_info.end()) {
-				dump_queues();
-				THROW("BUG: unlocking problem that is not locked!");
-			}
-
-			auto& pinfo = it->second;
-			if (--pinfo.locks_no == 0) {
-				auto pl = job_category.locked_problems.find(pid);
-				if (pl != job_category.locked_problems.end()) {
-					job_category.queue.try_emplace(pinfo.its_best_job,
-					                          std::move(pl->second));
-					job_category.locked_problems.erase(pl->first);
-				} else {
-					job_category.problem_info.erase(pid); /* There are no jobs
-					    that belong to this problem and it is lock-free now, so
-					    its records can be safely removed */
-				}
-			}
-		};
-
-		unlock_impl(judge_jobs);
-		unlock_impl(problem_jobs);
-
-		DEBUG_JOB_SERVER(
-		   stdlog(__FILE__ ":", __LINE__, ": ", __FUNCTION__, "()");)
-		DEBUG_JOB_SERVER(dump_queues();)
-	}
-
-	class JobHolder {
-		JobsQueue* jobs_queue;
-		decltype(judge_jobs)* job_category;
-
-	public:
-		Job job =
-		   Job::least(); // If is invalid it will be the last in comparison
-		uint64_t problem_id = 0;
-
-		JobHolder(JobsQueue& jq, decltype(judge_jobs)& jc)
-		   : jobs_queue(&jq), job_category(&jc) {}
-
-		JobHolder(JobsQueue& jq, decltype(judge_jobs)& jc, Job j, uint64_t pid)
-		   : jobs_queue(&jq), job_category(&jc), job(j), problem_id(pid) {}
-
-		JobHolder(const JobHolder&) = delete;
-		JobHolder(JobHolder&&) = default;
-		JobHolder& operator=(const JobHolder&) = delete;
-		JobHolder& operator=(JobHolder&&) = default;
-
-		operator Job() const noexcept { return job; }
-
-		bool ok() const noexcept { return not(job == Job::least()); }
-
-		// Removes the job from queue and locks problem if locks_problem is true
-		void was_passed() const {
-			STACK_UNWINDING_MARK;
-
-			auto it = job_category->problem_info.find(problem_id);
-			if (it == job_category->problem_info.end())
-				return; // There is no such problem
-
-			auto& pinfo = it->second;
-			Job best_job = pinfo.its_best_job;
-			auto& pjobs = (pinfo.locks_no > 0
-			                  ? job_category->locked_problems[problem_id]
-			                  : job_category->queue[best_job]);
-
-			if (not pjobs.jobs.erase(job)) {
-				THROW("Job erasion did not take place since the erased job was "
-				      "not found");
-			}
-
-			if (pjobs.jobs.empty()) {
-				// That was the last job of it's problem
-				if (pinfo.locks_no == 0) {
-					job_category->queue.erase(best_job);
-					job_category->problem_info.erase(problem_id);
-				} else { // Problem is locked
-					job_category->locked_problems.erase(problem_id);
-					pinfo.its_best_job = Job::least();
-				}
-
-			} else {
-				// The best job of the extracted job's problem changed
-				Job new_best = *pjobs.jobs.begin();
-				pinfo.its_best_job = new_best;
-				// Update queue (rekey ProblemJobs)
-				if (pinfo.locks_no == 0) {
-					auto nh = job_category->queue.extract(best_job);
-					nh.key() = new_best;
-					job_category->queue.insert(std::move(nh));
-				}
-			}
-
-			if (job.locks_problem)
-				jobs_queue->lock_problem(problem_id);
-		}
-	};
-
-private:
-	JobHolder best_job(decltype(judge_jobs)& job_category) {
-		if (job_category.queue.empty())
-			return {*this, job_category}; // No one left
-
-		auto it = job_category.queue.begin();
-		return {*this, job_category, it->first, it->second.problem_id};
-	}
-
-public:
-	// Ret val: id of the extracted job or -1 if none was found
-	JobHolder best_judge_job() {
-		STACK_UNWINDING_MARK;
-		return best_job(judge_jobs);
-	}
-
-	// Ret val: id of the extracted job or -1 if none was found
-	JobHolder best_problem_job() {
-		STACK_UNWINDING_MARK;
-		return best_job(problem_jobs);
-	}
-
-	class OtherJobHolder {
-		decltype(other_jobs)* oj;
-
-	public:
-		Job job =
-		   Job::least(); // If is invalid it will be the last in comparison
-
-		OtherJobHolder(decltype(other_jobs)& o) : oj(&o) {}
-
-		OtherJobHolder(decltype(other_jobs)& o, Job j) : oj(&o), job(j) {}
-
-		OtherJobHolder(const OtherJobHolder&) = delete;
-		OtherJobHolder(OtherJobHolder&&) = default;
-		OtherJobHolder& operator=(const OtherJobHolder&) = delete;
-		OtherJobHolder& operator=(OtherJobHolder&&) = default;
-
-		operator Job() const noexcept { return job; }
-
-		bool ok() const noexcept { return not(job == Job::least()); }
-
-		// Removes the job from queue
-		void was_passed() const { oj->erase(job); }
-	};
-
-	// Ret val: id of the extracted job or -1 if none was found
-	OtherJobHolder best_other_job() {
-		STACK_UNWINDING_MARK;
-		if (other_jobs.empty())
-			return {other_jobs}; // No one left
-
-		return {other_jobs, *other_jobs.begin()};
-	}
-} jobs_queue;
-
-class EventsQueue {
-	mutex events_lock;
-	std::queue<function<void()>> events;
-	volatile int notifier_fd_ = -1;
-
-	int set_notifier_fd_impl() {
-		if (notifier_fd_ != -1)
-			return notifier_fd_;
-
-		if ((notifier_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
-			THROW("eventfd() failed", errmsg());
-
-		return notifier_fd_;
-	}
-
-	static EventsQueue events_queue;
+// The jobs table, it has to be used only by the events loop's thread
+class MySQLJobsSource : public JobsSource {
+	std::optional<MySQL::Statement> select_stmt_;
+	uint64_t jid_;
+	EnumVal<JobType> jtype_;
+	MySQL::Optional<uintmax_t> aux_id_;
+	uint priority_;
+	InplaceBuff<512> info_;
+	MySQL::Optional<uint64_t> submission_id_;
+	MySQL::Optional<uint64_t> owner_;
+	MySQL::Optional<uint64_t> contest_id_;
+	MySQL::Optional<unsigned char> in_running_round_;
 
 public:
-	static int set_notifier_fd() {
+	void fetch_pending_jobs(
+	   uint limit,
+	   const std::function<void(const PendingJob&)>& callback) override {
 		STACK_UNWINDING_MARK;
-		lock_guard<mutex> lock(events_queue.events_lock);
-		return events_queue.set_notifier_fd_impl();
-	}
-
-	static int get_notifier_fd() { return events_queue.notifier_fd_; }
-
-	static void reset_notifier() {
-		lock_guard<mutex> lock(events_queue.events_lock);
-		eventfd_t x;
-		eventfd_read(events_queue.notifier_fd_, &x);
-	}
-
-	template <class Callable>
-	static void register_event(Callable&& ev) {
-		STACK_UNWINDING_MARK;
-		lock_guard<mutex> lock(events_queue.events_lock);
-		events_queue.events.push(std::forward<Callable>(ev));
-		eventfd_write(events_queue.notifier_fd_, 1);
-	}
-
-	/// Return value - a bool denoting whether the event processing took place
-	static bool process_next_event() {
-		STACK_UNWINDING_MARK;
-
-		function<void()> ev;
-		{
-			lock_guard<mutex> lock(events_queue.events_lock);
-			if (events_queue.events.empty())
-				return false;
-
-			ev = events_queue.events.front();
-			events_queue.events.pop();
-		}
-
-		ev();
-		return true;
-	}
-};
-
-EventsQueue EventsQueue::events_queue;
-
-class WorkersPool {
-public:
-	struct NextJob {
-		uint64_t id;
-		int64_t problem_id; // negative indicates that no problem is associated
-		                    // with the job
-		bool locked_its_problem;
-	};
-
-	struct WorkerInfo {
-		NextJob next_job {0, -1, false};
-		std::promise<void> next_job_signalizer;
-		std::future<void> next_job_waiter = next_job_signalizer.get_future();
-		bool is_idle = false;
-	};
-
-private:
-	mutex mtx_;
-	vector<thread::id> idle_workers;
-	map<thread::id, WorkerInfo>
-	   workers; // AVLDict cannot be used as addresses must not change
-
-	function<void(NextJob)> job_handler_;
-	function<void()> worker_becomes_idle_callback_;
-	function<void(WorkerInfo)> worker_dies_callback_;
-
-	class Worker {
-		WorkersPool& wp_;
-
-	public:
-		Worker(WorkersPool& wp) : wp_(wp) {
-			STACK_UNWINDING_MARK;
-			auto tid = std::this_thread::get_id();
-			lock_guard<mutex> lock(wp_.mtx_);
-			wp_.workers.emplace(tid, WorkerInfo {});
-		}
 
-		~Worker() {
-			STACK_UNWINDING_MARK;
-			lock_guard<mutex> lock(wp_.mtx_);
-			// Remove the worker from workers map and move out its info
-			auto tid = std::this_thread::get_id();
-			auto it = wp_.workers.find(tid);
-			auto wi = std::move(it->second);
-			wp_.workers.erase(it);
-			// Remove it from idle workers
-			if (wi.is_idle) {
-				for (auto k = wp_.idle_workers.begin();
-				     k != wp_.idle_workers.end(); ++k) {
-					if (*k == tid) {
-						wp_.idle_workers.erase(k);
-						break;
-					}
-				}
-			}
-
-			if (wp_.worker_dies_callback_) {
-				EventsQueue::register_event(
-				   shared_function([&callback = wp_.worker_dies_callback_,
-				                         winfo = std::move(wi)]() mutable {
-					   callback(std::move(winfo));
-				   }));
-			}
+		if (not select_stmt_) {
+			// Judge jobs come with their submissions' owners, contests and
+			// the states of their rounds (for the JudgeJobsPolicy)
+			select_stmt_ = mysql.prepare(
+			   "SELECT j.id, j.type, j.priority, j.aux_id, j.info, s.id,"
+			   " s.owner, s.contest_id, r.begins<=? AND ?<r.ends "
+			   "FROM jobs j "
+			   "LEFT JOIN submissions s ON s.id=j.aux_id AND j.type IN(?,?) "
+			   "LEFT JOIN contest_rounds r ON r.id=s.contest_round_id "
+			   "WHERE j.status=? "
+			   "ORDER BY j.priority DESC, j.id ASC LIMIT ?");
+			select_stmt_->res_bind_all(jid_, jtype_, priority_, aux_id_, info_,
+			                           submission_id_, owner_, contest_id_,
+			                           in_running_round_);
 		}
 
-		NextJob wait_for_next_job_id() {
-			STACK_UNWINDING_MARK;
-			auto tid = std::this_thread::get_id();
-			WorkerInfo* wi;
-			// Mark as idle
-			{
-				lock_guard<mutex> lock(wp_.mtx_);
-				wi = &wp_.workers[tid];
-				throw_assert(not wi->is_idle);
-				wi->is_idle = true;
-				wp_.idle_workers.emplace_back(tid);
+		auto curr_date = mysql_date();
+		select_stmt_->bind_and_execute(
+		   curr_date, curr_date, EnumVal(JobType::JUDGE_SUBMISSION),
+		   EnumVal(JobType::REJUDGE_SUBMISSION), EnumVal(JobStatus::PENDING),
+		   limit);
+		while (select_stmt_->next()) {
+			std::optional<Submission> submission;
+			if (submission_id_.has_value()) {
+				submission = Submission {
+				   owner_.opt(), contest_id_.opt(),
+				   in_running_round_.has_value() and in_running_round_.value()};
 			}
 
-			if (wp_.worker_becomes_idle_callback_)
-				EventsQueue::register_event(wp_.worker_becomes_idle_callback_);
-
-			// Wait for a job to be assigned to us (current worker)
-			wi->next_job_waiter.wait();
-			// Rearm promise-future pair
-			lock_guard<mutex> lock(wp_.mtx_);
-			wi->next_job_signalizer = decltype(wi->next_job_signalizer)();
-			wi->next_job_waiter = wi->next_job_signalizer.get_future();
-
-			return wi->next_job;
+			callback(
+			   {jid_, jtype_, priority_, aux_id_.opt(), info_, submission});
 		}
-	};
-
-public:
-	/**
-	 * @brief Construct a workers pool
-	 *
-	 * @param job_handler a function that will be called in a worker with a job
-	 *   id to handle as the first argument
-	 * @param idle_callback a function to call when a worker becomes idle
-	 */
-	WorkersPool(function<void(NextJob)> job_handler,
-	            function<void()> idle_callback,
-	            function<void(WorkerInfo)> dead_callback)
-	   : job_handler_(std::move(job_handler)),
-	     worker_becomes_idle_callback_(std::move(idle_callback)),
-	     worker_dies_callback_(std::move(dead_callback)) {
-		throw_assert(job_handler_);
 	}
 
-	void spawn_worker() {
+	void mark_as_noticed(const std::vector<uint64_t>& job_ids) override {
 		STACK_UNWINDING_MARK;
 
-		std::thread foo([this] {
-			try {
-				thread_local Worker w(*this);
-				// Connect to databases
-				mysql = MySQL::make_conn_with_credential_file(".db.config");
-
-				for (;;)
-					job_handler_(w.wait_for_next_job_id());
-
-			} catch (const std::exception& e) {
-				ERRLOG_CATCH(e);
-				// Sleep for a while to prevent exception inundation
-				std::this_thread::sleep_for(std::chrono::seconds(3));
-				pthread_exit(0);
-			}
-		});
-		foo.detach();
-	}
+		InplaceBuff<8192> ids;
+		for (uint64_t id : job_ids)
+			ids.append(ids.size == 0 ? "" : ",", id);
 
-	auto workers_no() {
-		lock_guard<mutex> lock(mtx_);
-		return workers.size();
+		// Jobs canceled in the meantime are left untouched
+		mysql.update("UPDATE jobs SET status=",
+		             EnumVal(JobStatus::NOTICED_PENDING).int_val(),
+		             " WHERE status=", EnumVal(JobStatus::PENDING).int_val(),
+		             " AND id IN(", ids, ')');
 	}
+} mysql_jobs_source;
 
-	bool pass_job(uint64_t job_id, int64_t problem_id = -1,
-	              bool locks_problem = false) {
-		STACK_UNWINDING_MARK;
-
-		lock_guard<mutex> lock(mtx_);
-		if (idle_workers.size() == 0)
-			return false;
-
-		// Assign the job to an idle worker
-		auto tid = idle_workers.back();
-		idle_workers.pop_back();
-		auto& wi = workers[tid];
-		wi.is_idle = false;
-		wi.next_job = {job_id, problem_id, locks_problem};
-		wi.next_job_signalizer.set_value();
-
-		return true;
-	}
-};
+JobsQueue jobs_queue(mysql_jobs_source);
 
 } // anonymous namespace
 
+static void connect_to_db() {
+	// Drops the cached statements of the previous connection
+	mysql = MySQL::make_conn_with_credential_file(".db.config");
+}
+
 static void spawn_worker(WorkersPool& wp) noexcept {
 	try {
-		wp.spawn_worker();
+		wp.spawn_worker(connect_to_db);
 	} catch (const std::exception& e) {
 		ERRLOG_CATCH(e);
 		// Give the system some time (yes I know it will block the whole thread,
@@ -667,10 +123,13 @@ static void spawn_worker(WorkersPool& wp) noexcept {
 static void process_job(const WorkersPool::NextJob& job) {
 	STACK_UNWINDING_MARK;
 
-	auto exit_procedures = [&job] {
-		EventsQueue::register_event([job] {
+	auto exit_procedures = [&job](bool job_was_run) {
+		EventsQueue::register_event([job, job_was_run] {
 			if (job.locked_its_problem)
 				jobs_queue.unlock_problem(job.problem_id);
+			// Job handlers may have added new jobs
+			if (job_was_run)
+				jobs_queue.mark_db_as_changed();
 		});
 	};
 
@@ -690,7 +149,7 @@ static void process_job(const WorkersPool::NextJob& job) {
 		                  info);
 
 		if (not stmt.next()) // Job has been probably canceled
-			return exit_procedures();
+			return exit_procedures(false);
 	}
 
 	// Mark as in progress
@@ -705,7 +164,7 @@ static void process_job(const WorkersPool::NextJob& job) {
 	job_dispatcher(job.id, jtype, file_id, tmp_file_id, creat, aux_id, info,
 	               added);
 
-	exit_procedures();
+	exit_procedures(true);
 }
 
 static void process_local_job(const WorkersPool::NextJob& job) {
@@ -728,118 +187,64 @@ static void process_judge_job(const WorkersPool::NextJob& job) {
 	process_job(job);
 }
 
+static void process_remote_judge_job(const WorkersPool::NextJob& job) {
+	STACK_UNWINDING_MARK;
+
+	stdlog(pthread_self(), " got remote judge job {id:", job.id,
+	       ", problem: ", job.problem_id, ", locked: ", job.locked_its_problem,
+	       ", worker: ", RemoteJudgeConnection::current()->peer(), '}');
+
+	process_job(job);
+}
+
 static void sync_and_assign_jobs();
 
-static WorkersPool local_workers(
-   process_local_job, sync_and_assign_jobs, [](WorkersPool::WorkerInfo winfo) {
-	   STACK_UNWINDING_MARK;
+// Restarts the job of the dead worker (if it had one)
+static void restart_workers_job(const WorkersPool::WorkerInfo& winfo) {
+	STACK_UNWINDING_MARK;
 
-	   // Job has to be reset and cleanup to be done
-	   if (not winfo.is_idle) {
-		   if (winfo.next_job.locked_its_problem)
-			   jobs_queue.unlock_problem(winfo.next_job.problem_id);
+	// Job has to be reset and cleanup to be done
+	if (not winfo.is_idle) {
+		if (winfo.next_job.locked_its_problem)
+			jobs_queue.unlock_problem(winfo.next_job.problem_id);
 
-		   jobs::restart_job(
-		      mysql,
-		      intentional_unsafe_string_view(to_string(winfo.next_job.id)),
-		      false);
-	   }
+		jobs::restart_job(
+		   mysql, intentional_unsafe_string_view(to_string(winfo.next_job.id)),
+		   false);
+		jobs_queue.mark_db_as_changed();
+	}
+}
 
+static WorkersPool local_workers(
+   process_local_job, sync_and_assign_jobs, [](WorkersPool::WorkerInfo winfo) {
+	   STACK_UNWINDING_MARK;
+	   restart_workers_job(winfo);
 	   EventsQueue::register_event([] { spawn_worker(local_workers); });
    });
 
 static WorkersPool judge_workers(
    process_judge_job, sync_and_assign_jobs, [](WorkersPool::WorkerInfo winfo) {
 	   STACK_UNWINDING_MARK;
-
-	   // Job has to be reset and cleanup to be done
-	   if (not winfo.is_idle) {
-		   if (winfo.next_job.locked_its_problem)
-			   jobs_queue.unlock_problem(winfo.next_job.problem_id);
-
-		   jobs::restart_job(
-		      mysql,
-		      intentional_unsafe_string_view(to_string(winfo.next_job.id)),
-		      false);
-	   }
-
+	   restart_workers_job(winfo);
 	   EventsQueue::register_event([] { spawn_worker(judge_workers); });
    });
 
+// Threads serving remote judge workers, each of them dies together with the
+// connection to its remote judge worker (it is not respawned)
+static WorkersPool remote_judge_workers(
+   process_remote_judge_job, sync_and_assign_jobs,
+   [](WorkersPool::WorkerInfo winfo) {
+	   STACK_UNWINDING_MARK;
+	   restart_workers_job(winfo);
+   });
+
 static void sync_and_assign_jobs() {
 	STACK_UNWINDING_MARK;
 
 	jobs_queue.sync_with_db(); // sync before assigning
 
-	auto problem_job = jobs_queue.best_problem_job();
-	auto other_job = jobs_queue.best_other_job();
-	auto judge_job = jobs_queue.best_judge_job();
-
-	struct SItem {
-		bool ok;
-		JobsQueue::Job job;
-	};
-
-	array<SItem, 3> selector {{
-	   // (is ok, best job)
-	   {problem_job.ok(), problem_job},
-	   {other_job.ok(), other_job},
-	   {judge_job.ok(), judge_job},
-	}};
-
-	while (selector[0].ok or selector[1].ok or selector[2].ok) {
-		// Select best job
-		auto best_job = JobsQueue::Job::least();
-		uint idx = selector.size();
-		for (uint i = 0; i < selector.size(); ++i)
-			if (selector[i].ok and selector[i].job < best_job) {
-				idx = i;
-				best_job = selector[i].job;
-			}
-
-		DEBUG_JOB_SERVER(stdlog("DEBUG: Got job: {id: ", best_job.id,
-		                        ", pri: ", best_job.priority,
-		                        ", locks: ", best_job.locks_problem, "}"));
-
-		if (idx == 0) { // Problem job
-			if (local_workers.pass_job(best_job.id, problem_job.problem_id,
-			                           best_job.locks_problem)) {
-				problem_job.was_passed();
-			} else
-				selector[0].ok = false; // No more workers available
-
-		} else if (idx == 1) { // Other job
-			if (local_workers.pass_job(best_job.id))
-				other_job.was_passed();
-			else
-				selector[1].ok = false; // No more workers available
-
-		} else if (idx == 2) { // Judge job
-			if (judge_workers.pass_job(best_job.id, judge_job.problem_id,
-			                           best_job.locks_problem)) {
-				judge_job.was_passed();
-			} else
-				selector[2].ok = false; // No more workers available
-
-		} else { // Invalid
-			THROW("Invalid idx: ", idx);
-		}
-
-		// Update selector (all types must be updated because some problem may
-		// become locked causing some jobs to become invalid)
-		if (selector[0].ok) {
-			problem_job = jobs_queue.best_problem_job();
-			selector[0] = {problem_job.ok(), problem_job};
-		}
-		if (selector[1].ok) {
-			other_job = jobs_queue.best_other_job();
-			selector[1] = {other_job.ok(), other_job};
-		}
-		if (selector[2].ok) {
-			judge_job = jobs_queue.best_judge_job();
-			selector[2] = {judge_job.ok(), judge_job};
-		}
-	}
+	assign_jobs(jobs_queue, local_workers, judge_workers,
+	            remote_judge_workers);
 }
 
 static void events_loop() noexcept {
@@ -862,6 +267,7 @@ static void events_loop() noexcept {
 			}
 
 			// Update jobs queue and distribute new jobs
+			jobs_queue.mark_db_as_changed();
 			sync_and_assign_jobs();
 
 			struct inotify_event* event = (struct inotify_event*)inotify_buff;
@@ -889,6 +295,7 @@ static void events_loop() noexcept {
 			constexpr uint SLEEP_INTERVAL = 30; // in milliseconds
 
 			// Update jobs queue
+			jobs_queue.mark_db_as_changed();
 			sync_and_assign_jobs();
 
 			// Inotify is broken
@@ -938,9 +345,9 @@ static void events_loop() noexcept {
 						if (tend < std::chrono::steady_clock::now())
 							break;
 
+						jobs_queue.mark_db_as_changed();
 						jobs_queue.sync_with_db();
-						while (EventsQueue::process_next_event()) {
-						}
+						EventsQueue::process_events();
 
 						std::this_thread::sleep_for(
 						   std::chrono::milliseconds(SLEEP_INTERVAL));
@@ -958,7 +365,9 @@ static void events_loop() noexcept {
 						if (tend < std::chrono::steady_clock::now())
 							break;
 
-						// Update queue - sth may have changed
+						// Update queue - sth may have changed (there is no
+						// notification without inotify)
+						jobs_queue.mark_db_as_changed();
 						sync_and_assign_jobs();
 
 						int rc = poll(&pfd, 1, SLEEP_INTERVAL);
@@ -966,8 +375,7 @@ static void events_loop() noexcept {
 							THROW("poll() failed", errmsg());
 
 						EventsQueue::reset_notifier();
-						while (EventsQueue::process_next_event()) {
-						}
+						EventsQueue::process_events();
 					}
 				}
 
@@ -1000,8 +408,7 @@ static void events_loop() noexcept {
 						if (not process_inotify_event())
 							continue; // inotify has just broken
 
-						while (EventsQueue::process_next_event()) {
-						}
+						EventsQueue::process_events();
 					}
 
 				} else {
@@ -1031,8 +438,7 @@ static void events_loop() noexcept {
 
 						if (pfd[EQ_IDX].revents != 0) {
 							EventsQueue::reset_notifier();
-							while (EventsQueue::process_next_event()) {
-							}
+							EventsQueue::process_events();
 						}
 					}
 				}
@@ -1050,6 +456,113 @@ static void events_loop() noexcept {
 	}
 }
 
+// Verifies the remote judge worker connected through @p conn and passes it to
+// a new thread of remote_judge_workers. It runs in its own thread, so that slow
+// or malicious peers cannot hold back accepting other connections.
+static void
+serve_remote_judge_worker(std::shared_ptr<RemoteJudgeConnection> conn,
+                          const string& token) noexcept {
+	try {
+		STACK_UNWINDING_MARK;
+
+		conn->handshake(token);
+		stdlog("Remote judge worker connected: ", conn->peer());
+
+		remote_judge_workers.spawn_worker([conn] {
+			connect_to_db();
+			// The connection lives as long as the worker's thread
+			thread_local std::shared_ptr<RemoteJudgeConnection> holder;
+			holder = conn;
+			RemoteJudgeConnection::current() = holder.get();
+		});
+
+	} catch (const std::exception& e) {
+		ERRLOG_CATCH(e);
+	}
+}
+
+// Accepts connections from remote judge workers, each of them is verified in
+// its own thread and then served by a new thread of remote_judge_workers
+static void accept_remote_judge_workers(int socket_fd,
+                                        const string& token) noexcept {
+	// Limits the threads of the connections that have not completed the
+	// handshake yet
+	constexpr uint MAX_PENDING_HANDSHAKES = 16;
+	static std::atomic<uint> pending_handshakes {0};
+
+	for (;;) {
+		try {
+			STACK_UNWINDING_MARK;
+
+			sockaddr_in name;
+			socklen_t name_len = sizeof(name);
+			FileDescriptor fd {
+			   accept4(socket_fd, (sockaddr*)&name, &name_len, SOCK_CLOEXEC)};
+			if (fd == -1) {
+				if (errno != EINTR and errno != ECONNABORTED)
+					THROW("accept4()", errmsg());
+
+				continue;
+			}
+
+			char ip[INET_ADDRSTRLEN];
+			inet_ntop(AF_INET, &name.sin_addr, ip, sizeof(ip));
+			auto peer = concat_tostr(ip, ':', ntohs(name.sin_port));
+			if (pending_handshakes >= MAX_PENDING_HANDSHAKES) {
+				errlog("Too many pending remote judge worker handshakes, "
+				       "rejected: ",
+				       peer);
+				continue; // Closes the connection
+			}
+
+			// Messages are small and should not be delayed
+			int true_ = 1;
+			(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &true_,
+			                 sizeof(true_));
+
+			auto conn =
+			   std::make_shared<RemoteJudgeConnection>(std::move(fd), peer);
+			++pending_handshakes;
+			try {
+				thread([conn, token] {
+					serve_remote_judge_worker(conn, token);
+					--pending_handshakes;
+				}).detach();
+			} catch (...) {
+				--pending_handshakes;
+				throw;
+			}
+
+		} catch (const std::exception& e) {
+			ERRLOG_CATCH(e);
+			// Sleep for a while to prevent exception inundation
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+}
+
+static void listen_for_remote_judge_workers(StringView address,
+                                            string token) {
+	STACK_UNWINDING_MARK;
+
+	sockaddr_in name = remote_judge::parse_address(address);
+	int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (socket_fd == -1)
+		THROW("socket()", errmsg());
+
+	int true_ = 1;
+	if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &true_, sizeof(int)))
+		THROW("setsockopt()", errmsg());
+
+	if (bind(socket_fd, (sockaddr*)&name, sizeof(name)))
+		THROW("Failed to bind to ", address, errmsg());
+
+	if (listen(socket_fd, 16))
+		THROW("listen()", errmsg());
+
+	thread(accept_remote_judge_workers, socket_fd, std::move(token)).detach();
+}
+
 // Clean up database
 static void clean_up_db() {
 	STACK_UNWINDING_MARK;
@@ -1125,7 +638,9 @@ int main() {
 		clean_up_db();
 
 		ConfigFile cf;
-		cf.add_vars("js_local_workers", "js_judge_workers");
+		cf.add_vars("js_local_workers", "js_judge_workers",
+		            "js_judge_parallel_tests", "js_remote_judge_address",
+		            "js_remote_judge_token");
 		cf.load_config_from_file("sim.conf");
 
 		size_t lworkers_no = cf["js_local_workers"].as<size_t>().value_or(0);
@@ -1138,11 +653,31 @@ int main() {
 			THROW("sim.conf: js_judge_workers has to be an integer greater "
 			      "than 0");
 
+		size_t parallel_tests_no =
+		   cf["js_judge_parallel_tests"].as<size_t>().value_or(1);
+		if (parallel_tests_no < 1)
+			THROW("sim.conf: js_judge_parallel_tests has to be an integer "
+			      "greater than 0");
+
+		job_handlers::JudgeBase::set_parallel_tests(parallel_tests_no);
+
+		string remote_judge_address =
+		   cf["js_remote_judge_address"].as_string();
+		string remote_judge_token = cf["js_remote_judge_token"].as_string();
+		if (not remote_judge_address.empty() and remote_judge_token.empty()) {
+			THROW("sim.conf: js_remote_judge_token has to be set if "
+			      "js_remote_judge_address is set");
+		}
+
 		// clang-format off
 		stdlog("\n=================== Job server launched ==================="
 		       "\nPID: ", getpid(),
 		       "\nlocal workers: ", lworkers_no,
-		       "\njudge workers: ", jworkers_no);
+		       "\njudge workers: ", jworkers_no,
+		       "\nparallel tests per judging: ", parallel_tests_no,
+		       "\nremote judge workers address: ",
+		       (remote_judge_address.empty() ? "disabled"
+		                                     : remote_judge_address));
 		// clang-format on
 
 		for (size_t i = 0; i < lworkers_no; ++i)
@@ -1151,6 +686,11 @@ int main() {
 		for (size_t i = 0; i < jworkers_no; ++i)
 			spawn_worker(judge_workers);
 
+		if (not remote_judge_address.empty()) {
+			listen_for_remote_judge_workers(remote_judge_address,
+			                                std::move(remote_judge_token));
+		}
+
 	} catch (const std::exception& e) {
 		ERRLOG_CATCH(e);
 		return 1;
@@ -1,5 +1,5 @@
 #pragma once
 
-#include <simlib/mysql.hh>
+#include <sim/mysql.hh>
 
-extern thread_local MySQL::Connection mysql;
+extern thread_local MySQL::CachedStatementsConnection mysql;
@@ -0,0 +1,196 @@
+#include "remote_judge_connection.hh"
+
+#include <fcntl.h>
+#include <sim/constants.hh>
+
+using remote_judge::ConnectionLost;
+using remote_judge::Message;
+using remote_judge::MessageType;
+using remote_judge::parse_payload;
+
+void RemoteJudgeConnection::handshake(StringView token) {
+	STACK_UNWINDING_MARK;
+
+	auto msg = remote_judge::receive_message(fd_, remote_judge::HELLO_TIMEOUT);
+	if (not msg)
+		throw ConnectionLost("No HELLO from the remote judge worker");
+
+	if (msg->type != MessageType::HELLO)
+		throw ConnectionLost("Remote judge worker did not send HELLO first");
+
+	StringView payload = msg->payload;
+	auto version = parse_payload(
+	   [&] { return jobs::extract_dumped_int<uint32_t>(payload); });
+	if (version != remote_judge::PROTOCOL_VERSION) {
+		throw ConnectionLost(concat_tostr(
+		   "Remote judge worker uses protocol version ", version,
+		   " but version ", remote_judge::PROTOCOL_VERSION, " is required"));
+	}
+
+	auto received_token =
+	   parse_payload([&] { return jobs::extract_dumped_string(payload); });
+	if (not remote_judge::tokens_equal(received_token, token))
+		throw ConnectionLost("Remote judge worker sent invalid token");
+}
+
+void RemoteJudgeConnection::start_job(const remote_judge::JobDescription& job) {
+	STACK_UNWINDING_MARK;
+
+	job_ = job;
+	remote_judge::send_message(fd_, MessageType::JOB, job.dump());
+}
+
+Message RemoteJudgeConnection::await_job_message() {
+	STACK_UNWINDING_MARK;
+
+	for (;;) {
+		// Every message from the worker renews its lease
+		auto msg =
+		   remote_judge::receive_message(fd_, remote_judge::LEASE_DURATION);
+		if (not msg) {
+			throw ConnectionLost(concat_tostr(
+			   "Lease expired: remote judge worker ", peer_, " did not respond",
+			   " for ", remote_judge::LEASE_DURATION.count(), " seconds"));
+		}
+
+		if (msg->type == MessageType::HELLO)
+			throw ConnectionLost("Unexpected HELLO from remote judge worker");
+
+		StringView payload = msg->payload;
+		auto job_id = parse_payload(
+		   [&] { return jobs::extract_dumped_int<uint64_t>(payload); });
+		bool is_current_job = (job_.has_value() and job_->job_id == job_id);
+
+		if (msg->type == MessageType::FILE_REQUEST) {
+			auto file_id = parse_payload(
+			   [&] { return jobs::extract_dumped_int<uint64_t>(payload); });
+			// Serve only the files needed by the current job
+			if (is_current_job and (file_id == job_->solution_file_id or
+			                        file_id == job_->problem_file_id)) {
+				send_file(file_id);
+			} else {
+				std::string res;
+				jobs::append_dumped(res, file_id);
+				remote_judge::send_message(fd_, MessageType::FILE_UNAVAILABLE,
+				                           res);
+			}
+			continue;
+		}
+
+		// Ignore messages that belong to an abandoned job and heartbeats
+		if (not is_current_job or msg->type == MessageType::HEARTBEAT)
+			continue;
+
+		msg->payload.erase(0, msg->payload.size() - payload.size());
+		return std::move(*msg);
+	}
+}
+
+void RemoteJudgeConnection::send_file(uint64_t file_id) {
+	STACK_UNWINDING_MARK;
+
+	auto path = internal_file_path(file_id);
+	FileDescriptor fd(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		errlog("Cannot serve file ", file_id, " to remote judge worker ",
+		       peer_, ": open(", path, ')', errmsg());
+		std::string res;
+		jobs::append_dumped(res, file_id);
+		return remote_judge::send_message(fd_, MessageType::FILE_UNAVAILABLE,
+		                                  res);
+	}
+
+	std::string chunk;
+	std::string buff(remote_judge::FILE_CHUNK_SIZE, '\0');
+	for (;;) {
+		ssize_t len = read(fd, buff.data(), buff.size());
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			THROW("read()", errmsg());
+		}
+
+		chunk.clear();
+		jobs::append_dumped(chunk, file_id);
+		jobs::append_dumped(chunk, StringView(buff.data(), len));
+		remote_judge::send_message(fd_, MessageType::FILE_CHUNK, chunk);
+		if (len == 0)
+			break; // The empty chunk marks the end of the file
+	}
+}
+
+void RemoteJudgeConnection::throw_judge_error(StringView payload) {
+	STACK_UNWINDING_MARK;
+
+	auto error =
+	   parse_payload([&] { return jobs::extract_dumped_string(payload); });
+	THROW("Remote judge error: ", error);
+}
+
+std::optional<std::string>
+RemoteJudgeConnection::await_compilation_result_impl(MessageType type) {
+	STACK_UNWINDING_MARK;
+
+	auto msg = await_job_message();
+	StringView payload = msg.payload;
+	if (msg.type == MessageType::JUDGE_ERROR)
+		throw_judge_error(payload);
+
+	if (msg.type != type) {
+		throw ConnectionLost(concat_tostr(
+		   "Unexpected message from remote judge worker: ", (int)msg.type));
+	}
+
+	return parse_payload([&] {
+		std::optional<std::string> compilation_errors;
+		jobs::extract_dumped(compilation_errors, payload);
+		return compilation_errors;
+	});
+}
+
+std::optional<std::string> RemoteJudgeConnection::await_compilation_result() {
+	return await_compilation_result_impl(MessageType::COMPILATION_RESULT);
+}
+
+std::optional<std::string>
+RemoteJudgeConnection::await_checker_compilation_result() {
+	return await_compilation_result_impl(
+	   MessageType::CHECKER_COMPILATION_RESULT);
+}
+
+sim::JudgeReport RemoteJudgeConnection::await_judge_report(
+   bool final,
+   const std::function<void(const sim::JudgeReport&)>&
+      partial_report_callback) {
+	STACK_UNWINDING_MARK;
+
+	for (;;) {
+		auto msg = await_job_message();
+		StringView payload = msg.payload;
+		if (msg.type == MessageType::JUDGE_ERROR)
+			throw_judge_error(payload);
+
+		if (msg.type != MessageType::JUDGE_REPORT) {
+			throw ConnectionLost(concat_tostr(
+			   "Unexpected message from remote judge worker: ", (int)msg.type));
+		}
+
+		bool report_final, partial;
+		sim::JudgeReport report;
+		parse_payload([&] {
+			jobs::extract_dumped(report_final, payload);
+			jobs::extract_dumped(partial, payload);
+			remote_judge::extract_dumped(report, payload);
+		});
+		if (report_final != final) {
+			throw ConnectionLost(
+			   "Remote judge worker sent report of unexpected tests");
+		}
+
+		if (not partial)
+			return report;
+
+		partial_report_callback(report);
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <functional>
+#include <sim/remote_judge.hh>
+#include <simlib/file_descriptor.hh>
+
+// Job server's end of a connection with a remote judge worker. Each remote
+// judge worker is served by a dedicated thread of the job server that owns the
+// connection, see RemoteJudgeConnection::current().
+class RemoteJudgeConnection {
+	FileDescriptor fd_;
+	std::string peer_;
+	std::optional<remote_judge::JobDescription> job_;
+
+public:
+	RemoteJudgeConnection(FileDescriptor fd, std::string peer)
+	   : fd_(std::move(fd)), peer_(std::move(peer)) {}
+
+	RemoteJudgeConnection(const RemoteJudgeConnection&) = delete;
+	RemoteJudgeConnection(RemoteJudgeConnection&&) = delete;
+	RemoteJudgeConnection& operator=(const RemoteJudgeConnection&) = delete;
+	RemoteJudgeConnection& operator=(RemoteJudgeConnection&&) = delete;
+
+	/// Connection served by the current thread or nullptr if the current thread
+	/// is not a thread of a remote judge worker
+	static RemoteJudgeConnection*& current() noexcept {
+		static thread_local RemoteJudgeConnection* conn = nullptr;
+		return conn;
+	}
+
+	const std::string& peer() const noexcept { return peer_; }
+
+	/**
+	 * @brief Receives and verifies the HELLO message of a freshly connected
+	 *   worker
+	 *
+	 * @errors Throws ConnectionLost if the worker is not allowed to connect
+	 */
+	void handshake(StringView token);
+
+	/// Passes the job to the remote judge worker. Messages that belong to the
+	/// previous job (if there was any) are ignored from now on.
+	void start_job(const remote_judge::JobDescription& job);
+
+	// Iff compilation failed, compilation errors are returned
+	std::optional<std::string> await_compilation_result();
+
+	// Iff compilation failed, compilation errors are returned
+	std::optional<std::string> await_checker_compilation_result();
+
+	/**
+	 * @brief Waits for the judge report of the initial or final tests
+	 *
+	 * @param final whether to wait for the final tests' report
+	 * @param partial_report_callback called with every partial report received
+	 *   before the complete one
+	 *
+	 * @return the complete judge report
+	 *
+	 * @errors If the worker reports a judge error, std::runtime_error is
+	 *   thrown. If the worker disconnects, its lease expires or it sends a
+	 *   malformed message, ConnectionLost is thrown.
+	 */
+	sim::JudgeReport await_judge_report(
+	   bool final,
+	   const std::function<void(const sim::JudgeReport&)>&
+	      partial_report_callback);
+
+private:
+	// Returns the next message of the current job with the job id stripped
+	// from the payload. File requests and heartbeats are handled internally.
+	remote_judge::Message await_job_message();
+
+	std::optional<std::string>
+	await_compilation_result_impl(remote_judge::MessageType type);
+
+	// Throws the error of the current job reported by the worker in the
+	// JUDGE_ERROR message with payload @p payload
+	[[noreturn]] static void throw_judge_error(StringView payload);
+
+	void send_file(uint64_t file_id);
+};
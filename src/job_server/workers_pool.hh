@@ -0,0 +1,213 @@
+#pragma once
+
+#include "events_queue.hh"
+#include "instrumented_mutex.hh"
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <simlib/debug.hh>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads, jobs are passed to the idle ones
+class WorkersPool {
+public:
+	struct NextJob {
+		uint64_t id;
+		int64_t problem_id; // negative indicates that no problem is associated
+		                    // with the job
+		bool locked_its_problem;
+	};
+
+	struct WorkerInfo {
+		NextJob next_job {0, -1, false};
+		std::promise<void> next_job_signalizer;
+		std::future<void> next_job_waiter = next_job_signalizer.get_future();
+		bool is_idle = false;
+		// Problems of the latest jobs passed to the worker - their packages are
+		// likely to be still cached by the worker
+		std::deque<int64_t> recent_problems;
+
+		bool handled_recently(int64_t problem_id) const {
+			return std::find(recent_problems.begin(), recent_problems.end(),
+			                 problem_id) != recent_problems.end();
+		}
+
+		/// Marks @p problem_id as the most recent problem. Like the worker's
+		/// cache of packages, the least recently used problem is forgotten.
+		void handles(int64_t problem_id) {
+			constexpr size_t RECENT_PROBLEMS_MAX_NO = 4;
+			auto it = std::find(recent_problems.begin(), recent_problems.end(),
+			                    problem_id);
+			if (it != recent_problems.end())
+				recent_problems.erase(it);
+
+			recent_problems.emplace_back(problem_id);
+			if (recent_problems.size() > RECENT_PROBLEMS_MAX_NO)
+				recent_problems.pop_front();
+		}
+	};
+
+private:
+	InstrumentedMutex mtx_;
+	std::vector<std::thread::id> idle_workers;
+	std::map<std::thread::id, WorkerInfo>
+	   workers; // AVLDict cannot be used as addresses must not change
+
+	std::function<void(NextJob)> job_handler_;
+	std::function<void()> worker_becomes_idle_callback_;
+	std::function<void(WorkerInfo)> worker_dies_callback_;
+
+	class Worker {
+		WorkersPool& wp_;
+
+	public:
+		Worker(WorkersPool& wp) : wp_(wp) {
+			STACK_UNWINDING_MARK;
+			auto tid = std::this_thread::get_id();
+			std::lock_guard<InstrumentedMutex> lock(wp_.mtx_);
+			wp_.workers.emplace(tid, WorkerInfo {});
+		}
+
+		~Worker() {
+			STACK_UNWINDING_MARK;
+			std::lock_guard<InstrumentedMutex> lock(wp_.mtx_);
+			// Remove the worker from workers map and move out its info
+			auto tid = std::this_thread::get_id();
+			auto it = wp_.workers.find(tid);
+			auto wi = std::move(it->second);
+			wp_.workers.erase(it);
+			// Remove it from idle workers
+			if (wi.is_idle) {
+				for (auto k = wp_.idle_workers.begin();
+				     k != wp_.idle_workers.end(); ++k) {
+					if (*k == tid) {
+						wp_.idle_workers.erase(k);
+						break;
+					}
+				}
+			}
+
+			if (wp_.worker_dies_callback_) {
+				EventsQueue::register_event(
+				   [&callback = wp_.worker_dies_callback_,
+				    winfo = std::move(wi)]() mutable {
+					   callback(std::move(winfo));
+				   });
+			}
+		}
+
+		NextJob wait_for_next_job_id() {
+			STACK_UNWINDING_MARK;
+			auto tid = std::this_thread::get_id();
+			WorkerInfo* wi;
+			// Mark as idle
+			{
+				std::lock_guard<InstrumentedMutex> lock(wp_.mtx_);
+				wi = &wp_.workers[tid];
+				throw_assert(not wi->is_idle);
+				wi->is_idle = true;
+				wp_.idle_workers.emplace_back(tid);
+			}
+
+			if (wp_.worker_becomes_idle_callback_)
+				EventsQueue::register_event(wp_.worker_becomes_idle_callback_);
+
+			// Wait for a job to be assigned to us (current worker)
+			wi->next_job_waiter.wait();
+			// Rearm promise-future pair
+			std::lock_guard<InstrumentedMutex> lock(wp_.mtx_);
+			wi->next_job_signalizer = decltype(wi->next_job_signalizer)();
+			wi->next_job_waiter = wi->next_job_signalizer.get_future();
+
+			return wi->next_job;
+		}
+	};
+
+public:
+	/**
+	 * @brief Construct a workers pool
+	 *
+	 * @param job_handler a function that will be called in a worker with a job
+	 *   id to handle as the first argument
+	 * @param idle_callback a function to call when a worker becomes idle
+	 */
+	WorkersPool(std::function<void(NextJob)> job_handler,
+	            std::function<void()> idle_callback,
+	            std::function<void(WorkerInfo)> dead_callback)
+	   : job_handler_(std::move(job_handler)),
+	     worker_becomes_idle_callback_(std::move(idle_callback)),
+	     worker_dies_callback_(std::move(dead_callback)) {
+		throw_assert(job_handler_);
+	}
+
+	/// @p worker_init is called in the worker's thread before it starts
+	/// waiting for jobs (e.g. to connect to the database)
+	void spawn_worker(std::function<void()> worker_init = nullptr) {
+		STACK_UNWINDING_MARK;
+
+		std::thread foo([this, worker_init = std::move(worker_init)] {
+			try {
+				thread_local Worker w(*this);
+				if (worker_init)
+					worker_init();
+
+				for (;;)
+					job_handler_(w.wait_for_next_job_id());
+
+			} catch (const std::exception& e) {
+				ERRLOG_CATCH(e);
+				// Sleep for a while to prevent exception inundation
+				std::this_thread::sleep_for(std::chrono::seconds(3));
+				pthread_exit(0);
+			}
+		});
+		foo.detach();
+	}
+
+	InstrumentedMutex::Stats lock_stats() const noexcept {
+		return mtx_.stats();
+	}
+
+	auto workers_no() {
+		std::lock_guard<InstrumentedMutex> lock(mtx_);
+		return workers.size();
+	}
+
+	bool pass_job(uint64_t job_id, int64_t problem_id = -1,
+	              bool locks_problem = false) {
+		STACK_UNWINDING_MARK;
+
+		std::lock_guard<InstrumentedMutex> lock(mtx_);
+		if (idle_workers.size() == 0)
+			return false;
+
+		// Prefer an idle worker that has recently handled the job's problem
+		auto it = idle_workers.end() - 1;
+		if (problem_id >= 0) {
+			auto warm_it = std::find_if(
+			   idle_workers.begin(), idle_workers.end(),
+			   [&](std::thread::id tid) {
+				   return workers[tid].handled_recently(problem_id);
+			   });
+			if (warm_it != idle_workers.end())
+				it = warm_it;
+		}
+
+		// Assign the job to the idle worker
+		auto tid = *it;
+		idle_workers.erase(it);
+		auto& wi = workers[tid];
+		wi.is_idle = false;
+		wi.next_job = {job_id, problem_id, locks_problem};
+		if (problem_id >= 0)
+			wi.handles(problem_id);
+		wi.next_job_signalizer.set_value();
+
+		return true;
+	}
+};
+
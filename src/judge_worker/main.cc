@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <condition_variable>
+#include <dirent.h>
+#include <netinet/tcp.h>
+#include <sim/constants.hh>
+#include <sim/judge_worker_cache.hh>
+#include <sim/judging.hh>
+#include <sim/remote_judge.hh>
+#include <simlib/config_file.hh>
+#include <simlib/file_manip.hh>
+#include <simlib/working_directory.hh>
+#include <sys/socket.h>
+#include <thread>
+#include <utime.h>
+
+using remote_judge::ConnectionLost;
+using remote_judge::JobDescription;
+using remote_judge::MessageType;
+using std::string;
+
+/**
+ * @brief Displays help
+ */
+static void help(const char* program_name) {
+	if (program_name == nullptr)
+		program_name = "sim-judge-worker";
+
+	printf("Usage: %s [config file]\n", program_name);
+	puts("Connect to the job server and judge submissions passed by it.");
+	puts("Config file defaults to judge-worker.conf in the Sim's installation "
+	     "directory.");
+}
+
+namespace {
+
+constexpr size_t JUDGE_WORKER_CACHE_SIZE = 4;
+
+struct Config {
+	string address;
+	string token;
+	string cache_dir;
+	size_t cache_max_packages;
+};
+
+class JobServerConnection {
+	FileDescriptor fd_;
+	std::mutex send_mtx_; // heartbeats are sent from a separate thread
+
+public:
+	explicit JobServerConnection(const Config& config)
+	   : fd_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP)) {
+		STACK_UNWINDING_MARK;
+
+		sockaddr_in name = remote_judge::parse_address(config.address);
+		if (fd_ == -1)
+			THROW("socket()", errmsg());
+
+		if (connect(fd_, (sockaddr*)&name, sizeof(name)))
+			THROW("Failed to connect to ", config.address, errmsg());
+
+		int true_ = 1;
+		(void)setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &true_,
+		                 sizeof(true_));
+
+		string hello;
+		jobs::append_dumped(hello, remote_judge::PROTOCOL_VERSION);
+		jobs::append_dumped(hello, config.token);
+		send(MessageType::HELLO, hello);
+	}
+
+	void send(MessageType type, StringView payload) {
+		std::lock_guard<std::mutex> lock(send_mtx_);
+		remote_judge::send_message(fd_, type, payload);
+	}
+
+	remote_judge::Message receive(std::chrono::milliseconds timeout) {
+		auto msg = remote_judge::receive_message(fd_, timeout);
+		if (not msg)
+			throw ConnectionLost("Job server did not respond in time");
+
+		return std::move(*msg);
+	}
+
+	// Blocks until the job server sends a job
+	JobDescription await_job() {
+		STACK_UNWINDING_MARK;
+
+		for (;;) {
+			auto msg = remote_judge::receive_message(fd_, std::chrono::hours(1));
+			if (not msg)
+				continue; // Idle workers do not have to hear from job server
+
+			if (msg->type != MessageType::JOB) {
+				throw ConnectionLost(concat_tostr(
+				   "Unexpected message from job server: ", (int)msg->type));
+			}
+
+			return JobDescription(msg->payload);
+		}
+	}
+};
+
+// Keeps the lease of the job alive while the job is being processed
+class HeartbeatSender {
+	std::mutex mtx_;
+	std::condition_variable cv_;
+	bool stop_ = false;
+	std::thread thread_;
+
+public:
+	HeartbeatSender(JobServerConnection& conn, uint64_t job_id)
+	   : thread_([this, &conn, job_id] {
+		     string payload;
+		     jobs::append_dumped(payload, job_id);
+		     std::unique_lock<std::mutex> lock(mtx_);
+		     while (not cv_.wait_for(lock, remote_judge::HEARTBEAT_INTERVAL,
+		                             [&] { return stop_; })) {
+			     try {
+				     conn.send(MessageType::HEARTBEAT, payload);
+			     } catch (const std::exception& e) {
+				     ERRLOG_CATCH(e);
+				     return; // The main thread will notice the broken
+				             // connection
+			     }
+		     }
+	     }) {}
+
+	HeartbeatSender(const HeartbeatSender&) = delete;
+	HeartbeatSender(HeartbeatSender&&) = delete;
+	HeartbeatSender& operator=(const HeartbeatSender&) = delete;
+	HeartbeatSender& operator=(HeartbeatSender&&) = delete;
+
+	~HeartbeatSender() {
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			stop_ = true;
+		}
+		cv_.notify_all();
+		thread_.join();
+	}
+};
+
+// Removes the least recently used problem packages from the cache
+void shrink_cache(const Config& config) {
+	STACK_UNWINDING_MARK;
+
+	std::vector<std::pair<time_t, string>> packages;
+	DIR* dir = opendir(config.cache_dir.c_str());
+	if (dir == nullptr)
+		THROW("opendir(", config.cache_dir, ')', errmsg());
+
+	while (dirent* file = readdir(dir)) {
+		StringView name = file->d_name;
+		if (not has_prefix(name, "problem_") or not has_suffix(name, ".zip"))
+			continue;
+
+		auto path = concat_tostr(config.cache_dir, name);
+		struct stat64 st;
+		if (stat64(path.c_str(), &st) == 0)
+			packages.emplace_back(st.st_mtime, std::move(path));
+	}
+	closedir(dir);
+
+	if (packages.size() <= config.cache_max_packages)
+		return;
+
+	std::sort(packages.begin(), packages.end());
+	for (size_t i = 0; i < packages.size() - config.cache_max_packages; ++i)
+		(void)unlink(packages[i].second.c_str());
+}
+
+/// Downloads file @p file_id of job @p job_id to @p dest_path
+void fetch_file(JobServerConnection& conn, uint64_t job_id, uint64_t file_id,
+                const string& dest_path) {
+	STACK_UNWINDING_MARK;
+
+	string request;
+	jobs::append_dumped(request, job_id);
+	jobs::append_dumped(request, file_id);
+	conn.send(MessageType::FILE_REQUEST, request);
+
+	// Download to a temporary file, so that concurrent workers sharing the
+	// cache never see a partially written file
+	auto tmp_path = concat_tostr(dest_path, ".tmp.", getpid());
+	FileRemover tmp_remover(tmp_path);
+	FileDescriptor fd(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+	                  S_0600);
+	if (fd == -1)
+		THROW("open(", tmp_path, ')', errmsg());
+
+	for (;;) {
+		auto msg = conn.receive(remote_judge::LEASE_DURATION);
+		StringView payload = msg.payload;
+		auto fid = remote_judge::parse_payload(
+		   [&] { return jobs::extract_dumped_int<uint64_t>(payload); });
+		if (fid != file_id or (msg.type != MessageType::FILE_CHUNK and
+		                       msg.type != MessageType::FILE_UNAVAILABLE)) {
+			throw ConnectionLost("Unexpected message from job server");
+		}
+
+		if (msg.type == MessageType::FILE_UNAVAILABLE)
+			THROW("Job server refused to send file ", file_id);
+
+		auto data = remote_judge::parse_payload(
+		   [&] { return jobs::extract_dumped_string(payload); });
+		if (data.empty())
+			break; // End of file
+
+		write_all_throw(fd, data);
+	}
+
+	if (fd.close())
+		THROW("close()", errmsg());
+
+	if (rename(tmp_path.c_str(), dest_path.c_str()))
+		THROW("rename(", tmp_path, ", ", dest_path, ')', errmsg());
+
+	tmp_remover.cancel();
+}
+
+string fetch_problem_package(JobServerConnection& conn, const Config& config,
+                             const JobDescription& job) {
+	STACK_UNWINDING_MARK;
+
+	// Internal files never change, so the package may be cached by its id
+	auto path = concat_tostr(config.cache_dir, "problem_", job.problem_file_id,
+	                         ".zip");
+	if (access(path.c_str(), F_OK) == 0) {
+		(void)utime(path.c_str(), nullptr); // Mark as recently used
+		return path;
+	}
+
+	fetch_file(conn, job.job_id, job.problem_file_id, path);
+	shrink_cache(config);
+	return path;
+}
+
+void send_compilation_result(JobServerConnection& conn, MessageType type,
+                             uint64_t job_id,
+                             const std::optional<string>& errors) {
+	string payload;
+	jobs::append_dumped(payload, job_id);
+	jobs::append_dumped(payload, errors);
+	conn.send(type, payload);
+}
+
+void judge(JobServerConnection& conn, const Config& config,
+           const JobDescription& job) {
+	STACK_UNWINDING_MARK;
+
+	stdlog("Judging submission ", job.submission_id, " (job ", job.job_id,
+	       ')');
+	HeartbeatSender heartbeat_sender(conn, job.job_id);
+	try {
+		// Internal files never change, so the package id identifies the
+		// package's contents
+		static JudgeWorkerCache jworker_cache(JUDGE_WORKER_CACHE_SIZE);
+		auto cached_jworker = jworker_cache.get(job.problem_file_id, "");
+		bool checker_is_compiled = (cached_jworker != nullptr);
+		if (not cached_jworker) {
+			cached_jworker = std::make_shared<sim::JudgeWorker>();
+			cached_jworker->checker_time_limit = CHECKER_TIME_LIMIT;
+			cached_jworker->checker_memory_limit = CHECKER_MEMORY_LIMIT;
+			cached_jworker->score_cut_lambda = SCORE_CUT_LAMBDA;
+			cached_jworker->load_package(
+			   fetch_problem_package(conn, config, job), std::nullopt);
+		}
+		auto& jworker = *cached_jworker;
+
+		auto solution_path = concat_tostr(config.cache_dir, "solution_",
+		                                  job.solution_file_id, '.', getpid());
+		FileRemover solution_remover(solution_path);
+		fetch_file(conn, job.job_id, job.solution_file_id, solution_path);
+
+		// Compile solution
+		string compilation_errors;
+		if (jworker.compile_solution(solution_path, job.language,
+		                             SOLUTION_COMPILATION_TIME_LIMIT,
+		                             &compilation_errors,
+		                             COMPILATION_ERRORS_MAX_LENGTH,
+		                             PROOT_PATH)) {
+			return send_compilation_result(conn,
+			                               MessageType::COMPILATION_RESULT,
+			                               job.job_id, compilation_errors);
+		}
+		send_compilation_result(conn, MessageType::COMPILATION_RESULT,
+		                        job.job_id, std::nullopt);
+
+		// Compile checker
+		if (not checker_is_compiled) {
+			if (jworker.compile_checker(SOLUTION_COMPILATION_TIME_LIMIT,
+			                            &compilation_errors,
+			                            COMPILATION_ERRORS_MAX_LENGTH,
+			                            PROOT_PATH)) {
+				return send_compilation_result(
+				   conn, MessageType::CHECKER_COMPILATION_RESULT, job.job_id,
+				   compilation_errors);
+			}
+
+			jworker_cache.put(job.problem_file_id, "", cached_jworker);
+		}
+		send_compilation_result(conn, MessageType::CHECKER_COMPILATION_RESULT,
+		                        job.job_id, std::nullopt);
+
+		// Judge
+		auto send_report = [&](bool final, bool partial,
+		                       const sim::JudgeReport& report) {
+			string payload;
+			jobs::append_dumped(payload, job.job_id);
+			jobs::append_dumped(payload, final);
+			jobs::append_dumped(payload, partial);
+			remote_judge::append_dumped(payload, report);
+			conn.send(MessageType::JUDGE_REPORT, payload);
+		};
+
+		sim::VerboseJudgeLogger logger(true);
+		for (bool final : {false, true}) {
+			auto partial_report_callback =
+			   [&](const sim::JudgeReport& partial) {
+				   send_report(final, true, partial);
+			   };
+			auto report =
+			   (job.stop_group_on_failure
+			       ? sim::judge_stopping_on_group_failure(
+			            jworker, final, logger, partial_report_callback)
+			       : jworker.judge(final, logger, partial_report_callback));
+			send_report(final, false, report);
+		}
+
+	} catch (const ConnectionLost&) {
+		throw;
+
+	} catch (const std::exception& e) {
+		ERRLOG_CATCH(e);
+		string payload;
+		jobs::append_dumped(payload, job.job_id);
+		jobs::append_dumped(payload, e.what());
+		conn.send(MessageType::JUDGE_ERROR, payload);
+	}
+}
+
+Config load_config(FilePath config_file) {
+	STACK_UNWINDING_MARK;
+
+	ConfigFile cf;
+	cf.add_vars("address", "token", "cache_dir", "cache_max_packages");
+	cf.load_config_from_file(config_file);
+
+	Config config;
+	config.address = cf["address"].as_string();
+	if (config.address.empty())
+		THROW(config_file, ": address has to be set");
+
+	config.token = cf["token"].as_string();
+	if (config.token.empty())
+		THROW(config_file, ": token has to be set");
+
+	config.cache_dir = cf["cache_dir"].as_string();
+	if (config.cache_dir.empty())
+		config.cache_dir = "judge-worker-cache/";
+	else if (config.cache_dir.back() != '/')
+		config.cache_dir += '/';
+
+	config.cache_max_packages =
+	   cf["cache_max_packages"].as<size_t>().value_or(64);
+	return config;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	if (argc > 2) {
+		help(argc > 0 ? argv[0] : nullptr);
+		return 1;
+	}
+
+	Config config;
+	try {
+		// The config file given as an argument is relative to the current
+		// working directory
+		if (argc == 2)
+			config = load_config(argv[1]);
+
+		// Sim's installation directory contains proot
+		chdir_relative_to_executable_dirpath("..");
+		if (argc == 1)
+			config = load_config("judge-worker.conf");
+
+		// cache_dir is relative to the Sim's installation directory
+		if (mkdir(config.cache_dir.c_str(), S_IRWXU) and errno != EEXIST)
+			THROW("mkdir(", config.cache_dir, ')', errmsg());
+
+	} catch (const std::exception& e) {
+		ERRLOG_CATCH(e);
+		return 1;
+	}
+
+	// Many judge workers may run on one machine, so the older instances are
+	// not terminated
+	for (;;) {
+		try {
+			JobServerConnection conn(config);
+			stdlog("Connected to the job server at ", config.address);
+			for (;;)
+				judge(conn, config, conn.await_job());
+
+		} catch (const std::exception& e) {
+			ERRLOG_CATCH(e);
+		}
+
+		// Reconnect after a while
+		std::this_thread::sleep_for(std::chrono::seconds(3));
+	}
+}
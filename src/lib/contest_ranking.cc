@@ -0,0 +1,159 @@
+#include <sim/contest_ranking.hh>
+
+namespace sim::contest_ranking {
+
+// Stamps the entry with the next version of its contest's ranking
+static void bump_entry_version(MySQL::Connection& mysql, uint64_t owner,
+                               uint64_t contest_problem_id) {
+	STACK_UNWINDING_MARK;
+	auto& stmts = MySQL::statements_cache(mysql);
+
+	// LAST_INSERT_ID(expr) makes the new version available for the next
+	// statement without a round trip
+	stmts
+	   .prepare("INSERT INTO contest_rankings (contest_id, version,"
+	            " reset_version) "
+	            "SELECT contest_id, LAST_INSERT_ID(1), 0 "
+	            "FROM contest_ranking_entries "
+	            "WHERE contest_problem_id=? AND owner=? "
+	            "ON DUPLICATE KEY UPDATE"
+	            " version=LAST_INSERT_ID(contest_rankings.version+1)")
+	   ->bind_and_execute(contest_problem_id, owner);
+
+	stmts
+	   .prepare("UPDATE contest_ranking_entries SET version=LAST_INSERT_ID() "
+	            "WHERE contest_problem_id=? AND owner=?")
+	   ->bind_and_execute(contest_problem_id, owner);
+}
+
+void update_entry(MySQL::Connection& mysql, uint64_t owner,
+                  uint64_t contest_problem_id, uint64_t final_id,
+                  uint64_t initial_final_id) {
+	STACK_UNWINDING_MARK;
+	auto& stmts = MySQL::statements_cache(mysql);
+
+	auto stmt = stmts.prepare(
+	   "INSERT INTO contest_ranking_entries (contest_problem_id, owner,"
+	   " contest_round_id, contest_id, final_id, final_full_status,"
+	   " final_score, initial_final_id, initial_final_status, version) "
+	   "SELECT sf.contest_problem_id, sf.owner, sf.contest_round_id,"
+	   " sf.contest_id, sf.id, sf.full_status, sf.score, si.id,"
+	   " si.initial_status, 0 "
+	   "FROM submissions sf JOIN submissions si ON si.id=? "
+	   "WHERE sf.id=? "
+	   "ON DUPLICATE KEY UPDATE final_id=VALUES(final_id),"
+	   " final_full_status=VALUES(final_full_status),"
+	   " final_score=VALUES(final_score),"
+	   " initial_final_id=VALUES(initial_final_id),"
+	   " initial_final_status=VALUES(initial_final_status)");
+	stmt->bind_and_execute(initial_final_id, final_id);
+	// Re-judging usually does not change the finals, then the readers do not
+	// need to know about it
+	if (stmt->affected_rows() == 0)
+		return;
+
+	bump_entry_version(mysql, owner, contest_problem_id);
+}
+
+void remove_entry(MySQL::Connection& mysql, uint64_t owner,
+                  uint64_t contest_problem_id) {
+	STACK_UNWINDING_MARK;
+	auto& stmts = MySQL::statements_cache(mysql);
+
+	auto stmt = stmts.prepare(
+	   "UPDATE contest_ranking_entries "
+	   "SET final_id=NULL, final_full_status=NULL, final_score=NULL,"
+	   " initial_final_id=NULL, initial_final_status=NULL "
+	   "WHERE contest_problem_id=? AND owner=? AND final_id IS NOT NULL");
+	stmt->bind_and_execute(contest_problem_id, owner);
+	if (stmt->affected_rows() == 0)
+		return; // There was no final submission
+
+	bump_entry_version(mysql, owner, contest_problem_id);
+}
+
+void invalidate(MySQL::Connection& mysql, uint64_t contest_id) {
+	STACK_UNWINDING_MARK;
+
+	mysql
+	   .prepare("INSERT INTO contest_rankings (contest_id, version,"
+	            " reset_version) "
+	            "VALUES(?, 1, 1) "
+	            "ON DUPLICATE KEY UPDATE reset_version=version+1,"
+	            " version=version+1")
+	   .bind_and_execute(contest_id);
+}
+
+void invalidate_user(MySQL::Connection& mysql, uint64_t user_id) {
+	STACK_UNWINDING_MARK;
+
+	mysql
+	   .prepare("INSERT INTO contest_rankings (contest_id, version,"
+	            " reset_version) "
+	            "SELECT DISTINCT contest_id, 1, 1 "
+	            "FROM contest_ranking_entries WHERE owner=? "
+	            "ON DUPLICATE KEY UPDATE"
+	            " reset_version=contest_rankings.version+1,"
+	            " version=contest_rankings.version+1")
+	   .bind_and_execute(user_id);
+}
+
+void rebuild_contest_problem(MySQL::Connection& mysql,
+                             uint64_t contest_problem_id) {
+	STACK_UNWINDING_MARK;
+
+	mysql
+	   .prepare("DELETE FROM contest_ranking_entries "
+	            "WHERE contest_problem_id=?")
+	   .bind_and_execute(contest_problem_id);
+	mysql
+	   .prepare("INSERT INTO contest_ranking_entries (contest_problem_id,"
+	            " owner, contest_round_id, contest_id, final_id,"
+	            " final_full_status, final_score, initial_final_id,"
+	            " initial_final_status, version) "
+	            "SELECT sf.contest_problem_id, sf.owner, sf.contest_round_id,"
+	            " sf.contest_id, sf.id, sf.full_status, sf.score, si.id,"
+	            " si.initial_status, 0 "
+	            "FROM submissions sf "
+	            "JOIN submissions si ON si.owner=sf.owner"
+	            " AND si.contest_problem_id=sf.contest_problem_id"
+	            " AND si.contest_initial_final=1 "
+	            "WHERE sf.contest_problem_id=? AND sf.contest_final=1")
+	   .bind_and_execute(contest_problem_id);
+	// The readers have to load the whole ranking, as the removed entries are
+	// gone
+	mysql
+	   .prepare("INSERT INTO contest_rankings (contest_id, version,"
+	            " reset_version) "
+	            "SELECT contest_id, 1, 1 FROM contest_problems WHERE id=? "
+	            "ON DUPLICATE KEY UPDATE"
+	            " reset_version=contest_rankings.version+1,"
+	            " version=contest_rankings.version+1")
+	   .bind_and_execute(contest_problem_id);
+}
+
+void rebuild(MySQL::Connection& mysql) {
+	STACK_UNWINDING_MARK;
+
+	mysql.update("DELETE FROM contest_ranking_entries");
+	mysql.update(
+	   "INSERT INTO contest_ranking_entries (contest_problem_id, owner,"
+	   " contest_round_id, contest_id, final_id, final_full_status,"
+	   " final_score, initial_final_id, initial_final_status, version) "
+	   "SELECT sf.contest_problem_id, sf.owner, sf.contest_round_id,"
+	   " sf.contest_id, sf.id, sf.full_status, sf.score, si.id,"
+	   " si.initial_status, 0 "
+	   "FROM submissions sf "
+	   "JOIN submissions si ON si.owner=sf.owner"
+	   " AND si.contest_problem_id=sf.contest_problem_id"
+	   " AND si.contest_initial_final=1 "
+	   "WHERE sf.contest_final=1");
+	mysql.update("INSERT INTO contest_rankings (contest_id, version,"
+	             " reset_version) "
+	             "SELECT id, 1, 1 FROM contests "
+	             "ON DUPLICATE KEY UPDATE"
+	             " reset_version=contest_rankings.version+1,"
+	             " version=contest_rankings.version+1");
+}
+
+} // namespace sim::contest_ranking
@@ -0,0 +1,64 @@
+#include <sim/judging.hh>
+#include <simlib/call_in_destructor.hh>
+
+namespace sim {
+
+JudgeReport judge_stopping_on_group_failure(
+   JudgeWorker& jworker, bool final, JudgeLogger& logger,
+   const std::function<void(const JudgeReport&)>& partial_report_callback) {
+	STACK_UNWINDING_MARK;
+
+	auto& tgroups = jworker.simfile().tgroups;
+	const auto all_tgroups = tgroups;
+	CallInDtor tgroups_restorer([&] { tgroups = all_tgroups; });
+
+	JudgeReport res;
+	for (auto& tgroup : all_tgroups) {
+		for (size_t i = 0; i < tgroup.tests.size(); ++i) {
+			tgroups = {tgroup};
+			tgroups[0].tests = {tgroup.tests[i]};
+			auto rep = jworker.judge(final, logger);
+			back_insert(res.judge_log, rep.judge_log);
+			if (rep.groups.empty())
+				break; // The group does not belong to this judging
+
+			auto& judged = rep.groups[0];
+			if (i == 0) {
+				auto& group = res.groups.emplace_back();
+				group.score = judged.score;
+				group.max_score = judged.max_score;
+				for (auto& test : tgroup.tests) {
+					group.tests.emplace_back(
+					   test.name, JudgeReport::Test::SKIPPED,
+					   std::chrono::nanoseconds(0), test.time_limit, 0,
+					   test.memory_limit, "");
+				}
+			}
+
+			// The score of a group is determined by its worst test
+			auto& group = res.groups.back();
+			group.score = (group.max_score >= 0
+			                  ? std::min(group.score, judged.score)
+			                  : std::max(group.score, judged.score));
+			group.tests[i] = judged.tests[0];
+
+			bool failed = (judged.tests[0].status != JudgeReport::Test::OK);
+			if (failed and i + 1 < tgroup.tests.size()) {
+				group.score = 0;
+				back_insert(res.judge_log, "Group of test ",
+				            tgroup.tests[0].name,
+				            " failed - its remaining tests were skipped\n");
+			}
+
+			if (partial_report_callback)
+				partial_report_callback(res);
+
+			if (failed)
+				break;
+		}
+	}
+
+	return res;
+}
+
+} // namespace sim
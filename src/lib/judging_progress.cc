@@ -0,0 +1,42 @@
+#include <sim/judging_progress.hh>
+
+namespace sim::judging_progress {
+
+size_t judged_groups(const JudgeReport& report) noexcept {
+	size_t res = 0;
+	for (auto&& group : report.groups) {
+		res += std::none_of(group.tests.begin(), group.tests.end(),
+		                    [](const JudgeReport::Test& test) {
+			                    return (test.status == JudgeReport::Test::SKIPPED);
+		                    });
+	}
+
+	return res;
+}
+
+void update(MySQL::Connection& mysql, uint64_t submission_id, bool final,
+            const JudgeReport& partial_report) {
+	STACK_UNWINDING_MARK;
+
+	// Selecting the submission skips the deleted ones
+	MySQL::statements_cache(mysql)
+	   .prepare("INSERT INTO submission_judging_progress (submission_id,"
+	            " final, record) "
+	            "SELECT id, ?, ? FROM submissions WHERE id=? "
+	            "ON DUPLICATE KEY UPDATE final=VALUES(final),"
+	            " record=VALUES(record)")
+	   ->bind_and_execute(
+	      final, submission_report::dump(partial_report, final, true),
+	      submission_id);
+}
+
+void clear(MySQL::Connection& mysql, uint64_t submission_id) {
+	STACK_UNWINDING_MARK;
+
+	MySQL::statements_cache(mysql)
+	   .prepare("DELETE FROM submission_judging_progress "
+	            "WHERE submission_id=?")
+	   ->bind_and_execute(submission_id);
+}
+
+} // namespace sim::judging_progress
@@ -1,4 +1,5 @@
 #include <sim/mysql.hh>
+#include <memory>
 #include <simlib/config_file.hh>
 
 namespace MySQL {
@@ -29,4 +30,28 @@ Connection make_conn_with_credential_file(FilePath filename) {
 	}
 }
 
+namespace {
+
+using StatementsCaches =
+   std::map<const Connection*, std::unique_ptr<StatementsCache>>;
+
+StatementsCaches& thread_statements_caches() {
+	thread_local StatementsCaches caches;
+	return caches;
+}
+
+} // anonymous namespace
+
+StatementsCache& statements_cache(Connection& conn) {
+	auto& cache = thread_statements_caches()[&conn];
+	if (not cache)
+		cache = std::make_unique<StatementsCache>(conn);
+
+	return *cache;
+}
+
+void drop_statements_cache(const Connection& conn) noexcept {
+	thread_statements_caches().erase(&conn);
+}
+
 } // namespace MySQL
@@ -0,0 +1,209 @@
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sim/remote_judge.hh>
+#include <sys/socket.h>
+
+using std::chrono::steady_clock;
+
+namespace remote_judge {
+
+namespace {
+
+// Returns false iff @p deadline passed before any byte was read
+bool read_exactly(int fd, char* buff, size_t len,
+                  steady_clock::time_point deadline, bool allow_timeout) {
+	STACK_UNWINDING_MARK;
+
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+
+	size_t pos = 0;
+	while (pos < len) {
+		auto now = steady_clock::now();
+		int timeout =
+		   (deadline < now ? 0
+		                   : duration_cast<milliseconds>(deadline - now).count());
+		pollfd pfd = {fd, POLLIN, 0};
+		int rc = poll(&pfd, 1, timeout);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+
+			throw ConnectionLost(concat_tostr("poll() failed", errmsg()));
+		}
+
+		if (rc == 0) {
+			if (allow_timeout and pos == 0)
+				return false;
+
+			throw ConnectionLost("Timed out while receiving a message");
+		}
+
+		ssize_t got = read(fd, buff + pos, len - pos);
+		if (got == 0)
+			throw ConnectionLost("Connection closed by the peer");
+
+		if (got < 0) {
+			if (errno == EINTR or errno == EAGAIN)
+				continue;
+
+			throw ConnectionLost(concat_tostr("read() failed", errmsg()));
+		}
+
+		pos += got;
+	}
+
+	return true;
+}
+
+} // anonymous namespace
+
+void send_message(int fd, MessageType type, StringView payload) {
+	STACK_UNWINDING_MARK;
+
+	if (payload.size() > MAX_MESSAGE_SIZE)
+		THROW("Message is too big: ", payload.size(), " bytes");
+
+	std::string frame;
+	frame.reserve(sizeof(uint32_t) + 1 + payload.size());
+	jobs::append_dumped<uint32_t>(frame, payload.size());
+	jobs::append_dumped(frame, static_cast<uint8_t>(type));
+	frame += payload;
+
+	size_t pos = 0;
+	while (pos < frame.size()) {
+		// MSG_NOSIGNAL: a disconnected peer must not kill us with SIGPIPE
+		ssize_t rc =
+		   send(fd, frame.data() + pos, frame.size() - pos, MSG_NOSIGNAL);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			throw ConnectionLost(concat_tostr("send() failed", errmsg()));
+		}
+
+		pos += rc;
+	}
+}
+
+std::optional<Message> receive_message(int fd,
+                                       std::chrono::milliseconds timeout) {
+	STACK_UNWINDING_MARK;
+
+	char header[sizeof(uint32_t) + 1];
+	if (not read_exactly(fd, header, sizeof(header),
+	                     steady_clock::now() + timeout, true)) {
+		return std::nullopt;
+	}
+
+	StringView hdr(header, sizeof(header));
+	auto size = jobs::extract_dumped_int<uint32_t>(hdr);
+	auto type = jobs::extract_dumped_int<uint8_t>(hdr);
+	if (size > MAX_MESSAGE_SIZE)
+		throw ConnectionLost(concat_tostr("Message is too big: ", size));
+
+	Message msg {MessageType(type), std::string(size, '\0')};
+	// The rest of the message should follow immediately
+	read_exactly(fd, msg.payload.data(), size,
+	             steady_clock::now() + LEASE_DURATION, false);
+	return msg;
+}
+
+bool tokens_equal(StringView received, StringView expected) noexcept {
+	unsigned char diff = (received.size() != expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		unsigned char c = (i < received.size() ? received[i] : 0);
+		diff |= c ^ static_cast<unsigned char>(expected[i]);
+	}
+
+	return diff == 0;
+}
+
+sockaddr_in parse_address(StringView address) {
+	STACK_UNWINDING_MARK;
+
+	sockaddr_in res;
+	memset(&res, 0, sizeof(res));
+	res.sin_family = AF_INET;
+
+	size_t colon_pos = address.rfind(':');
+	if (colon_pos == StringView::npos)
+		THROW("Address `", address, "` does not contain a port");
+
+	auto port = str2num<in_port_t>(address.substring(colon_pos + 1));
+	if (not port)
+		THROW("Invalid port number in address `", address, '`');
+
+	res.sin_port = htons(*port);
+
+	auto host = address.substring(0, colon_pos).to_string();
+	if (host == "*")
+		res.sin_addr.s_addr = htonl(INADDR_ANY);
+	else if (host.empty() or inet_aton(host.data(), &res.sin_addr) == 0)
+		THROW("Invalid IPv4 address in address `", address, '`');
+
+	return res;
+}
+
+void append_dumped(std::string& buff, const sim::JudgeReport& report) {
+	STACK_UNWINDING_MARK;
+	using jobs::append_dumped;
+
+	append_dumped(buff, report.judge_log);
+	append_dumped<uint32_t>(buff, report.groups.size());
+	for (auto&& group : report.groups) {
+		append_dumped(buff, group.score);
+		append_dumped(buff, group.max_score);
+		append_dumped<uint32_t>(buff, group.tests.size());
+		for (auto&& test : group.tests) {
+			append_dumped(buff, test.name);
+			append_dumped(
+			   buff,
+			   static_cast<std::underlying_type_t<decltype(test.status)>>(
+			      test.status));
+			append_dumped(buff, test.runtime);
+			append_dumped(buff, test.time_limit);
+			append_dumped(buff, test.memory_consumed);
+			append_dumped(buff, test.memory_limit);
+			append_dumped(buff, test.comment);
+		}
+	}
+}
+
+void extract_dumped(sim::JudgeReport& report, StringView& dumped_str) {
+	STACK_UNWINDING_MARK;
+	using jobs::extract_dumped;
+	using Test = sim::JudgeReport::Test;
+
+	report.judge_log = jobs::extract_dumped_string(dumped_str);
+	report.groups.clear();
+	uint32_t groups_no;
+	extract_dumped(groups_no, dumped_str);
+	for (uint32_t i = 0; i < groups_no; ++i) {
+		auto& group = report.groups.emplace_back();
+		extract_dumped(group.score, dumped_str);
+		extract_dumped(group.max_score, dumped_str);
+		uint32_t tests_no;
+		extract_dumped(tests_no, dumped_str);
+		for (uint32_t j = 0; j < tests_no; ++j) {
+			auto name = jobs::extract_dumped_string(dumped_str);
+			std::underlying_type_t<Test::Status> status;
+			extract_dumped(status, dumped_str);
+			decltype(Test::runtime) runtime;
+			extract_dumped(runtime, dumped_str);
+			decltype(Test::time_limit) time_limit;
+			extract_dumped(time_limit, dumped_str);
+			decltype(Test::memory_consumed) memory_consumed;
+			extract_dumped(memory_consumed, dumped_str);
+			decltype(Test::memory_limit) memory_limit;
+			extract_dumped(memory_limit, dumped_str);
+			auto comment = jobs::extract_dumped_string(dumped_str);
+
+			group.tests.emplace_back(std::move(name), Test::Status(status),
+			                         runtime, time_limit, memory_consumed,
+			                         memory_limit, std::move(comment));
+		}
+	}
+}
+
+} // namespace remote_judge
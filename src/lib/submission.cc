@@ -1,242 +1,344 @@
 #include <sim/constants.hh>
 #include <sim/contest_problem.hh>
+#include <sim/contest_ranking.hh>
+#include <sim/mysql.hh>
 #include <sim/submission.hh>
 #include <simlib/time.hh>
 
+#include <map>
+
 using sim::ContestProblem;
 
-static void update_problem_final(MySQL::Connection& mysql,
-                                 uint64_t submission_owner,
-                                 uint64_t problem_id) {
+namespace {
+
+// A submission of the owner that belongs to the problem or the contest
+// problem whose finals are being selected
+struct OwnersSubmission {
+	uint64_t problem_id;
+	std::optional<uint64_t> contest_problem_id;
+	bool final_candidate;
+	bool problem_final;
+	bool contest_final;
+	bool contest_initial_final;
+	submission::FinalCandidate candidate;
+};
+
+// The final submission has the highest score, then the best full status, then
+// it is the latest one
+bool is_better_final(const submission::FinalCandidate& a,
+                     const submission::FinalCandidate& b) noexcept {
+	if (a.score != b.score)
+		return a.score > b.score;
+	if (a.full_status != b.full_status)
+		return a.full_status < b.full_status;
+	return a.id > b.id;
+}
+
+// Before the full results, the submission with the best initial status is
+// shown, then the latest one
+bool is_better_initial_final(const submission::FinalCandidate& a,
+                             const submission::FinalCandidate& b) noexcept {
+	if (a.initial_status != b.initial_status)
+		return a.initial_status < b.initial_status;
+	return a.id > b.id;
+}
+
+// Selects the finals of @p submission_owner in memory from all of their
+// submissions to the problem and the contest problem, which are read in one
+// query, and writes only the flags that changed
+void update_finals(MySQL::Connection& mysql, uint64_t submission_owner,
+                   uint64_t problem_id,
+                   std::optional<uint64_t> contest_problem_id) {
 	STACK_UNWINDING_MARK;
+	auto& stmts = MySQL::statements_cache(mysql);
 
-	// Such index: (final_candidate, owner, problem_id, score DESC, full_status,
-	// id DESC) is what we need, but MySQL does not support it, so the below
-	// workaround is used to select the final submission efficiently
-	auto stmt = mysql.prepare("SELECT score FROM submissions USE INDEX(final3) "
-	                          "WHERE final_candidate=1 AND owner=?"
-	                          " AND problem_id=? "
-	                          "ORDER BY score DESC LIMIT 1");
-	stmt.bind_and_execute(submission_owner, problem_id);
-
-	int64_t final_score;
-	stmt.res_bind_all(final_score);
-	if (not stmt.next()) {
-		// Unset final submissions if there are any because there are no
-		// candidates now
-		mysql
-		   .prepare("UPDATE submissions SET problem_final=0 "
-		            "WHERE owner=? AND problem_id=? AND problem_final=1")
-		   .bind_and_execute(submission_owner, problem_id);
-		return; // Nothing more to be done
+	// Get the final selecting method and whether the score is revealed
+	decltype(ContestProblem::final_selecting_method) final_selecting_method;
+	decltype(ContestProblem::score_revealing) score_revealing;
+	if (contest_problem_id.has_value()) {
+		auto stmt = stmts.prepare("SELECT final_selecting_method,"
+		                          " score_revealing "
+		                          "FROM contest_problems WHERE id=?");
+		stmt->bind_and_execute(contest_problem_id);
+		stmt->res_bind_all(final_selecting_method, score_revealing);
+		if (not stmt->next()) {
+			// Such contest problem does not exist (probably had just been
+			// deleted)
+			contest_problem_id = std::nullopt;
+		}
 	}
 
+	// Both indexes (owner, problem_id, id) and (owner, contest_problem_id, id)
+	// are used here
+	auto stmt = stmts.prepare(
+	   "SELECT id, problem_id, contest_problem_id, final_candidate,"
+	   " problem_final, contest_final, contest_initial_final, score,"
+	   " initial_status, full_status "
+	   "FROM submissions "
+	   "WHERE owner=? AND (problem_id=? OR contest_problem_id=?)");
+	stmt->bind_and_execute(submission_owner, problem_id, contest_problem_id);
+
+	uint64_t id;
+	uint64_t s_problem_id;
+	MySQL::Optional<uint64_t> s_contest_problem_id;
+	bool final_candidate;
+	bool problem_final;
+	bool contest_final;
+	bool contest_initial_final;
+	MySQL::Optional<int64_t> score;
+	EnumVal<SubmissionStatus> initial_status;
 	EnumVal<SubmissionStatus> full_status;
-	stmt = mysql.prepare("SELECT full_status "
-	                     "FROM submissions USE INDEX(final3) "
-	                     "WHERE final_candidate=1 AND owner=? AND problem_id=?"
-	                     " AND score=? "
-	                     "ORDER BY full_status LIMIT 1");
-	stmt.bind_and_execute(submission_owner, problem_id, final_score);
-	stmt.res_bind_all(full_status);
-	throw_assert(stmt.next()); // Previous query succeeded, so this has to
-
-	// Choose the new final submission
-	stmt = mysql.prepare("SELECT id FROM submissions USE INDEX(final3) "
-	                     "WHERE final_candidate=1 AND owner=? AND problem_id=?"
-	                     " AND score=? AND full_status=? "
-	                     "ORDER BY id DESC LIMIT 1");
-	stmt.bind_and_execute(submission_owner, problem_id, final_score,
-	                      full_status);
-
-	uint64_t new_final_id;
-	stmt.res_bind_all(new_final_id);
-	throw_assert(stmt.next()); // Previous query succeeded, so this has to
-
-	// Update finals
-	mysql
-	   .prepare("UPDATE submissions SET problem_final=IF(id=?, 1, 0) "
-	            "WHERE owner=? AND problem_id=? AND (problem_final=1 OR id=?)")
-	   .bind_and_execute(new_final_id, submission_owner, problem_id,
-	                     new_final_id);
+	stmt->res_bind_all(id, s_problem_id, s_contest_problem_id,
+	                   final_candidate, problem_final, contest_final,
+	                   contest_initial_final, score, initial_status,
+	                   full_status);
+
+	std::vector<OwnersSubmission> submissions;
+	std::vector<submission::FinalCandidate> problem_candidates;
+	std::vector<submission::FinalCandidate> contest_candidates;
+	while (stmt->next()) {
+		submission::FinalCandidate candidate {id, score.value_or(0),
+		                                      initial_status, full_status};
+		auto& s = submissions.emplace_back(OwnersSubmission {
+		   s_problem_id, std::nullopt, final_candidate, problem_final,
+		   contest_final, contest_initial_final, candidate});
+		if (s_contest_problem_id.has_value())
+			s.contest_problem_id = s_contest_problem_id.value();
+
+		if (not final_candidate)
+			continue;
+
+		if (s.problem_id == problem_id)
+			problem_candidates.emplace_back(candidate);
+		if (contest_problem_id.has_value() and
+		    s.contest_problem_id == contest_problem_id) {
+			contest_candidates.emplace_back(candidate);
+		}
+	}
+
+	auto new_problem_final =
+	   submission::select_problem_final(problem_candidates);
+	std::optional<submission::ContestFinals> new_contest_finals;
+	if (contest_problem_id.has_value()) {
+		new_contest_finals = submission::select_contest_finals(
+		   contest_candidates, final_selecting_method, score_revealing);
+	}
+
+	// Usually at most a few submissions change their flags
+	for (auto& s : submissions) {
+		bool new_problem_final_flag = s.problem_final;
+		if (s.problem_id == problem_id)
+			new_problem_final_flag = (s.candidate.id == new_problem_final);
+
+		bool new_contest_final_flag = s.contest_final;
+		bool new_contest_initial_final_flag = s.contest_initial_final;
+		if (contest_problem_id.has_value() and
+		    s.contest_problem_id == contest_problem_id) {
+			new_contest_final_flag =
+			   (new_contest_finals and
+			    s.candidate.id == new_contest_finals->final_id);
+			new_contest_initial_final_flag =
+			   (new_contest_finals and
+			    s.candidate.id == new_contest_finals->initial_final_id);
+		}
+
+		if (new_problem_final_flag != s.problem_final or
+		    new_contest_final_flag != s.contest_final or
+		    new_contest_initial_final_flag != s.contest_initial_final) {
+			stmts
+			   .prepare("UPDATE submissions "
+			            "SET problem_final=?, contest_final=?,"
+			            " contest_initial_final=? "
+			            "WHERE id=?")
+			   ->bind_and_execute(new_problem_final_flag,
+			                      new_contest_final_flag,
+			                      new_contest_initial_final_flag,
+			                      s.candidate.id);
+		}
+	}
+
+	if (not contest_problem_id.has_value())
+		return;
+
+	if (new_contest_finals) {
+		sim::contest_ranking::update_entry(
+		   mysql, submission_owner, *contest_problem_id,
+		   new_contest_finals->final_id, new_contest_finals->initial_final_id);
+	} else {
+		sim::contest_ranking::remove_entry(mysql, submission_owner,
+		                                   *contest_problem_id);
+	}
 }
 
-static void update_contest_final(MySQL::Connection& mysql,
-                                 uint64_t submission_owner,
-                                 uint64_t contest_problem_id) {
-	// TODO: update the initial_final if the submission is half-judged (only
-	// initial_status is set and final selecting method does not show points)
+// A submission read by the bulk reselection
+struct BulkSubmission {
+	bool final_candidate;
+	bool final; // problem_final or contest_final
+	bool initial_final; // contest_initial_final
+	submission::FinalCandidate candidate;
+};
+
+// Reads the rows (id, owner, final_candidate, final, initial_final, score,
+// initial_status, full_status) of the executed @p stmt grouped by owner
+template <class Statement>
+std::map<uint64_t, std::vector<BulkSubmission>>
+read_bulk_submissions(Statement& stmt) {
+	uint64_t id;
+	uint64_t owner;
+	bool final_candidate;
+	bool final;
+	bool initial_final;
+	MySQL::Optional<int64_t> score;
+	EnumVal<SubmissionStatus> initial_status;
+	EnumVal<SubmissionStatus> full_status;
+	stmt.res_bind_all(id, owner, final_candidate, final, initial_final, score,
+	                  initial_status, full_status);
+
+	std::map<uint64_t, std::vector<BulkSubmission>> owners;
+	while (stmt.next()) {
+		owners[owner].emplace_back(BulkSubmission {
+		   final_candidate, final, initial_final,
+		   {id, score.value_or(0), initial_status, full_status}});
+	}
+
+	return owners;
+}
+
+constexpr size_t FLAG_CHANGES_BATCH_SIZE = 1000;
+
+// Locks, in the order of ids, the first submission to the problem of every
+// owner - the rows that update_final_lock() locks. The other submissions stay
+// unlocked, so e.g. judging them is not blocked.
+void lock_problem_submissions(MySQL::Connection& mysql, uint64_t problem_id) {
 	STACK_UNWINDING_MARK;
 
-	// Get the final selecting method and whether the score is revealed
-	auto stmt = mysql.prepare("SELECT final_selecting_method, score_revealing "
-	                          "FROM contest_problems WHERE id=?");
-	stmt.bind_and_execute(contest_problem_id);
+	auto stmt = mysql.prepare("SELECT MIN(id) FROM submissions "
+	                          "WHERE problem_id=? AND owner IS NOT NULL "
+	                          "GROUP BY owner ORDER BY MIN(id)");
+	stmt.bind_and_execute(problem_id);
+	uint64_t id;
+	stmt.res_bind_all(id);
+	std::vector<uint64_t> ids;
+	while (stmt.next())
+		ids.emplace_back(id);
+
+	for (size_t beg = 0; beg < ids.size(); beg += FLAG_CHANGES_BATCH_SIZE) {
+		size_t end = std::min(beg + FLAG_CHANGES_BATCH_SIZE, ids.size());
+		// The ids are numbers, so they can be put directly into the query
+		InplaceBuff<1 << 14> query;
+		query.append("UPDATE submissions SET id=id WHERE id IN (", ids[beg]);
+		for (size_t i = beg + 1; i < end; ++i)
+			query.append(',', ids[i]);
+		query.append(") ORDER BY id");
+		mysql.update(query);
+	}
+}
 
-	decltype(ContestProblem::final_selecting_method) final_selecting_method;
-	decltype(ContestProblem::score_revealing) score_revealing;
-	stmt.res_bind_all(final_selecting_method, score_revealing);
-	if (not stmt.next())
-		return; // Such contest problem does not exist (probably had just
-		        // been deleted)
-
-	auto unset_all_finals = [&] {
-		// Unset final submissions if there are any because there are no
-		// candidates now
-		mysql
-		   .prepare("UPDATE submissions "
-		            "SET contest_final=0, contest_initial_final=0 "
-		            "WHERE owner=? AND contest_problem_id=?"
-		            " AND (contest_final=1 OR contest_initial_final=1)")
-		   .bind_and_execute(submission_owner, contest_problem_id);
-	};
+// The submissions whose flag @p column has to be set to @p value
+struct FlagChange {
+	const char* column;
+	bool value;
+	std::vector<uint64_t> ids = {};
+};
+
+void apply_flag_changes(MySQL::Connection& mysql,
+                        const std::vector<FlagChange>& changes,
+                        const submission::BulkReselectionProgress& progress) {
+	STACK_UNWINDING_MARK;
+
+	uint64_t total = 0;
+	for (auto& change : changes)
+		total += change.ids.size();
+
+	uint64_t done = 0;
+	for (auto& change : changes) {
+		for (size_t beg = 0; beg < change.ids.size();
+		     beg += FLAG_CHANGES_BATCH_SIZE) {
+			size_t end =
+			   std::min(beg + FLAG_CHANGES_BATCH_SIZE, change.ids.size());
+			// The ids are numbers, so they can be put directly into the query
+			InplaceBuff<1 << 14> query;
+			query.append("UPDATE submissions SET ", change.column, '=',
+			             (change.value ? '1' : '0'), " WHERE id IN (",
+			             change.ids[beg]);
+			for (size_t i = beg + 1; i < end; ++i)
+				query.append(',', change.ids[i]);
+			query.append(')');
+			mysql.update(query);
+
+			done += end - beg;
+			if (progress)
+				progress(done, total);
+		}
+	}
+}
+
+} // anonymous namespace
+
+namespace submission {
+
+std::optional<uint64_t>
+select_problem_final(const std::vector<FinalCandidate>& candidates) noexcept {
+	const FinalCandidate* best = nullptr;
+	for (auto& candidate : candidates) {
+		if (not best or is_better_final(candidate, *best))
+			best = &candidate;
+	}
+
+	if (not best)
+		return std::nullopt;
+
+	return best->id;
+}
+
+std::optional<ContestFinals> select_contest_finals(
+   const std::vector<FinalCandidate>& candidates,
+   ContestProblem::FinalSubmissionSelectingMethod final_selecting_method,
+   ContestProblem::ScoreRevealingMode score_revealing) noexcept {
+	if (candidates.empty())
+		return std::nullopt;
 
-	uint64_t new_final_id, new_initial_final_id;
 	using FSSM = ContestProblem::FinalSubmissionSelectingMethod;
 	switch (final_selecting_method) {
 	case FSSM::LAST_COMPILING: {
-		// Choose the new final submission
-		stmt = mysql.prepare("SELECT id FROM submissions USE INDEX(final1) "
-		                     "WHERE owner=? AND contest_problem_id=?"
-		                     " AND final_candidate=1 "
-		                     "ORDER BY id DESC LIMIT 1");
-		stmt.bind_and_execute(submission_owner, contest_problem_id);
-		stmt.res_bind_all(new_final_id);
-		if (not stmt.next()) // Nothing to do (no submission that may be final)
-			return unset_all_finals();
-
-		new_initial_final_id = new_final_id;
-		break;
+		uint64_t last_id = 0;
+		for (auto& candidate : candidates)
+			last_id = std::max(last_id, candidate.id);
+
+		return ContestFinals {last_id, last_id};
 	}
-	case FSSM::WITH_HIGHEST_SCORE: {
-		// Such index: (final_candidate, owner, contest_problem_id, score DESC,
-		// full_status, id DESC) is what we need, but MySQL does not support it,
-		// so the below workaround is used to select the final submission
-		// efficiently
-		int64_t final_score;
-		stmt = mysql.prepare("SELECT score FROM submissions USE INDEX(final2) "
-		                     "WHERE final_candidate=1 AND owner=?"
-		                     " AND contest_problem_id=? "
-		                     "ORDER BY score DESC LIMIT 1");
-		stmt.bind_and_execute(submission_owner, contest_problem_id);
-		stmt.res_bind_all(final_score);
-		if (not stmt.next()) // Nothing to do (no submission that may be final)
-			return unset_all_finals();
-
-		EnumVal<SubmissionStatus> full_status;
-		stmt = mysql.prepare("SELECT full_status "
-		                     "FROM submissions USE INDEX(final2) "
-		                     "WHERE final_candidate=1 AND owner=?"
-		                     " AND contest_problem_id=? AND score=? "
-		                     "ORDER BY full_status LIMIT 1");
-		stmt.bind_and_execute(submission_owner, contest_problem_id,
-		                      final_score);
-		stmt.res_bind_all(full_status);
-		throw_assert(stmt.next()); // Previous query succeeded, so this has to
-
-		// Choose the new final submission
-		stmt = mysql.prepare("SELECT id FROM submissions USE INDEX(final2) "
-		                     "WHERE final_candidate=1 AND owner=?"
-		                     " AND contest_problem_id=? AND score=?"
-		                     " AND full_status=? "
-		                     "ORDER BY id DESC LIMIT 1");
-		stmt.bind_and_execute(submission_owner, contest_problem_id, final_score,
-		                      full_status);
-		stmt.res_bind_all(new_final_id);
-		throw_assert(stmt.next()); // Previous query succeeded, so this has to
-
-		// Choose the new initial final submission
-		switch (score_revealing) {
-		case ContestProblem::ScoreRevealingMode::NONE: {
-			// Such index: (final_candidate, owner, contest_problem_id,
-			// initial_status, id DESC) is what we need, but MySQL does not
-			// support it, so the below workaround is used to select the initial
-			// final submission efficiently
-			EnumVal<SubmissionStatus> initial_status;
-			stmt = mysql.prepare("SELECT initial_status "
-			                     "FROM submissions USE INDEX(initial_final2) "
-			                     "WHERE final_candidate=1 AND owner=?"
-			                     " AND contest_problem_id=? "
-			                     "ORDER BY initial_status LIMIT 1");
-			stmt.bind_and_execute(submission_owner, contest_problem_id);
-			stmt.res_bind_all(initial_status);
-			throw_assert(
-			   stmt.next()); // Previous query succeeded, so this has to
-
-			stmt = mysql.prepare("SELECT id "
-			                     "FROM submissions USE INDEX(initial_final2) "
-			                     "WHERE final_candidate=1 AND owner=?"
-			                     " AND contest_problem_id=?"
-			                     " AND initial_status=? "
-			                     "ORDER BY id DESC LIMIT 1");
-			stmt.bind_and_execute(submission_owner, contest_problem_id,
-			                      initial_status);
-			stmt.res_bind_all(new_initial_final_id);
-			throw_assert(
-			   stmt.next()); // Previous query succeeded, so this has to
-			break;
-		}
 
-		case ContestProblem::ScoreRevealingMode::ONLY_SCORE: {
-			// Such index: (final_candidate, owner, contest_problem_id,
-			// score DESC, initial_status, id DESC) is what we need, but MySQL
-			// does not support it, so the below workaround is used to select
-			// the initial final submission efficiently
-			EnumVal<SubmissionStatus> initial_status;
-			stmt = mysql.prepare("SELECT initial_status "
-			                     "FROM submissions USE INDEX(initial_final3) "
-			                     "WHERE final_candidate=1 AND owner=?"
-			                     " AND contest_problem_id=? AND score=? "
-			                     "ORDER BY initial_status LIMIT 1");
-			stmt.bind_and_execute(submission_owner, contest_problem_id,
-			                      final_score);
-			stmt.res_bind_all(initial_status);
-			throw_assert(
-			   stmt.next()); // Previous query succeeded, so this has to
-
-			stmt = mysql.prepare("SELECT id "
-			                     "FROM submissions USE INDEX(initial_final3) "
-			                     "WHERE final_candidate=1 AND owner=?"
-			                     " AND contest_problem_id=? AND score=?"
-			                     " AND initial_status=? "
-			                     "ORDER BY id DESC LIMIT 1");
-			stmt.bind_and_execute(submission_owner, contest_problem_id,
-			                      final_score, initial_status);
-			stmt.res_bind_all(new_initial_final_id);
-			throw_assert(
-			   stmt.next()); // Previous query succeeded, so this has to
-			break;
-		}
+	case FSSM::WITH_HIGHEST_SCORE: break;
+	}
 
-		case ContestProblem::ScoreRevealingMode::SCORE_AND_FULL_STATUS: {
-			new_initial_final_id = new_final_id;
-			break;
-		}
+	const FinalCandidate* final = &candidates.front();
+	for (auto& candidate : candidates) {
+		if (is_better_final(candidate, *final))
+			final = &candidate;
+	}
+
+	using SRM = ContestProblem::ScoreRevealingMode;
+	if (score_revealing == SRM::SCORE_AND_FULL_STATUS)
+		return ContestFinals {final->id, final->id};
+
+	// Only the score (if revealed) and the initial status are known before the
+	// full results
+	const FinalCandidate* initial_final = nullptr;
+	for (auto& candidate : candidates) {
+		if (score_revealing == SRM::ONLY_SCORE and
+		    candidate.score != final->score) {
+			continue;
 		}
 
-		break;
-	}
+		if (not initial_final or
+		    is_better_initial_final(candidate, *initial_final)) {
+			initial_final = &candidate;
+		}
 	}
 
-	// Update finals
-	mysql
-	   .prepare("UPDATE submissions SET contest_final=IF(id=?, 1, 0) "
-	            "WHERE id=?"
-	            " OR (owner=? AND contest_problem_id=? AND contest_final=1)")
-	   .bind_and_execute(new_final_id, new_final_id, submission_owner,
-	                     contest_problem_id);
-
-	// Update initial finals
-	mysql
-	   .prepare("UPDATE submissions SET contest_initial_final=IF(id=?, 1, 0) "
-	            "WHERE id=? OR (owner=? AND contest_problem_id=?"
-	            " AND contest_initial_final=1)")
-	   .bind_and_execute(new_initial_final_id, new_initial_final_id,
-	                     submission_owner, contest_problem_id);
+	return ContestFinals {final->id, initial_final->id};
 }
 
-namespace submission {
-
 void update_final_lock(MySQL::Connection& mysql,
                        std::optional<uint64_t> submission_owner,
                        uint64_t problem_id) {
@@ -244,10 +346,10 @@ void update_final_lock(MySQL::Connection& mysql,
 		return; // update_final on System submission is no-op
 
 	// This acts as a lock that serializes updating finals
-	mysql
+	MySQL::statements_cache(mysql)
 	   .prepare("UPDATE submissions SET id=id "
 	            "WHERE owner=? AND problem_id=? ORDER BY id LIMIT 1")
-	   .bind_and_execute(submission_owner, problem_id);
+	   ->bind_and_execute(submission_owner, problem_id);
 }
 
 void update_final(MySQL::Connection& mysql,
@@ -260,10 +362,8 @@ void update_final(MySQL::Connection& mysql,
 		return; // Nothing to do with System submission
 
 	auto impl = [&] {
-		update_problem_final(mysql, submission_owner.value(), problem_id);
-		if (contest_problem_id.has_value())
-			update_contest_final(mysql, submission_owner.value(),
-			                     contest_problem_id.value());
+		update_finals(mysql, submission_owner.value(), problem_id,
+		              contest_problem_id);
 	};
 
 	if (make_transaction) {
@@ -276,4 +376,118 @@ void update_final(MySQL::Connection& mysql,
 	}
 }
 
+BulkReselectionStats
+reselect_problem_finals(MySQL::Connection& mysql, uint64_t problem_id,
+                        const BulkReselectionProgress& progress) {
+	STACK_UNWINDING_MARK;
+
+	lock_problem_submissions(mysql, problem_id);
+
+	// System submissions (without owner) have no finals
+	auto stmt = mysql.prepare(
+	   "SELECT id, owner, final_candidate, problem_final, 0, score,"
+	   " initial_status, full_status "
+	   "FROM submissions WHERE problem_id=? AND owner IS NOT NULL "
+	   "ORDER BY id");
+	stmt.bind_and_execute(problem_id);
+	auto owners = read_bulk_submissions(stmt);
+
+	BulkReselectionStats stats;
+	stats.owners = owners.size();
+	std::vector<FlagChange> changes = {
+	   {"problem_final", false},
+	   {"problem_final", true},
+	};
+	std::vector<FinalCandidate> candidates;
+	for (auto& [owner, submissions] : owners) {
+		candidates.clear();
+		for (auto& s : submissions) {
+			if (s.final_candidate)
+				candidates.emplace_back(s.candidate);
+		}
+
+		auto final_id = select_problem_final(candidates);
+		for (auto& s : submissions) {
+			bool final = (s.candidate.id == final_id);
+			if (final != s.final) {
+				changes[final].ids.emplace_back(s.candidate.id);
+				++stats.changed_submissions;
+			}
+		}
+	}
+
+	apply_flag_changes(mysql, changes, progress);
+	return stats;
+}
+
+BulkReselectionStats
+reselect_contest_finals(MySQL::Connection& mysql, uint64_t contest_problem_id,
+                        const BulkReselectionProgress& progress) {
+	STACK_UNWINDING_MARK;
+
+	uint64_t problem_id;
+	decltype(ContestProblem::final_selecting_method) final_selecting_method;
+	decltype(ContestProblem::score_revealing) score_revealing;
+	{
+		auto stmt = mysql.prepare("SELECT problem_id, final_selecting_method,"
+		                          " score_revealing "
+		                          "FROM contest_problems WHERE id=?");
+		stmt.bind_and_execute(contest_problem_id);
+		stmt.res_bind_all(problem_id, final_selecting_method, score_revealing);
+		if (not stmt.next())
+			return {}; // Such contest problem does not exist
+	}
+
+	// update_final_lock() locks the first submission of the owner to the
+	// problem, which need not be in the contest problem
+	lock_problem_submissions(mysql, problem_id);
+
+	auto stmt = mysql.prepare(
+	   "SELECT id, owner, final_candidate, contest_final,"
+	   " contest_initial_final, score, initial_status, full_status "
+	   "FROM submissions WHERE contest_problem_id=? AND owner IS NOT NULL "
+	   "ORDER BY id");
+	stmt.bind_and_execute(contest_problem_id);
+	auto owners = read_bulk_submissions(stmt);
+
+	BulkReselectionStats stats;
+	stats.owners = owners.size();
+	std::vector<FlagChange> changes = {
+	   {"contest_final", false},
+	   {"contest_final", true},
+	   {"contest_initial_final", false},
+	   {"contest_initial_final", true},
+	};
+	std::vector<FinalCandidate> candidates;
+	for (auto& [owner, submissions] : owners) {
+		candidates.clear();
+		for (auto& s : submissions) {
+			if (s.final_candidate)
+				candidates.emplace_back(s.candidate);
+		}
+
+		auto finals = select_contest_finals(candidates, final_selecting_method,
+		                                    score_revealing);
+		for (auto& s : submissions) {
+			bool final = (finals and s.candidate.id == finals->final_id);
+			bool initial_final =
+			   (finals and s.candidate.id == finals->initial_final_id);
+			if (final != s.final)
+				changes[final].ids.emplace_back(s.candidate.id);
+			if (initial_final != s.initial_final)
+				changes[2 + initial_final].ids.emplace_back(s.candidate.id);
+			if (final != s.final or initial_final != s.initial_final)
+				++stats.changed_submissions;
+		}
+	}
+
+	apply_flag_changes(mysql, changes, progress);
+	if (stats.changed_submissions > 0) {
+		sim::contest_ranking::rebuild_contest_problem(mysql,
+		                                              contest_problem_id);
+	}
+
+	return stats;
+}
+
 } // namespace submission
@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <map>
+#include <sim/submission_report.hh>
+#include <simlib/string_transform.hh>
+#include <simlib/time.hh>
+
+using sim::JudgeReport;
+using std::optional;
+using std::string;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+namespace sim::submission_report {
+
+string dump(const JudgeReport& report, bool final, bool partial) {
+	STACK_UNWINDING_MARK;
+	using jobs::append_dumped;
+
+	string res = MAGIC.to_string();
+	append_dumped<uint8_t>(res, (final ? FINAL : 0) | (partial ? PARTIAL : 0));
+
+	append_dumped<uint32_t>(res, report.groups.size());
+	for (auto&& group : report.groups) {
+		append_dumped<int64_t>(res, group.score);
+		append_dumped<int64_t>(res, group.max_score);
+		append_dumped<uint32_t>(res, group.tests.size());
+	}
+
+	auto for_each_test = [&](auto&& func) {
+		for (auto&& group : report.groups)
+			for (auto&& test : group.tests)
+				func(test);
+	};
+
+	for_each_test([&](auto&& test) { append_dumped(res, test.name); });
+	for_each_test(
+	   [&](auto&& test) { append_dumped<uint8_t>(res, test.status); });
+	for_each_test([&](auto&& test) {
+		append_dumped<uint32_t>(
+		   res, duration_cast<milliseconds>(test.runtime).count());
+	});
+	for_each_test([&](auto&& test) {
+		append_dumped<uint32_t>(
+		   res, duration_cast<milliseconds>(test.time_limit).count());
+	});
+	for_each_test([&](auto&& test) {
+		append_dumped<uint32_t>(res, test.memory_consumed >> 10);
+	});
+	for_each_test([&](auto&& test) {
+		append_dumped<uint32_t>(res, test.memory_limit >> 10);
+	});
+
+	// Most of the tests share the same few comments (usually the empty one)
+	std::map<StringView, uint32_t> comment_idx;
+	std::vector<StringView> comments;
+	string indexes;
+	for_each_test([&](auto&& test) {
+		auto [it, inserted] =
+		   comment_idx.emplace(test.comment, comments.size());
+		if (inserted)
+			comments.emplace_back(test.comment);
+
+		append_dumped<uint32_t>(indexes, it->second);
+	});
+
+	append_dumped<uint32_t>(res, comments.size());
+	for (auto comment : comments)
+		append_dumped(res, comment);
+
+	return res += indexes;
+}
+
+string dump_compilation_errors(StringView errors) {
+	STACK_UNWINDING_MARK;
+
+	string res = MAGIC.to_string();
+	jobs::append_dumped<uint8_t>(res, COMPILATION_ERRORS);
+	jobs::append_dumped(res, errors);
+	return res;
+}
+
+Report extract(StringView record) {
+	STACK_UNWINDING_MARK;
+	using jobs::extract_dumped_int;
+	using jobs::extract_dumped_string;
+	using Test = JudgeReport::Test;
+
+	throw_assert(is_dumped(record));
+	record.remove_prefix(MAGIC.size());
+
+	Report report;
+	auto flags = extract_dumped_int<uint8_t>(record);
+	report.final = (flags & FINAL);
+	report.partial = (flags & PARTIAL);
+	if (flags & COMPILATION_ERRORS) {
+		report.compilation_errors = extract_dumped_string(record);
+		return report;
+	}
+
+	auto& groups = report.judge_report.groups;
+	std::vector<uint32_t> tests_nos;
+	size_t tests_no = 0;
+	groups.resize(extract_dumped_int<uint32_t>(record));
+	for (auto& group : groups) {
+		group.score = extract_dumped_int<int64_t>(record);
+		group.max_score = extract_dumped_int<int64_t>(record);
+		tests_no +=
+		   tests_nos.emplace_back(extract_dumped_int<uint32_t>(record));
+	}
+
+	// Every column has a fixed size apart from the names and the comments
+	std::vector<string> names(tests_no);
+	for (auto& name : names)
+		name = extract_dumped_string(record);
+
+	throw_assert(record.size() >= tests_no * 17);
+	auto column = [&](size_t field_size) {
+		auto res = record;
+		record.remove_prefix(tests_no * field_size);
+		return res;
+	};
+	StringView statuses = column(1);
+	StringView runtimes = column(4);
+	StringView time_limits = column(4);
+	StringView memory = column(4);
+	StringView memory_limits = column(4);
+
+	std::vector<string> comments(extract_dumped_int<uint32_t>(record));
+	for (auto& comment : comments)
+		comment = extract_dumped_string(record);
+
+	size_t i = 0;
+	for (size_t g = 0; g < groups.size(); ++g) {
+		for (uint32_t j = 0; j < tests_nos[g]; ++j, ++i) {
+			auto comment_idx = extract_dumped_int<uint32_t>(record);
+			throw_assert(comment_idx < comments.size());
+			groups[g].tests.emplace_back(
+			   std::move(names[i]),
+			   Test::Status(extract_dumped_int<uint8_t>(statuses)),
+			   milliseconds(extract_dumped_int<uint32_t>(runtimes)),
+			   milliseconds(extract_dumped_int<uint32_t>(time_limits)),
+			   uint64_t(extract_dumped_int<uint32_t>(memory)) << 10,
+			   uint64_t(extract_dumped_int<uint32_t>(memory_limits)) << 10,
+			   comments[comment_idx]);
+		}
+	}
+
+	return report;
+}
+
+string to_html(StringView record) {
+	STACK_UNWINDING_MARK;
+
+	if (not is_dumped(record))
+		return record.to_string();
+
+	auto report = extract(record);
+	if (report.compilation_errors) {
+		return concat_tostr("<pre class=\"compilation-errors\">",
+		                    html_escape(*report.compilation_errors), "</pre>");
+	}
+
+	auto& jr = report.judge_report;
+	if (jr.groups.empty())
+		return "";
+
+	InplaceBuff<65536> res;
+	// clang-format off
+	res.append("<h2>", (report.final ? "Final" : "Initial"),
+	               " testing report</h2>"
+	           "<table class=\"table\">"
+	               "<thead>"
+	                   "<tr>"
+	                       "<th class=\"test\">Test</th>"
+	                       "<th class=\"result\">Result</th>"
+	                       "<th class=\"time\">Time [s]</th>"
+	                       "<th class=\"memory\">Memory [KiB]</th>"
+	                       "<th class=\"points\">Score</th>"
+	                   "</tr>"
+	               "</thead>"
+	               "<tbody>");
+	// clang-format on
+
+	auto append_normal_columns = [&](const JudgeReport::Test& test) {
+		auto as_td_string = [&](JudgeReport::Test::Status s) {
+			switch (s) {
+			case JudgeReport::Test::OK:
+				return "<td class=\"status green\">OK</td>";
+			case JudgeReport::Test::WA:
+				return "<td class=\"status red\">Wrong answer</td>";
+			case JudgeReport::Test::TLE:
+				return "<td class=\"status yellow\">Time limit exceeded</td>";
+			case JudgeReport::Test::MLE:
+				return "<td class=\"status yellow\">Memory limit exceeded</td>";
+			case JudgeReport::Test::RTE:
+				return "<td class=\"status intense-red\">Runtime error</td>";
+			case JudgeReport::Test::CHECKER_ERROR:
+				return "<td class=\"status blue\">Checker error</td>";
+			case JudgeReport::Test::SKIPPED:
+				return (report.partial ? "<td class=\"status\">Pending</td>"
+				                       : "<td class=\"status\">Skipped</td>");
+			}
+
+			throw_assert(false); // We shouldn't get here
+		};
+
+		res.append("<td>", html_escape(test.name), "</td>",
+		           as_td_string(test.status), "<td>");
+
+		if (test.status == JudgeReport::Test::SKIPPED)
+			res.append('?');
+		else
+			res.append(to_string(floor_to_10ms(test.runtime), false));
+
+		res.append(" / ", to_string(floor_to_10ms(test.time_limit), false),
+		           "</td><td>");
+
+		if (test.status == JudgeReport::Test::SKIPPED)
+			res.append('?');
+		else
+			res.append(test.memory_consumed >> 10);
+
+		res.append(" / ", test.memory_limit >> 10, "</td>");
+	};
+
+	bool there_are_comments = false;
+	for (auto&& group : jr.groups) {
+		throw_assert(group.tests.size() > 0);
+		// First row
+		res.append("<tr>");
+		append_normal_columns(group.tests[0]);
+		res.append("<td class=\"groupscore\" rowspan=\"", group.tests.size(),
+		           "\">", group.score, " / ", group.max_score, "</td></tr>");
+		// Other rows
+		for (size_t i = 1; i < group.tests.size(); ++i) {
+			res.append("<tr>");
+			append_normal_columns(group.tests[i]);
+			res.append("</tr>");
+		}
+
+		for (auto&& test : group.tests)
+			there_are_comments |= !test.comment.empty();
+	}
+
+	res.append("</tbody></table>");
+
+	// Tests comments
+	if (there_are_comments) {
+		res.append("<ul class=\"tests-comments\">");
+		for (auto&& group : jr.groups) {
+			for (auto&& test : group.tests) {
+				if (test.comment.size()) {
+					res.append("<li><span class=\"test-id\">",
+					           html_escape(test.name), "</span>",
+					           html_escape(test.comment), "</li>");
+				}
+			}
+		}
+
+		res.append("</ul>");
+	}
+
+	return res.to_string();
+}
+
+string to_json(StringView record) {
+	STACK_UNWINDING_MARK;
+
+	if (record.empty())
+		return "null";
+	if (not is_dumped(record))
+		return concat_tostr("{\"html\":", json_stringify(record), '}');
+
+	auto report = extract(record);
+	if (report.compilation_errors) {
+		return concat_tostr("{\"compilation_errors\":",
+		                    json_stringify(*report.compilation_errors), '}');
+	}
+
+	auto as_str = [&](JudgeReport::Test::Status s) {
+		switch (s) {
+		case JudgeReport::Test::OK: return "OK";
+		case JudgeReport::Test::WA: return "WA";
+		case JudgeReport::Test::TLE: return "TLE";
+		case JudgeReport::Test::MLE: return "MLE";
+		case JudgeReport::Test::RTE: return "RTE";
+		case JudgeReport::Test::CHECKER_ERROR: return "CHECKER_ERROR";
+		case JudgeReport::Test::SKIPPED:
+			return (report.partial ? "PENDING" : "SKIPPED");
+		}
+
+		throw_assert(false); // We shouldn't get here
+	};
+
+	InplaceBuff<65536> res;
+	res.append("{\"final\":", (report.final ? "true" : "false"),
+	           ",\"partial\":", (report.partial ? "true" : "false"),
+	           ",\"groups\":[");
+	auto& groups = report.judge_report.groups;
+	for (auto&& group : groups) {
+		if (&group != &groups.front())
+			res.append(',');
+
+		res.append('[', group.score, ',', group.max_score, ",[");
+		for (auto&& test : group.tests) {
+			if (&test != &group.tests.front())
+				res.append(',');
+
+			res.append('[', json_stringify(test.name), ",\"",
+			           as_str(test.status), "\",",
+			           duration_cast<milliseconds>(test.runtime).count(), ',',
+			           duration_cast<milliseconds>(test.time_limit).count(), ',',
+			           test.memory_consumed >> 10, ',', test.memory_limit >> 10,
+			           ',', json_stringify(test.comment), ']');
+		}
+		res.append("]]");
+	}
+
+	res.append("]}");
+	return res.to_string();
+}
+
+namespace {
+
+// Parses the HTML reports rendered by JudgeBase::construct_report() of the
+// older versions of Sim
+class LegacyHtmlParser {
+	StringView html_;
+
+public:
+	explicit LegacyHtmlParser(StringView html) : html_(html) {}
+
+	bool at_end() const noexcept { return html_.empty(); }
+
+	// Skips @p str if the remaining HTML begins with it
+	bool skip(StringView str) noexcept {
+		if (not has_prefix(html_, str))
+			return false;
+
+		html_.remove_prefix(str.size());
+		return true;
+	}
+
+	// Extracts everything up to @p str and skips @p str
+	optional<StringView> extract_until(StringView str) noexcept {
+		auto pos = html_.find(str);
+		if (pos == StringView::npos)
+			return std::nullopt;
+
+		auto res = html_.substring(0, pos);
+		html_.remove_prefix(pos + str.size());
+		return res;
+	}
+};
+
+optional<string> html_unescape(StringView str) {
+	constexpr std::pair<StringView, char> entities[] = {
+	   {"&amp;", '&'}, {"&lt;", '<'},   {"&gt;", '>'},
+	   {"&quot;", '"'}, {"&apos;", '\''}, {"&#39;", '\''},
+	};
+
+	string res;
+	while (not str.empty()) {
+		if (str[0] != '&') {
+			res += str[0];
+			str.remove_prefix(1);
+			continue;
+		}
+
+		auto it = std::find_if(
+		   std::begin(entities), std::end(entities),
+		   [&](auto& entity) { return has_prefix(str, entity.first); });
+		if (it == std::end(entities))
+			return std::nullopt;
+
+		res += it->second;
+		str.remove_prefix(it->first.size());
+	}
+
+	return res;
+}
+
+// Parses "X / Y" where X may be "?" (the test was not run)
+template <class T, class Parse>
+optional<std::pair<T, T>> parse_pair(StringView str, Parse&& parse) {
+	auto pos = str.find(" / ");
+	if (pos == StringView::npos)
+		return std::nullopt;
+
+	auto second = parse(str.substr(pos + 3));
+	if (not second)
+		return std::nullopt;
+
+	StringView first_str = str.substring(0, pos);
+	if (first_str == "?")
+		return std::pair {T {}, *second};
+
+	auto first = parse(first_str);
+	if (not first)
+		return std::nullopt;
+
+	return std::pair {*first, *second};
+}
+
+// Parses seconds rendered with at most 3 decimal places e.g. "1.25"
+optional<milliseconds> parse_seconds(StringView str) {
+	auto dot = str.find('.');
+	auto secs = str2num<uint64_t>(str.substring(0, dot));
+	if (not secs)
+		return std::nullopt;
+
+	uint64_t ms = *secs * 1000;
+	if (dot != StringView::npos) {
+		StringView frac = str.substr(dot + 1);
+		if (frac.empty() or frac.size() > 3 or not is_digit(frac))
+			return std::nullopt;
+
+		for (size_t i = 0, mul = 100; i < frac.size(); ++i, mul /= 10)
+			ms += (frac[i] - '0') * mul;
+	}
+
+	return milliseconds(ms);
+}
+
+} // anonymous namespace
+
+optional<string> from_legacy_html(StringView html) {
+	STACK_UNWINDING_MARK;
+	using Test = JudgeReport::Test;
+
+	LegacyHtmlParser parser(html);
+	if (parser.skip("<pre class=\"compilation-errors\">")) {
+		auto errors = parser.extract_until("</pre>");
+		if (not errors or not parser.at_end())
+			return std::nullopt;
+
+		auto unescaped = html_unescape(*errors);
+		if (not unescaped)
+			return std::nullopt;
+
+		return dump_compilation_errors(*unescaped);
+	}
+
+	bool final;
+	if (parser.skip("<h2>Final testing report</h2>"))
+		final = true;
+	else if (parser.skip("<h2>Initial testing report</h2>"))
+		final = false;
+	else
+		return std::nullopt;
+
+	if (not parser.extract_until("<tbody>"))
+		return std::nullopt;
+
+	JudgeReport report;
+	bool partial = false;
+	size_t rows_left_in_group = 0;
+	while (parser.skip("<tr><td>")) {
+		auto name = parser.extract_until("</td><td class=\"status");
+		auto status_str = parser.extract_until("</td><td>");
+		auto times = parser.extract_until("</td><td>");
+		auto memory = parser.extract_until("</td>");
+		if (not name or not status_str or not times or not memory)
+			return std::nullopt;
+
+		if (rows_left_in_group == 0) {
+			// The first row of a group
+			if (not parser.skip("<td class=\"groupscore\" rowspan=\""))
+				return std::nullopt;
+
+			auto rowspan = parser.extract_until("\">");
+			auto scores = parser.extract_until("</td>");
+			auto parse_int = [](StringView s) { return str2num<int64_t>(s); };
+			auto rows = (rowspan ? str2num<size_t>(*rowspan) : std::nullopt);
+			auto score_pair =
+			   (scores ? parse_pair<int64_t>(*scores, parse_int)
+			           : std::nullopt);
+			if (not rows or *rows == 0 or not score_pair)
+				return std::nullopt;
+
+			auto& group = report.groups.emplace_back();
+			group.score = score_pair->first;
+			group.max_score = score_pair->second;
+			rows_left_in_group = *rows;
+		}
+		if (not parser.skip("</tr>"))
+			return std::nullopt;
+
+		--rows_left_in_group;
+
+		// Status
+		constexpr std::pair<StringView, Test::Status> statuses[] = {
+		   {" green\">OK", Test::OK},
+		   {" red\">Wrong answer", Test::WA},
+		   {" yellow\">Time limit exceeded", Test::TLE},
+		   {" yellow\">Memory limit exceeded", Test::MLE},
+		   {" intense-red\">Runtime error", Test::RTE},
+		   {" blue\">Checker error", Test::CHECKER_ERROR},
+		   {"\">Skipped", Test::SKIPPED},
+		   {"\">Pending", Test::SKIPPED},
+		};
+		auto it = std::find_if(
+		   std::begin(statuses), std::end(statuses),
+		   [&](auto& status) { return status.first == *status_str; });
+		if (it == std::end(statuses))
+			return std::nullopt;
+
+		partial |= (*status_str == "\">Pending");
+
+		auto time_pair = parse_pair<milliseconds>(*times, parse_seconds);
+		auto memory_pair = parse_pair<uint64_t>(
+		   *memory, [](StringView s) { return str2num<uint64_t>(s); });
+		auto unescaped_name = html_unescape(*name);
+		if (not time_pair or not memory_pair or not unescaped_name)
+			return std::nullopt;
+
+		report.groups.back().tests.emplace_back(
+		   std::move(*unescaped_name), it->second, time_pair->first,
+		   time_pair->second, memory_pair->first << 10,
+		   memory_pair->second << 10, "");
+	}
+
+	if (rows_left_in_group != 0 or not parser.skip("</tbody></table>"))
+		return std::nullopt;
+
+	// Tests comments
+	if (parser.skip("<ul class=\"tests-comments\">")) {
+		while (parser.skip("<li><span class=\"test-id\">")) {
+			auto name = parser.extract_until("</span>");
+			auto comment = parser.extract_until("</li>");
+			if (not name or not comment)
+				return std::nullopt;
+
+			auto unescaped_name = html_unescape(*name);
+			auto unescaped_comment = html_unescape(*comment);
+			if (not unescaped_name or not unescaped_comment)
+				return std::nullopt;
+
+			Test* test = nullptr;
+			for (auto& group : report.groups) {
+				for (auto& t : group.tests) {
+					if (t.name == *unescaped_name)
+						test = &t;
+				}
+			}
+			if (not test)
+				return std::nullopt;
+
+			test->comment = std::move(*unescaped_comment);
+		}
+
+		if (not parser.skip("</ul>"))
+			return std::nullopt;
+	}
+
+	if (not parser.at_end())
+		return std::nullopt;
+
+	return dump(report, final, partial);
+}
+
+} // namespace sim::submission_report
@@ -102,10 +102,12 @@ static void create_db_config(FilePath db_config_path) {
 		'\n')));
 }
 
-constexpr std::array<CStringView, 13> tables = {{
+constexpr std::array<CStringView, 16> tables = {{
    "contest_entry_tokens",
    "contest_files",
    "contest_problems",
+   "contest_ranking_entries",
+   "contest_rankings",
    "contest_rounds",
    "contest_users",
    "contests",
@@ -114,6 +116,7 @@ constexpr std::array<CStringView, 13> tables = {{
    "problem_tags",
    "problems",
    "session",
+   "submission_judging_progress",
    "submissions",
    "users",
 }};
@@ -267,6 +270,7 @@ int main(int argc, char** argv) {
 			"`owner` int unsigned NULL,"
 			"`added` datetime NOT NULL,"
 			"`last_edit` datetime NOT NULL,"
+			"`stop_group_on_failure` BOOLEAN NOT NULL DEFAULT FALSE,"
 			"PRIMARY KEY (id),"
 			"KEY (owner, id),"
 			"KEY (type, id),"
@@ -464,6 +468,53 @@ int main(int argc, char** argv) {
 		") ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
 	// clang-format on
 
+	// clang-format off
+	try_to_create_table("submission_judging_progress",
+		"CREATE TABLE IF NOT EXISTS `submission_judging_progress` ("
+			"`submission_id` int unsigned NOT NULL,"
+			"`final` BOOLEAN NOT NULL,"
+			"`record` mediumblob NOT NULL,"
+			"PRIMARY KEY (submission_id),"
+			"FOREIGN KEY (submission_id) REFERENCES submissions(id) ON DELETE CASCADE"
+		") ENGINE=InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
+	// clang-format on
+
+	// clang-format off
+	try_to_create_table("contest_rankings",
+		"CREATE TABLE IF NOT EXISTS `contest_rankings` ("
+			"`contest_id` int unsigned NOT NULL,"
+			"`version` bigint unsigned NOT NULL,"
+			"`reset_version` bigint unsigned NOT NULL,"
+			"PRIMARY KEY (contest_id),"
+			"FOREIGN KEY (contest_id) REFERENCES contests(id) ON DELETE CASCADE"
+		") ENGINE=InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
+	// clang-format on
+
+	// clang-format off
+	try_to_create_table("contest_ranking_entries",
+		"CREATE TABLE IF NOT EXISTS `contest_ranking_entries` ("
+			"`contest_problem_id` int unsigned NOT NULL,"
+			"`owner` int unsigned NOT NULL,"
+			"`contest_round_id` int unsigned NOT NULL,"
+			"`contest_id` int unsigned NOT NULL,"
+			// NULLs if the owner no longer has a final submission
+			"`final_id` int unsigned NULL,"
+			"`final_full_status` TINYINT NULL,"
+			"`final_score` int NULL,"
+			"`initial_final_id` int unsigned NULL,"
+			"`initial_final_status` TINYINT NULL,"
+			"`version` bigint unsigned NOT NULL,"
+			"PRIMARY KEY (contest_problem_id, owner),"
+			"KEY (contest_id, version),"
+			"KEY (owner),"
+			// Foreign keys
+			"FOREIGN KEY (contest_problem_id) REFERENCES contest_problems(id) ON DELETE CASCADE,"
+			"FOREIGN KEY (owner) REFERENCES users(id) ON DELETE CASCADE,"
+			"FOREIGN KEY (contest_round_id) REFERENCES contest_rounds(id) ON DELETE CASCADE,"
+			"FOREIGN KEY (contest_id) REFERENCES contests(id) ON DELETE CASCADE"
+		") ENGINE=InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
+	// clang-format on
+
 	// clang-format off
 	try_to_create_table("jobs", concat(
 		"CREATE TABLE IF NOT EXISTS `jobs` ("
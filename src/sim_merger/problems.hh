@@ -42,12 +42,13 @@ class ProblemsMerger : public Merger<sim::Problem> {
 		sim::Problem prob;
 		MySQL::Optional<decltype(prob.owner)::value_type> m_owner;
 		auto stmt = conn.prepare("SELECT id, file_id, type, name, label, "
-		                         "simfile, owner, added, last_edit FROM ",
+		                         "simfile, owner, added, last_edit, "
+		                         "stop_group_on_failure FROM ",
 		                         record_set.sql_table_name);
 		stmt.bind_and_execute();
 		stmt.res_bind_all(prob.id, prob.file_id, prob.type, prob.name,
 		                  prob.label, prob.simfile, m_owner, prob.added,
-		                  prob.last_edit);
+		                  prob.last_edit, prob.stop_group_on_failure);
 		while (stmt.next()) {
 			prob.file_id =
 			   internal_files_.new_id(prob.file_id, record_set.kind);
@@ -126,15 +127,17 @@ public:
 		conn.update("TRUNCATE ", sql_table_name());
 		auto stmt = conn.prepare("INSERT INTO ", sql_table_name(),
 		                         "(id, file_id, type, name, label, simfile,"
-		                         " owner, added, last_edit) "
-		                         "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?)");
+		                         " owner, added, last_edit,"
+		                         " stop_group_on_failure) "
+		                         "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
 
 		ProgressBar progress_bar("Problems saved:", new_table_.size(), 128);
 		for (const NewRecord& new_record : new_table_) {
 			Defer progressor = [&] { progress_bar.iter(); };
 			const sim::Problem& x = new_record.data;
 			stmt.bind_and_execute(x.id, x.file_id, x.type, x.name, x.label,
-			                      x.simfile, x.owner, x.added, x.last_edit);
+			                      x.simfile, x.owner, x.added, x.last_edit,
+			                      x.stop_group_on_failure);
 		}
 
 		conn.update("ALTER TABLE ", sql_table_name(),
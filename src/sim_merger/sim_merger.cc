@@ -13,6 +13,7 @@
 #include "users.hh"
 
 #include <iostream>
+#include <sim/contest_ranking.hh>
 #include <sim/mysql.hh>
 #include <simlib/config_file.hh>
 #include <simlib/defer.hh>
@@ -324,6 +325,13 @@ static int true_main(int argc, char** argv) {
 		merger->run_after_saving_hooks();
 	}
 
+	// The progress of judging refers to the unmerged submission ids
+	conn.update("DELETE FROM submission_judging_progress");
+
+	// Rankings are derived from the final submissions
+	stdlog("\033[1;36mMaterializing contest rankings\033[m...");
+	sim::contest_ranking::rebuild(conn);
+
 	conn.update("COMMIT");
 	conn.update("SET AUTOCOMMIT=1");
 
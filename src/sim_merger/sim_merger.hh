@@ -10,10 +10,12 @@ inline InplaceBuff<PATH_MAX> main_sim_build;
 inline InplaceBuff<PATH_MAX> other_sim_build;
 
 constexpr StringView main_sim_table_prefix = "main_sim_";
-constexpr std::array<CStringView, 13> tables = {{
+constexpr std::array<CStringView, 16> tables = {{
    "contest_entry_tokens",
    "contest_files",
    "contest_problems",
+   "contest_ranking_entries",
+   "contest_rankings",
    "contest_rounds",
    "contest_users",
    "contests",
@@ -22,6 +24,7 @@ constexpr std::array<CStringView, 13> tables = {{
    "problem_tags",
    "problems",
    "session",
+   "submission_judging_progress",
    "submissions",
    "users",
 }};
@@ -2,9 +2,11 @@
 #include "simlib/file_info.hh"
 #include "simlib/file_manip.hh"
 #include <climits>
+#include <sim/contest_ranking.hh>
 #include <sim/contest_round.hh>
 #include <sim/inf_datetime.hh>
 #include <sim/mysql.hh>
+#include <sim/submission_report.hh>
 #include <simlib/defer.hh>
 #include <simlib/process.hh>
 #include <simlib/spawner.hh>
@@ -20,9 +22,147 @@ struct CmdOptions {
 
 } // namespace
 
+// Converts the pre-rendered HTML reports of the submissions to the dumped ones
+// (see sim/submission_report.hh), the reports that cannot be parsed are left
+// as they are (they are still rendered correctly)
+static void convert_legacy_submission_reports() {
+	STACK_UNWINDING_MARK;
+
+	struct Row {
+		uint64_t id;
+		std::string initial_report;
+		std::string final_report;
+	};
+
+	auto convert = [](std::string& report) {
+		if (report.empty() or sim::submission_report::is_dumped(report))
+			return true;
+
+		auto dumped = sim::submission_report::from_legacy_html(report);
+		if (not dumped)
+			return false;
+
+		report = std::move(*dumped);
+		return true;
+	};
+
+	uint64_t last_id = 0;
+	size_t converted = 0, unparsable = 0;
+	size_t html_bytes = 0, dumped_bytes = 0;
+	for (;;) {
+		// Only the HTML reports are fetched (they begin with '<')
+		auto stmt = conn.prepare(
+		   "SELECT id, initial_report, final_report FROM submissions "
+		   "WHERE id>? AND (LEFT(initial_report, 1)='<'"
+		   " OR LEFT(final_report, 1)='<') "
+		   "ORDER BY id LIMIT 1000");
+		stmt.bind_and_execute(last_id);
+		uint64_t id;
+		InplaceBuff<65536> initial_report, final_report;
+		stmt.res_bind_all(id, initial_report, final_report);
+
+		std::vector<Row> rows;
+		while (stmt.next()) {
+			rows.push_back(
+			   {id, initial_report.to_string(), final_report.to_string()});
+		}
+		if (rows.empty())
+			break;
+
+		last_id = rows.back().id;
+		auto transaction = conn.start_transaction();
+		stmt = conn.prepare("UPDATE submissions "
+		                    "SET initial_report=?, final_report=? WHERE id=?");
+		for (auto& row : rows) {
+			size_t html_size =
+			   row.initial_report.size() + row.final_report.size();
+			bool ok = convert(row.initial_report);
+			ok &= convert(row.final_report);
+			if (not ok) {
+				++unparsable;
+				continue;
+			}
+
+			stmt.bind_and_execute(row.initial_report, row.final_report,
+			                      row.id);
+			++converted;
+			html_bytes += html_size;
+			dumped_bytes +=
+			   row.initial_report.size() + row.final_report.size();
+		}
+		transaction.commit();
+	}
+
+	stdlog("Converted the reports of ", converted, " submissions (", html_bytes,
+	       " bytes -> ", dumped_bytes, " bytes), left ", unparsable,
+	       " submissions with HTML reports");
+}
+
+// ADD COLUMN IF NOT EXISTS is not supported by MySQL, hence the check
+static bool column_exists(StringView table, StringView column) {
+	STACK_UNWINDING_MARK;
+
+	auto stmt = conn.prepare("SELECT 1 FROM information_schema.COLUMNS "
+	                         "WHERE TABLE_SCHEMA=DATABASE() AND TABLE_NAME=?"
+	                         " AND COLUMN_NAME=?");
+	stmt.bind_and_execute(table, column);
+	return stmt.next();
+}
+
 static int perform_upgrade() {
 	STACK_UNWINDING_MARK;
 
+	if (not column_exists("problems", "stop_group_on_failure")) {
+		conn.update("ALTER TABLE problems ADD COLUMN"
+		            " stop_group_on_failure BOOLEAN NOT NULL DEFAULT FALSE"
+		            " AFTER last_edit");
+	}
+
+	// clang-format off
+	conn.update("CREATE TABLE IF NOT EXISTS `contest_rankings` ("
+			"`contest_id` int unsigned NOT NULL,"
+			"`version` bigint unsigned NOT NULL,"
+			"`reset_version` bigint unsigned NOT NULL,"
+			"PRIMARY KEY (contest_id),"
+			"FOREIGN KEY (contest_id) REFERENCES contests(id) ON DELETE CASCADE"
+		") ENGINE=InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
+	conn.update("CREATE TABLE IF NOT EXISTS `contest_ranking_entries` ("
+			"`contest_problem_id` int unsigned NOT NULL,"
+			"`owner` int unsigned NOT NULL,"
+			"`contest_round_id` int unsigned NOT NULL,"
+			"`contest_id` int unsigned NOT NULL,"
+			"`final_id` int unsigned NULL,"
+			"`final_full_status` TINYINT NULL,"
+			"`final_score` int NULL,"
+			"`initial_final_id` int unsigned NULL,"
+			"`initial_final_status` TINYINT NULL,"
+			"`version` bigint unsigned NOT NULL,"
+			"PRIMARY KEY (contest_problem_id, owner),"
+			"KEY (contest_id, version),"
+			"KEY (owner),"
+			"FOREIGN KEY (contest_problem_id) REFERENCES contest_problems(id) ON DELETE CASCADE,"
+			"FOREIGN KEY (owner) REFERENCES users(id) ON DELETE CASCADE,"
+			"FOREIGN KEY (contest_round_id) REFERENCES contest_rounds(id) ON DELETE CASCADE,"
+			"FOREIGN KEY (contest_id) REFERENCES contests(id) ON DELETE CASCADE"
+		") ENGINE=InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
+	conn.update("CREATE TABLE IF NOT EXISTS `submission_judging_progress` ("
+			"`submission_id` int unsigned NOT NULL,"
+			"`final` BOOLEAN NOT NULL,"
+			"`record` mediumblob NOT NULL,"
+			"PRIMARY KEY (submission_id),"
+			"FOREIGN KEY (submission_id) REFERENCES submissions(id) ON DELETE CASCADE"
+		") ENGINE=InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_bin");
+	// clang-format on
+	stdlog("Materializing contest rankings...");
+	{
+		auto transaction = conn.start_transaction();
+		sim::contest_ranking::rebuild(conn);
+		transaction.commit();
+	}
+
+	stdlog("Converting the submissions' reports...");
+	convert_legacy_submission_reports();
+
 	(void)remove(concat_tostr(sim_build, "sim-server"));
 	(void)remove(concat_tostr(sim_build, "job-server"));
 	(void)remove(concat_tostr(sim_build, "backup"));
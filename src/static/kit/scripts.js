@@ -2620,6 +2620,91 @@ function delete_submission(submission_id) {
 		}), 'Yes, delete it', 'btn-small red', '/api/submission/' + submission_id + '/delete',
 		'The submission has been deleted.', 'No, go back');
 }
+// Shows the progress of judging the submission, refreshing it until the
+// judging is finished
+function submission_progress(submission_id) {
+	var elem = $('<div>', {class: 'judging-progress'});
+	var statuses = {
+		OK: ['green', 'OK'],
+		WA: ['red', 'Wrong answer'],
+		TLE: ['yellow', 'Time limit exceeded'],
+		MLE: ['yellow', 'Memory limit exceeded'],
+		RTE: ['intense-red', 'Runtime error'],
+		CHECKER_ERROR: ['blue', 'Checker error'],
+		SKIPPED: ['', 'Skipped'],
+		PENDING: ['', 'Pending']
+	};
+	var render = function(progress) {
+		var tbody = $('<tbody>');
+		progress.groups.forEach(function(group) {
+			group[2].forEach(function(test, i) {
+				var pending = (test[1] === 'PENDING');
+				var row = $('<tr>', {html: [
+					$('<td>', {text: test[0]}),
+					$('<td>', {
+						class: 'status ' + statuses[test[1]][0],
+						text: statuses[test[1]][1]
+					}),
+					$('<td>', {text: (pending ? '?' : (Math.floor(test[2] / 10) / 100).toFixed(2)) +
+						' / ' + (Math.floor(test[3] / 10) / 100).toFixed(2)}),
+					$('<td>', {text: (pending ? '?' : test[4]) + ' / ' + test[5]})
+				]});
+				if (i === 0)
+					row.append($('<td>', {
+						class: 'groupscore',
+						rowspan: group[2].length,
+						text: group[0] + ' / ' + group[1]
+					}));
+				tbody.append(row);
+			});
+		});
+
+		elem.empty().append($('<h2>', {
+				text: (progress.final ? 'Final' : 'Initial') + ' testing in progress'
+			}), $('<table>', {
+				class: 'table',
+				html: [
+					'<thead><tr>' +
+						'<th class="test">Test</th>' +
+						'<th class="result">Result</th>' +
+						'<th class="time">Time [s]</th>' +
+						'<th class="memory">Memory [KiB]</th>' +
+						'<th class="points">Score</th>' +
+					'</tr></thead>',
+					tbody
+				]
+			}));
+	};
+	var refresh = function() {
+		if (!$.contains(document.documentElement, elem[0]))
+			return;
+
+		$.ajax({
+			url: '/api/submission/' + submission_id + '/progress',
+			type: 'POST',
+			processData: false,
+			contentType: false,
+			data: new FormData(add_csrf_token_to($('<form>')).get(0)),
+			dataType: 'json',
+			success: function(progress) {
+				if (progress === null) {
+					if (elem.children().length !== 0)
+						elem.empty().append($('<p>', {text: 'Judging has finished, reload to see the reports.'}));
+					return;
+				}
+
+				render(progress);
+				setTimeout(refresh, 2000);
+			},
+			error: function() {
+				setTimeout(refresh, 5000);
+			}
+		});
+	};
+
+	setTimeout(refresh);
+	return elem;
+}
 function view_submission(as_modal, submission_id, opt_hash /*= ''*/) {
 	view_ajax(as_modal, '/api/submissions/=' + submission_id, function(data) {
 		if (data.length === 0)
@@ -2723,6 +2808,8 @@ function view_submission(as_modal, submission_id, opt_hash /*= ''*/) {
 					class: 'results',
 					html: function() {
 						var res = [s.initial_report, s.final_report];
+						if (s.status.text === 'Pending')
+							res.push(submission_progress(submission_id));
 						if (s.final_report === null) {
 							var message_to_show;
 							if (utcdt_or_tm_to_Date(s.full_results) === Infinity)
@@ -3007,6 +3094,9 @@ function add_problem(as_modal) {
 			})).add(Form.field_group('Reset scoring', {
 				type: 'checkbox',
 				name: 'reset_scoring'
+			})).add(Form.field_group('Stop judging a group at its first failed test', {
+				type: 'checkbox',
+				name: 'stop_group_on_failure'
 			})).add(Form.field_group('Ignore Simfile', {
 				type: 'checkbox',
 				name: 'ignore_simfile',
@@ -3090,6 +3180,10 @@ function append_reupload_problem(elem, as_modal, problem) {
 		})).add(Form.field_group('Reset scoring', {
 			type: 'checkbox',
 			name: 'reset_scoring'
+		})).add(Form.field_group('Stop judging a group at its first failed test', {
+			type: 'checkbox',
+			name: 'stop_group_on_failure',
+			checked: (problem.stop_group_on_failure === true)
 		})).add(Form.field_group('Ignore Simfile', {
 			type: 'checkbox',
 			name: 'ignore_simfile',
@@ -148,3 +148,79 @@ void Sim::api_logs() {
 	append(end_offset - len, '\n'); // New offset
 	append(to_hex(buff)); // Data
 }
+
+std::optional<Sim::ApiListMode> Sim::api_list_mode() {
+	STACK_UNWINDING_MARK;
+
+	StringView target = request.target;
+	size_t query_beg = target.find('?');
+	if (query_beg == StringView::npos)
+		return ApiListMode::PAGE;
+
+	// Streaming occupies a worker for the whole response, so anonymous
+	// clients are not allowed to do it
+	StringView query = target.substr(query_beg + 1);
+	if (query == "stream") {
+		if (session_is_open)
+			return ApiListMode::STREAM;
+
+		api_error403("You have to be logged in to stream lists");
+		return std::nullopt;
+	}
+
+	if (query == "export") {
+		if (session_is_open and session_user_type == User::Type::ADMIN)
+			return ApiListMode::EXPORT;
+
+		api_error403("Only admins may export lists");
+		return std::nullopt;
+	}
+
+	api_error400(intentional_unsafe_string_view(
+	   concat("Invalid list mode: ", query)));
+	return std::nullopt;
+}
+
+void Sim::api_list_empty(const std::vector<std::string>& head,
+                         bool rows_in_array) {
+	STACK_UNWINDING_MARK;
+
+	auto mode = api_list_mode();
+	if (not mode)
+		return;
+
+	resp.content.clear();
+	if (*mode == ApiListMode::EXPORT)
+		resp.headers["Content-type"] = "application/x-ndjson; charset=utf-8";
+
+	server::api_list::append_head(resp.content, *mode, head, rows_in_array);
+	server::api_list::append_tail(resp.content, *mode, rows_in_array);
+}
+
+void Sim::api_list(const ApiList& list,
+                   const std::function<bool(MySQL::Result&)>& append_row) {
+	STACK_UNWINDING_MARK;
+
+	auto mode = api_list_mode();
+	if (not mode)
+		return;
+
+	resp.content.clear();
+	if (*mode == ApiListMode::EXPORT)
+		resp.headers["Content-type"] = "application/x-ndjson; charset=utf-8";
+
+	// Whole lists are streamed, so that neither the response nor the query
+	// results have to fit in memory
+	if (*mode != ApiListMode::PAGE)
+		stream_response(); // If it fails, the list is sent as a whole
+
+	using server::api_list::Status;
+	switch (server::api_list::append(mysql, list, *mode, resp.content,
+	                                 append_row,
+	                                 [&] { return flush_streamed_content(); })) {
+	case Status::COMPLETE:
+	case Status::CLIENT_GONE: return;
+	case Status::INCOMPLETE: return end_streamed_response(true);
+	case Status::REFUSED: return api_list_empty(list.head, list.rows_in_array);
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <sim/constants.hh>
+#include <simlib/debug.hh>
+#include <string>
+#include <vector>
+
+namespace server::api_list {
+
+/// Query of a list API: the rows are ordered by a unique key and fetched
+/// using keyset pagination, i.e. every batch of them continues after the key
+/// of the last row of the previous one
+struct List {
+	// "SELECT key, ... WHERE ..." - the key has to be the first selected
+	// column and the query has to end with the WHERE clause
+	std::string query;
+	StringView key_column; // E.g. "s.id"
+	bool key_descending = true;
+	bool key_is_string = false; // The key is alphanumeric, not numeric
+	uint rows_limit = API_FIRST_QUERY_ROWS_LIMIT; // Of a page
+	// Whole lists are fetched in batches of that many rows
+	uint batch_rows = API_LIST_BATCH_ROWS;
+	// JSON values that precede the rows (the first describes the columns)
+	std::vector<std::string> head;
+	// Whether the rows form a JSON array of their own (after the head)
+	bool rows_in_array = false;
+};
+
+enum class Mode : uint8_t {
+	PAGE, // At most rows_limit rows
+	// "?stream" (logged-in users only): all the rows, streamed as the same
+	// JSON
+	STREAM,
+	// "?export" (admins only): all the rows, streamed as NDJSON (every head
+	// value and every row on a separate line)
+	EXPORT,
+};
+
+/// Appends the beginning of the list (up to the first row) to @p content
+template <class Content>
+void append_head(Content& content, Mode mode,
+                 const std::vector<std::string>& head, bool rows_in_array) {
+	if (mode == Mode::EXPORT) {
+		for (auto& value : head)
+			content.append(value, '\n');
+		return;
+	}
+
+	content.append('[');
+	for (size_t i = 0; i < head.size(); ++i)
+		content.append((i == 0 ? "\n" : ",\n"), head[i]);
+	if (rows_in_array)
+		content.append(",[");
+}
+
+/// Appends the end of the list (after the last row) to @p content
+template <class Content>
+void append_tail(Content& content, Mode mode, bool rows_in_array) {
+	if (mode != Mode::EXPORT)
+		content.append(rows_in_array ? "\n]]" : "\n]");
+}
+
+enum class Status : uint8_t {
+	COMPLETE,
+	// append_row() returned false before any content was flushed: the whole
+	// list has to be empty
+	REFUSED,
+	// append_row() returned false after some of the content was flushed: the
+	// client has to see that the list is incomplete
+	INCOMPLETE,
+	CLIENT_GONE, // flush() returned false
+};
+
+/**
+ * @brief Appends the list @p list (its head, rows and tail) to @p content
+ * @details The rows are fetched from @p mysql (anything with query() that
+ *   concatenates its arguments into the SQL) - a page of them or all of them
+ *   in batches, depending on @p mode.
+ *
+ * @param append_row appends the current row of the query result to
+ *   @p content, returns false if the whole list has to be empty (e.g. because
+ *   of missing permissions)
+ * @param flush called after every row, may send @p content and clear it,
+ *   returns false if the client will not receive it
+ */
+template <class Connection, class Content, class AppendRow, class Flush>
+Status append(Connection& mysql, const List& list, Mode mode,
+              Content& content, AppendRow&& append_row, Flush&& flush) {
+	STACK_UNWINDING_MARK;
+
+	append_head(content, mode, list.head, list.rows_in_array);
+	uint batch_rows = (mode == Mode::PAGE ? list.rows_limit : list.batch_rows);
+	bool first_row = true;
+	bool content_sent = false; // Some of the content is already flushed
+	InplaceBuff<64> cursor; // Condition selecting the rows after the last one
+	for (;;) {
+		auto res =
+		   mysql.query(list.query, cursor, " ORDER BY ", list.key_column,
+		               (list.key_descending ? " DESC" : ""), " LIMIT ",
+		               batch_rows);
+
+		uint rows = 0;
+		while (res.next()) {
+			++rows;
+			if (mode != Mode::EXPORT)
+				content.append(first_row and list.rows_in_array ? "\n" : ",\n");
+
+			if (not append_row(res))
+				return (content_sent ? Status::INCOMPLETE : Status::REFUSED);
+
+			if (mode == Mode::EXPORT)
+				content.append('\n');
+
+			first_row = false;
+			StringView key = res[0];
+			if (not(list.key_is_string ? is_alnum(key) : is_digit(key)))
+				THROW("Invalid key of the listed row: ", key);
+
+			cursor.clear();
+			cursor.append(" AND ", list.key_column,
+			              (list.key_descending ? '<' : '>'));
+			if (list.key_is_string)
+				cursor.append('\'', key, '\'');
+			else
+				cursor.append(key);
+
+			if (not flush())
+				return Status::CLIENT_GONE;
+
+			content_sent |= (content.size == 0);
+		}
+
+		if (mode == Mode::PAGE or rows < batch_rows)
+			break;
+	}
+
+	append_tail(content, mode, list.rows_in_array);
+	return Status::COMPLETE;
+}
+
+} // namespace server::api_list
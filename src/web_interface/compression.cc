@@ -0,0 +1,341 @@
+#include "compression.hh"
+
+#include <cctype>
+#include <simlib/debug.hh>
+#include <zlib.h>
+
+#ifdef SIM_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+using std::string;
+
+namespace server {
+
+namespace {
+
+bool equal_ignoring_case(StringView a, StringView b) noexcept {
+	return a.size() == b.size() and
+	       std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+		       return tolower(x) == tolower(y);
+	       });
+}
+
+StringView trimmed(StringView str) noexcept {
+	while (not str.empty() and is_space(str.front()))
+		str.remove_prefix(1);
+	while (not str.empty() and is_space(str.back()))
+		str.remove_suffix(1);
+	return str;
+}
+
+// Parses the qvalue (RFC 7231, section 5.3.1) of the Accept-Encoding element
+// parameters @p params into thousandths, returns 1000 if there is none
+int parse_qvalue(StringView params) noexcept {
+	for (;;) {
+		size_t semicolon = params.find(';');
+		if (semicolon == StringView::npos)
+			return 1000;
+
+		params.remove_prefix(semicolon + 1);
+		StringView param = trimmed(params.substr(0, params.find(';')));
+		if (param.size() < 2 or tolower(param[0]) != 'q' or param[1] != '=')
+			continue;
+
+		StringView val = param.substr(2);
+		if (val.empty() or (val[0] != '0' and val[0] != '1'))
+			return 0; // Invalid qvalue makes the coding unacceptable
+
+		int res = (val[0] - '0') * 1000;
+		if (val.size() > 1 and val[1] == '.') {
+			int unit = 100;
+			for (size_t i = 2; i < val.size() and i < 5; ++i, unit /= 10) {
+				if (not isdigit(val[i]))
+					return 0;
+				res += (val[i] - '0') * unit;
+			}
+		}
+
+		return std::min(res, 1000);
+	}
+}
+
+string gzip_compress(StringView data, int level) {
+	z_stream zs = {};
+	// 15 + 16: the largest window with the gzip wrapper
+	if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8,
+	                 Z_DEFAULT_STRATEGY) != Z_OK) {
+		THROW("deflateInit2() failed: ", zs.msg ? zs.msg : "unknown error");
+	}
+
+	string res;
+	// The data is fed and the output is taken in chunks, as the lengths in
+	// z_stream are 32-bit
+	constexpr size_t CHUNK = 1 << 20;
+	int rc = Z_OK;
+	size_t pos = 0;
+	while (rc != Z_STREAM_END) {
+		if (zs.avail_in == 0 and pos < data.size()) {
+			zs.next_in = (Bytef*)data.data() + pos;
+			zs.avail_in = std::min(CHUNK, data.size() - pos);
+			pos += zs.avail_in;
+		}
+
+		size_t out_beg = res.size();
+		res.resize(out_beg + CHUNK);
+		zs.next_out = (Bytef*)res.data() + out_beg;
+		zs.avail_out = CHUNK;
+		rc = deflate(&zs, (pos == data.size() ? Z_FINISH : Z_NO_FLUSH));
+		res.resize(res.size() - zs.avail_out);
+		if (rc != Z_OK and rc != Z_STREAM_END and rc != Z_BUF_ERROR) {
+			deflateEnd(&zs);
+			THROW("deflate() failed: ", zs.msg ? zs.msg : "unknown error");
+		}
+	}
+
+	deflateEnd(&zs);
+	return res;
+}
+
+#ifdef SIM_HAVE_BROTLI
+string brotli_compress(StringView data, int quality) {
+	string res(BrotliEncoderMaxCompressedSize(data.size()), '\0');
+	size_t size = res.size();
+	if (res.empty() or
+	    not BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW,
+	                              BROTLI_MODE_TEXT, data.size(),
+	                              (const uint8_t*)data.data(), &size,
+	                              (uint8_t*)res.data())) {
+		THROW("BrotliEncoderCompress() failed");
+	}
+
+	res.resize(size);
+	return res;
+}
+#endif
+
+} // anonymous namespace
+
+bool is_supported(ContentCoding coding) noexcept {
+#ifdef SIM_HAVE_BROTLI
+	(void)coding;
+	return true;
+#else
+	return coding != ContentCoding::BROTLI;
+#endif
+}
+
+ContentCoding choose_content_coding(StringView accept_encoding) noexcept {
+	// Qvalues (in thousandths) of the codings, -1 means not listed
+	int gzip_q = -1, br_q = -1, any_q = -1;
+	while (not accept_encoding.empty()) {
+		size_t comma = accept_encoding.find(',');
+		StringView elem = accept_encoding.substr(0, comma);
+		accept_encoding.remove_prefix(
+		   comma == StringView::npos ? accept_encoding.size() : comma + 1);
+
+		StringView coding = trimmed(elem.substr(0, elem.find(';')));
+		int q = parse_qvalue(elem);
+		if (equal_ignoring_case(coding, "gzip") or
+		    equal_ignoring_case(coding, "x-gzip")) {
+			gzip_q = q;
+		} else if (equal_ignoring_case(coding, "br")) {
+			br_q = q;
+		} else if (coding == "*") {
+			any_q = q;
+		}
+	}
+
+	if (gzip_q == -1)
+		gzip_q = any_q;
+	if (not is_supported(ContentCoding::BROTLI))
+		br_q = -1;
+	else if (br_q == -1)
+		br_q = any_q;
+
+	// On equal preference brotli is chosen, as it compresses better
+	if (br_q > 0 and br_q >= gzip_q)
+		return ContentCoding::BROTLI;
+	if (gzip_q > 0)
+		return ContentCoding::GZIP;
+
+	return ContentCoding::IDENTITY;
+}
+
+bool is_compressible(StringView content_type) noexcept {
+	StringView type = trimmed(content_type.substr(0, content_type.find(';')));
+	auto has_prefix_ignoring_case = [&](StringView prefix) {
+		return type.size() >= prefix.size() and
+		       equal_ignoring_case(type.substr(0, prefix.size()), prefix);
+	};
+	auto has_suffix_ignoring_case = [&](StringView suffix) {
+		return type.size() >= suffix.size() and
+		       equal_ignoring_case(type.substr(type.size() - suffix.size()),
+		                           suffix);
+	};
+
+	return has_prefix_ignoring_case("text/") or
+	       equal_ignoring_case(type, "application/json") or
+	       equal_ignoring_case(type, "application/javascript") or
+	       equal_ignoring_case(type, "application/x-ndjson") or
+	       equal_ignoring_case(type, "application/xml") or
+	       equal_ignoring_case(type, "image/svg+xml") or
+	       has_suffix_ignoring_case("+json") or
+	       has_suffix_ignoring_case("+xml");
+}
+
+string compress(StringView data, ContentCoding coding, CompressionLevel level) {
+	switch (coding) {
+	case ContentCoding::IDENTITY: break;
+	case ContentCoding::GZIP:
+		return gzip_compress(data, (level == CompressionLevel::FAST ? 5 : 9));
+	case ContentCoding::BROTLI:
+#ifdef SIM_HAVE_BROTLI
+		return brotli_compress(data,
+		                       (level == CompressionLevel::FAST ? 4 : 11));
+#else
+		THROW("Brotli compression is not supported");
+#endif
+	}
+
+	THROW("Invalid content coding: ", content_coding_name(coding));
+}
+
+struct StreamCompressor::Encoder {
+	ContentCoding coding;
+	z_stream zs = {};
+#ifdef SIM_HAVE_BROTLI
+	BrotliEncoderState* brotli = nullptr;
+#endif
+
+	explicit Encoder(ContentCoding coding_) : coding(coding_) {}
+
+	~Encoder() {
+		if (coding == ContentCoding::GZIP)
+			deflateEnd(&zs);
+#ifdef SIM_HAVE_BROTLI
+		if (brotli)
+			BrotliEncoderDestroyInstance(brotli);
+#endif
+	}
+
+	// Compresses @p data with @p flush (Z_SYNC_FLUSH or Z_FINISH)
+	void deflate_all(StringView data, int flush, string& out) {
+		constexpr size_t CHUNK = 1 << 16;
+		for (;;) {
+			// The lengths in z_stream are 32-bit
+			if (zs.avail_in == 0) {
+				zs.next_in = (Bytef*)data.data();
+				zs.avail_in = std::min(CHUNK, data.size());
+				data.remove_prefix(zs.avail_in);
+			}
+
+			size_t out_beg = out.size();
+			out.resize(out_beg + CHUNK);
+			zs.next_out = (Bytef*)out.data() + out_beg;
+			zs.avail_out = CHUNK;
+			int rc = deflate(&zs, (data.empty() ? flush : Z_NO_FLUSH));
+			out.resize(out.size() - zs.avail_out);
+			if (rc == Z_STREAM_END)
+				return;
+			if (rc != Z_OK and rc != Z_BUF_ERROR)
+				THROW("deflate() failed: ", zs.msg ? zs.msg : "unknown error");
+
+			// The flush is complete once deflate() leaves some output space
+			if (data.empty() and zs.avail_in == 0 and zs.avail_out > 0 and
+			    flush != Z_FINISH) {
+				return;
+			}
+		}
+	}
+
+#ifdef SIM_HAVE_BROTLI
+	void brotli_all(StringView data, BrotliEncoderOperation op, string& out) {
+		size_t avail_in = data.size();
+		auto* next_in = (const uint8_t*)data.data();
+		do {
+			size_t avail_out = 0;
+			if (not BrotliEncoderCompressStream(brotli, op, &avail_in,
+			                                    &next_in, &avail_out, nullptr,
+			                                    nullptr)) {
+				THROW("BrotliEncoderCompressStream() failed");
+			}
+
+			size_t size = 0;
+			auto* output = BrotliEncoderTakeOutput(brotli, &size);
+			out.append((const char*)output, size);
+		} while (avail_in > 0 or BrotliEncoderHasMoreOutput(brotli) or
+		         (op == BROTLI_OPERATION_FINISH and
+		          not BrotliEncoderIsFinished(brotli)));
+	}
+#endif
+};
+
+StreamCompressor::StreamCompressor(ContentCoding coding)
+   : encoder_(std::make_unique<Encoder>(coding)) {
+	switch (coding) {
+	case ContentCoding::IDENTITY: break;
+	case ContentCoding::GZIP:
+		if (deflateInit2(&encoder_->zs, 5, Z_DEFLATED, 15 + 16, 8,
+		                 Z_DEFAULT_STRATEGY) != Z_OK) {
+			encoder_->coding = ContentCoding::IDENTITY; // Nothing to end
+			THROW("deflateInit2() failed");
+		}
+		return;
+
+	case ContentCoding::BROTLI:
+#ifdef SIM_HAVE_BROTLI
+		encoder_->brotli =
+		   BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+		if (not encoder_->brotli)
+			THROW("BrotliEncoderCreateInstance() failed");
+
+		BrotliEncoderSetParameter(encoder_->brotli, BROTLI_PARAM_QUALITY, 4);
+		BrotliEncoderSetParameter(encoder_->brotli, BROTLI_PARAM_MODE,
+		                          BROTLI_MODE_TEXT);
+		return;
+#else
+		THROW("Brotli compression is not supported");
+#endif
+	}
+
+	THROW("Invalid content coding: ", content_coding_name(coding));
+}
+
+StreamCompressor::~StreamCompressor() = default;
+
+void StreamCompressor::write(StringView data, string& out) {
+	if (data.empty())
+		return; // Flushing would produce output anyway
+
+	if (encoder_->coding == ContentCoding::GZIP)
+		return encoder_->deflate_all(data, Z_SYNC_FLUSH, out);
+
+#ifdef SIM_HAVE_BROTLI
+	encoder_->brotli_all(data, BROTLI_OPERATION_FLUSH, out);
+#endif
+}
+
+void StreamCompressor::finish(string& out) {
+	if (encoder_->coding == ContentCoding::GZIP)
+		return encoder_->deflate_all({}, Z_FINISH, out);
+
+#ifdef SIM_HAVE_BROTLI
+	encoder_->brotli_all({}, BROTLI_OPERATION_FINISH, out);
+#endif
+}
+
+string static_file_version(std::chrono::system_clock::time_point mtime) {
+	using namespace std::chrono;
+	return to_string(
+	   duration_cast<microseconds>(mtime.time_since_epoch()).count());
+}
+
+string static_file_version(const timespec& mtime) {
+	using namespace std::chrono;
+	return static_file_version(system_clock::time_point(
+	   duration_cast<system_clock::duration>(seconds(mtime.tv_sec) +
+	                                         nanoseconds(mtime.tv_nsec))));
+}
+
+} // namespace server
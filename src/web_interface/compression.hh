@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <simlib/string_view.hh>
+#include <string>
+
+namespace server {
+
+enum class ContentCoding : uint8_t {
+	IDENTITY,
+	GZIP,
+	BROTLI, // Available only if the server is built with the brotli library
+};
+
+constexpr const char* content_coding_name(ContentCoding coding) noexcept {
+	switch (coding) {
+	case ContentCoding::IDENTITY: return "identity";
+	case ContentCoding::GZIP: return "gzip";
+	case ContentCoding::BROTLI: return "br";
+	}
+	return "unknown";
+}
+
+/// Whether the server is built with the library for @p coding
+bool is_supported(ContentCoding coding) noexcept;
+
+/// Returns the best supported coding that the Accept-Encoding header value
+/// @p accept_encoding allows (identity if the header is empty)
+ContentCoding choose_content_coding(StringView accept_encoding) noexcept;
+
+/// Whether the content of the type @p content_type (value of the Content-Type
+/// header) is worth compressing
+bool is_compressible(StringView content_type) noexcept;
+
+// Smaller responses are not compressed, as it would barely save anything
+constexpr size_t MIN_COMPRESSED_CONTENT_SIZE = 1024;
+
+enum class CompressionLevel : uint8_t {
+	FAST, // For responses generated on every request
+	BEST, // For content compressed once and sent many times
+};
+
+/// Compresses @p data with @p coding (which must not be identity). Throws on
+/// error.
+std::string compress(StringView data, ContentCoding coding,
+                     CompressionLevel level);
+
+/// Compresses a content that is generated and sent in pieces: every piece is
+/// flushed, so that the client can decode everything that was sent so far
+/// (at the cost of slightly worse compression). The compression level is
+/// CompressionLevel::FAST.
+class StreamCompressor {
+	struct Encoder;
+	std::unique_ptr<Encoder> encoder_;
+
+public:
+	/// @p coding must not be identity. Throws on error.
+	explicit StreamCompressor(ContentCoding coding);
+
+	StreamCompressor(const StreamCompressor&) = delete;
+	StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+	~StreamCompressor();
+
+	/// Appends the compressed @p data to @p out. Throws on error.
+	void write(StringView data, std::string& out);
+
+	/// Appends the end of the compressed content to @p out, nothing can be
+	/// written after it. Throws on error.
+	void finish(std::string& out);
+};
+
+/// Version of a static file: its modification time in microseconds. It is
+/// put in the URLs of the static files, so that browsers fetch the current
+/// versions.
+std::string static_file_version(std::chrono::system_clock::time_point mtime);
+
+std::string static_file_version(const timespec& mtime);
+
+} // namespace server
@@ -1,7 +1,15 @@
 #include "connection.hh"
-
+#include "compression.hh"
+#include "multipart_form_data_parser.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cinttypes>
+#include <cstring>
+#include <ctime>
 #include <iostream>
-#include <poll.h>
+#include <random>
+#include <sim/constants.hh>
 #include <simlib/debug.hh>
 #include <simlib/file_descriptor.hh>
 #include <simlib/file_manip.hh>
@@ -15,149 +23,271 @@ using std::string;
 
 namespace server {
 
-int Connection::peek() {
-	if (state_ == CLOSED)
-		return -1;
+// Compares @p str case-insensitively with the lowercase @p lower
+static bool equals_lower(StringView str, StringView lower) {
+	return str.size() == lower.size() and
+	       std::equal(str.begin(), str.end(), lower.begin(),
+	                  [](char a, char b) { return tolower(a) == b; });
+}
 
-	if (pos_ >= buff_size_) {
-		// wait for data
-		pollfd pfd = {sock_fd_, POLLIN, 0};
-		D(stdlog("peek(): polling... ");)
+// Checks whether the comma-separated list @p value (e.g. of the Connection
+// header options) contains the lowercase @p option (case-insensitive)
+static bool list_contains(StringView value, StringView option) {
+	while (not value.empty()) {
+		size_t comma = value.find(',');
+		StringView opt = value.substr(0, comma);
+		value.remove_prefix(comma == StringView::npos ? value.size()
+		                                              : comma + 1);
+		while (not opt.empty() and is_space(opt.front()))
+			opt.remove_prefix(1);
+		while (not opt.empty() and is_space(opt.back()))
+			opt.remove_suffix(1);
+
+		if (equals_lower(opt, option))
+			return true;
+	}
 
-		if (poll(&pfd, 1, POLL_TIMEOUT) <= 0) {
-			D(stdlog("peek(): No response");)
-			error408();
-			return -1;
-		}
-		D(stdlog("peek(): OK");)
+	return false;
+}
 
-		pos_ = 0;
-		buff_size_ = read(sock_fd_, buffer_, BUFFER_SIZE);
-		D(stdlog("peek(): Reading completed; buff_size: ", buff_size_);)
-		// D(stdlog("buff: `", StringView((const char*)buffer_, buff_size_),
-		//          "`");)
+string Connection::file_etag(uint64_t inode, uint64_t size, timespec mtime) {
+	char buff[64];
+	int len = snprintf(buff, sizeof(buff),
+	                   "\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "\"", inode, size,
+	                   uint64_t(mtime.tv_sec) * 1'000'000'000 + mtime.tv_nsec);
+	return string(buff, len);
+}
 
-		if (buff_size_ <= 0) {
-			state_ = CLOSED;
-			return -1; // Failed
+// Checks whether the list of entity tags @p tags (value of If-None-Match or
+// If-Range) contains @p etag. Weak comparison ignores the W/ prefixes, strong
+// comparison does not match weak tags at all.
+static bool etag_list_matches(StringView tags, StringView etag,
+                              bool weak_comparison) {
+	while (not tags.empty()) {
+		if (is_space(tags.front()) or tags.front() == ',') {
+			tags.remove_prefix(1);
+			continue;
 		}
+
+		if (tags.front() == '*')
+			return true;
+
+		bool weak = has_prefix(tags, "W/");
+		if (weak)
+			tags.remove_prefix(2);
+
+		size_t end = (tags.empty() or tags.front() != '"'
+		                 ? StringView::npos
+		                 : tags.find('"', 1));
+		if (end == StringView::npos)
+			return false; // Invalid list
+
+		if ((weak_comparison or not weak) and tags.substr(0, end + 1) == etag)
+			return true;
+
+		tags.remove_prefix(end + 1);
 	}
 
-	return buffer_[pos_];
+	return false;
 }
 
-string Connection::get_header_line() {
-	string line;
-	int c;
+static std::optional<time_t> parse_http_date(const string& str) {
+	struct tm tm {};
+	if (str.empty() or
+	    strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm) == nullptr) {
+		return std::nullopt;
+	}
 
-	while ((c = get_char()) != -1) {
-		if (c == '\n' && line.size() && line.back() == '\r') {
-			line.pop_back();
-			break;
+	return timegm(&tm);
+}
 
-		} else if (line.size() > MAX_HEADER_LENGTH) {
-			error431();
-			return "";
+struct ByteRange {
+	off64_t offset;
+	off64_t length;
+};
+
+// Parses value of the Range header for a file of size @p size. Returns
+// std::nullopt if the header has to be ignored (it is invalid, uses other unit
+// than bytes or specifies too many ranges) and an empty vector if none of the
+// ranges is satisfiable. The ranges are sorted and the overlapping or adjacent
+// ones are coalesced, so no byte of the file is sent twice.
+static std::optional<std::vector<ByteRange>>
+parse_byte_ranges(StringView value, off64_t size) {
+	constexpr size_t MAX_RANGES = 16;
+	if (not has_prefix(value, "bytes="))
+		return std::nullopt;
+
+	value.remove_prefix(6);
+	std::vector<ByteRange> ranges;
+	size_t specs_no = 0;
+	while (not value.empty()) {
+		size_t comma = value.find(',');
+		StringView spec = value.substr(0, comma);
+		value.remove_prefix(comma == StringView::npos ? value.size()
+		                                              : comma + 1);
+		while (not spec.empty() and is_space(spec.front()))
+			spec.remove_prefix(1);
+		while (not spec.empty() and is_space(spec.back()))
+			spec.remove_suffix(1);
+		if (spec.empty())
+			continue;
 
-		} else
-			line += c;
+		if (++specs_no > MAX_RANGES)
+			return std::nullopt;
+
+		size_t dash = spec.find('-');
+		if (dash == StringView::npos)
+			return std::nullopt;
+
+		StringView first = spec.substr(0, dash);
+		StringView last = spec.substr(dash + 1);
+		if (first.empty()) {
+			// The last bytes of the file
+			auto suffix_len = str2num<uint64_t>(last);
+			if (not suffix_len)
+				return std::nullopt;
+
+			off64_t len = std::min<uint64_t>(*suffix_len, size);
+			if (len > 0)
+				ranges.push_back({size - len, len});
+			continue;
+		}
+
+		auto beg = str2num<uint64_t>(first);
+		if (not beg)
+			return std::nullopt;
+
+		uint64_t end = size - 1;
+		if (not last.empty()) {
+			auto opt = str2num<uint64_t>(last);
+			if (not opt or *opt < *beg)
+				return std::nullopt;
+
+			end = std::min(end, *opt);
+		}
+
+		if (*beg < uint64_t(size))
+			ranges.push_back({off64_t(*beg), off64_t(end - *beg + 1)});
 	}
 
-	return (state_ == OK ? line : "");
-}
+	if (specs_no == 0)
+		return std::nullopt;
+
+	std::sort(ranges.begin(), ranges.end(),
+	          [](const ByteRange& a, const ByteRange& b) {
+		          return a.offset < b.offset;
+	          });
+	size_t coalesced_no = 0;
+	for (auto& r : ranges) {
+		if (coalesced_no > 0) {
+			auto& last = ranges[coalesced_no - 1];
+			if (r.offset <= last.offset + last.length) {
+				last.length = std::max(last.length,
+				                       r.offset + r.length - last.offset);
+				continue;
+			}
+		}
 
-pair<string, string> Connection::parse_header_line(const string& header) {
-	size_t beg = header.find(':'), end;
-	if (beg == string::npos) {
-		error400();
-		return pair<string, string>();
+		ranges[coalesced_no++] = r;
 	}
 
-	// Check for white space in field-name
-	end = header.find(' ');
-	if (end != string::npos && end < beg) {
-		error400();
-		return pair<string, string>();
+	ranges.resize(coalesced_no);
+	return ranges;
+}
+
+static string multipart_boundary() {
+	thread_local std::mt19937_64 gen {std::random_device {}()};
+	char buff[32];
+	int len = snprintf(buff, sizeof(buff), "sim-%016" PRIx64, gen());
+	return string(buff, len);
+}
+
+StringView Connection::read_head() {
+	// Empty lines before the request line are ignored
+	while (has_prefix(input_, "\r\n"))
+		input_.remove_prefix(2);
+
+	constexpr char terminator[] = "\r\n\r\n";
+	constexpr size_t terminator_len = sizeof(terminator) - 1;
+	auto* end = static_cast<const char*>(
+	   memmem(input_.data(), std::min(input_.size(), MAX_HEAD_LENGTH),
+	          terminator, terminator_len));
+	if (not end) {
+		if (input_.size() >= MAX_HEAD_LENGTH)
+			error431();
+		else
+			state_ = CLOSED; // Incomplete head
+
+		return {};
 	}
 
-	string ret = header.substr(0, beg);
-	// Erase leading white space
-	end = header.size();
-	while (is_space(header[end - 1]))
-		--end;
+	StringView head = input_.substr(0, end - input_.data() + terminator_len);
+	input_.remove_prefix(head.size());
+	return head;
+}
 
-	// Erase trailing white space
-	while (++beg < header.size() && is_space(header[beg])) {
+StringView Connection::read_content(size_t len) {
+	if (input_.size() < len) {
+		state_ = CLOSED; // Truncated content
+		return {};
 	}
 
-	return make_pair(ret, header.substr(beg, end - beg));
+	StringView content = input_.substr(0, len);
+	input_.remove_prefix(len);
+	return content;
 }
 
 void Connection::read_post(HttpRequest& req) {
 	size_t content_length = 0;
 	{
-		auto opt =
-		   str2num<decltype(content_length)>(req.headers["Content-Length"]);
+		StringView len_str = req.headers.get("Content-Length");
+		auto opt = str2num<decltype(content_length)>(
+		   len_str.empty() ? StringView("0") : len_str);
 		if (not opt)
 			return error400();
 
 		content_length = *opt;
 	}
 
-	int c = '\0';
-	string field_name, field_content;
-	bool is_name;
-	string& con_type = req.headers["Content-Type"];
-	LimitedReader reader(*this, content_length);
+	StringView content = read_content(content_length);
+	if (state_ == CLOSED)
+		return;
 
+	CStringView con_type = req.headers.get("Content-Type");
 	if (has_prefix(con_type, "text/plain")) {
-		for (; c != -1;) {
-			// Clear all variables
-			field_name = field_content = "";
-			is_name = true;
-
-			while ((c = reader.get_char()) != -1) {
-				if (c == '\r') {
-					if (peek() == '\n')
-						c = reader.get_char();
-					break;
-				}
-
-				if (is_name && c == '=')
-					is_name = false;
-				else if (is_name)
-					field_name += c;
-				else
-					field_content += c;
-			}
-			if (state_ == CLOSED)
-				return;
-
-			req.form_data[field_name] = field_content;
+		// Fields are separated with CR (optionally followed by LF)
+		for (;;) {
+			auto* cr = static_cast<const char*>(
+			   memchr(content.data(), '\r', content.size()));
+			size_t len = (cr ? cr - content.data() : content.size());
+			StringView field = content.substr(0, len);
+			size_t eq = field.find('=');
+			req.form_data[field.substr(0, eq)] =
+			   (eq == StringView::npos ? string()
+			                           : field.substr(eq + 1).to_string());
+			if (not cr)
+				break;
+
+			content.remove_prefix(len + 1);
+			if (has_prefix(content, "\n"))
+				content.remove_prefix(1);
 		}
 
 	} else if (has_prefix(con_type, "application/x-www-form-urlencoded")) {
-		for (; c != -1;) {
-			// Clear all variables
-			field_name = field_content = "";
-			is_name = true;
-
-			while ((c = reader.get_char()) != -1) {
-				if (c == '&')
-					break;
-
-				if (is_name && c == '=')
-					is_name = false;
-				else if (is_name)
-					field_name += c;
-				else
-					field_content += c;
-			}
-			if (state_ == CLOSED)
-				return;
-
-			req.form_data[decode_uri(field_name).to_string()] =
-			   decode_uri(field_content).to_string();
+		for (;;) {
+			auto* amp = static_cast<const char*>(
+			   memchr(content.data(), '&', content.size()));
+			size_t len = (amp ? amp - content.data() : content.size());
+			StringView field = content.substr(0, len);
+			size_t eq = field.find('=');
+			req.form_data[decode_uri(field.substr(0, eq)).to_string()] =
+			   (eq == StringView::npos
+			       ? string()
+			       : decode_uri(field.substr(eq + 1)).to_string());
+			if (not amp)
+				break;
+
+			content.remove_prefix(len + 1);
 		}
 
 	} else if (has_prefix(con_type, "multipart/form-data")) {
@@ -167,208 +297,42 @@ void Connection::read_post(HttpRequest& req) {
 			return;
 		}
 
-		string boundary =
-		   "\r\n--"; // Is always part of a request, except at the beginning
-		boundary += con_type.substr(beg + 9);
-
-		// Compute p array for KMP algorithm
-		std::vector<int> p(boundary.size());
-		size_t k = 0;
-		p[0] = 0;
-
-		for (size_t i = 1; i < boundary.size(); ++i) {
-			while (k > 0 && boundary[k] != boundary[i])
-				k = p[k - 1];
-
-			if (boundary[k] == boundary[i])
-				++k;
-			p[i] = k;
+		StringView boundary = StringView(con_type).substr(beg + 9);
+		boundary = boundary.substr(0, boundary.find(';'));
+		if (boundary.size() >= 2 and boundary.front() == '"' and
+		    boundary.back() == '"') {
+			boundary = boundary.substr(1, boundary.size() - 2);
 		}
+		if (boundary.empty())
+			return error400();
 
-		// Search for boundary
-		int fd = -1;
-		FILE* tmp_file = nullptr;
-		bool first_boundary = true;
-		k = 2; // Because "\r\n" may not exist at the beginning
-
-		// TODO: consider changing structure of the while below
-		// While we can read
-		// In each loop pass parse EXACTLY one field
-		while ((c = reader.get_char()) != -1) {
-			while (k > 0 && boundary[k] != c)
-				k = p[k - 1];
-
-			if (boundary[k] == c)
-				++k;
-			// If we have found a boundary
-			if (k == boundary.size()) {
-				if (first_boundary) {
-					first_boundary = false;
-				} else {
-					// Manage last field
-					if (fd == -1) { // Normal variable
-						// Erase boundary: +1 because we did not append the last
-						// character to the boundary
-						field_content.erase(
-						   (field_content.size() < boundary.size()
-						       ? 0
-						       : field_content.size() - boundary.size() + 1));
-						req.form_data[field_name] = field_content;
-
-					} else { // File
-						// Get file size
-						fflush(tmp_file);
-						fseek(tmp_file, 0, SEEK_END);
-						size_t tmp_file_size = ftell(tmp_file);
-						// Erase boundary: +1 because we did not append the last
-						// character to the boundary
-						ftruncate(fileno(tmp_file),
-						          (tmp_file_size < boundary.size()
-						              ? 0
-						              : tmp_file_size - boundary.size() + 1));
-
-						fclose(tmp_file);
-						tmp_file = nullptr;
-						fd = -1;
-					}
-				}
-
-				// Prepare next field
-				// Ignore LFCR or "--"
-				(void)reader.get_char();
-				if (reader.get_char() == -1) {
-					error400();
-					goto safe_return;
-				}
-
-				// Headers
-				for (;;) {
-					field_content = ""; // Header in this case
-
-					while ((c = reader.get_char()) != -1) {
-						// Found CRLF
-						if (c == '\n' && field_content.size() &&
-						    field_content.back() == '\r') {
-							field_content.pop_back();
-							break;
-
-						} else if (field_content.size() > MAX_HEADER_LENGTH) {
-							error431();
-							goto safe_return;
-						}
-
-						field_content += c;
-					}
-
-					if (state_ != OK) // Something went wrong
-						goto safe_return;
-
-					if (field_content.empty()) // End of headers
-						break;
-
-					D(stdlog("header: '", field_content, '\'');)
-					pair<string, string> header =
-					   parse_header_line(field_content);
-					if (state_ != OK) // Something went wrong
-						goto safe_return;
-
-					if (to_lower(header.first) == "content-disposition") {
-						// extract all needed information
-						size_t st = 0, last = 0;
-						field_name = "";
-						header.second += ';';
-						string var_name, var_val;
-						char tmp_filename[] = "/tmp/sim-server-tmp.XXXXXX";
-
-						// extract all variables from header content
-						while ((last = header.second.find(';', st)) !=
-						       string::npos) {
-							while (is_blank(header.second[st]))
-								++st;
-
-							var_name = var_val = "";
-							// extract var_name
-							while (st < last && !is_blank(header.second[st]) &&
-							       header.second[st] != '=') {
-								var_name += header.second[st++];
-							}
-
-							// extract var_val
-							if (header.second[st] == '=') {
-								++st; // this is safe because last character is
-								      // always ';'
-
-								if (header.second[st] == '"')
-									while (++st < last &&
-									       header.second[st] != '"') {
-										if (header.second[st] == '\\')
-											++st; // safe because last character
-											      // is ';'
-										var_val += header.second[st];
-									}
-
-								else
-									while (st < last &&
-									       !is_blank(header.second[st])) {
-										var_val += header.second[st++];
-									}
-							}
-							st = last + 1;
-
-							// Check for specific values
-							if (var_name == "filename" && fd == -1) {
-								umask(
-								   077); // Only we can access temporary files
-								if ((fd = mkstemp(tmp_filename)) == -1) {
-									error507();
-									goto safe_return;
-								}
-
-								// store client filename
-								field_content = var_val;
-
-							} else if (var_name == "name")
-								field_name = var_val;
-						}
-
-						// Add file field to req.form_data
-						if (fd != -1) {
-							if (tmp_file) {
-								fclose(tmp_file);
-								tmp_file = nullptr;
-							}
-
-							tmp_file = fdopen(fd, "w");
-							req.form_data.files[field_name] = tmp_filename;
-							// field_name => client filename
-							req.form_data[field_name] = field_content;
-						}
-					}
-				}
-				k = p[k - 1];
-
-			} else if (fd == -1) {
-				field_content += c;
-				if (field_content.size() > MAX_CONTENT_LENGTH) {
-					error413();
-					goto safe_return;
-				}
-
-			} else
-				putc(c, tmp_file);
+		// Files are created next to the internal files, so that moving them
+		// there is just a rename
+		MultipartFormDataParser parser(boundary, req.form_data, UPLOADS_DIR,
+		                               MAX_HEADER_LENGTH, MAX_CONTENT_LENGTH);
+		using Status = MultipartFormDataParser::Status;
+		(void)parser.feed(content);
+		switch (parser.finish()) {
+		case Status::NEED_MORE_DATA:
+		case Status::FINISHED: return;
+		case Status::MALFORMED: return error400();
+		case Status::HEADER_TOO_LONG: return error431();
+		case Status::FIELD_TOO_LONG: return error413();
+		case Status::FILE_ERROR: return error507();
 		}
 
-	safe_return:
-		// Remove trash
-		if (fd != -1)
-			fclose(tmp_file);
-
 	} else
 		error415();
 }
 
 void Connection::error400() {
-	send("<html>\n"
+	send("HTTP/1.1 400 Bad Request\r\n"
+	     "Server: sim-server\r\n"
+	     "Connection: close\r\n"
+	     "Content-Type: text/html; charset=utf-8\r\n"
+	     "Content-Length: 116\r\n"
+	     "\r\n"
+	     "<html>\n"
 	     "<head><title>400 Bad Request</title></head>\n"
 	     "<body>\n"
 	     "<center><h1>400 Bad Request</h1></center>\n"
@@ -505,6 +469,22 @@ void Connection::error501() {
 	state_ = CLOSED;
 }
 
+void Connection::error503() {
+	send("HTTP/1.1 503 Service Unavailable\r\n"
+	     "Server: sim-server\r\n"
+	     "Connection: close\r\n"
+	     "Content-Type: text/html; charset=utf-8\r\n"
+	     "Content-Length: 132\r\n"
+	     "\r\n"
+	     "<html>\n"
+	     "<head><title>503 Service Unavailable</title></head>\n"
+	     "<body>\n"
+	     "<center><h1>503 Service Unavailable</h1></center>\n"
+	     "</body>\n"
+	     "</html>\n");
+	state_ = CLOSED;
+}
+
 void Connection::error504() {
 	send("HTTP/1.1 504 Gateway Timeout\r\n"
 	     "Server: sim-server\r\n"
@@ -540,14 +520,17 @@ void Connection::error507() {
 HttpRequest Connection::get_request() {
 	HttpRequest req;
 
-	// Get request line
-	string request_line = get_header_line(), tmp;
-	while (state_ == OK && request_line.empty())
-		request_line = get_header_line();
-
+	// The request line and the headers
+	StringView head = read_head();
 	if (state_ == CLOSED)
 		return req;
 
+	size_t request_line_len = head.find("\r\n");
+	StringView request_line = head.substr(0, request_line_len);
+	// Header lines, without the terminating empty line
+	StringView header_lines = head.substr(
+	   request_line_len + 2, head.size() - request_line_len - 4);
+
 	D(stdlog("\033[33mREQUEST: ", request_line, "\033[m");)
 	// Extract method
 	size_t beg = 0, end = 0;
@@ -574,7 +557,7 @@ HttpRequest Connection::get_request() {
 	while (end < request_line.size() && !is_space(request_line[end]))
 		++end;
 
-	req.target = request_line.substr(beg, end - beg);
+	req.target = request_line.substr(beg, end - beg).to_string();
 	if (req.target.compare(0, 1, "/") != 0) {
 		error400();
 		return req;
@@ -587,7 +570,7 @@ HttpRequest Connection::get_request() {
 	while (end < request_line.size() && !is_space(request_line[end]))
 		++end;
 
-	req.http_version = request_line.substr(beg, end - beg);
+	req.http_version = request_line.substr(beg, end - beg).to_string();
 	if (req.http_version.compare(0, 7, "HTTP/1.") != 0 ||
 	    (req.http_version.compare(7, string::npos, "0") != 0 &&
 	     req.http_version.compare(7, string::npos, "1") != 0)) {
@@ -595,24 +578,31 @@ HttpRequest Connection::get_request() {
 		return req;
 	}
 
-	// Read headers
-	req.headers["Content-Length"] = '0';
-	string header;
-
-	D(auto tmplog = stdlog("HEADERS:\n");)
-	while ((header = get_header_line()).size()) {
-		D(tmplog("\t", header, "\n");)
-		pair<string, string> hdr = parse_header_line(header);
-
-		if (state_ == CLOSED)
-			return req;
-
-		req.headers[hdr.first] = hdr.second;
+	D(stdlog("HEADERS:\n", header_lines);)
+	if (not req.headers.parse(header_lines)) {
+		error400();
+		return req;
 	}
-	D(tmplog.flush();)
 
-	if (state_ == CLOSED)
-		return req;
+	if (req.method == HttpRequest::GET) {
+		conditions_ = {
+		   req.headers.get("Range").to_string(),
+		   req.headers.get("If-Range").to_string(),
+		   req.headers.get("If-None-Match").to_string(),
+		   req.headers.get("If-Modified-Since").to_string(),
+		};
+	}
+	accept_encoding_ = req.headers.get("Accept-Encoding").to_string();
+	http_1_0_ = (req.http_version == "HTTP/1.0");
+
+	// HTTP/1.1 connections are persistent by default, HTTP/1.0 ones have to
+	// ask for it
+	if (keep_alive_) {
+		StringView options = req.headers.get("Connection");
+		keep_alive_ = (req.http_version == "HTTP/1.0"
+		                  ? list_contains(options, "keep-alive")
+		                  : not list_contains(options, "close"));
+	}
 
 	// Read content
 	if (req.method == HttpRequest::POST) {
@@ -621,7 +611,9 @@ HttpRequest Connection::get_request() {
 	}
 
 	{
-		auto opt = str2num<decltype(end)>(req.headers["Content-Length"]);
+		StringView len_str = req.headers.get("Content-Length");
+		auto opt = str2num<decltype(end)>(
+		   len_str.empty() ? StringView("0") : len_str);
 		if (not opt) {
 			error400();
 			return req;
@@ -636,20 +628,11 @@ HttpRequest Connection::get_request() {
 			return req;
 		}
 
-		try {
-			req.content.resize(end);
-		} catch (...) {
-			error507();
+		StringView content = read_content(end);
+		if (state_ == CLOSED)
 			return req;
-		}
-
-		for (beg = 0; beg < end; ++beg) {
-			int c = get_char();
-			if (c == -1)
-				return req;
 
-			req.content[beg] = c;
-		}
+		req.content = content.to_string();
 	}
 
 	return req;
@@ -659,41 +642,47 @@ void Connection::send(const char* str, size_t len) {
 	if (state_ == CLOSED)
 		return;
 
-	size_t pos = 0;
-	ssize_t written;
-
-	while (pos < len) {
-		written = write(sock_fd_, str + pos, len - pos);
-		D(stdlog("written: ", written);)
-
-		if (written == -1) {
-			state_ = CLOSED;
-			break;
-		}
-
-		pos += written;
-	}
+	output_.data.append(str, len);
 }
 
-void Connection::send_response(const HttpResponse& res) {
+string Connection::response_head(const HttpResponse& res,
+                                 StringView status_code,
+                                 bool skip_content_type,
+                                 bool vary_accept_encoding) {
 	string str = "HTTP/1.1 ";
 	str.reserve(res.content.size + 500);
-	str.append(res.status_code.data(), res.status_code.size).append("\r\n");
+	str.append(status_code.data(), status_code.size()).append("\r\n");
 	str += "Server: sim-server\r\n";
-	str += "Connection: close\r\n";
+	str += (keep_alive_ ? "Connection: keep-alive\r\n"
+	                    : "Connection: close\r\n");
 
+	bool vary_sent = false;
 	for (auto&& [name, val] : res.headers) {
 		if (name == "server" || name == "connection" ||
-		    name == "content-length") {
+		    name == "content-length" ||
+		    (skip_content_type && name == "content-type")) {
 			continue;
 		}
 
 		str += name;
 		str += ": ";
 		str += val;
+		if (vary_accept_encoding && equals_lower(name, "vary")) {
+			// Merged, as there may be only one Vary header
+			vary_sent = true;
+			if (val.empty()) {
+				str += "Accept-Encoding";
+			} else if (!list_contains(val, "accept-encoding") &&
+			           !list_contains(val, "*")) {
+				str += ", Accept-Encoding";
+			}
+		}
 		str += "\r\n";
 	}
 
+	if (vary_accept_encoding && !vary_sent)
+		str += "Vary: Accept-Encoding\r\n";
+
 	for (auto&& [name, val] : res.cookies) {
 		str += "Set-Cookie: ";
 		str += name;
@@ -718,14 +707,37 @@ void Connection::send_response(const HttpResponse& res) {
 		}
 	})
 
+	return str;
+}
+
+void Connection::send_response(const HttpResponse& res) {
+	StringView status_code(res.status_code.data(), res.status_code.size);
 	switch (res.content_type) {
-	case HttpResponse::TEXT:
-		str += "Content-Length: ";
-		str += to_string(res.content.size);
-		str += "\r\n\r\n";
-		str += res.content;
+	case HttpResponse::TEXT: {
+		// Generated content is compressed if it is large enough
+		StringView content(res.content.data(), res.content.size);
+		bool compressible =
+		   (content.size() >= MIN_COMPRESSED_CONTENT_SIZE &&
+		    res.headers.get("content-encoding").empty() &&
+		    is_compressible(res.headers.get("content-type")));
+		string str = response_head(res, status_code, false, compressible);
+		string compressed;
+		if (compressible) {
+			auto coding = choose_content_coding(accept_encoding_);
+			if (coding != ContentCoding::IDENTITY) {
+				compressed =
+				   compress(content, coding, CompressionLevel::FAST);
+				content = compressed;
+				back_insert(str, "Content-Encoding: ",
+				            content_coding_name(coding), "\r\n");
+			}
+		}
+
+		back_insert(str, "Content-Length: ", content.size(), "\r\n\r\n",
+		            content);
 		send(str);
 		break;
+	}
 
 	case HttpResponse::FILE:
 	case HttpResponse::FILE_TO_REMOVE:
@@ -753,29 +765,213 @@ void Connection::send_response(const HttpResponse& res) {
 			return error404();
 
 		off64_t fsize = sb.st_size;
-		str += "Accept-Ranges: none\r\n"; // Not supported yet, change to: bytes
-		str += "Content-Length: ";
-		str += to_string(fsize);
-		str += "\r\n\r\n";
+		string headers = "Accept-Ranges: bytes\r\n";
+		// Conditional and range requests apply only to complete responses
+		bool full_content = (status_code == "200 OK");
+
+		// Validators of persistent files
+		string etag, last_modified;
+		if (full_content && res.content_type == HttpResponse::FILE) {
+			etag = file_etag(sb.st_ino, fsize, sb.st_mtim);
+			last_modified = date("%a, %d %b %Y %H:%M:%S GMT", sb.st_mtime);
+			if (res.headers.get("etag").empty())
+				back_insert(headers, "ETag: ", etag, "\r\n");
+			if (res.headers.get("last-modified").empty())
+				back_insert(headers, "Last-Modified: ", last_modified, "\r\n");
+
+			// If-None-Match takes precedence over If-Modified-Since
+			bool not_modified = false;
+			if (!conditions_.if_none_match.empty()) {
+				not_modified =
+				   etag_list_matches(conditions_.if_none_match, etag, true);
+			} else if (auto since =
+			              parse_http_date(conditions_.if_modified_since)) {
+				not_modified = (sb.st_mtime <= *since);
+			}
 
-		constexpr size_t buff_length = 1 << 20;
-		char buff[buff_length];
+			if (not_modified) {
+				send(concat_tostr(response_head(res, "304 Not Modified", false),
+				                  headers, "\r\n"));
+				break;
+			}
+		}
 
-		send(str);
-		if (state_ == CLOSED)
-			return;
+		// If-Range makes the range conditional on the file being unchanged
+		bool if_range_holds = conditions_.if_range.empty() ||
+		                      (!etag.empty() &&
+		                       (etag_list_matches(conditions_.if_range, etag,
+		                                          false) ||
+		                        conditions_.if_range == last_modified));
+		std::vector<ByteRange> ranges;
+		if (full_content && !conditions_.range.empty() && if_range_holds) {
+			auto parsed = parse_byte_ranges(conditions_.range, fsize);
+			if (parsed && parsed->empty()) {
+				send(concat_tostr(
+				   response_head(res, "416 Range Not Satisfiable", false),
+				   headers, "Content-Range: bytes */", fsize,
+				   "\r\nContent-Length: 0\r\n\r\n"));
+				break;
+			}
 
-		// Read from file and write to socket
-		off64_t pos = 0;
-		ssize_t read_len;
-		while (pos < fsize && state_ == OK &&
-		       (read_len = read(fd, buff, buff_length)) != -1) {
-			send(buff, read_len);
-			pos += read_len;
+			if (parsed)
+				ranges = std::move(*parsed);
 		}
+
+		string str;
+		std::vector<Output::FilePart> parts;
+		if (ranges.empty()) {
+			str = concat_tostr(response_head(res, status_code, false), headers,
+			                   "Content-Length: ", fsize, "\r\n\r\n");
+			parts.push_back({0, fsize, {}});
+
+		} else if (ranges.size() == 1) {
+			auto [offset, length] = ranges[0];
+			str = concat_tostr(response_head(res, "206 Partial Content", false),
+			                   headers, "Content-Range: bytes ", offset, '-',
+			                   offset + length - 1, '/', fsize,
+			                   "\r\nContent-Length: ", length, "\r\n\r\n");
+			parts.push_back({offset, length, {}});
+
+		} else {
+			// multipart/byteranges: every part is preceded by its own headers
+			string boundary = multipart_boundary();
+			StringView content_type = res.headers.get("content-type");
+			if (content_type.empty())
+				content_type = "application/octet-stream";
+
+			auto part_head = [&](const ByteRange& r) {
+				return concat_tostr("--", boundary,
+				                    "\r\nContent-Type: ", content_type,
+				                    "\r\nContent-Range: bytes ", r.offset, '-',
+				                    r.offset + r.length - 1, '/', fsize,
+				                    "\r\n\r\n");
+			};
+
+			string first_part_head = part_head(ranges[0]);
+			uint64_t content_length = first_part_head.size();
+			for (size_t i = 0; i < ranges.size(); ++i) {
+				string after =
+				   (i + 1 < ranges.size()
+				       ? concat_tostr("\r\n", part_head(ranges[i + 1]))
+				       : concat_tostr("\r\n--", boundary, "--\r\n"));
+				content_length += ranges[i].length + after.size();
+				parts.push_back({ranges[i].offset, ranges[i].length,
+				                 std::move(after)});
+			}
+
+			str = concat_tostr(response_head(res, "206 Partial Content", true),
+			                   headers,
+			                   "Content-Type: multipart/byteranges; boundary=",
+			                   boundary, "\r\nContent-Length: ", content_length,
+			                   "\r\n\r\n", first_part_head);
+		}
+
+		send(str);
+		// The file is sent by the owner of the output (the opened file stays
+		// readable even if the remover deletes it)
+		output_.file = std::move(fd);
+		output_.file_parts = std::move(parts);
+		break;
+	}
+
+	if (state_ == OK)
+		output_.keep_alive = keep_alive_;
+
+	state_ = CLOSED;
+}
+
+std::shared_ptr<ResponseStream> Connection::send_streamed_response_head(
+   const HttpResponse& res, std::function<void(ResponseStream&)> wake_reader) {
+	// HTTP/1.0 clients do not know the chunked transfer coding, they learn the
+	// end of the content from the closing of the connection
+	bool chunked = !http_1_0_;
+	if (!chunked)
+		keep_alive_ = false;
+
+	// The size of the content is unknown, so it is compressed if its type is
+	// compressible
+	bool compressible = (res.headers.get("content-encoding").empty() &&
+	                     is_compressible(res.headers.get("content-type")));
+	auto coding = (compressible ? choose_content_coding(accept_encoding_)
+	                            : ContentCoding::IDENTITY);
+	StringView status_code(res.status_code.data(), res.status_code.size);
+	string str = response_head(res, status_code, false, compressible);
+	if (coding != ContentCoding::IDENTITY)
+		back_insert(str, "Content-Encoding: ", content_coding_name(coding),
+		            "\r\n");
+	str += (chunked ? "Transfer-Encoding: chunked\r\n\r\n" : "\r\n");
+	send(str);
+
+	auto stream = std::make_shared<ResponseStream>(
+	   chunked, std::move(wake_reader), ResponseStream::MAX_WRITE_WAIT, coding);
+	if (state_ == OK) {
+		output_.stream = stream;
+		output_.keep_alive = keep_alive_;
+	} else {
+		stream->abort(); // Nobody will read it
+	}
+
+	state_ = CLOSED;
+	return stream;
+}
+
+bool Connection::send_cached_file(const StaticFilesCache::File& file,
+                                  bool fingerprinted) {
+	// Range requests are served from the disk
+	if (!conditions_.range.empty())
+		return false;
+
+	auto coding = choose_content_coding(accept_encoding_);
+	auto it = file.representations.find(coding);
+	if (it == file.representations.end()) {
+		coding = ContentCoding::IDENTITY;
+		it = file.representations.find(coding);
+	}
+	auto& repr = it->second;
+
+	HttpResponse res;
+	res.headers["Content-Type"] = file.content_type;
+	res.headers["Accept-Ranges"] = "bytes";
+	res.headers["ETag"] = repr.etag;
+	res.headers["Last-Modified"] =
+	   date("%a, %d %b %Y %H:%M:%S GMT", file.mtime);
+	if (file.representations.size() > 1)
+		res.headers["Vary"] = "Accept-Encoding";
+	if (coding != ContentCoding::IDENTITY)
+		res.headers["Content-Encoding"] = content_coding_name(coding);
+
+	if (fingerprinted) {
+		// The URL changes together with the file, so the response never
+		// becomes stale and browsers need not even revalidate it
+		res.headers["Cache-Control"] = "public, max-age=31536000, immutable";
+	} else {
+		res.set_cache(true, 100 * 24 * 60 * 60, false); // 100 days
+	}
+
+	// If-None-Match takes precedence over If-Modified-Since
+	bool not_modified = false;
+	if (!conditions_.if_none_match.empty()) {
+		not_modified =
+		   etag_list_matches(conditions_.if_none_match, repr.etag, true);
+	} else if (auto since = parse_http_date(conditions_.if_modified_since)) {
+		not_modified = (file.mtime <= *since);
+	}
+
+	if (not_modified) {
+		send(concat_tostr(response_head(res, "304 Not Modified", false),
+		                  "\r\n"));
+	} else {
+		send(concat_tostr(response_head(res, "200 OK", false),
+		                  "Content-Length: ", repr.content->size(),
+		                  "\r\n\r\n"));
+		output_.shared_data = repr.content;
 	}
 
+	if (state_ == OK)
+		output_.keep_alive = keep_alive_;
+
 	state_ = CLOSED;
+	return true;
 }
 
 } // namespace server
@@ -2,76 +2,95 @@
 
 #include "http_request.hh"
 #include "http_response.hh"
+#include "response_stream.hh"
+#include "static_files_cache.hh"
 
-#include <simlib/likely.hh>
+#include <memory>
+#include <simlib/file_descriptor.hh>
+#include <vector>
 
 namespace server {
 
+/**
+ * HTTP connection working on an in-memory request: the response is appended
+ * to an Output instead of being sent (the event-driven server does the I/O
+ * itself).
+ */
 class Connection {
 private:
-	static const size_t BUFFER_SIZE = 1 << 16;
-	static const int POLL_TIMEOUT = 20 * 1000; // in milliseconds
 	static const size_t MAX_CONTENT_LENGTH = 10 << 20; // 10 MiB
-	static const size_t MAX_HEADER_LENGTH = 8192;
+	static const size_t MAX_HEADER_LENGTH = 8192; // Of a multipart part
+	// Request line and headers
+	static constexpr size_t MAX_HEAD_LENGTH = 64 << 10; // 64 KiB
 
 public:
 	enum State : uint8_t { OK, CLOSED };
 
-private:
-	State state_;
-	int sock_fd_, buff_size_, pos_;
-	unsigned char buffer_[BUFFER_SIZE];
-
-	int peek();
-
-	int get_char() {
-		int res = peek();
-		++pos_;
-		return res;
-	}
-
-	class LimitedReader {
-		Connection& conn_;
-		size_t read_limit_;
-
-	public:
-		LimitedReader(Connection& cn, size_t rl) : conn_(cn), read_limit_(rl) {}
-
-		size_t limit() const { return read_limit_; }
-
-		int get_char() {
-			if (UNLIKELY(read_limit_ == 0))
-				return -1;
-
-			--read_limit_;
-			return conn_.get_char();
-		}
+	// Response of the connection
+	struct Output {
+		std::string data;
+		// Content sent right after the data, shared with the static files
+		// cache instead of being copied
+		std::shared_ptr<const std::string> shared_data;
+		// If the response content is a file: the parts of it to send after the
+		// data, each followed by its data_after
+		FileDescriptor file;
+		struct FilePart {
+			off64_t offset;
+			off64_t length;
+			std::string data_after;
+		};
+		std::vector<FilePart> file_parts;
+		// If the response content is generated while it is sent: the content
+		// to send after the data
+		std::shared_ptr<ResponseStream> stream;
+		// Whether the connection may be reused after sending the response
+		bool keep_alive = false;
 	};
 
-	std::string get_header_line();
-	std::pair<std::string, std::string>
-	parse_header_line(const std::string& header);
+private:
+	State state_ = OK;
+	StringView input_;
+	Output& output_;
+	bool keep_alive_;
+	// Request headers that apply to file responses (of GET requests)
+	struct {
+		std::string range, if_range, if_none_match, if_modified_since;
+	} conditions_;
+	// Value of the request's Accept-Encoding header
+	std::string accept_encoding_;
+	bool http_1_0_ = false; // The request is an HTTP/1.0 one
+
+	/// Reads the request line and the headers (with the terminating empty
+	/// line). The result is a view into the input.
+	StringView read_head();
+
+	/// Reads @p len bytes of the content. The result is a view into the input.
+	StringView read_content(size_t len);
+
 	void read_post(HttpRequest& req);
 
+	/// Status line and headers of the response, without the terminating
+	/// empty line. If @p vary_accept_encoding is true, Accept-Encoding is
+	/// added to the Vary header.
+	std::string response_head(const HttpResponse& res, StringView status_code,
+	                          bool skip_content_type,
+	                          bool vary_accept_encoding = false);
+
 public:
-	explicit Connection(int client_socket_fd)
-	   : state_(OK), sock_fd_(client_socket_fd), buff_size_(0), pos_(0) {}
+	/// Reads the request from @p raw_request and appends the response to
+	/// @p output. If @p allow_keep_alive is true and the client does not
+	/// object, the response is sent with "Connection: keep-alive" and
+	/// output.keep_alive is set.
+	Connection(StringView raw_request, Output& output,
+	           bool allow_keep_alive = false)
+	   : input_(raw_request), output_(output),
+	     keep_alive_(allow_keep_alive) {}
 
 	~Connection() = default;
 
 	State state() const { return state_; }
 
-	void clear() {
-		state_ = OK;
-		buff_size_ = 0;
-		pos_ = 0;
-	}
-
-	void assign(int new_sock_fd) {
-		sock_fd_ = new_sock_fd;
-		clear();
-	}
-
 	void error400();
 	void error403();
 	void error404();
@@ -81,6 +100,7 @@ public:
 	void error431();
 	void error500();
 	void error501();
+	void error503();
 	void error504();
 	void error507();
 
@@ -88,6 +108,26 @@ public:
 	void send(const char* str, size_t len);
 	void send(const std::string& str) { send(str.c_str(), str.size()); }
 	void send_response(const HttpResponse& res);
+
+	/// Sends the head of the response @p res whose content will be written to
+	/// the returned stream, which is put into the output. @p wake_reader is
+	/// passed to the stream.
+	std::shared_ptr<ResponseStream> send_streamed_response_head(
+	   const HttpResponse& res,
+	   std::function<void(ResponseStream&)> wake_reader);
+
+	/// Sends the cached static file @p file in response to the GET request
+	/// just read. If @p fingerprinted is true, the URL identifies the version
+	/// of the file, so the response is cacheable forever. Returns false (and
+	/// sends nothing) if the request has to be handled by Sim instead (range
+	/// requests).
+	bool send_cached_file(const StaticFilesCache::File& file,
+	                      bool fingerprinted);
+
+	/// Entity tag derived from the file metadata: a changed file gets a new
+	/// tag
+	static std::string file_etag(uint64_t inode, uint64_t size,
+	                             timespec mtime);
 };
 
 } // namespace server
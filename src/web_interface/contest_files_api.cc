@@ -39,29 +39,25 @@ void Sim::api_contest_files() {
 		CUSERNAME
 	};
 
-	auto append_column_names = [&] {
-		// clang-format off
-		append("[{\"fields\":["
-		           "\"overall_actions\","
-		           "{\"name\":\"rows\", \"columns\":["
-		               "\"id\","
-		               "\"name\","
-		               "\"description\","
-		               "\"file_size\","
-		               "\"modified\","
-		               "\"contest_id\","
-		               "\"creator_id\","
-		               "\"creator_username\","
-		               "\"actions\""
-		           "]}"
-		       "]}");
-		// clang-format on
-	};
+	// clang-format off
+	const std::string column_names = "{\"fields\":["
+	       "\"overall_actions\","
+	       "{\"name\":\"rows\", \"columns\":["
+	           "\"id\","
+	           "\"name\","
+	           "\"description\","
+	           "\"file_size\","
+	           "\"modified\","
+	           "\"contest_id\","
+	           "\"creator_id\","
+	           "\"creator_username\","
+	           "\"actions\""
+	       "]}"
+	   "]}";
+	// clang-format on
 
 	auto set_empty_response = [&] {
-		resp.content.clear();
-		append_column_names();
-		append(",\n\"\",[\n]]"); // Empty overall actions
+		api_list_empty({column_names, "\"\""}, true); // Empty overall actions
 	};
 
 	// Precess restrictions
@@ -141,27 +137,25 @@ void Sim::api_contest_files() {
 	if (not allow_access)
 		return set_empty_response();
 
-	// Execute query
-	auto res = mysql.query(intentional_unsafe_string_view(
-	   concat(query, " ORDER BY cf.id DESC LIMIT ", rows_limit)));
-
-	append_column_names();
-
 	// Overall actions
-	append(",\n\"");
+	std::string overall_actions = "\"";
 	if (uint(overall_perms & OverallPermissions::ADD))
-		append('A');
+		overall_actions += 'A';
 	if (uint(overall_perms & OverallPermissions::VIEW_CREATOR))
-		append('C');
-	append("\",[");
-
-	for (bool first = true; res.next();) {
-		if (first)
-			first = false;
-		else
-			append(',');
+		overall_actions += 'C';
+	overall_actions += '"';
 
-		append("\n[", json_stringify(res[FID]), ',', json_stringify(res[FNAME]),
+	// Execute query
+	ApiList list;
+	list.query = query.to_string();
+	list.key_column = "cf.id";
+	list.key_is_string = true;
+	list.rows_limit = rows_limit;
+	list.head = {column_names, std::move(overall_actions)};
+	list.rows_in_array = true;
+
+	api_list(list, [&](MySQL::Result& res) {
+		append('[', json_stringify(res[FID]), ',', json_stringify(res[FNAME]),
 		       ',', json_stringify(res[DESCRIPTION]), ',', res[FSIZE], ",\"",
 		       res[MODIFIED], "\",", res[CONTEST_ID], ',');
 
@@ -181,9 +175,8 @@ void Sim::api_contest_files() {
 		if (uint(perms & Permissions::DELETE))
 			append("D");
 		append("\"]");
-	}
-
-	append("\n]]");
+		return true;
+	});
 }
 
 void Sim::api_contest_file() {
@@ -0,0 +1,243 @@
+#include "contest_ranking.hh"
+
+#include <algorithm>
+#include <simlib/string_transform.hh>
+
+using sim::ContestProblem;
+using std::string;
+
+namespace server {
+
+const char* submission_status_text(SubmissionStatus status) noexcept {
+	using SS = SubmissionStatus;
+	switch (status) {
+	case SS::OK: return "OK";
+	case SS::WA: return "Wrong answer";
+	case SS::TLE: return "Time limit exceeded";
+	case SS::MLE: return "Memory limit exceeded";
+	case SS::RTE: return "Runtime error";
+	case SS::PENDING: return "Pending";
+	case SS::COMPILATION_ERROR: return "Compilation failed";
+	case SS::CHECKER_COMPILATION_ERROR: return "Checker compilation failed";
+	case SS::JUDGE_ERROR: return "Judge error";
+	}
+
+	return "Unknown"; // Shouldn't happen
+}
+
+void ContestRanking::set_entry(uint64_t owner_id, string owner_name,
+                               const Entry& entry) {
+	auto& owner = owners[owner_id];
+	owner.name = std::move(owner_name);
+	auto it = std::lower_bound(
+	   owner.entries.begin(), owner.entries.end(), entry.contest_problem_id,
+	   [](const Entry& e, uint64_t id) { return e.contest_problem_id < id; });
+	if (it != owner.entries.end() and
+	    it->contest_problem_id == entry.contest_problem_id) {
+		*it = entry;
+	} else {
+		owner.entries.insert(it, entry);
+	}
+}
+
+void ContestRanking::erase_entry(uint64_t owner_id,
+                                 uint64_t contest_problem_id) noexcept {
+	auto owner_it = owners.find(owner_id);
+	if (owner_it == owners.end())
+		return;
+
+	auto& entries = owner_it->second.entries;
+	auto it = std::lower_bound(
+	   entries.begin(), entries.end(), contest_problem_id,
+	   [](const Entry& e, uint64_t id) { return e.contest_problem_id < id; });
+	if (it != entries.end() and it->contest_problem_id == contest_problem_id)
+		entries.erase(it);
+
+	if (entries.empty())
+		owners.erase(owner_it);
+}
+
+bool ContestRanking::render_row(string& out, uint64_t owner_id,
+                                const Owner& owner, Scope scope,
+                                uint64_t scope_id, bool is_admin,
+                                bool show_ids, StringView curr_date) const {
+	size_t initial_size = out.size();
+	if (show_ids)
+		back_insert(out, '[', owner_id, ',');
+	else
+		out += "[null,";
+	back_insert(out, json_stringify(owner.name), ",[");
+
+	bool first = true;
+	for (auto& entry : owner.entries) {
+		auto problem_it = problems.find(entry.contest_problem_id);
+		if (problem_it == problems.end())
+			continue; // The contest problem has just been deleted
+		auto& problem = problem_it->second;
+		if ((scope == Scope::CONTEST_ROUND and
+		     problem.contest_round_id != scope_id) or
+		    (scope == Scope::CONTEST_PROBLEM and
+		     entry.contest_problem_id != scope_id)) {
+			continue;
+		}
+
+		auto round_it = rounds.find(problem.contest_round_id);
+		if (round_it == rounds.end())
+			continue; // The contest round has just been deleted
+		auto& round = round_it->second;
+		if (not is_admin and
+		    (not(round.begins <= curr_date) or
+		     not(round.ranking_exposure <= curr_date))) {
+			continue;
+		}
+
+		using SRM = ContestProblem::ScoreRevealingMode;
+		bool show_all = (is_admin or round.full_results <= curr_date);
+		bool show_full_status =
+		   (show_all or problem.score_revealing == SRM::SCORE_AND_FULL_STATUS);
+		bool show_score = (show_all or problem.score_revealing != SRM::NONE);
+
+		out += (first ? "\n[" : ",\n[");
+		first = false;
+		if (not show_ids)
+			out += "null,";
+		else if (show_full_status)
+			back_insert(out, entry.final_id, ',');
+		else
+			back_insert(out, entry.initial_final_id, ',');
+
+		back_insert(out, problem.contest_round_id, ',',
+		            entry.contest_problem_id, ',');
+		append_submission_status_json(out, entry.initial_final_status,
+		                              entry.final_full_status,
+		                              show_full_status);
+		if (show_score)
+			back_insert(out, ',', entry.final_score, ']');
+		else
+			out += ",null]";
+	}
+
+	if (first) { // No entry is visible
+		out.resize(initial_size);
+		return false;
+	}
+
+	out += "\n]]";
+	return true;
+}
+
+std::shared_ptr<const ContestRanking::View>
+ContestRanking::render_view(Scope scope, uint64_t scope_id, bool is_admin,
+                            StringView curr_date) const {
+	STACK_UNWINDING_MARK;
+
+	// The view depends on the time only through the rounds' states
+	string key =
+	   concat_tostr(int(scope), ' ', scope_id, (is_admin ? " admin " : " "));
+	if (not is_admin) {
+		for (auto& [id, round] : rounds) {
+			key += (round.begins <= curr_date and
+			                round.ranking_exposure <= curr_date
+			           ? 'v'
+			           : '-');
+			key += (round.full_results <= curr_date ? 'f' : '-');
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(views_mtx_);
+		auto it = views_.find(key);
+		if (it != views_.end())
+			return it->second;
+	}
+
+	auto view = std::make_shared<View>();
+	auto& json = view->json;
+	// clang-format off
+	json = "[\n{\"columns\":["
+	           "\"id\",\"name\","
+	           "{\"name\":\"submissions\",\"columns\":["
+	               "\"id\",\"contest_round_id\","
+	               "\"contest_problem_id\","
+	               "{\"name\":\"status\",\"fields\":["
+	                   "\"class\","
+	                   "\"text\""
+	               "]},"
+	               "\"score\""
+	           "]}"
+	       "]}";
+	// clang-format on
+
+	for (auto& [owner_id, owner] : owners) {
+		size_t separator_pos = json.size();
+		json += (view->rows.empty() ? ",\n" : ",");
+		size_t begin = json.size();
+		if (render_row(json, owner_id, owner, scope, scope_id, is_admin,
+		               is_admin, curr_date)) {
+			view->rows.emplace_back(owner_id, begin, json.size());
+		} else {
+			json.resize(separator_pos);
+		}
+	}
+	json += ']';
+
+	std::lock_guard<std::mutex> lock(views_mtx_);
+	if (views_.size() >= MAX_CACHED_VIEWS)
+		views_.clear();
+
+	views_.emplace(std::move(key), view);
+	return view;
+}
+
+string ContestRanking::render(Scope scope, uint64_t scope_id, bool is_admin,
+                              uint64_t session_uid,
+                              StringView curr_date) const {
+	STACK_UNWINDING_MARK;
+
+	auto view = render_view(scope, scope_id, is_admin, curr_date);
+	if (is_admin)
+		return view->json;
+
+	// The user sees the ids in their own row
+	auto row_it = std::lower_bound(
+	   view->rows.begin(), view->rows.end(), session_uid,
+	   [](auto& row, uint64_t id) { return std::get<0>(row) < id; });
+	if (row_it == view->rows.end() or std::get<0>(*row_it) != session_uid)
+		return view->json;
+
+	auto [owner_id, begin, end] = *row_it;
+	string res;
+	res.reserve(view->json.size() + 64);
+	res.append(view->json, 0, begin);
+	render_row(res, owner_id, owners.at(owner_id), scope, scope_id, false,
+	           true, curr_date);
+	res.append(view->json, end);
+	return res;
+}
+
+std::shared_ptr<const ContestRanking>
+ContestRankingCache::find(uint64_t contest_id) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	auto it = rankings_.find(contest_id);
+	return (it == rankings_.end() ? nullptr : it->second);
+}
+
+void ContestRankingCache::store(
+   uint64_t contest_id, std::shared_ptr<const ContestRanking> ranking) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	auto it = rankings_.find(contest_id);
+	if (it != rankings_.end()) {
+		// Another worker might have loaded a newer version in the meantime
+		if (it->second->version < ranking->version)
+			it->second = std::move(ranking);
+		return;
+	}
+
+	// Contests with the lowest ids are the oldest ones
+	if (rankings_.size() >= MAX_CONTESTS)
+		rankings_.erase(rankings_.begin());
+
+	rankings_.emplace(contest_id, std::move(ranking));
+}
+
+} // namespace server
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sim/constants.hh>
+#include <sim/contest_problem.hh>
+#include <sim/inf_datetime.hh>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace server {
+
+/// Returns the text shown for the submission status, e.g. "Wrong answer"
+const char* submission_status_text(SubmissionStatus status) noexcept;
+
+/// Appends to @p out the status JSON of a submission, e.g.
+/// ["initial green","OK"]
+template <class Str>
+void append_submission_status_json(Str& out, SubmissionStatus initial_status,
+                                   SubmissionStatus full_status,
+                                   bool show_full_status) {
+	out.append(show_full_status ? "[\"" : "[\"initial ");
+	auto status = (show_full_status ? full_status : initial_status);
+	out.append(css_color_class(status));
+	out.append("\",\"");
+	out.append(submission_status_text(status));
+	out.append("\"]");
+}
+
+/**
+ * In-memory copy of the materialized ranking of a contest (see
+ * sim/contest_ranking.hh) as of a specific version. Once shared, the object
+ * is not modified anymore: a newer version is made by copying it and applying
+ * the changed entries. The rendered views are cached inside the object, so
+ * they go away together with the version they were rendered from.
+ */
+class ContestRanking {
+public:
+	struct Round {
+		sim::InfDatetime begins;
+		sim::InfDatetime full_results;
+		sim::InfDatetime ranking_exposure;
+	};
+
+	struct Problem {
+		uint64_t contest_round_id;
+		sim::ContestProblem::ScoreRevealingMode score_revealing;
+	};
+
+	struct Entry {
+		uint64_t contest_problem_id;
+		uint64_t final_id;
+		SubmissionStatus final_full_status;
+		int64_t final_score;
+		uint64_t initial_final_id;
+		SubmissionStatus initial_final_status;
+	};
+
+	struct Owner {
+		std::string name;
+		std::vector<Entry> entries; // Sorted by contest_problem_id
+	};
+
+	enum class Scope { CONTEST, CONTEST_ROUND, CONTEST_PROBLEM };
+
+	// Rendered views are dropped all at once if there are more of them
+	static constexpr size_t MAX_CACHED_VIEWS = 64;
+
+	uint64_t version = 0;
+	std::map<uint64_t, Round> rounds; // By id
+	std::map<uint64_t, Problem> problems; // By id
+	std::map<uint64_t, Owner> owners; // By id
+
+private:
+	// The view with all the owners' rows, where the owners and submissions ids
+	// are hidden unless it is an admin's view. A user sees it with their own
+	// row (showing the ids) spliced in place of the anonymous one.
+	struct View {
+		std::string json;
+		// (owner id, beginning and end of the owner's row in json), sorted
+		std::vector<std::tuple<uint64_t, size_t, size_t>> rows;
+	};
+
+	mutable std::mutex views_mtx_;
+	mutable std::map<std::string, std::shared_ptr<const View>> views_;
+
+	/// Appends to @p out the row of the owner (nothing if none of the owner's
+	/// entries is visible), returns whether anything was appended
+	bool render_row(std::string& out, uint64_t owner_id, const Owner& owner,
+	                Scope scope, uint64_t scope_id, bool is_admin,
+	                bool show_ids, StringView curr_date) const;
+
+	std::shared_ptr<const View> render_view(Scope scope, uint64_t scope_id,
+	                                        bool is_admin,
+	                                        StringView curr_date) const;
+
+public:
+	ContestRanking() = default;
+
+	// The rendered views are not copied, as the copy is going to be modified
+	ContestRanking(const ContestRanking& other)
+	   : version(other.version), rounds(other.rounds),
+	     problems(other.problems), owners(other.owners) {}
+
+	ContestRanking& operator=(const ContestRanking&) = delete;
+
+	/// Sets the entry of the owner @p owner_id named @p owner_name
+	void set_entry(uint64_t owner_id, std::string owner_name,
+	               const Entry& entry);
+
+	/// Removes the entry of the owner @p owner_id in the contest problem
+	/// @p contest_problem_id (if there is one)
+	void erase_entry(uint64_t owner_id, uint64_t contest_problem_id) noexcept;
+
+	/// Returns the ranking JSON (used by the API) of the contest, contest round
+	/// or contest problem (depending on @p scope) with id @p scope_id, as seen
+	/// at @p curr_date by the user @p session_uid (0 if there is no session)
+	/// who is the contest admin iff @p is_admin
+	std::string render(Scope scope, uint64_t scope_id, bool is_admin,
+	                   uint64_t session_uid, StringView curr_date) const;
+};
+
+/// Shares the newest known versions of the contests' rankings among the
+/// server's workers
+class ContestRankingCache {
+public:
+	static constexpr size_t MAX_CONTESTS = 256;
+
+private:
+	std::mutex mtx_;
+	std::map<uint64_t, std::shared_ptr<const ContestRanking>> rankings_;
+
+public:
+	/// Returns nullptr if there is no cached ranking of the contest
+	/// @p contest_id
+	std::shared_ptr<const ContestRanking> find(uint64_t contest_id);
+
+	/// Caches @p ranking of the contest @p contest_id, unless a newer version
+	/// is already cached
+	void store(uint64_t contest_id,
+	           std::shared_ptr<const ContestRanking> ranking);
+};
+
+} // namespace server
@@ -148,26 +148,22 @@ void Sim::api_contest_users() {
 
 	enum ColumnIdx { UID, USERNAME, FNAME, LNAME, MODE };
 
-	auto append_column_names = [&] {
-		// clang-format off
-		append("[{\"fields\":["
-		           "\"overall_actions\","
-		           "{\"name\":\"rows\", \"columns\":["
-		                "\"id\","
-		                "\"username\","
-		                "\"first_name\","
-		                "\"last_name\","
-		                "\"mode\","
-		                "\"actions\""
-		           "]}"
-		       "]}");
-		// clang-format on
-	};
+	// clang-format off
+	const std::string column_names = "{\"fields\":["
+	       "\"overall_actions\","
+	       "{\"name\":\"rows\", \"columns\":["
+	            "\"id\","
+	            "\"username\","
+	            "\"first_name\","
+	            "\"last_name\","
+	            "\"mode\","
+	            "\"actions\""
+	       "]}"
+	   "]}";
+	// clang-format on
 
 	auto set_empty_response = [&] {
-		resp.content.clear();
-		append_column_names();
-		append(",\n\"\",[\n]]"); // Empty overall actions
+		api_list_empty({column_names, "\"\""}, true); // Empty overall actions
 	};
 
 	// Process restrictions
@@ -242,31 +238,27 @@ void Sim::api_contest_users() {
 	if (not allow_access)
 		return set_empty_response();
 
-	// Execute query
-	auto res = mysql.query(qfields, qwhere, " ORDER BY cu.user_id DESC LIMIT ",
-	                       rows_limit);
-
-	append_column_names();
-
 	// Overall actions
-	append(",\n\"");
+	std::string overall_actions = "\"";
 	if (uint(overall_perms & CUP::ADD_CONTESTANT))
-		append("Ac");
+		overall_actions += "Ac";
 	if (uint(overall_perms & CUP::ADD_MODERATOR))
-		append("Am");
+		overall_actions += "Am";
 	if (uint(overall_perms & CUP::ADD_OWNER))
-		append("Ao");
-	append("\",[");
-
-	auto curr_date = mysql_date();
-	for (bool first = true; res.next();) {
-		if (first)
-			first = false;
-		else
-			append(',');
+		overall_actions += "Ao";
+	overall_actions += '"';
 
+	// Execute query
+	ApiList list;
+	list.query = concat_tostr(qfields, qwhere);
+	list.key_column = "cu.user_id";
+	list.rows_limit = rows_limit;
+	list.head = {column_names, std::move(overall_actions)};
+	list.rows_in_array = true;
+
+	api_list(list, [&](MySQL::Result& res) {
 		// User id, username, first name, last name
-		append("\n[", res[UID], ',', json_stringify(res[USERNAME]), ',',
+		append('[', res[UID], ',', json_stringify(res[USERNAME]), ',',
 		       json_stringify(res[FNAME]), ',', json_stringify(res[LNAME]),
 		       ',');
 
@@ -292,9 +284,8 @@ void Sim::api_contest_users() {
 		if (uint(perms & CUP::EXPEL))
 			append("E");
 		append("\"]");
-	}
-
-	append("\n]]");
+		return true;
+	});
 }
 
 void Sim::api_contest_user() {
@@ -6,6 +6,7 @@
 #include <sim/contest.hh>
 #include <sim/contest_permissions.hh>
 #include <sim/contest_problem.hh>
+#include <sim/contest_ranking.hh>
 #include <sim/contest_round.hh>
 #include <sim/contest_user.hh>
 #include <sim/inf_datetime.hh>
@@ -46,27 +47,6 @@ inline bool whether_to_show_full_status(
 	__builtin_unreachable();
 }
 
-inline bool
-whether_to_show_score(sim::contest::Permissions cperms,
-                      InfDatetime full_results,
-                      const decltype(mysql_date())& curr_mysql_date,
-                      ContestProblem::ScoreRevealingMode score_revealing) {
-	// TODO: check append_submission_status() for making it use the new function
-	if (uint(cperms & sim::contest::Permissions::ADMIN))
-		return true;
-
-	if (full_results <= curr_mysql_date)
-		return true;
-
-	switch (score_revealing) {
-	case ContestProblem::ScoreRevealingMode::NONE: return false;
-	case ContestProblem::ScoreRevealingMode::ONLY_SCORE: return true;
-	case ContestProblem::ScoreRevealingMode::SCORE_AND_FULL_STATUS: return true;
-	}
-
-	__builtin_unreachable();
-}
-
 inline static InplaceBuff<32>
 color_class_json(sim::contest::Permissions cperms, InfDatetime full_results,
                  const decltype(mysql_date())& curr_mysql_date,
@@ -262,17 +242,13 @@ void Sim::api_contests() {
 	qfields.append("SELECT c.id, c.name, c.is_public, cu.mode");
 	qwhere.append(" FROM contests c LEFT JOIN contest_users cu ON "
 	              "cu.contest_id=c.id AND cu.user_id=",
-	              (session_is_open ? session_user_id : StringView("''")));
+	              (session_is_open ? session_user_id : StringView("''")),
+	              " WHERE TRUE"); // Needed to easily append constraints
 
 	enum ColumnIdx { CID, CNAME, IS_PUBLIC, USER_MODE };
 
-	auto qwhere_append = [&, where_was_added = false](auto&&... args) mutable {
-		if (where_was_added) {
-			qwhere.append(" AND ", std::forward<decltype(args)>(args)...);
-		} else {
-			qwhere.append(" WHERE ", std::forward<decltype(args)>(args)...);
-			where_was_added = true;
-		}
+	auto qwhere_append = [&](auto&&... args) {
+		qwhere.append(" AND ", std::forward<decltype(args)>(args)...);
 	};
 
 	// Get the overall permissions to the contests list
@@ -333,20 +309,21 @@ void Sim::api_contests() {
 	}
 
 	// Execute query
-	qfields.append(qwhere, " ORDER BY c.id DESC LIMIT ", rows_limit);
-	auto res = mysql.query(qfields);
-
+	ApiList list;
+	list.query = concat_tostr(qfields, qwhere);
+	list.key_column = "c.id";
+	list.rows_limit = rows_limit;
 	// Column names
 	// clang-format off
-	append("[\n{\"columns\":["
-	           "\"id\","
-	           "\"name\","
-	           "\"is_public\","
-	           "\"actions\""
-	       "]}");
+	list.head = {"{\"columns\":["
+	                 "\"id\","
+	                 "\"name\","
+	                 "\"is_public\","
+	                 "\"actions\""
+	             "]}"};
 	// clang-format on
 
-	while (res.next()) {
+	api_list(list, [&](MySQL::Result& res) {
 		StringView cid = res[CID];
 		StringView name = res[CNAME];
 		bool is_public = WONT_THROW(str2num<bool>(res[IS_PUBLIC]).value());
@@ -362,7 +339,7 @@ void Sim::api_contests() {
 		   is_public, cumode);
 
 		// Id
-		append(",\n[", cid, ",");
+		append('[', cid, ",");
 		// Name
 		append(json_stringify(name), ',');
 		// Is public
@@ -372,9 +349,8 @@ void Sim::api_contests() {
 		append_contest_actions_str(resp.content, contest_overall_perms,
 		                           contest_perms);
 		append(']');
-	}
-
-	append("\n]");
+		return true;
+	});
 }
 
 void Sim::api_contest() {
@@ -421,7 +397,9 @@ void Sim::api_contest() {
 	next_arg = url_args.extract_next_arg();
 	if (next_arg == "ranking") {
 		transaction.rollback(); // We only read data...
-		return api_contest_ranking(contest_perms, "contest_id", contest_id);
+		return api_contest_ranking(contest_perms, contest.id,
+		                           server::ContestRanking::Scope::CONTEST,
+		                           contest.id);
 	} else if (next_arg == "edit") {
 		transaction.rollback(); // We only read data...
 		return api_contest_edit(contest_id, contest_perms, contest.is_public);
@@ -502,15 +480,17 @@ void Sim::api_contest_round(StringView contest_round_id) {
 	StringView next_arg = url_args.extract_next_arg();
 	if (next_arg == "ranking") {
 		transaction.rollback(); // We only read data...
-		return api_contest_ranking(contest_perms, "contest_round_id",
-		                           contest_round_id);
+		return api_contest_ranking(
+		   contest_perms, contest.id,
+		   server::ContestRanking::Scope::CONTEST_ROUND, contest_round.id);
 	} else if (next_arg == "attach_problem") {
 		transaction.rollback(); // We only read data...
 		return api_contest_problem_add(contest.id, contest_round.id,
 		                               contest_perms);
 	} else if (next_arg == "edit") {
 		transaction.rollback(); // We only read data...
-		return api_contest_round_edit(contest_round.id, contest_perms);
+		return api_contest_round_edit(contest.id, contest_round.id,
+		                              contest_perms);
 	} else if (next_arg == "delete") {
 		transaction.rollback(); // We only read data...
 		return api_contest_round_delete(contest_round.id, contest_perms);
@@ -596,15 +576,17 @@ void Sim::api_contest_problem(StringView contest_problem_id) {
 		return api_contest_problem_statement(problem_id_str);
 	} else if (next_arg == "ranking") {
 		transaction.rollback(); // We only read data...
-		return api_contest_ranking(contest_perms, "contest_problem_id",
-		                           contest_problem_id);
+		return api_contest_ranking(
+		   contest_perms, contest.id,
+		   server::ContestRanking::Scope::CONTEST_PROBLEM, contest_problem.id);
 	} else if (next_arg == "rejudge_all_submissions") {
 		transaction.rollback(); // We only read data...
 		return api_contest_problem_rejudge_all_submissions(
 		   contest_problem_id, contest_perms, problem_id_str);
 	} else if (next_arg == "edit") {
 		transaction.rollback(); // We only read data...
-		return api_contest_problem_edit(contest_problem_id, contest_perms);
+		return api_contest_problem_edit(contest.id, contest_problem_id,
+		                                contest_perms);
 	} else if (next_arg == "delete") {
 		transaction.rollback(); // We only read data...
 		return api_contest_problem_delete(contest_problem_id, contest_perms);
@@ -1065,7 +1047,8 @@ void Sim::api_contest_round_clone(StringView contest_id,
 	append(new_round_id);
 }
 
-void Sim::api_contest_round_edit(uintmax_t contest_round_id,
+void Sim::api_contest_round_edit(uintmax_t contest_id,
+                                 uintmax_t contest_round_id,
                                  sim::contest::Permissions perms) {
 	STACK_UNWINDING_MARK;
 
@@ -1088,6 +1071,7 @@ void Sim::api_contest_round_edit(uintmax_t contest_round_id,
 		return api_error400(notifications);
 
 	// Update round
+	auto transaction = mysql.start_transaction();
 	auto curr_date = mysql_date();
 	auto stmt = mysql.prepare("UPDATE contest_rounds "
 	                          "SET name=?, begins=?, ends=?, full_results=?,"
@@ -1098,6 +1082,9 @@ void Sim::api_contest_round_edit(uintmax_t contest_round_id,
 	                      inf_timestamp_to_InfDatetime(full_results).to_str(),
 	                      inf_timestamp_to_InfDatetime(ranking_expo).to_str(),
 	                      contest_round_id);
+	// The times decide what the ranking shows
+	sim::contest_ranking::invalidate(mysql, contest_id);
+	transaction.commit();
 }
 
 void Sim::api_contest_round_delete(uintmax_t contest_round_id,
@@ -1231,7 +1218,8 @@ void Sim::api_contest_problem_rejudge_all_submissions(
 	jobs::notify_job_server();
 }
 
-void Sim::api_contest_problem_edit(StringView contest_problem_id,
+void Sim::api_contest_problem_edit(uintmax_t contest_id,
+                                   StringView contest_problem_id,
                                    sim::contest::Permissions perms) {
 	STACK_UNWINDING_MARK;
 
@@ -1313,6 +1301,8 @@ void Sim::api_contest_problem_edit(StringView contest_problem_id,
 	                 "WHERE id=?");
 	stmt.bind_and_execute(name, score_revealing, final_selecting_method,
 	                      contest_problem_id);
+	// The score revealing mode decides what the ranking shows
+	sim::contest_ranking::invalidate(mysql, contest_id);
 
 	transaction.commit();
 	jobs::notify_job_server();
@@ -1360,186 +1350,135 @@ void Sim::api_contest_problem_statement(StringView problem_id) {
 
 namespace {
 
-struct SubmissionOwner {
-	uint64_t id;
-	InplaceBuff<32> name; // static size is set manually to save memory
-
-	template <class... Args>
-	SubmissionOwner(uint64_t sowner, Args&&... args) : id(sowner) {
-		name.append(std::forward<Args>(args)...);
-	}
-
-	bool operator<(const SubmissionOwner& s) const noexcept {
-		return id < s.id;
-	}
-
-	bool operator==(const SubmissionOwner& s) const noexcept {
-		return id == s.id;
-	}
-};
-
-} // anonymous namespace
+// Shared by all the workers
+server::ContestRankingCache contest_ranking_cache;
 
-void Sim::api_contest_ranking(sim::contest::Permissions perms,
-                              StringView submissions_query_id_name,
-                              StringView query_id) {
+// Returns the current version of the contest's ranking, loading from the
+// database only what has changed since the cached version
+std::shared_ptr<const server::ContestRanking>
+load_contest_ranking(MySQL::Connection& mysql, uint64_t contest_id) {
 	STACK_UNWINDING_MARK;
+	using server::ContestRanking;
 
-	if (uint(~perms & sim::contest::Permissions::VIEW))
-		return api_error403();
-
-	// We read data several times, so transaction makes it consistent
+	// The ranking has to be consistent with its version
 	auto transaction = mysql.start_transaction();
 
-	// Gather submissions owners
-	auto stmt = mysql.prepare(intentional_unsafe_string_view(
-	   concat("SELECT u.id, u.first_name, u.last_name FROM submissions s JOIN "
-	          "users u ON s.owner=u.id WHERE s.",
-	          submissions_query_id_name,
-	          "=? AND s.contest_final=1 GROUP BY (u.id) ORDER BY u.id")));
-	stmt.bind_and_execute(query_id);
-
-	uintmax_t u_id;
-	decltype(User::first_name) fname;
-	decltype(User::last_name) lname;
-	stmt.res_bind_all(u_id, fname, lname);
-
-	std::vector<SubmissionOwner> sowners;
-	while (stmt.next())
-		sowners.emplace_back(u_id, fname, ' ', lname);
-
-	// Gather submissions
+	uint64_t version;
+	uint64_t reset_version;
+	// Loaded on every request for a ranking
+	auto& stmts = MySQL::statements_cache(mysql);
+	auto stmt = stmts.prepare("SELECT version, reset_version "
+	                          "FROM contest_rankings WHERE contest_id=?");
+	stmt->bind_and_execute(contest_id);
+	stmt->res_bind_all(version, reset_version);
+	if (not stmt->next())
+		version = reset_version = 0; // Nothing was submitted yet
+
+	auto cached = contest_ranking_cache.find(contest_id);
+	if (cached and cached->version == version)
+		return cached;
+
+	bool incremental = (cached and reset_version <= cached->version and
+	                    cached->version < version);
+	auto ranking = (incremental ? std::make_shared<ContestRanking>(*cached)
+	                            : std::make_shared<ContestRanking>());
+	ranking->version = version;
+
+	// Rounds and problems are few, so they are reloaded every time
+	ranking->rounds.clear();
+	stmt = stmts.prepare("SELECT id, begins, full_results, ranking_exposure "
+	                     "FROM contest_rounds WHERE contest_id=?");
+	stmt->bind_and_execute(contest_id);
 	decltype(ContestRound::id) cr_id;
+	decltype(ContestRound::begins) cr_begins;
 	decltype(ContestRound::full_results) cr_full_results;
+	decltype(ContestRound::ranking_exposure) cr_ranking_exposure;
+	stmt->res_bind_all(cr_id, cr_begins, cr_full_results, cr_ranking_exposure);
+	while (stmt->next()) {
+		ranking->rounds.emplace(
+		   cr_id,
+		   ContestRanking::Round {cr_begins.as_inf_datetime(),
+		                          cr_full_results.as_inf_datetime(),
+		                          cr_ranking_exposure.as_inf_datetime()});
+	}
+
+	ranking->problems.clear();
+	stmt = stmts.prepare("SELECT id, contest_round_id, score_revealing "
+	                     "FROM contest_problems WHERE contest_id=?");
+	stmt->bind_and_execute(contest_id);
 	decltype(ContestProblem::id) cp_id;
+	decltype(ContestProblem::contest_round_id) cp_contest_round_id;
 	decltype(ContestProblem::score_revealing) cp_score_revealing;
-	uintmax_t s_owner;
-	uintmax_t sf_id;
-	EnumVal<SubmissionStatus> sf_full_status;
-	int64_t sf_score;
-	uintmax_t si_id;
-	EnumVal<SubmissionStatus> si_initial_status;
-
-	// TODO: there is too much logic duplication (not only below) on whether to
-	// show full or initial status and show or not show the score
-	auto prepare_stmt = [&](auto&& extra_cr_sql, auto&&... extra_bind_params) {
-		// clang-format off
-		stmt = mysql.prepare(
-		   "SELECT cr.id, cr.full_results, cp.id, cp.score_revealing, sf.owner,"
-		   " sf.id, sf.full_status, sf.score, si.id, si.initial_status "
-		   "FROM submissions sf "
-		   "JOIN submissions si ON si.owner=sf.owner"
-		   " AND si.contest_problem_id=sf.contest_problem_id"
-		   " AND si.contest_initial_final=1 "
-		   "JOIN contest_rounds cr ON cr.id=sf.contest_round_id ",
-		      std::forward<decltype(extra_cr_sql)>(extra_cr_sql), " "
-		   "JOIN contest_problems cp ON cp.id=sf.contest_problem_id "
-		   "WHERE sf.", submissions_query_id_name, "=? AND sf.contest_final=1 "
-		   "ORDER BY sf.owner");
-		// clang-format on
-		stmt.bind_and_execute(
-		   std::forward<decltype(extra_bind_params)>(extra_bind_params)...,
-		   query_id);
-		stmt.res_bind_all(cr_id, cr_full_results, cp_id, cp_score_revealing,
-		                  s_owner, sf_id, sf_full_status, sf_score, si_id,
-		                  si_initial_status);
-	};
-
-	auto curr_date = mysql_date();
-
-	bool is_admin = uint(perms & sim::contest::Permissions::ADMIN);
-	if (is_admin) {
-		prepare_stmt("");
-	} else {
-		prepare_stmt("AND cr.begins<=? AND cr.ranking_exposure<=?", curr_date,
-		             curr_date);
+	stmt->res_bind_all(cp_id, cp_contest_round_id, cp_score_revealing);
+	while (stmt->next()) {
+		ranking->problems.emplace(
+		   cp_id, ContestRanking::Problem {cp_contest_round_id,
+		                                   cp_score_revealing});
 	}
 
-	append('[');
-	// Column names
 	// clang-format off
-	append("\n{\"columns\":["
-	           "\"id\",\"name\","
-	           "{\"name\":\"submissions\",\"columns\":["
-	               "\"id\",\"contest_round_id\","
-	               "\"contest_problem_id\","
-	               "{\"name\":\"status\",\"fields\":["
-	                   "\"class\","
-	                   "\"text\""
-	               "]},"
-	               "\"score\""
-	           "]}"
-	       "]}");
+	stmt = stmts.prepare(intentional_unsafe_string_view(concat(
+	   "SELECT e.owner, u.first_name, u.last_name, e.contest_problem_id,"
+	   " e.final_id, e.final_full_status, e.final_score, e.initial_final_id,"
+	   " e.initial_final_status "
+	   "FROM contest_ranking_entries e "
+	   "JOIN users u ON u.id=e.owner "
+	   "WHERE e.contest_id=? ",
+	   (incremental ? "AND e.version>?" : "AND e.final_id IS NOT NULL"))));
 	// clang-format on
-
-	const uint64_t session_uid =
-	   (session_is_open
-	       ? WONT_THROW(str2num<uintmax_t>(session_user_id).value())
-	       : 0);
-
-	bool first_owner = true;
-	std::optional<uintmax_t> prev_owner;
-	bool show_owner_and_submission_id = false;
-
-	while (stmt.next()) {
-		// Owner changes
-		if (first_owner or s_owner != prev_owner.value()) {
-			auto it = binary_find(sowners, SubmissionOwner(s_owner));
-			if (it == sowners.end())
-				continue; // Ignore submission as there is no owner to bind it
-				          // to (this maybe a little race condition, but if the
-				          // user will query again it will not be the case (with
-				          // the current owner))
-
-			if (first_owner) {
-				append(",\n[");
-				first_owner = false;
-			} else {
-				--resp.content.size; // remove trailing ','
-				append("\n]],[");
-			}
-
-			prev_owner = s_owner;
-			show_owner_and_submission_id =
-			   (is_admin or (session_is_open and session_uid == s_owner));
-			// Owner
-			if (show_owner_and_submission_id)
-				append(s_owner);
-			else
-				append("null");
-			// Owner name
-			append(',', json_stringify(it->name), ",[");
+	if (incremental)
+		stmt->bind_and_execute(contest_id, cached->version);
+	else
+		stmt->bind_and_execute(contest_id);
+
+	uint64_t e_owner;
+	decltype(User::first_name) u_first_name;
+	decltype(User::last_name) u_last_name;
+	uint64_t e_contest_problem_id;
+	MySQL::Optional<uint64_t> e_final_id;
+	MySQL::Optional<EnumVal<SubmissionStatus>> e_final_full_status;
+	MySQL::Optional<int64_t> e_final_score;
+	MySQL::Optional<uint64_t> e_initial_final_id;
+	MySQL::Optional<EnumVal<SubmissionStatus>> e_initial_final_status;
+	stmt->res_bind_all(e_owner, u_first_name, u_last_name, e_contest_problem_id,
+	                   e_final_id, e_final_full_status, e_final_score,
+	                   e_initial_final_id, e_initial_final_status);
+	while (stmt->next()) {
+		if (not e_final_id.has_value() or not e_initial_final_id.has_value()) {
+			ranking->erase_entry(e_owner, e_contest_problem_id);
+			continue;
 		}
 
-		bool show_full_status = whether_to_show_full_status(
-		   perms, cr_full_results, curr_date, cp_score_revealing);
+		ranking->set_entry(
+		   e_owner, concat_tostr(u_first_name, ' ', u_last_name),
+		   ContestRanking::Entry {e_contest_problem_id, e_final_id.value(),
+		                          e_final_full_status.value(),
+		                          e_final_score.value_or(0),
+		                          e_initial_final_id.value(),
+		                          e_initial_final_status.value()});
+	}
 
-		append("\n[");
-		if (not show_owner_and_submission_id) {
-			append("null,");
-		} else if (show_full_status) {
-			append(sf_id, ',');
-		} else {
-			append(si_id, ',');
-		}
+	contest_ranking_cache.store(contest_id, ranking);
+	return ranking;
+}
 
-		append(cr_id, ',', cp_id, ',');
-		append_submission_status(si_initial_status, sf_full_status,
-		                         show_full_status);
+} // anonymous namespace
 
-		bool show_score = whether_to_show_score(perms, cr_full_results,
-		                                        curr_date, cp_score_revealing);
-		if (show_score) {
-			append(',', sf_score, "],");
-		} else {
-			append(",null],");
-		}
-	}
+void Sim::api_contest_ranking(sim::contest::Permissions perms,
+                              uintmax_t contest_id,
+                              server::ContestRanking::Scope scope,
+                              uintmax_t scope_id) {
+	STACK_UNWINDING_MARK;
 
-	if (first_owner) // no submission was appended
-		append(']');
-	else {
-		--resp.content.size; // remove trailing ','
-		append("\n]]]");
-	}
+	if (uint(~perms & sim::contest::Permissions::VIEW))
+		return api_error403();
+
+	auto ranking = load_contest_ranking(mysql, contest_id);
+	const uint64_t session_uid =
+	   (session_is_open
+	       ? WONT_THROW(str2num<uintmax_t>(session_user_id).value())
+	       : 0);
+	append(ranking->render(scope, scope_id,
+	                       uint(perms & sim::contest::Permissions::ADMIN),
+	                       session_uid, mysql_date()));
 }
@@ -0,0 +1,703 @@
+#include "events_loop.hh"
+
+#include <cstring>
+#include <netinet/in.h>
+#include <simlib/debug.hh>
+#include <simlib/logger.hh>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using std::string;
+using std::chrono::steady_clock;
+
+namespace server {
+
+namespace {
+
+constexpr size_t READ_BUFF_SIZE = 1 << 16;
+
+// Header field names are case-insensitive, @p name has to be lowercase
+bool is_field(StringView field_name, StringView name) noexcept {
+	if (field_name.size() != name.size())
+		return false;
+
+	for (size_t i = 0; i < field_name.size(); ++i) {
+		if (tolower(field_name[i]) != name[i])
+			return false;
+	}
+
+	return true;
+}
+
+} // anonymous namespace
+
+void EventsLoop::epoll_ctl_or_throw(int op, int fd, uint32_t events,
+                                    void* ptr) {
+	epoll_event event;
+	event.events = events;
+	event.data.ptr = ptr;
+	if (epoll_ctl(epoll_fd_, op, fd, &event))
+		THROW("epoll_ctl()", errmsg());
+}
+
+void EventsLoop::set_accepting(bool accepting) {
+	if (accepting_ == accepting)
+		return;
+
+	accepting_ = accepting;
+	uint32_t events = (accepting ? EPOLLIN : 0U);
+	epoll_ctl_or_throw(EPOLL_CTL_MOD, socket_fd_, events,
+	                   &listening_socket_tag);
+}
+
+void EventsLoop::set_timeout(Client& c, std::list<Client*>& timeouts) {
+	c.deadline = steady_clock::now() +
+	             (&timeouts == &idle_timeouts_ ? idle_timeout_ : io_timeout_);
+	if (c.timeouts == &timeouts) {
+		timeouts.splice(timeouts.end(), timeouts, c.timeouts_it);
+		return;
+	}
+
+	clear_timeout(c);
+	c.timeouts = &timeouts;
+	c.timeouts_it = timeouts.emplace(timeouts.end(), &c);
+}
+
+void EventsLoop::clear_timeout(Client& c) {
+	if (c.timeouts) {
+		c.timeouts->erase(c.timeouts_it);
+		c.timeouts = nullptr;
+	}
+}
+
+void EventsLoop::release_content(Client* c) {
+	buffered_contents_size_ -= c->reserved_content_length;
+	c->reserved_content_length = 0;
+}
+
+void EventsLoop::close_client(Client* c) {
+	clear_timeout(*c);
+	drop_stream(c);
+	release_content(c);
+
+	stats_.connections += 1;
+	stats_.reused_connections += (c->requests_no > 1);
+	stats_.requests += c->requests_no;
+	stats_.max_requests = std::max(stats_.max_requests, c->requests_no);
+
+	c->state = Client::State::CLOSED;
+	(void)c->fd.close(); // Also removes the socket from epoll
+	closed_clients_.splice(closed_clients_.end(), clients_, c->clients_it);
+	set_accepting(true);
+}
+
+void EventsLoop::accept_clients() {
+	while (clients_.size() < max_clients_) {
+		sockaddr_in name;
+		socklen_t name_len = sizeof(name);
+		FileDescriptor fd {accept4(socket_fd_, (sockaddr*)&name, &name_len,
+		                           SOCK_NONBLOCK | SOCK_CLOEXEC)};
+		if (fd == -1) {
+			if (errno == EMFILE or errno == ENFILE) {
+				errlog("accept4()", errmsg());
+				break; // Wait until some client is closed
+			}
+
+			return; // EAGAIN or an aborted connection
+		}
+
+		auto it = clients_.emplace(clients_.end(), std::make_unique<Client>());
+		Client* c = it->get();
+		c->clients_it = it;
+		c->fd = std::move(fd);
+		inet_ntop(AF_INET, &name.sin_addr, c->ip, INET_ADDRSTRLEN);
+		epoll_ctl_or_throw(EPOLL_CTL_ADD, c->fd, EPOLLIN | EPOLLRDHUP, c);
+		set_timeout(*c, idle_timeouts_);
+	}
+
+	set_accepting(false);
+}
+
+void EventsLoop::start_writing(Client* c) {
+	c->state = Client::State::WRITING;
+	c->write_step = 0;
+	c->step_pos = 0;
+	if (c->out.stream)
+		streams_.emplace(c->out.stream.get(), c);
+
+	set_timeout(*c, io_timeouts_);
+	epoll_ctl_or_throw(EPOLL_CTL_MOD, c->fd, EPOLLOUT, c);
+	write_to(c);
+}
+
+void EventsLoop::drop_stream(Client* c) {
+	if (not c->out.stream)
+		return;
+
+	c->out.stream->abort();
+	streams_.erase(c->out.stream.get());
+	c->out.stream = nullptr;
+	c->stream_data = {};
+	c->stream_pos = 0;
+	c->waiting_for_stream = false;
+}
+
+void EventsLoop::finish_response(Client* c) {
+	if (not c->out.keep_alive)
+		return close_client(c);
+
+	drop_stream(c);
+	release_content(c);
+	c->state = Client::State::READING;
+	c->out = {};
+	c->headers_end = 0;
+	c->headers_scanned = 0;
+	epoll_ctl_or_throw(EPOLL_CTL_MOD, c->fd, EPOLLIN | EPOLLRDHUP, c);
+	if (c->in.empty()) {
+		string().swap(c->in); // Idle connections hold no buffers
+		set_timeout(*c, idle_timeouts_);
+	} else {
+		set_timeout(*c, io_timeouts_);
+	}
+	// The next request may be already buffered (pipelining)
+	process_input(c);
+}
+
+template <class ErrorFunc>
+void EventsLoop::respond_with_error(Client* c, ErrorFunc error_func) {
+	// The response closes the connection, so the rest of the input is
+	// irrelevant
+	c->in = {};
+	c->out = {};
+	Connection conn(StringView {}, c->out);
+	(conn.*error_func)();
+	start_writing(c);
+}
+
+bool EventsLoop::parse_headers(Client* c) {
+	StringView headers(c->in.data(), c->headers_end);
+	bool content_length_found = false;
+	c->content_length = 0;
+	while (not headers.empty()) {
+		size_t eol = headers.find("\r\n");
+		StringView line = headers.substr(0, eol);
+		headers.remove_prefix(std::min(headers.size(), eol + 2));
+
+		size_t colon = line.find(':');
+		if (colon == StringView::npos)
+			continue;
+
+		StringView field_name = line.substr(0, colon);
+		if (is_field(field_name, "transfer-encoding")) {
+			// Only the contents delimited by Content-Length are supported
+			respond_with_error(c, &Connection::error501);
+			return false;
+		}
+		if (not is_field(field_name, "content-length"))
+			continue;
+
+		// Proxies may pick a different one of the repeated values and see a
+		// different request
+		if (content_length_found) {
+			respond_with_error(c, &Connection::error400);
+			return false;
+		}
+		content_length_found = true;
+
+		StringView value = line.substr(colon + 1);
+		while (not value.empty() and is_space(value.front()))
+			value.remove_prefix(1);
+		while (not value.empty() and is_space(value.back()))
+			value.remove_suffix(1);
+		auto len = str2num<size_t>(value);
+		if (not len) {
+			respond_with_error(c, &Connection::error400);
+			return false;
+		}
+		if (*len > MAX_CONTENT_LENGTH) {
+			respond_with_error(c, &Connection::error413);
+			return false;
+		}
+
+		c->content_length = *len;
+	}
+
+	if (c->content_length >
+	    MAX_BUFFERED_CONTENTS_SIZE - buffered_contents_size_) {
+		respond_with_error(c, &Connection::error503);
+		return false;
+	}
+
+	c->reserved_content_length = c->content_length;
+	buffered_contents_size_ += c->content_length;
+	return true;
+}
+
+void EventsLoop::read_from(Client* c) {
+	for (;;) {
+		// Only the current request is read: its headers (if they are not
+		// complete, one byte more than their limit is enough to reject them)
+		// and then its declared content. The rest stays in the socket until
+		// the response is sent.
+		size_t wanted =
+		   (c->headers_end == 0 ? MAX_HEADERS_SIZE + 1
+		                        : c->headers_end + c->content_length);
+		if (c->in.size() >= wanted)
+			break;
+
+		size_t len = std::min(READ_BUFF_SIZE, wanted - c->in.size());
+		ssize_t rc = read(c->fd, read_buff_.get(), len);
+		if (rc == 0)
+			return close_client(c); // Client closed the connection
+
+		if (rc < 0) {
+			if (errno == EAGAIN or errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+
+			return close_client(c);
+		}
+
+		c->in.append(read_buff_.get(), rc);
+		if (size_t(rc) < len)
+			break; // Most likely there is nothing more to read
+	}
+
+	if (not c->in.empty())
+		set_timeout(*c, io_timeouts_);
+
+	process_input(c);
+}
+
+void EventsLoop::process_input(Client* c) {
+	if (c->headers_end == 0) {
+		// Empty lines before the request line are ignored
+		size_t skip = 0;
+		while (c->in.compare(skip, 2, "\r\n") == 0)
+			skip += 2;
+		if (skip > 0) {
+			c->in.erase(0, skip);
+			c->headers_scanned = 0;
+		}
+		if (c->in.empty())
+			return;
+
+		// Only the newly read data (and the possible beginning of the
+		// terminator before it) is searched
+		size_t from = (c->headers_scanned < 3 ? 0 : c->headers_scanned - 3);
+		auto* found = static_cast<const char*>(memmem(
+		   c->in.data() + from, c->in.size() - from, "\r\n\r\n", 4));
+		c->headers_scanned = c->in.size();
+		if (not found and c->in.size() <= MAX_HEADERS_SIZE)
+			return; // Headers are not complete
+
+		size_t pos = (found ? found - c->in.data() : c->in.size());
+		if (not found or pos + 4 > MAX_HEADERS_SIZE) {
+			respond_with_error(c, &Connection::error431);
+			return;
+		}
+
+		c->headers_end = pos + 4;
+		if (not parse_headers(c))
+			return;
+	}
+
+	if (c->in.size() < c->headers_end + c->content_length)
+		return; // Content is not complete
+
+	// Further data is not read until the response is sent
+	c->state = Client::State::PROCESSING;
+	clear_timeout(*c);
+	epoll_ctl_or_throw(EPOLL_CTL_MOD, c->fd, 0, c);
+
+	size_t request_len = c->headers_end + c->content_length;
+	string request;
+	if (request_len == c->in.size()) {
+		request = std::move(c->in);
+		c->in.clear();
+	} else {
+		// Pipelined requests stay buffered
+		request = c->in.substr(0, request_len);
+		c->in.erase(0, request_len);
+	}
+
+	++c->requests_no;
+	bool allow_keep_alive = (c->requests_no < max_requests_per_connection_);
+	if (serve_from_cache(c, request, allow_keep_alive))
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(tasks_mtx_);
+		tasks_.push_back({c, std::move(request), c->ip, allow_keep_alive});
+	}
+	tasks_cv_.notify_one();
+}
+
+bool EventsLoop::serve_from_cache(Client* c, StringView request,
+                                  bool allow_keep_alive) {
+	if (not has_prefix(request, "GET /kit/"))
+		return false;
+
+	Connection conn(request, c->out, allow_keep_alive);
+	HttpRequest req = conn.get_request();
+	if (conn.state() == Connection::OK) {
+		// Paths are matched verbatim, so the ones that need decoding miss the
+		// cache and are left to Sim
+		StringView target = req.target;
+		size_t query_beg = std::min(target.find('?'), target.size());
+		const auto* file = static_files_.find(target.substr(0, query_beg));
+		if (not file) {
+			c->out = {};
+			return false;
+		}
+
+		// Pages refer to the files with their versions as the query
+		bool fingerprinted =
+		   (target.substr(query_beg) == concat_tostr('?', file->version));
+		if (not conn.send_cached_file(*file, fingerprinted)) {
+			c->out = {};
+			return false;
+		}
+	}
+
+	start_writing(c);
+	return true;
+}
+
+void EventsLoop::write_to(Client* c) {
+	auto& out = c->out;
+	// Step 0 is the data, then every file part is followed by its data_after
+	size_t steps_no = 1 + 2 * out.file_parts.size();
+	while (c->write_step < steps_no) {
+		ssize_t rc;
+		// Let the headers share packets with the file content
+		int flags = (c->write_step + 1 < steps_no ? MSG_MORE : 0);
+		if (c->write_step == 0) {
+			// The data is followed by the shared data (if there is any), both
+			// are sent at once
+			StringView parts[2] = {out.data, {}};
+			if (out.shared_data)
+				parts[1] = *out.shared_data;
+
+			iovec iov[2];
+			int iovcnt = 0;
+			uint64_t skip = c->step_pos;
+			for (StringView part : parts) {
+				if (skip >= part.size()) {
+					skip -= part.size();
+					continue;
+				}
+
+				iov[iovcnt].iov_base = const_cast<char*>(part.data()) + skip;
+				iov[iovcnt++].iov_len = part.size() - skip;
+				skip = 0;
+			}
+			if (iovcnt == 0) {
+				++c->write_step;
+				c->step_pos = 0;
+				continue;
+			}
+
+			msghdr msg = {};
+			msg.msg_iov = iov;
+			msg.msg_iovlen = iovcnt;
+			rc = sendmsg(c->fd, &msg, flags);
+
+		} else if (c->write_step % 2 == 0) {
+			const string& data =
+			   out.file_parts[c->write_step / 2 - 1].data_after;
+			if (c->step_pos == data.size()) {
+				++c->write_step;
+				c->step_pos = 0;
+				continue;
+			}
+
+			rc = send(c->fd, data.data() + c->step_pos,
+			          data.size() - c->step_pos, flags);
+
+		} else {
+			auto& part = out.file_parts[c->write_step / 2];
+			if (c->step_pos == uint64_t(part.length)) {
+				++c->write_step;
+				c->step_pos = 0;
+				continue;
+			}
+
+			// Zero-copy: the file content does not go through user space
+			off64_t offset = part.offset + c->step_pos;
+			rc = sendfile64(c->fd, out.file, &offset,
+			                part.length - c->step_pos);
+			if (rc == 0)
+				return close_client(c); // File got truncated
+		}
+
+		if (rc < 0) {
+			if (errno == EAGAIN or errno == EWOULDBLOCK)
+				return set_timeout(*c, io_timeouts_);
+			if (errno == EINTR)
+				continue;
+
+			return close_client(c);
+		}
+
+		c->step_pos += rc;
+	}
+
+	if (out.stream)
+		return write_stream(c);
+
+	finish_response(c);
+}
+
+void EventsLoop::write_stream(Client* c) {
+	for (;;) {
+		if (c->stream_pos == c->stream_data.size()) {
+			c->stream_data.clear();
+			c->stream_pos = 0;
+			switch (c->out.stream->read(c->stream_data)) {
+			case ResponseStream::State::OPEN:
+				if (c->stream_data.empty()) {
+					// The worker is generating the content, so the client
+					// cannot be blamed for the inactivity
+					c->waiting_for_stream = true;
+					clear_timeout(*c);
+					epoll_ctl_or_throw(EPOLL_CTL_MOD, c->fd, 0, c);
+					return;
+				}
+				break;
+
+			case ResponseStream::State::FINISHED: return finish_response(c);
+
+			case ResponseStream::State::FAILED:
+			case ResponseStream::State::ABORTED:
+				// Closing the connection tells the client that the content is
+				// incomplete
+				return close_client(c);
+			}
+		}
+
+		ssize_t rc = send(c->fd, c->stream_data.data() + c->stream_pos,
+		                  c->stream_data.size() - c->stream_pos, 0);
+		if (rc < 0) {
+			if (errno == EAGAIN or errno == EWOULDBLOCK)
+				return set_timeout(*c, io_timeouts_);
+			if (errno == EINTR)
+				continue;
+
+			return close_client(c);
+		}
+
+		c->stream_pos += rc;
+	}
+}
+
+void EventsLoop::handle_event(Client* c, uint32_t events) {
+	switch (c->state) {
+	case Client::State::READING:
+		if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			read_from(c);
+		break;
+
+	case Client::State::PROCESSING:
+		// Only EPOLLHUP and EPOLLERR are reported - the client cannot be
+		// closed until its worker finishes, so stop watching it
+		c->hung_up = true;
+		epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c->fd, nullptr);
+		break;
+
+	case Client::State::WRITING:
+		if (events & (EPOLLHUP | EPOLLERR))
+			close_client(c);
+		else if (events & EPOLLOUT)
+			write_to(c);
+		break;
+
+	case Client::State::CLOSED: break;
+	}
+}
+
+void EventsLoop::push_completion(Completion completion) {
+	std::lock_guard<std::mutex> lock(completions_mtx_);
+	completions_.emplace_back(std::move(completion));
+	if (completions_.size() + woken_streams_.size() == 1)
+		eventfd_write(completions_fd_, 1);
+}
+
+void EventsLoop::wake_stream(ResponseStream& stream) {
+	std::lock_guard<std::mutex> lock(completions_mtx_);
+	woken_streams_.emplace_back(stream.shared_from_this());
+	if (completions_.size() + woken_streams_.size() == 1)
+		eventfd_write(completions_fd_, 1);
+}
+
+void EventsLoop::process_completions() {
+	std::vector<Completion> completions;
+	std::vector<std::shared_ptr<ResponseStream>> woken_streams;
+	{
+		eventfd_t x;
+		eventfd_read(completions_fd_, &x);
+		std::lock_guard<std::mutex> lock(completions_mtx_);
+		completions.swap(completions_);
+		woken_streams.swap(woken_streams_);
+	}
+
+	for (auto& completion : completions) {
+		Client* c = completion.client;
+		if (c->hung_up) {
+			c->out = std::move(completion.response);
+			close_client(c);
+			continue;
+		}
+
+		c->out = std::move(completion.response);
+		start_writing(c);
+	}
+
+	for (auto& stream : woken_streams) {
+		auto it = streams_.find(stream.get());
+		if (it == streams_.end())
+			continue; // The client is already gone
+
+		Client* c = it->second;
+		if (not c->waiting_for_stream)
+			continue;
+
+		c->waiting_for_stream = false;
+		set_timeout(*c, io_timeouts_);
+		epoll_ctl_or_throw(EPOLL_CTL_MOD, c->fd, EPOLLOUT, c);
+		write_stream(c);
+	}
+}
+
+void EventsLoop::handle_timeouts() {
+	auto now = steady_clock::now();
+	while (not idle_timeouts_.empty() and
+	       idle_timeouts_.front()->deadline <= now) {
+		close_client(idle_timeouts_.front());
+	}
+
+	while (not io_timeouts_.empty() and io_timeouts_.front()->deadline <= now) {
+		Client* c = io_timeouts_.front();
+		if (c->state == Client::State::READING)
+			respond_with_error(c, &Connection::error408);
+		else
+			close_client(c);
+	}
+}
+
+int EventsLoop::epoll_timeout() const {
+	steady_clock::time_point deadline = steady_clock::time_point::max();
+	for (auto* timeouts : {&idle_timeouts_, &io_timeouts_}) {
+		if (not timeouts->empty())
+			deadline = std::min(deadline, timeouts->front()->deadline);
+	}
+
+	if (deadline == steady_clock::time_point::max())
+		return -1;
+
+	using namespace std::chrono;
+	auto left = deadline - steady_clock::now();
+	return std::max<int64_t>(0,
+	                         duration_cast<milliseconds>(left).count() + 1);
+}
+
+void EventsLoop::report_stats() {
+	constexpr auto REPORT_INTERVAL = std::chrono::minutes(10);
+	auto now = steady_clock::now();
+	if (now < stats_.last_report + REPORT_INTERVAL)
+		return;
+
+	stats_.last_report = now;
+	if (stats_.connections == 0)
+		return;
+
+	stdlog("Connections: ", stats_.connections, " closed, ",
+	       stats_.requests * 100 / stats_.connections,
+	       " requests per 100 connections, ",
+	       stats_.reused_connections * 100 / stats_.connections,
+	       "% served more than one request, max: ", stats_.max_requests,
+	       " requests; open: ", clients_.size());
+	auto last_report = stats_.last_report;
+	stats_ = {};
+	stats_.last_report = last_report;
+}
+
+EventsLoop::EventsLoop(int socket_fd, size_t max_clients,
+                       StaticFilesCache& static_files,
+                       int static_files_watch_fd,
+                       std::chrono::milliseconds idle_timeout,
+                       std::chrono::milliseconds io_timeout,
+                       uint max_requests_per_connection)
+   : socket_fd_(socket_fd), max_clients_(max_clients),
+     idle_timeout_(idle_timeout), io_timeout_(io_timeout),
+     max_requests_per_connection_(max_requests_per_connection),
+     epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), static_files_(static_files),
+     completions_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+     read_buff_(new char[READ_BUFF_SIZE]) {
+	if (epoll_fd_ == -1)
+		THROW("epoll_create1()", errmsg());
+	if (completions_fd_ == -1)
+		THROW("eventfd()", errmsg());
+
+	epoll_ctl_or_throw(EPOLL_CTL_ADD, socket_fd_, EPOLLIN,
+	                   &listening_socket_tag);
+	epoll_ctl_or_throw(EPOLL_CTL_ADD, completions_fd_, EPOLLIN,
+	                   &completions_tag);
+	if (static_files_watch_fd != -1) {
+		epoll_ctl_or_throw(EPOLL_CTL_ADD, static_files_watch_fd, EPOLLIN,
+		                   &static_files_tag);
+	}
+}
+
+void EventsLoop::run() {
+	constexpr int MAX_EVENTS = 256;
+	epoll_event events[MAX_EVENTS];
+	while (not stopped_) {
+		int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, epoll_timeout());
+		if (n < 0 and errno != EINTR)
+			THROW("epoll_wait()", errmsg());
+
+		for (int i = 0; i < n; ++i) {
+			void* ptr = events[i].data.ptr;
+			if (ptr == &listening_socket_tag)
+				accept_clients();
+			else if (ptr == &completions_tag)
+				process_completions();
+			else if (ptr == &static_files_tag)
+				static_files_.handle_changes();
+			else
+				handle_event(static_cast<Client*>(ptr), events[i].events);
+		}
+
+		handle_timeouts();
+		closed_clients_.clear();
+		report_stats();
+	}
+}
+
+void EventsLoop::stop() {
+	{
+		std::lock_guard<std::mutex> lock(tasks_mtx_);
+		stopped_ = true;
+	}
+	tasks_cv_.notify_all();
+	eventfd_write(completions_fd_, 1); // Wakes up run()
+}
+
+std::optional<EventsLoop::Task> EventsLoop::pop_task() {
+	std::unique_lock<std::mutex> lock(tasks_mtx_);
+	tasks_cv_.wait(lock, [&] { return stopped_ or not tasks_.empty(); });
+	if (stopped_)
+		return std::nullopt;
+
+	Task task = std::move(tasks_.front());
+	tasks_.pop_front();
+	return task;
+}
+
+} // namespace server
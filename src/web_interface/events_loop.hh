@@ -0,0 +1,251 @@
+#pragma once
+
+#include "connection.hh"
+#include "static_files_cache.hh"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <simlib/file_descriptor.hh>
+#include <unordered_map>
+#include <vector>
+
+namespace server {
+
+/**
+ * Events loop of the event-driven sim-server: one thread accepts connections
+ * and does all the socket I/O using nonblocking sockets and epoll(7), so idle
+ * connections cost no threads. Once a request is completely received, it is
+ * passed as a Task to the workers (pop_task()), which parse it, handle it and
+ * pass the response back (respond()) to be sent. Requests for the static
+ * files are answered by the events loop itself, from the in-memory cache. A
+ * worker may also stream the response: then the events loop sends the
+ * content while the worker is generating it.
+ */
+class EventsLoop {
+public:
+	// Requests are buffered in memory before being passed to a worker
+	static constexpr size_t MAX_HEADERS_SIZE = 64 << 10; // 64 KiB
+	static constexpr size_t MAX_CONTENT_LENGTH = 128 << 20; // 128 MiB
+	// Limit of the total size of the contents of the requests buffered by all
+	// the connections, requests that would exceed it are rejected
+	static constexpr size_t MAX_BUFFERED_CONTENTS_SIZE = 512 << 20; // 512 MiB
+	// Maximum time of inactivity of a connection that is being read or
+	// written
+	static constexpr std::chrono::milliseconds IO_TIMEOUT =
+	   std::chrono::seconds(20);
+	// Maximum time a connection may wait for its (next) request
+	static constexpr std::chrono::milliseconds IDLE_TIMEOUT =
+	   std::chrono::seconds(10);
+	// Then the connection is closed after the response, so that clients
+	// cannot hold the connections forever
+	static constexpr uint MAX_REQUESTS_PER_CONNECTION = 1000;
+
+private:
+	struct Client {
+		enum class State : uint8_t { READING, PROCESSING, WRITING, CLOSED };
+
+		State state = State::READING;
+		FileDescriptor fd;
+		char ip[INET_ADDRSTRLEN];
+		// The client disconnected while its request was being processed
+		bool hung_up = false;
+		uint requests_no = 0;
+		std::list<std::unique_ptr<Client>>::iterator clients_it;
+
+		// Reading, may contain pipelined requests
+		std::string in;
+		size_t headers_end = 0; // 0 means that headers are not complete yet
+		// Prefix of in searched for the end of headers
+		size_t headers_scanned = 0;
+		size_t content_length = 0;
+		// Counted in the limit of the buffered contents until the response is
+		// sent
+		size_t reserved_content_length = 0;
+
+		// Writing
+		Connection::Output out;
+		size_t write_step = 0; // See write_to()
+		uint64_t step_pos = 0;
+		// Content of out.stream that is being sent
+		std::string stream_data;
+		size_t stream_pos = 0;
+		bool waiting_for_stream = false; // Nothing to send until it is woken up
+
+		std::chrono::steady_clock::time_point deadline;
+		// nullptr iff PROCESSING or waiting_for_stream
+		std::list<Client*>* timeouts = nullptr;
+		std::list<Client*>::iterator timeouts_it;
+	};
+
+public:
+	/// Completely received request, to be handled by a worker
+	struct Task {
+		Client* client;
+		std::string request;
+		std::string client_ip;
+		bool allow_keep_alive;
+	};
+
+private:
+	struct Completion {
+		Client* client;
+		Connection::Output response;
+	};
+
+	int socket_fd_;
+	size_t max_clients_;
+	const std::chrono::milliseconds idle_timeout_;
+	const std::chrono::milliseconds io_timeout_;
+	const uint max_requests_per_connection_;
+	FileDescriptor epoll_fd_;
+	StaticFilesCache& static_files_;
+	std::atomic<bool> stopped_ = false;
+
+	// Tasks are taken by the workers
+	std::mutex tasks_mtx_;
+	std::condition_variable tasks_cv_;
+	std::deque<Task> tasks_;
+
+	// Responses passed back to the events loop, which is woken up through
+	// eventfd, together with the streamed responses that have new content to
+	// send
+	FileDescriptor completions_fd_;
+	std::mutex completions_mtx_;
+	std::vector<Completion> completions_;
+	std::vector<std::shared_ptr<ResponseStream>> woken_streams_;
+
+	// Owns the open clients
+	std::list<std::unique_ptr<Client>> clients_;
+	size_t buffered_contents_size_ = 0; // See MAX_BUFFERED_CONTENTS_SIZE
+	bool accepting_ = true;
+	// Clients waiting for a (next) request, ordered by deadline
+	std::list<Client*> idle_timeouts_;
+	// Clients that are being read or written, ordered by deadline
+	std::list<Client*> io_timeouts_;
+	// Closed clients may still have events in the currently processed batch,
+	// so they are freed after it
+	std::list<std::unique_ptr<Client>> closed_clients_;
+	// Clients sending streamed responses, by the stream. Wake-ups of a stream
+	// may arrive after its client is gone, so they are looked up here.
+	std::unordered_map<const ResponseStream*, Client*> streams_;
+	// Every read goes through it, so that the input buffers of the clients
+	// grow only by what is actually read
+	std::unique_ptr<char[]> read_buff_;
+
+	struct {
+		// Of the closed connections
+		uint64_t connections = 0;
+		uint64_t reused_connections = 0; // Served more than one request
+		uint64_t requests = 0;
+		uint max_requests = 0;
+		std::chrono::steady_clock::time_point last_report =
+		   std::chrono::steady_clock::now();
+	} stats_;
+
+	// Tags of the non-client events
+	static inline char listening_socket_tag;
+	static inline char completions_tag;
+	static inline char static_files_tag;
+
+	void epoll_ctl_or_throw(int op, int fd, uint32_t events, void* ptr);
+
+	void set_accepting(bool accepting);
+
+	// Moves @p c to the end of @p timeouts with the deadline refreshed
+	void set_timeout(Client& c, std::list<Client*>& timeouts);
+
+	void clear_timeout(Client& c);
+
+	void release_content(Client* c);
+
+	void close_client(Client* c);
+
+	void accept_clients();
+
+	void start_writing(Client* c);
+
+	// Unless the stream has ended, its writer is told that nobody will read it
+	void drop_stream(Client* c);
+
+	// Called after the response is sent
+	void finish_response(Client* c);
+
+	template <class ErrorFunc>
+	void respond_with_error(Client* c, ErrorFunc error_func);
+
+	// Returns false iff the request is malformed (then the response is set)
+	bool parse_headers(Client* c);
+
+	void read_from(Client* c);
+
+	// Passes the first buffered request to a worker once it is complete
+	// (unless it is served from the static files cache)
+	void process_input(Client* c);
+
+	// Static files are served straight from the cache, without involving the
+	// workers. Returns false if the request has to be passed to a worker.
+	bool serve_from_cache(Client* c, StringView request, bool allow_keep_alive);
+
+	void write_to(Client* c);
+
+	// Sends the content of the streamed response, as long as there is some
+	void write_stream(Client* c);
+
+	void handle_event(Client* c, uint32_t events);
+
+	void push_completion(Completion completion);
+
+	void process_completions();
+
+	void handle_timeouts();
+
+	int epoll_timeout() const;
+
+	void report_stats();
+
+public:
+	/// @p static_files_watch_fd is the file descriptor returned by
+	/// static_files.watch(), -1 if the cache is not refreshed. The limits
+	/// other than the defaults are meant for the tests.
+	EventsLoop(int socket_fd, size_t max_clients,
+	           StaticFilesCache& static_files, int static_files_watch_fd,
+	           std::chrono::milliseconds idle_timeout = IDLE_TIMEOUT,
+	           std::chrono::milliseconds io_timeout = IO_TIMEOUT,
+	           uint max_requests_per_connection = MAX_REQUESTS_PER_CONNECTION);
+
+	EventsLoop(const EventsLoop&) = delete;
+	EventsLoop& operator=(const EventsLoop&) = delete;
+
+	/// Serves the connections until stop() is called
+	void run();
+
+	/// May be called from any thread, the open connections are closed once
+	/// the events loop is destroyed, which has to wait for the workers to
+	/// finish their tasks
+	void stop();
+
+	/* Workers (any threads) */
+
+	/// Blocks until there is a request to handle, returns std::nullopt once
+	/// the events loop is stopped
+	std::optional<Task> pop_task();
+
+	/// Passes @p response to the request of @p task to be sent. A streamed
+	/// response is passed once its head is ready.
+	void respond(const Task& task, Connection::Output response) {
+		push_completion({task.client, std::move(response)});
+	}
+
+	/// To be called by the writer of a streamed response (see respond()) when
+	/// the events loop has to be woken up to send its content
+	void wake_stream(ResponseStream& stream);
+};
+
+} // namespace server
@@ -0,0 +1,91 @@
+#include "http_headers.hh"
+
+#include <cstring>
+#include <limits>
+
+namespace server {
+
+std::optional<CStringView> HttpHeaders::find_parsed(StringView key) const
+   noexcept {
+	for (auto it = parsed_.rbegin(); it != parsed_.rend(); ++it) {
+		if (it->name_len != key.size())
+			continue;
+
+		const char* name = parsed_lines_.data() + it->name_beg;
+		bool equal = true;
+		for (size_t i = 0; equal and i < key.size(); ++i)
+			equal = (tolower(name[i]) == tolower(key[i]));
+
+		if (equal)
+			return CStringView(parsed_lines_.data() + it->value_beg,
+			                   it->value_len);
+	}
+
+	return std::nullopt;
+}
+
+bool HttpHeaders::parse(StringView lines) {
+	clear();
+	if (lines.size() >= std::numeric_limits<uint32_t>::max())
+		return false;
+
+	parsed_lines_.assign(lines.data(), lines.size());
+	char* data = parsed_lines_.data();
+	size_t size = parsed_lines_.size();
+	for (size_t pos = 0; pos < size;) {
+		// Lines end with CRLF, a lone LF belongs to the line (memchr(3) is
+		// vectorized, so it is used for the scanning)
+		size_t line_end = size;
+		for (size_t from = pos; from < size;) {
+			auto* lf =
+			   static_cast<char*>(memchr(data + from, '\n', size - from));
+			if (not lf)
+				break;
+
+			if (lf > data + pos and lf[-1] == '\r') {
+				line_end = lf - 1 - data;
+				break;
+			}
+
+			from = lf - data + 1;
+		}
+
+		auto* colon =
+		   static_cast<char*>(memchr(data + pos, ':', line_end - pos));
+		if (not colon) {
+			clear();
+			return false;
+		}
+
+		size_t name_end = colon - data;
+		for (size_t i = pos; i < name_end; ++i) {
+			if (is_space(data[i])) { // Field name cannot contain white space
+				clear();
+				return false;
+			}
+		}
+
+		size_t value_beg = name_end + 1;
+		size_t value_end = line_end;
+		while (value_beg < value_end and is_space(data[value_beg]))
+			++value_beg;
+		while (value_end > value_beg and is_space(data[value_end - 1]))
+			--value_end;
+
+		// Make the name and the value null-terminated (value_end may be
+		// equal to size, then the string's terminator is overwritten with
+		// '\0', which is allowed)
+		data[name_end] = '\0';
+		data[value_end] = '\0';
+		parsed_.push_back({static_cast<uint32_t>(pos),
+		                   static_cast<uint32_t>(name_end - pos),
+		                   static_cast<uint32_t>(value_beg),
+		                   static_cast<uint32_t>(value_end - value_beg)});
+
+		pos = line_end + 2;
+	}
+
+	return true;
+}
+
+} // namespace server
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <map>
+#include <optional>
 #include <simlib/string_compare.hh>
 #include <simlib/string_transform.hh>
 #include <string>
+#include <vector>
 
 namespace server {
 
@@ -15,6 +17,19 @@ class HttpHeaders {
 	// header name => header value
 	std::map<std::string, std::string, Comparator> entries_;
 
+	// Headers parsed by parse(): names and values are null-terminated slices
+	// of parsed_lines_ (kept as offsets, so that copying and moving is
+	// trivial). They are looked up only if entries_ has no such header.
+	struct ParsedEntry {
+		uint32_t name_beg, name_len, value_beg, value_len;
+	};
+
+	std::string parsed_lines_;
+	std::vector<ParsedEntry> parsed_;
+
+	// Returns the value of the last parsed header @p key
+	std::optional<CStringView> find_parsed(StringView key) const noexcept;
+
 public:
 	HttpHeaders() = default;
 	HttpHeaders(const HttpHeaders&) = default;
@@ -23,8 +38,20 @@ public:
 	HttpHeaders& operator=(HttpHeaders&&) noexcept = default;
 	~HttpHeaders() = default;
 
+	/// Replaces the headers with the header lines @p lines (every one ending
+	/// with CRLF). The lines are copied into one buffer, which the parsed
+	/// headers reference, so that parsing needs no allocation per header.
+	/// Returns false iff a line is malformed (then the headers are cleared).
+	bool parse(StringView lines);
+
 	std::string& operator[](std::string&& key) {
-		return entries_[std::move(key)];
+		auto it = entries_.find(key);
+		if (it != entries_.end()) {
+			return it->second;
+		}
+		auto parsed = find_parsed(key);
+		return entries_[std::move(key)] =
+		          (parsed ? parsed->to_string() : std::string());
 	}
 
 	template<class Key>
@@ -32,7 +59,9 @@ public:
 		StringView strkey = std::forward<Key>(key);
 		auto it = entries_.find(strkey);
 		if (it == entries_.end()) {
-			return entries_[strkey.to_string()];
+			auto parsed = find_parsed(strkey);
+			return entries_[strkey.to_string()] =
+			          (parsed ? parsed->to_string() : std::string());
 		}
 		return it->second;
 	}
@@ -40,17 +69,23 @@ public:
 	CStringView get(StringView key) const noexcept {
 		auto it = entries_.find(key);
 		if (it == entries_.end()) {
-			return "";
+			return find_parsed(key).value_or("");
 		}
 		return it->second;
 	}
 
+	// Iteration covers only the headers set by operator[] (i.e. the response
+	// headers), not the parsed ones
 	[[nodiscard]] auto begin() noexcept { return entries_.begin(); }
 	[[nodiscard]] auto begin() const noexcept { return entries_.begin(); }
 	[[nodiscard]] auto end() noexcept { return entries_.end(); }
 	[[nodiscard]] auto end() const noexcept { return entries_.end(); }
 
-	void clear() noexcept { entries_.clear(); }
+	void clear() noexcept {
+		entries_.clear();
+		parsed_lines_.clear();
+		parsed_.clear();
+	}
 };
 
 } // namespace server
@@ -76,28 +76,22 @@ void Sim::api_jobs() {
 		JOB_LOG_VIEW
 	};
 
-	auto append_column_names = [&] {
-		// clang-format off
-		append("[\n{\"columns\":["
-		           "\"id\","
-		           "\"added\","
-		           "\"type\","
-		           "{\"name\":\"status\",\"fields\":[\"class\",\"text\"]},"
-		           "\"priority\","
-		           "\"creator_id\","
-		           "\"creator_username\","
-		           "\"info\","
-		           "\"actions\","
-		           "{\"name\":\"log\",\"fields\":[\"is_incomplete\",\"text\"]}"
-		       "]}");
-		// clang-format on
-	};
-
-	auto set_empty_response = [&] {
-		resp.content.clear();
-		append_column_names();
-		append("\n]");
-	};
+	// clang-format off
+	const std::string column_names = "{\"columns\":["
+	       "\"id\","
+	       "\"added\","
+	       "\"type\","
+	       "{\"name\":\"status\",\"fields\":[\"class\",\"text\"]},"
+	       "\"priority\","
+	       "\"creator_id\","
+	       "\"creator_username\","
+	       "\"info\","
+	       "\"actions\","
+	       "{\"name\":\"log\",\"fields\":[\"is_incomplete\",\"text\"]}"
+	   "]}";
+	// clang-format on
+
+	auto set_empty_response = [&] { api_list_empty({column_names}); };
 
 	bool allow_access = uint(jobs_perms & PERM::VIEW_ALL);
 	bool select_specified_job = false;
@@ -205,19 +199,20 @@ void Sim::api_jobs() {
 		return set_empty_response();
 
 	// Execute query
-	qfields.append(qwhere, " ORDER BY j.id DESC LIMIT ", rows_limit);
-	auto res = mysql.query(qfields);
-
-	append_column_names();
+	ApiList list;
+	list.query = concat_tostr(qfields, qwhere);
+	list.key_column = "j.id";
+	list.rows_limit = rows_limit;
+	list.head = {column_names};
 
-	while (res.next()) {
+	api_list(list, [&](MySQL::Result& res) {
 		EnumVal<JobType> job_type {WONT_THROW(
 		   str2num<std::underlying_type_t<JobType>>(res[JTYPE]).value())};
 		EnumVal<JobStatus> job_status {WONT_THROW(
 		   str2num<std::underlying_type_t<JobStatus>>(res[JSTATUS]).value())};
 
 		// clang-format off
-		append(",\n[", res[JID], ","
+		append('[', res[JID], ","
 		       "\"", res[ADDED], "\","
 		       "\"", job_type_str(job_type), "\",");
 		// clang-format on
@@ -293,7 +288,9 @@ void Sim::api_jobs() {
 			       ",\"seek for new tests\":",
 			       info.seek_for_new_tests ? "\"yes\"" : "\"no\"",
 			       ",\"reset scoring\":",
-			       info.reset_scoring ? "\"yes\"" : "\"no\"");
+			       info.reset_scoring ? "\"yes\"" : "\"no\"",
+			       ",\"stop group on failure\":",
+			       info.stop_group_on_failure ? "\"yes\"" : "\"no\"");
 
 			if (not res.is_null(AUX_ID)) {
 				append(",\"problem\":", res[AUX_ID]);
@@ -399,9 +396,8 @@ void Sim::api_jobs() {
 			       ',', json_stringify(res[JOB_LOG_VIEW]), ']');
 
 		append(']');
-	}
-
-	append("\n]");
+		return true;
+	});
 }
 
 void Sim::api_job() {
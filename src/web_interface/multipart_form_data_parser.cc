@@ -0,0 +1,297 @@
+#include "multipart_form_data_parser.hh"
+
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <simlib/debug.hh>
+#include <unistd.h>
+
+using std::string;
+
+namespace server {
+
+MultipartFormDataParser::MultipartFormDataParser(StringView boundary,
+                                                 HttpRequest::Form& form,
+                                                 string files_dir,
+                                                 size_t max_header_len,
+                                                 size_t max_field_len)
+   : form_(form), files_dir_(std::move(files_dir)),
+     max_header_len_(max_header_len), max_field_len_(max_field_len),
+     delimiter_(concat_tostr("\r\n--", boundary)),
+     // The first delimiter may be at the very beginning of the content
+     partial_delimiter_("\r\n") {}
+
+void MultipartFormDataParser::emit(StringView data) {
+	if (data.empty())
+		return;
+
+	if (file_ != -1) {
+		while (not data.empty()) {
+			ssize_t rc = write(file_, data.data(), data.size());
+			if (rc == -1 and errno == EINTR)
+				continue;
+
+			if (rc <= 0) {
+				status_ = Status::FILE_ERROR;
+				return;
+			}
+
+			data.remove_prefix(rc);
+		}
+
+	} else if (field_) {
+		if (field_->size() + data.size() > max_field_len_) {
+			status_ = Status::FIELD_TOO_LONG;
+			return;
+		}
+
+		field_->append(data.data(), data.size());
+	}
+}
+
+void MultipartFormDataParser::parse_body(StringView& data) {
+	// Continue matching the delimiter that started at the end of the previous
+	// block
+	while (not partial_delimiter_.empty()) {
+		size_t matched = partial_delimiter_.size();
+		size_t len = std::min(delimiter_.size() - matched, data.size());
+		StringView expected = StringView(delimiter_).substr(matched, len);
+		if (data.substr(0, len) != expected) {
+			// Not a delimiter: its first byte is data, but a delimiter may
+			// begin later in it
+			string rest = partial_delimiter_.substr(1);
+			emit(StringView(partial_delimiter_).substr(0, 1));
+			partial_delimiter_.clear();
+			StringView rest_view = rest;
+			parse_body(rest_view); // Cannot contain the whole delimiter
+			if (status_ != Status::NEED_MORE_DATA)
+				return;
+
+			continue;
+		}
+
+		data.remove_prefix(len);
+		if (matched + len < delimiter_.size()) {
+			partial_delimiter_.append(delimiter_, matched, len);
+			return; // Need more data
+		}
+
+		partial_delimiter_.clear();
+		if (state_ == State::BODY)
+			end_part();
+
+		state_ = State::DELIMITER_LINE;
+		buff_.clear();
+		return;
+	}
+
+	auto* found =
+	   memmem(data.data(), data.size(), delimiter_.data(), delimiter_.size());
+	if (found) {
+		size_t pos = static_cast<const char*>(found) - data.data();
+		emit(data.substr(0, pos));
+		data.remove_prefix(pos + delimiter_.size());
+		if (status_ != Status::NEED_MORE_DATA)
+			return;
+
+		if (state_ == State::BODY)
+			end_part();
+
+		state_ = State::DELIMITER_LINE;
+		buff_.clear();
+		return;
+	}
+
+	// The end of the block may be a beginning of the delimiter
+	size_t keep_from = data.size();
+	size_t i = (data.size() < delimiter_.size()
+	               ? 0
+	               : data.size() - delimiter_.size() + 1);
+	for (; i < data.size(); ++i) {
+		if (data[i] == '\r' and
+		    data.substr(i) ==
+		       StringView(delimiter_).substr(0, data.size() - i)) {
+			keep_from = i;
+			break;
+		}
+	}
+
+	emit(data.substr(0, keep_from));
+	partial_delimiter_ = data.substr(keep_from).to_string();
+	data.remove_prefix(data.size());
+}
+
+void MultipartFormDataParser::parse_delimiter_line(StringView& data) {
+	while (not data.empty()) {
+		buff_ += data.front();
+		data.remove_prefix(1);
+		if (buff_ == "--") {
+			state_ = State::EPILOGUE;
+			status_ = Status::FINISHED;
+			return;
+		}
+
+		if (has_suffix(buff_, "\r\n")) {
+			// Only transport padding may precede the CRLF
+			for (size_t j = 0; j + 2 < buff_.size(); ++j) {
+				if (not is_blank(buff_[j])) {
+					status_ = Status::MALFORMED;
+					return;
+				}
+			}
+
+			state_ = State::HEADERS;
+			// Thanks to the CRLF, headers end with the first CRLFCRLF even if
+			// there are no headers
+			buff_ = "\r\n";
+			return;
+		}
+
+		if (buff_.size() > max_header_len_) {
+			status_ = Status::MALFORMED;
+			return;
+		}
+	}
+}
+
+void MultipartFormDataParser::parse_headers(StringView& data) {
+	size_t old_size = buff_.size();
+	size_t max_size = max_header_len_ + 4; // With the CRLFs around headers
+	size_t len = std::min(data.size(), max_size + 1 - old_size);
+	buff_.append(data.data(), len);
+
+	size_t pos = buff_.find("\r\n\r\n", (old_size < 3 ? 0 : old_size - 3));
+	if (pos == string::npos) {
+		if (buff_.size() > max_size)
+			status_ = Status::HEADER_TOO_LONG;
+
+		data.remove_prefix(len);
+		return;
+	}
+
+	data.remove_prefix(pos + 4 - old_size);
+	begin_part(StringView(buff_).substr(2, pos - 2));
+	state_ = State::BODY;
+}
+
+void MultipartFormDataParser::begin_part(StringView headers) {
+	std::optional<string> name, filename;
+	while (not headers.empty()) {
+		size_t eol = headers.find("\r\n");
+		StringView line = headers.substr(0, eol);
+		headers.remove_prefix(eol == StringView::npos ? headers.size()
+		                                              : eol + 2);
+
+		size_t colon = line.find(':');
+		if (colon == StringView::npos) {
+			status_ = Status::MALFORMED;
+			return;
+		}
+
+		StringView header_name = line.substr(0, colon);
+		if (header_name.size() != 19 or
+		    not std::equal(header_name.begin(), header_name.end(),
+		                   "content-disposition",
+		                   [](char a, char b) { return tolower(a) == b; })) {
+			continue;
+		}
+
+		// Parameters: form-data; name="field"; filename="file.txt"
+		StringView params = line.substr(colon + 1);
+		while (not params.empty()) {
+			size_t end = 0;
+			while (end < params.size() and params[end] != ';' and
+			       params[end] != '=') {
+				++end;
+			}
+
+			StringView param = params.substr(0, end);
+			while (not param.empty() and is_blank(param.front()))
+				param.remove_prefix(1);
+			while (not param.empty() and is_blank(param.back()))
+				param.remove_suffix(1);
+
+			params.remove_prefix(end);
+			string value;
+			if (not params.empty() and params.front() == '=') {
+				params.remove_prefix(1);
+				while (not params.empty() and is_blank(params.front()))
+					params.remove_prefix(1);
+
+				if (not params.empty() and params.front() == '"') {
+					size_t j = 1;
+					for (; j < params.size() and params[j] != '"'; ++j) {
+						if (params[j] == '\\' and j + 1 < params.size())
+							++j;
+						value += params[j];
+					}
+					params.remove_prefix(std::min(j + 1, params.size()));
+				} else {
+					while (not params.empty() and params.front() != ';' and
+					       not is_blank(params.front())) {
+						value += params.front();
+						params.remove_prefix(1);
+					}
+				}
+			}
+
+			// Skip to the next parameter
+			size_t semicolon = params.find(';');
+			params.remove_prefix(semicolon == StringView::npos ? params.size()
+			                                                   : semicolon + 1);
+
+			if (param == "name")
+				name = std::move(value);
+			else if (param == "filename")
+				filename = std::move(value);
+		}
+	}
+
+	string field_name = name.value_or("");
+	if (filename) {
+		string path = concat_tostr(files_dir_, "sim-upload.XXXXXX");
+		file_ = FileDescriptor(mkostemp(path.data(), O_CLOEXEC));
+		if (file_ == -1) {
+			status_ = Status::FILE_ERROR;
+			return;
+		}
+
+		// A repeated field replaces the previous one
+		auto it = form_.files.find(field_name);
+		if (it != form_.files.end()) {
+			(void)unlink(it->second.c_str());
+			it->second = std::move(path);
+		} else {
+			form_.files.emplace(field_name, std::move(path));
+		}
+
+		form_[std::move(field_name)] = std::move(*filename);
+
+	} else {
+		field_ = &form_[std::move(field_name)];
+		field_->clear();
+	}
+}
+
+void MultipartFormDataParser::end_part() {
+	if (file_ != -1 and file_.close())
+		status_ = Status::FILE_ERROR;
+
+	field_ = nullptr;
+}
+
+MultipartFormDataParser::Status MultipartFormDataParser::feed(StringView data) {
+	while (status_ == Status::NEED_MORE_DATA and not data.empty()) {
+		switch (state_) {
+		case State::PREAMBLE:
+		case State::BODY: parse_body(data); break;
+		case State::DELIMITER_LINE: parse_delimiter_line(data); break;
+		case State::HEADERS: parse_headers(data); break;
+		case State::EPILOGUE: return status_;
+		}
+	}
+
+	return status_;
+}
+
+} // namespace server
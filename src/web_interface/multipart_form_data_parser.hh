@@ -0,0 +1,88 @@
+#pragma once
+
+#include "http_request.hh"
+
+#include <simlib/file_descriptor.hh>
+
+namespace server {
+
+/**
+ * Incremental parser of multipart/form-data content. The content may be fed
+ * in blocks of any size. Delimiters are searched for with memmem(3) over whole
+ * blocks and the content of a file field is written to its file directly from
+ * the fed blocks, so an in-memory request is written with one write(2) per
+ * file.
+ *
+ * Fields are stored in the form: files are created in the directory given to
+ * the constructor (form.files[name] = path, form[name] = client filename),
+ * other fields are stored as form[name] = value.
+ */
+class MultipartFormDataParser {
+public:
+	enum class Status : uint8_t {
+		NEED_MORE_DATA,
+		FINISHED, // The closing delimiter was found, the rest is ignored
+		MALFORMED,
+		HEADER_TOO_LONG,
+		FIELD_TOO_LONG,
+		FILE_ERROR, // Failed to create or write a file
+	};
+
+private:
+	enum class State : uint8_t {
+		PREAMBLE,
+		DELIMITER_LINE, // After the delimiter: "--" or padding and CRLF
+		HEADERS,
+		BODY,
+		EPILOGUE,
+	};
+
+	HttpRequest::Form& form_;
+	std::string files_dir_;
+	size_t max_header_len_;
+	size_t max_field_len_;
+
+	std::string delimiter_; // "\r\n--" boundary
+	State state_ = State::PREAMBLE;
+	Status status_ = Status::NEED_MORE_DATA;
+	// Prefix of the delimiter found at the end of the previously fed block
+	std::string partial_delimiter_;
+	std::string buff_; // Delimiter line or headers of the current part
+
+	std::string* field_ = nullptr; // Value of the current non-file field
+	FileDescriptor file_; // File of the current file field
+
+	// Passes @p data to the current field (or discards it if outside one)
+	void emit(StringView data);
+
+	// Consumes data of the body (or the preamble) until the delimiter
+	void parse_body(StringView& data);
+
+	void parse_delimiter_line(StringView& data);
+
+	void parse_headers(StringView& data);
+
+	void begin_part(StringView headers);
+
+	void end_part();
+
+public:
+	/// @p boundary is the boundary parameter of the Content-Type header
+	MultipartFormDataParser(StringView boundary, HttpRequest::Form& form,
+	                        std::string files_dir, size_t max_header_len,
+	                        size_t max_field_len);
+
+	/// Parses the next block of the content. Once the returned status is other
+	/// than NEED_MORE_DATA, the following calls have no effect and return the
+	/// same status.
+	Status feed(StringView data);
+
+	/// Status after the whole content was fed: an unterminated content is
+	/// malformed
+	Status finish() noexcept {
+		return (status_ == Status::NEED_MORE_DATA ? Status::MALFORMED
+		                                          : status_);
+	}
+};
+
+} // namespace server
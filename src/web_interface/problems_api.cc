@@ -55,7 +55,8 @@ void Sim::api_problems() {
 		OWNER,
 		OWN_USERNAME,
 		SFULL_STATUS,
-		SIMFILE
+		SIMFILE,
+		STOP_GROUP_ON_FAILURE
 	};
 
 	auto overall_perms = sim::problem::get_overall_permissions(
@@ -127,7 +128,7 @@ void Sim::api_problems() {
 			mask |= ID_COND;
 
 		} else if (cond == '=' and ~mask & ID_COND) {
-			qfields.append(", p.simfile");
+			qfields.append(", p.simfile, p.stop_group_on_failure");
 			select_specified_problem = true;
 			qwhere.append(" AND p.id", arg);
 			mask |= ID_COND;
@@ -150,28 +151,30 @@ void Sim::api_problems() {
 	}
 
 	// Execute query
-	qfields.append(qwhere, " ORDER BY p.id DESC LIMIT ", rows_limit);
-	auto res = mysql.query(qfields);
-
+	ApiList list;
+	list.query = concat_tostr(qfields, qwhere);
+	list.key_column = "p.id";
+	list.rows_limit = rows_limit;
 	// Column names
 	// clang-format off
-	append("[\n{\"columns\":["
-	           "\"id\","
-	           "\"added\","
-	           "\"type\","
-	           "\"name\","
-	           "\"label\","
-	           "\"owner_id\","
-	           "\"owner_username\","
-	           "\"actions\","
-	           "{\"name\":\"tags\",\"fields\":["
-	               "\"public\","
-	               "\"hidden\""
-	           "]},"
-	           "\"color_class\","
-	           "\"simfile\","
-	           "\"memory_limit\""
-	       "]}");
+	list.head = {"{\"columns\":["
+	                 "\"id\","
+	                 "\"added\","
+	                 "\"type\","
+	                 "\"name\","
+	                 "\"label\","
+	                 "\"owner_id\","
+	                 "\"owner_username\","
+	                 "\"actions\","
+	                 "{\"name\":\"tags\",\"fields\":["
+	                     "\"public\","
+	                     "\"hidden\""
+	                 "]},"
+	                 "\"color_class\","
+	                 "\"simfile\","
+	                 "\"memory_limit\","
+	                 "\"stop_group_on_failure\""
+	             "]}"};
 	// clang-format on
 
 	// Tags selector
@@ -183,7 +186,7 @@ void Sim::api_problems() {
 	stmt.bind_all(pid, hidden);
 	stmt.res_bind_all(tag);
 
-	while (res.next()) {
+	api_list(list, [&](MySQL::Result& res) {
 		EnumVal<Problem::Type> problem_type {WONT_THROW(
 		   str2num<std::underlying_type_t<Problem::Type>>(res[PTYPE]).value())};
 		auto problem_perms = sim::problem::get_permissions(
@@ -200,7 +203,7 @@ void Sim::api_problems() {
 		using PERMS = sim::problem::Permissions;
 
 		// Id
-		append(",\n[", res[PID], ",");
+		append('[', res[PID], ",");
 
 		// Added
 		if (uint(problem_perms & PERMS::VIEW_ADD_TIME))
@@ -307,20 +310,20 @@ void Sim::api_problems() {
 			       "\"");
 		}
 
-		// Append simfile and memory limit
+		// Append simfile, memory limit and the judging policy
 		if (select_specified_problem and
 		    uint(problem_perms & PERMS::VIEW_SIMFILE)) {
 			ConfigFile cf;
 			cf.add_vars("memory_limit");
 			cf.load_config_from_string(res[SIMFILE].to_string());
 			append(',', json_stringify(res[SIMFILE]), // simfile
-			       ',', json_stringify(cf.get_var("memory_limit").as_string()));
+			       ',', json_stringify(cf.get_var("memory_limit").as_string()),
+			       (res[STOP_GROUP_ON_FAILURE] == "1" ? ",true" : ",false"));
 		}
 
 		append(']');
-	}
-
-	append("\n]");
+		return true;
+	});
 }
 
 void Sim::api_problem() {
@@ -392,6 +395,8 @@ void Sim::api_problem_add_or_reupload_impl(bool reuploading) {
 	bool ignore_simfile = request.form_data.exist("ignore_simfile");
 	bool seek_for_new_tests = request.form_data.exist("seek_for_new_tests");
 	bool reset_scoring = request.form_data.exist("reset_scoring");
+	bool stop_group_on_failure =
+	   request.form_data.exist("stop_group_on_failure");
 
 	form_validate(name, "name", "Problem's name",
 	              decltype(Problem::name)::max_len);
@@ -449,6 +454,7 @@ void Sim::api_problem_add_or_reupload_impl(bool reuploading) {
 	                              ignore_simfile,
 	                              seek_for_new_tests,
 	                              reset_scoring,
+	                              stop_group_on_failure,
 	                              ptype};
 
 	auto transaction = mysql.start_transaction();
@@ -0,0 +1,128 @@
+#include "response_stream.hh"
+
+#include <cstdio>
+#include <utility>
+
+namespace server {
+
+bool ResponseStream::write(StringView data) {
+	if (not compressor_)
+		return write_encoded(data);
+
+	if (data.empty())
+		return true;
+
+	compressed_.clear();
+	try {
+		compressor_->write(data, compressed_);
+	} catch (...) {
+		fail();
+		throw;
+	}
+
+	return write_encoded(compressed_);
+}
+
+bool ResponseStream::write_encoded(StringView data) {
+	if (data.empty())
+		return true;
+
+	bool wake;
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (not buffer_drained_.wait_for(lock, max_write_wait_, [&] {
+			    return buffer_.size() < MAX_BUFFERED or state_ != State::OPEN;
+		    })) {
+			// The client reads too slowly to be worth the occupied writer
+			lock.unlock();
+			fail();
+			return false;
+		}
+
+		if (state_ != State::OPEN)
+			return false;
+
+		if (chunked_) {
+			char size[20];
+			int len = snprintf(size, sizeof(size), "%zx\r\n", data.size());
+			buffer_.append(size, len);
+		}
+		buffer_.append(data.data(), data.size());
+		if (chunked_)
+			buffer_ += "\r\n";
+
+		wake = std::exchange(reader_waiting_, false);
+	}
+
+	if (wake)
+		wake_reader_(*this);
+
+	return true;
+}
+
+void ResponseStream::finish() {
+	if (compressor_) {
+		compressed_.clear();
+		try {
+			compressor_->finish(compressed_);
+		} catch (...) {
+			fail();
+			throw;
+		}
+
+		compressor_ = nullptr;
+		if (not write_encoded(compressed_))
+			return;
+
+		std::string().swap(compressed_);
+	}
+
+	end(State::FINISHED);
+}
+
+void ResponseStream::end(State state) {
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (state_ != State::OPEN)
+			return;
+
+		if (state == State::FINISHED and chunked_)
+			buffer_ += "0\r\n\r\n"; // The last chunk
+
+		state_ = state;
+		wake = std::exchange(reader_waiting_, false);
+	}
+
+	if (wake)
+		wake_reader_(*this);
+}
+
+ResponseStream::State ResponseStream::read(std::string& out) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	if (buffer_.empty()) {
+		reader_waiting_ = (state_ == State::OPEN);
+		return state_;
+	}
+
+	if (out.empty())
+		out.swap(buffer_);
+	else
+		out += buffer_;
+
+	buffer_.clear();
+	buffer_drained_.notify_one();
+	// Whatever was written before the end has to be sent first
+	return (state_ == State::FINISHED ? State::OPEN : state_);
+}
+
+void ResponseStream::abort() {
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		state_ = State::ABORTED;
+		reader_waiting_ = false;
+	}
+	buffer_drained_.notify_one();
+}
+
+} // namespace server
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "compression.hh"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <simlib/string_view.hh>
+#include <string>
+
+namespace server {
+
+/**
+ * Content of a response that is sent while it is being generated: a worker
+ * writes it and the events loop sends it (as chunks of the chunked transfer
+ * coding, unless the client speaks HTTP/1.0, which is then told the end by
+ * closing the connection). The writer blocks while MAX_BUFFERED bytes wait to
+ * be sent, so the memory used does not depend on the size of the content, but
+ * for a limited time: a client that reads too slowly makes the stream fail
+ * instead of occupying the writer indefinitely. The content may be compressed
+ * on the fly (by the writer), then every write is flushed to the client.
+ */
+class ResponseStream
+   : public std::enable_shared_from_this<ResponseStream> {
+public:
+	static constexpr size_t MAX_BUFFERED = 256 << 10; // 256 KiB
+	// How long the writer may wait for the buffered data to be sent
+	static constexpr std::chrono::milliseconds MAX_WRITE_WAIT =
+	   std::chrono::seconds(20);
+
+	enum class State : uint8_t { OPEN, FINISHED, FAILED, ABORTED };
+
+private:
+	std::mutex mtx_;
+	std::condition_variable buffer_drained_;
+	const bool chunked_;
+	const std::chrono::milliseconds max_write_wait_;
+	std::string buffer_;
+	State state_ = State::OPEN;
+	// The reader found nothing to send and waits for wake_reader_() to be
+	// called
+	bool reader_waiting_ = false;
+	const std::function<void(ResponseStream&)> wake_reader_;
+	// Used only by the writer
+	std::unique_ptr<StreamCompressor> compressor_;
+	std::string compressed_;
+
+	// Appends the already compressed @p data, see write()
+	bool write_encoded(StringView data);
+
+	// Sets the state of the writer's side and wakes up the reader if it waits
+	void end(State state);
+
+public:
+	/// @p wake_reader is called with the stream (by the writer, without any
+	/// lock held) when there is something for the reader that waits for it.
+	/// The content is compressed with @p coding.
+	ResponseStream(
+	   bool chunked, std::function<void(ResponseStream&)> wake_reader,
+	   std::chrono::milliseconds max_write_wait = MAX_WRITE_WAIT,
+	   ContentCoding coding = ContentCoding::IDENTITY)
+	   : chunked_(chunked), max_write_wait_(max_write_wait),
+	     wake_reader_(std::move(wake_reader)),
+	     compressor_(coding == ContentCoding::IDENTITY
+	                    ? nullptr
+	                    : std::make_unique<StreamCompressor>(coding)) {}
+
+	ResponseStream(const ResponseStream&) = delete;
+	ResponseStream& operator=(const ResponseStream&) = delete;
+
+	/* Writer */
+
+	/// Appends @p data to the content, blocks while too much data waits to be
+	/// sent. Returns false if the reader has aborted the stream (e.g. the
+	/// client has disconnected) or the data has not been sent for longer than
+	/// max_write_wait (then the stream fails), so the rest of the content is
+	/// not needed.
+	bool write(StringView data);
+
+	/// Ends the content
+	void finish();
+
+	/// Ends the content abnormally: the connection will be closed without the
+	/// end of the content, so that the client sees the response is incomplete
+	void fail() { end(State::FAILED); }
+
+	/* Reader */
+
+	/// Appends the data that waits to be sent (already encoded) to @p out and
+	/// returns the state of the stream. If nothing was appended to an OPEN
+	/// stream, the reader waits until the wake_reader function is called.
+	State read(std::string& out);
+
+	/// Tells the writer that the content will not be sent
+	void abort();
+};
+
+} // namespace server
@@ -1,432 +1,89 @@
-#include "connection.hh"
+#include "events_loop.hh"
 #include "sim.hh"
 
 #include <arpa/inet.h>
-#include <set>
+#include <chrono>
+#include <cstring>
+#include <csignal>
+#include <netinet/in.h>
+#include <pthread.h>
 #include <simlib/config_file.hh>
 #include <simlib/debug.hh>
 #include <simlib/process.hh>
-#include <sys/epoll.h>
+#include <simlib/working_directory.hh>
 #include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
 #include <unistd.h>
 
-using std::array;
 using std::string;
-using std::unique_ptr;
-using std::vector;
+using std::chrono::steady_clock;
 
-static int socket_fd; // Major socket
-static int workers; // Number of workers
-static int epoll_fd; // epoll(7) instance
-static unsigned connections; // number of connections
+// Event-driven sim-server: see EventsLoop, the workers handle the requests
+// using their own Sim instances
 
 namespace {
 
-struct Headers {
-	size_t content_length = 0;
-	FixedString connection = "keep-alive";
-	FixedString host;
-	FixedString user_agent;
-	vector<std::pair<FixedString, FixedString>> other;
-
-	Headers() = default;
-
-	Headers(const Headers&) = delete; // TODO: default;
-	Headers(Headers&&) = default;
-	Headers& operator=(const Headers&) = delete; // TODO: default;
-	Headers& operator=(Headers&&) = default;
-
-	// Returns value of header with name @p name or empty string if such a
-	// header does not exist
-	StringView find(StringView name) {
-		decltype(other.begin()) beg = other.begin(), end = other.end(), mid;
-		while (beg < end) {
-			mid = beg + ((end - beg) >> 1);
-			if (special_less<int(int)>(mid->first, name, to_lower))
-				beg = ++mid;
-			else
-				end = mid;
-		}
-		return (mid == other.end() || lower_equal(mid->first, name)
-		           ? ""
-		           : mid->second);
-	}
-};
-
-struct Request {
-	enum Method : uint8_t { GET, POST } method;
-	FixedString target, http_version;
-	Headers headers;
-	FixedString content;
-};
-
-class Connection {
-	static constexpr size_t MAX_HEADER_LENGTH = 8192;
-	static constexpr uint8_t MAX_HEADERS_NO =
-	   100; // be careful with type (see field: header_no)
-	static constexpr size_t MAX_NON_FORM_CONTENT_LENGTH = 1 << 20; // 1 MiB
-
-	int fd_;
-	in_addr sin_addr_; // Client address
-	unsigned short port_; // Client port
-
-	Request req_; // Currently parsed request
-	string buff_;
-	uint8_t header_no = 0;
-	uint8_t making_headers : 1;
-
-public:
-	uint8_t idle : 1;
-	uint8_t reading : 1;
-	uint8_t writing : 1;
-
-	vector<Request> requests;
-
-	Connection(int fde, const sockaddr_in& sock_addr, bool idl = true,
-	           bool rd = false, bool wr = false)
-	   : fd_(fde), sin_addr_(sock_addr.sin_addr),
-	     port_(ntohs(sock_addr.sin_port)), making_headers(true), idle(idl),
-	     reading(rd), writing(wr) {}
-
-	Connection(const Connection&) = delete;
-
-	Connection(Connection&&) = default; // TODO
-
-	Connection& operator=(const Connection&) = delete;
-
-	Connection& operator=(Connection&&) = default; // TODO
-
-	~Connection() {};
-
-	int fd() const noexcept { return fd_; }
-
-	const char* ip(char* s) const noexcept {
-		return inet_ntop(AF_INET, &sin_addr_, s, INET_ADDRSTRLEN);
-	}
-
-	FixedString ip() const {
-		char s[INET_ADDRSTRLEN];
-		(void)inet_ntop(AF_INET, &sin_addr_, s, INET_ADDRSTRLEN);
-		return s;
-	}
-
-	unsigned short port() const noexcept { return port_; }
-
-	void parse(const char* str, size_t len);
-
-private:
-	// Parses @p str header to construct @p name and value on it; returns false
-	// on success, true on error
-	static bool parse_header(StringView str, StringView& name,
-	                        StringView& value);
-
-	// Constructs headers, returns false on success, true otherwise (and may add
-	// proper response to TODO: where?)
-	bool construct_headers(StringView& data);
-};
-
-namespace {
-
-struct ConnectionCompare {
-	bool operator()(const Connection& a, const Connection& b) const {
-		return a.fd() < b.fd();
-	}
-};
-
-} // anonymous namespace
-
-class ConnectionSet : private std::set<Connection, ConnectionCompare> {
-	typedef std::set<Connection, ConnectionCompare> BaseType;
-
-public:
-	ConnectionSet() = default;
-
-	ConnectionSet(const ConnectionSet&) = delete;
-	ConnectionSet(ConnectionSet&&) = delete;
-	ConnectionSet& operator=(const ConnectionSet&) = delete;
-	ConnectionSet& operator=(ConnectionSet&&) = delete;
-
-	using BaseType::begin;
-	using BaseType::const_iterator;
-	using BaseType::emplace;
-	using BaseType::end;
-	using BaseType::iterator;
-
-	iterator find(int fd) {
-		return BaseType::find(Connection(fd, {0, 0, {0}, {}}));
-	}
-
-	const_iterator find(int fd) const {
-		return BaseType::find(Connection(fd, {0, 0, {0}, {}}));
-	}
-
-	void erase(int fd) { BaseType::erase(find(fd)); }
-
-	void erase(iterator it) { BaseType::erase(it); }
-};
-
-} // anonymous namespace
-
-static ConnectionSet connset; // set of connections
-
-namespace {
-
-class Job {
-public:
-	Job() = default;
-
-	Job(const Job&) = delete;
-	Job(Job&&) = delete;
-	Job& operator=(const Job&) = delete;
-	Job& operator=(Job&&) = delete;
-
-	~Job() {};
-};
-
-} // anonymous namespace
-
-#if 1
-// # warning "Before committing disable this debug"
-#define DEBUG_HEADERS(...) stdlog(__VA_ARGS__)
-#else
-#define DEBUG_HEADERS(...)
-#endif
-
-bool Connection::parse_header(StringView str, StringView& name,
-                             StringView& value) {
-	name = str.substr(0, str.find(':'));
-	if (name.find(' ') != StringView::npos || name.size() == 0 ||
-	    name.size() == str.size()) {
-		return true; // Invalid header
-	}
-
-	str.remove_prefix(name.size() + 1);
-	str.remove_leading(is_space);
-	str.remove_trailing(is_space);
-	value = str;
-	return false;
-}
-
-bool Connection::construct_headers(StringView& data) {
-	DEBUG_HEADERS("Connection ", fd_, " -> \033[1;33mParsing:\033[m ",
-	              ConfigFile::escape_string(data, true));
-
-	if (data.empty())
-		return false;
-
-	StringView header;
-	const auto pick_next_header = [&]() -> bool {
-		size_t x = data.find("\r\n");
-		if (x == StringView::npos)
-			return false; // Failure
-
-		header = data.substr(0, x);
-		data.remove_prefix(x + 2);
-		return true; // Success
-	};
-
-	// Sophisticated way to efficiently get first header
-	if (buff_.size()) {
-		if (buff_.back() == '\r' && data.front() == '\n') {
-			header = StringView(buff_.data(), buff_.size() - 1);
-			data.remove_prefix(1);
-		} else {
-			size_t x = data.find("\r\n");
-			if (x == StringView::npos) {
-				buff_.append(data.data(), data.size());
-				data.clear();
-				return false;
-			}
-
-			buff_.append(data.data(), x);
-			header = buff_;
-			data.remove_prefix(x + 2);
-		}
-
-	} else if (!pick_next_header()) { // No header is ready yet
-		buff_.assign(data.data(), data.size());
-		data.clear();
-		return false;
-	}
-
-	do {
-		DEBUG_HEADERS("Connection ", fd_, " -> Header: \033[36m", header,
-		              "\033[m");
-		++header_no;
-
-		/* Request line */
-		if (header_no == 1) {
-			if (header.empty()) { // Ignore empty requests
-				header_no = 0;
-				continue;
-			}
-
-			req_.headers = Headers();
-
-			// Method
-			size_t pos = 0;
-			for (; pos < header.size() && !is_space(header[pos]); ++pos) {
-			}
-
-			if (header.substr(0, pos) == "GET")
-				req_.method = Request::GET;
-			else if (header.substr(0, pos) == "POST")
-				req_.method = Request::POST;
-			else {
-				// TODO: error 501
-				return true;
-			}
-
-			header.remove_prefix(pos);
-
-			// Target
-			header.remove_leading(is_space);
-			for (pos = 0; pos < header.size() && !is_space(header[pos]);
-			     ++pos) {
-			}
-			req_.target = header.substr(0, pos);
-			header.remove_prefix(pos);
-
-			// HTTP version
-			header.remove_leading(is_space);
-			if (header != "HTTP/1.0" && header != "HTTP/1.1") {
-				// TODO: error 400
-				return true;
-			}
-			req_.http_version = header;
-			continue;
-		}
-
-		/* Headers limit */
-		if (header_no > MAX_HEADERS_NO) {
-			// TODO: error 413
-			header_no = 0;
-			return true;
-		}
-
-		/* Headers are complete */
-		if (header.empty()) {
-			DEBUG_HEADERS("Connection ", fd_,
-			              " -> \033[1;32mHeaders parsed.\033[m");
-
-			std::sort(req_.headers.other.begin(), req_.headers.other.end());
-			if (req_.headers.find("Expect") == "100-continue") {
-			} // TODO: add response: 100
-
-			if (req_.headers.content_length == 0) {
-			} // TODO: add request to queue
-			else
-				making_headers = false;
-
-			header_no = 0;
-			buff_.clear();
-			return false;
-		}
-
-		/* Normal header */
-
-		if (header.size() > MAX_HEADER_LENGTH) {
-			// TODO: error 431
-			return true;
-		}
-
-		StringView name, value;
-		if (parse_header(header, name, value)) {
-			// TODO: error 400
-			return true;
-		}
-
-		// Put it into correct place
-		if (lower_equal(name, "content-length")) {
-			if (!is_digit(value)) {
-				// TODO: error 400
-				return true;
-			}
-			req_.headers.content_length = digits_to_u<size_t>(value);
-			if (req_.headers.content_length > MAX_NON_FORM_CONTENT_LENGTH) {
-				// TODO: error 413
-				return true;
-			}
-
-		} else if (lower_equal(name, "host"))
-			req_.headers.host = value;
-		else if (lower_equal(name, "connection"))
-			req_.headers.connection = value;
-		else if (lower_equal(name, "user-agent"))
-			req_.headers.user_agent = value;
-		else
-			req_.headers.other.emplace_back(name, value);
-
-	} while (pick_next_header());
-
-	buff_.assign(data.data(), data.size());
-	data.clear();
-	return false;
-}
-
-void Connection::parse(const char* str, size_t len) {
-	StringView data(str, len);
-	while (data.size()) {
-		if (making_headers) { // Headers
-			construct_headers(data);
-
-		} else if (req_.method == Request::GET) { // Content (GET)
-			size_t x = std::min(data.size(),
-			                    req_.headers.content_length - buff_.size());
-			buff_.append(data.data(), x);
-			data.remove_prefix(x);
-
-			// Content is completely read
-			if (req_.headers.content_length == buff_.size()) {
-				// TODO: append request to queue
-				making_headers = true;
-				header_no = 0;
-				buff_.clear();
-			}
-
-		} else if (req_.method == Request::POST) { // Content (POST)
-			// TODO: implement
-			data.clear();
-
-		} else { // Bug
-			errlog(__FILE__, ':', meta::ToString<__LINE__> {},
-			       ": Nothing to parse - this is probably a bug");
-			// TODO: connection state = CLOSE
-			return;
-		}
-	}
-}
-
-#if 0
-static void* worker(void*) {
+void* worker(void* events_loop_ptr) {
+	auto& events_loop = *static_cast<server::EventsLoop*>(events_loop_ptr);
 	try {
-		sockaddr_in name;
-		socklen_t client_name_len = sizeof(name);
-		char ip[INET_ADDRSTRLEN];
-		server::Connection conn(-1);
 		Sim sim_worker;
+		// Reported every so often, like the connections by the events loop
+		constexpr auto STATS_REPORT_INTERVAL = std::chrono::minutes(10);
+		auto last_stats_report = steady_clock::now();
+		while (auto task = events_loop.pop_task()) {
+			server::Connection::Output response;
+			// A streamed response is passed to the events loop once its head
+			// is ready, the content is written while the events loop sends it
+			bool passed = false;
+			try {
+				server::Connection conn(task->request, response,
+				                        task->allow_keep_alive);
+				server::HttpRequest req = conn.get_request();
+				if (conn.state() == server::Connection::OK) {
+					using namespace std::chrono;
+					auto beg = steady_clock::now();
+
+					server::HttpResponse resp = sim_worker.handle(
+					   task->client_ip, std::move(req),
+					   [&](const server::HttpResponse& head) {
+						   auto stream = conn.send_streamed_response_head(
+						      head, [&](server::ResponseStream& s) {
+							      events_loop.wake_stream(s);
+						      });
+						   events_loop.respond(*task, std::move(response));
+						   passed = true;
+						   return stream;
+					   });
+
+					auto microdur =
+					   duration_cast<microseconds>(steady_clock::now() - beg);
+					stdlog("Response generated in ",
+					       to_string(microdur * 1000), " ms.");
+
+					if (not passed)
+						conn.send_response(resp);
+				}
 
-		for (;;) {
-			// accept the connection
-			int client_socket_fd = accept4(socket_fd, (sockaddr*)&name,
-				&client_name_len, SOCK_CLOEXEC);
-			FileDescriptorCloser closer(client_socket_fd);
-			if (client_socket_fd == -1)
-				continue;
-
-			// extract IP
-			inet_ntop(AF_INET, &name, ip, INET_ADDRSTRLEN);
-			stdlog("Connection accepted: ", pthread_self(), " form ", ip);
-
-			conn.assign(client_socket_fd);
-			server::HttpRequest req = conn.get_request();
+			} catch (const std::exception& e) {
+				ERRLOG_CATCH(e);
+				if (not passed) {
+					response = {};
+					server::Connection(StringView {}, response).error500();
+				}
+			}
 
-			if (conn.state() == server::Connection::OK)
-				conn.send_response(sim_worker.handle(ip, req));
+			if (not passed)
+				events_loop.respond(*task, std::move(response));
 
-			stdlog("Closing...");
-			closer.close();
-			stdlog("Closed");
+			auto now = steady_clock::now();
+			if (now >= last_stats_report + STATS_REPORT_INTERVAL) {
+				last_stats_report = now;
+				auto& stmts = sim_worker.statements_cache();
+				stdlog("Statements cache of the worker: ", stmts.hits(),
+				       " hits, ", stmts.misses(), " misses, ", stmts.size(),
+				       " statements");
+			}
 		}
 
 	} catch (const std::exception& e) {
@@ -438,282 +95,222 @@ static void* worker(void*) {
 
 	return nullptr;
 }
-#endif
-
-// Reads data from connections
-static void* reader_thread(void*) {
-	// Leave all signals to the main thread
-	pthread_sigmask(SIG_SETMASK, &SignalBlocker::full_mask, nullptr);
-
-	constexpr uint MAX_EVENTS = 64;
-	constexpr uint MAX_ITERATIONS_PER_ONE = 32;
-
-	array<epoll_event, MAX_EVENTS> events;
-	array<char, 65536> buff;
-
-	for (;;) {
-		int n = epoll_wait(epoll_fd, events.data(), events.size(), -1);
-		if (n < 0) {
-			errlog(__FILE__, ':', meta::ToString<__LINE__> {}, ": epoll_wait()",
-			       error());
-			continue;
-		}
 
-		for (int i = 0; i < n; ++i) {
-			D(stdlog(
-			     "Event: ", (int)events[i].data.fd, " -> ",
-			     (events[i].events & EPOLLIN ? "EPOLLIN | " : ""),
-			     (events[i].events & EPOLLOUT ? "EPOLLOUT | " : ""),
-			     (events[i].events & EPOLLRDHUP ? "EPOLLRDHUP | " : ""),
-			     (events[i].events & EPOLLPRI ? "EPOLLPRI | " : ""),
-			     (events[i].events & EPOLLERR ? "EPOLLERR | " : ""),
-			     (events[i].events & EPOLLHUP ? "EPOLLHUP | " : ""),
-			     (events[i].events & EPOLLET ? "EPOLLET | " : ""),
-			     (events[i].events & EPOLLONESHOT ? "EPOLLONESHOT | " : ""));)
-
-			for (uint j = 0; j < MAX_ITERATIONS_PER_ONE; ++j) {
-				ssize_t rc = read(events[i].data.fd, buff.data(), buff.size());
-				D(stdlog("read: ", rc);)
-
-				if (rc < 0)
-					break;
-
-				if (rc == 0) { // Connection was closed
-					// TODO: create job to close connection
-					(void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, events[i].data.fd,
-					                nullptr);
-					break;
-				}
+} // anonymous namespace
 
-				const_cast<Connection&>(*connset.find(events[i].data.fd))
-				   .parse(buff.data(), rc);
-			}
-		}
-		// TODO: exceptions
+int main() {
+	// Init server
+	// Change directory to process executable directory
+	try {
+		chdir_relative_to_executable_dirpath("..");
+	} catch (const std::exception& e) {
+		errlog("Failed to change working directory: ", e.what());
 	}
-	return nullptr;
-}
 
-// Writes data to connections
-static void* writer_thread(void*) {
-	// Leave all signals to the main thread
-	pthread_sigmask(SIG_SETMASK, &SignalBlocker::full_mask, nullptr);
-	// TODO: exceptions
+	// Terminate older instances
+	kill_processes_by_exec({executable_path(getpid())}, std::chrono::seconds(4),
+	                       true);
 
-	return nullptr;
-}
-/*
-// Manages workers
-static void* workers_manager_thread(void*) {
-    // Leave all signals to the main thread
-    pthread_sigmask(SIG_SETMASK, &SignalBlocker::full_mask, nullptr);
-
-    // TODO: exceptions
-    return nullptr;
-}*/
-
-// Manages workers, accepts connections
-static void main_process_cycle() {
-	// epoll(7)
-	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
-	if (epoll_fd == -1) {
-		errlog("Error: epoll_create1()", error());
-		exit(9);
+	// Loggers
+	// stdlog (like everything) writes to stderr, so redirect stdout and stderr
+	// to the log file
+	if (freopen(SERVER_LOG, "a", stdout) == nullptr ||
+	    dup3(STDOUT_FILENO, STDERR_FILENO, O_CLOEXEC) == -1) {
+		errlog("Failed to open `", SERVER_LOG, '`', errmsg());
 	}
 
-	// Run reader and writer threads
-	pthread_t reader_pid, writer_pid;
-	if (pthread_create(&reader_pid, nullptr, reader_thread, nullptr) == -1 ||
-	    pthread_create(&writer_pid, nullptr, writer_thread, nullptr) == -1) {
-		errlog("Failed to spawn reader and writer threads", error());
-		exit(10);
+	try {
+		errlog.open(SERVER_ERROR_LOG);
+	} catch (const std::exception& e) {
+		errlog("Failed to open `", SERVER_ERROR_LOG, "`: ", e.what());
 	}
 
-	// Adjust soft limit to hard limit of file descriptors
-	struct rlimit limit;
-	(void)getrlimit(RLIMIT_NOFILE, &limit);
-	limit.rlim_cur = limit.rlim_max; // TODO: check out what happens when limit
-	                                 // is reached
-	(void)setrlimit(RLIMIT_NOFILE, &limit);
-
-	stdlog("NOFILE limit: ", limit.rlim_max,
-	       "\n=================== Server launched ===================");
-	stdlog.label(true);
-
-	for (;;) {
-		sockaddr_in name;
-		socklen_t name_len = sizeof(name);
-		// Accept connection
-		int fd = accept4(socket_fd, (sockaddr*)&name, &name_len,
-		                 SOCK_NONBLOCK | SOCK_CLOEXEC);
-		if (fd == -1)
-			continue;
-
-		// Insert connection to connset
-		auto x = connset.emplace(fd, name, false, true);
-		throw_assert(x.second == true);
-		const Connection& conn = *x.first;
-
-		stdlog("Connection ", fd, " from ", conn.ip(), ':', conn.port(),
-		       " accepted");
-
-		// Add connection epoll
-		epoll_event event;
-		memset(&event, 0, sizeof(event));
-		event.events = EPOLLIN | EPOLLPRI;
-		event.data.fd = fd;
-		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
-			errlog("Error: epoll_ctl()", error());
-			// TODO: write error 500
-			connset.erase(x.first);
-			close(fd);
-		}
-	}
-}
+	// Signal control
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &exit;
+
+	(void)sigaction(SIGINT, &sa, nullptr);
+	(void)sigaction(SIGTERM, &sa, nullptr);
+	(void)sigaction(SIGQUIT, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN); // Writing to a closed connection is not fatal
 
-// Loads server configuration
-static void load_server_config(const CStringView config_path,
-                             sockaddr_in& sock_name) {
 	ConfigFile config;
 	try {
 		config.add_vars("address", "workers", "connections");
 
-		config.load_config_from_file(config_path);
+		config.load_config_from_file("sim.conf");
 	} catch (const std::exception& e) {
-		errlog("Failed to load ", config_path, ": ", e.what());
-		exit(5);
+		errlog("Failed to load sim.config: ", e.what());
+		return 5;
 	}
 
-	const char* vars[] = {"address", "workers", "connections"};
-	for (auto var : vars)
-		if (!config[var].is_set()) {
-			errlog(config_path, ": variable '", var, "' is not defined");
-			exit(6);
-		}
+	string full_address = config["address"].as_string();
+	size_t workers = config["workers"].as<size_t>().value_or(0);
+	size_t connections = config["connections"].as<size_t>().value_or(0);
 
-	string address = config["address"].as_string();
-	workers = config["workers"].as_int();
 	if (workers < 1) {
-		errlog(config_path, ": Number of workers cannot be lower than 1");
-		exit(6);
+		errlog("sim.conf: Number of workers cannot be lower than 1");
+		return 6;
 	}
 
-	connections = config["connections"].as_int();
 	if (connections < 1) {
-		errlog(config_path, ": Number of connections cannot be lower than 1");
-		exit(6);
+		errlog("sim.conf: Number of connections cannot be lower than 1");
+		return 6;
 	}
 
-	sock_name.sin_family = AF_INET;
-	memset(sock_name.sin_zero, 0, sizeof(sock_name.sin_zero));
+	// Every connection needs a file descriptor, so raise the soft limit
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		(void)setrlimit(RLIMIT_NOFILE, &limit);
+		// Leave some descriptors for the workers (database connections,
+		// files being sent, temporary files etc.)
+		constexpr size_t RESERVED_FDS = 64 + 8;
+		size_t fds_limit = limit.rlim_cur;
+		if (fds_limit < RESERVED_FDS + workers * 8 + connections) {
+			connections =
+			   std::max<ssize_t>(1, ssize_t(fds_limit) - RESERVED_FDS -
+			                           ssize_t(workers) * 8);
+			errlog("Warning: NOFILE limit (", fds_limit,
+			       ") is too low, connections limited to ", connections);
+		}
+	}
+
+	sockaddr_in name;
+	name.sin_family = AF_INET;
+	memset(name.sin_zero, 0, sizeof(name.sin_zero));
 
 	// Extract port from address
-	unsigned port = 80; // server port
-	size_t colon_pos = address.find(':');
-	// Colon has been found
-	if (colon_pos < address.size()) {
-		if (strtou(address, port, colon_pos + 1) !=
-		    static_cast<int>(address.size() - colon_pos - 1)) {
-			errlog(config_path, ": incorrect port number");
-			exit(7);
+	in_port_t port = 80; // server port
+	CStringView address_str;
+	if (size_t colon_pos = full_address.find(':');
+	    colon_pos != full_address.npos) {
+		full_address[colon_pos] = '\0';
+		address_str = CStringView(full_address.data(), colon_pos);
+
+		auto port_opt =
+		   str2num<decltype(port)>(substring(full_address, colon_pos + 1));
+		if (not port_opt) {
+			errlog("sim.config: incorrect port number");
+			return 7;
 		}
-		address[colon_pos] = '\0'; // need to extract IPv4 address
-	} else
-		address += '\0'; // need to extract IPv4 address
-	// Set server port
-	sock_name.sin_port = htons(port);
-	address = "127.1.1.1"; // TODO: uncomment it
 
-	// Extract IPv4 address
-	if (0 == strcmp(address.data(), "*")) // strcmp because of '\0' in address
-		sock_name.sin_addr.s_addr = htonl(INADDR_ANY); // server address
-	else if (address.empty() ||
-	         inet_aton(address.data(), &sock_name.sin_addr) == 0) {
-		errlog(config_path, ": incorrect IPv4 address");
-		exit(8);
+		port = *port_opt;
+	} else {
+		address_str = full_address;
 	}
 
-	stdlog("ADDRESS: ", address, ':', port);
-	stdlog("workers: ", workers);
-	stdlog("connections: ", connections);
-}
+	// Set server port
+	name.sin_port = htons(port);
 
-int main() {
-	// Init server
-	// Change directory to process executable directory
-	try {
-		chdir_to_exec_dir();
-	} catch (const std::exception& e) {
-		errlog("Failed to change working directory: ", e.what());
+	// Extract IPv4 address
+	if (address_str == "*") {
+		name.sin_addr.s_addr = htonl(INADDR_ANY); // server address
+	} else if (address_str.empty() ||
+	           inet_aton(address_str.data(), &name.sin_addr) == 0) {
+		errlog("sim.config: incorrect IPv4 address");
+		return 8;
 	}
 
-	// Loggers TODO: use global log filenames
-	// Set stderr to write to server.log (stdlog writes to stderr)
-	if (freopen("server2.log", "a", stderr) == NULL) // TODO: remove '2'
-		errlog("Failed to open 'server.log'", error());
-
+	// clang-format off
+	stdlog("\n=================== Server launched ==================="
+	       "\nPID: ", getpid(),
+	       "\nworkers: ", workers,
+	       "\nconnections: ", connections,
+	       "\naddress: ", address_str, ':', port);
+	// clang-format on
+
+	// Static files are loaded (and compressed) once, before the server starts
+	// (it works without them as well, the files are then served by Sim)
+	server::StaticFilesCache static_files("static");
+	int static_files_watch_fd = -1;
 	try {
-		errlog.open("server2_error.log"); // TODO: remove '2'
+		static_files.load("/kit/");
+		stdlog("Static files cache: ", static_files.files_no(), " files, ",
+		       static_files.total_size() >> 10, " KiB");
+		static_files_watch_fd = static_files.watch();
 	} catch (const std::exception& e) {
-		errlog("Failed to open 'server_error.log': ", e.what());
+		ERRLOG_CATCH(e);
 	}
 
-	// Signal control
-	// TODO: manage server via signals
-	struct sigaction sa;
-	memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = &exit;
-
-	(void)sigaction(SIGINT, &sa, nullptr);
-	(void)sigaction(SIGTERM, &sa, nullptr);
-	(void)sigaction(SIGQUIT, &sa, nullptr);
-
-	stdlog("Initializing server...");
-	stdlog.label(false); // Turn label off (temporarily)
-	stdlog("PID: ", getpid());
-
-	// Load config
-	sockaddr_in name;
-	load_server_config("sim.conf", name);
-
-	socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+	int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	                       IPPROTO_TCP);
 	if (socket_fd < 0) {
-		errlog("Failed to create socket", error());
+		errlog("Failed to create socket", errmsg());
 		return 1;
 	}
 
-	int _true = 1;
-	if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &_true, sizeof(int))) {
-		errlog("Error: setopt()", error());
+	int true_ = 1;
+	if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &true_, sizeof(int))) {
+		errlog("Failed to setopt", errmsg());
 		return 2;
 	}
 
 	// Bind
-	constexpr int TRIES = 8;
-	for (int try_no = 1; bind(socket_fd, (sockaddr*)&name, sizeof(name));) {
-		errlog("Failed to bind (try ", try_no, ')', error());
-		if (++try_no > TRIES)
-			return 3;
+	constexpr int FAST_SILENT_TRIES = 40;
+	constexpr int SLOW_TRIES = 8;
+	int bound = [&] {
+		auto call_bind = [&] {
+			return bind(socket_fd, (sockaddr*)&name, sizeof(name));
+		};
+		for (int try_no = 1; try_no <= FAST_SILENT_TRIES; ++try_no) {
+			if (try_no > 1) {
+				std::this_thread::sleep_for(
+				   std::chrono::milliseconds(1000 / FAST_SILENT_TRIES));
+			}
+
+			if (call_bind() == 0)
+				return true;
+		}
+
+		for (int try_no = 1; try_no <= SLOW_TRIES; ++try_no) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(800));
+			if (call_bind() == 0)
+				return true;
+
+			errlog("Failed to bind (try ", try_no, ')', errmsg());
+		}
+
+		return false;
+	}();
 
-		usleep(800000);
+	if (not bound) {
+		errlog("Giving up");
+		return 3;
 	}
 
-	if (listen(socket_fd, 10)) {
-		errlog("Error: listen()", error());
+	// Contest start spikes produce bursts of connections
+	if (listen(socket_fd, SOMAXCONN)) {
+		errlog("Failed to listen", errmsg());
+		return 4;
+	}
+
+	// Alter default thread stack size
+	pthread_attr_t attr;
+	constexpr size_t THREAD_STACK_SIZE = 4 << 20; // 4 MiB
+	if (pthread_attr_init(&attr) ||
+	    pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE)) {
+		errlog("Failed to set new thread stack size");
 		return 4;
 	}
 
 	try {
-		main_process_cycle();
+		server::EventsLoop events_loop(socket_fd, connections, static_files,
+		                               static_files_watch_fd);
+		for (size_t i = 0; i < workers; ++i) {
+			pthread_t thread;
+			if (pthread_create(&thread, &attr, worker, &events_loop)) {
+				errlog("Failed to spawn a worker", errmsg());
+				return 9;
+			}
+		}
+		std::thread(Sim::sessions_sweeper).detach();
+
+		events_loop.run();
 
 	} catch (const std::exception& e) {
 		ERRLOG_CATCH(e);
-		return 5;
-
-	} catch (...) {
-		ERRLOG_CATCH();
-		return 5;
+		return 10;
 	}
-
-	return 0;
 }
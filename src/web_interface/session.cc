@@ -2,10 +2,13 @@
 
 #include <sim/random.hh>
 #include <simlib/debug.hh>
+#include <thread>
 
 using sim::User;
 using std::string;
 
+server::SessionsCache Sim::sessions_cache;
+
 bool Sim::session_open() {
 	STACK_UNWINDING_MARK;
 
@@ -17,26 +20,46 @@ bool Sim::session_open() {
 	if (session_id.size == 0)
 		return false;
 
-	auto stmt = mysql.prepare("SELECT csrf_token, user_id, data, type,"
-	                          " username, ip, user_agent "
-	                          "FROM session s, users u "
-	                          "WHERE s.id=? AND expires>=?"
-	                          " AND u.id=s.user_id");
-	stmt.bind_and_execute(session_id, mysql_date());
-
-	InplaceBuff<SESSION_IP_LEN + 1> session_ip;
-	InplaceBuff<4096> user_agent;
-	decltype(User::type) s_u_type;
-	stmt.res_bind_all(session_csrf_token, session_user_id, session_data,
-	                  s_u_type, session_username, session_ip, user_agent);
-
-	if (stmt.next()) {
-		session_user_type = s_u_type;
-		return (session_is_open = true);
+	auto curr_time = time(nullptr);
+	auto cached = sessions_cache.find(session_id, curr_time);
+	if (not cached) {
+		// Has to be taken before reading the session
+		uint64_t generation = sessions_cache.generation();
+		auto stmt = MySQL::statements_cache(mysql).prepare(
+		   "SELECT csrf_token, user_id, data, type, username, expires "
+		   "FROM session s, users u "
+		   "WHERE s.id=? AND expires>=? AND u.id=s.user_id");
+		stmt->bind_and_execute(session_id, mysql_date(curr_time));
+
+		InplaceBuff<32> expires;
+		decltype(User::type) s_u_type;
+		stmt->res_bind_all(session_csrf_token, session_user_id, session_data,
+		                   s_u_type, session_username, expires);
+		if (not stmt->next()) {
+			resp.set_cookie("session", "", 0); // Delete cookie
+			return false;
+		}
+
+		cached = server::SessionsCache::Session {
+		   session_csrf_token.to_string(),
+		   session_user_id.to_string(),
+		   s_u_type,
+		   session_username.to_string(),
+		   session_data.to_string(),
+		   expires.to_string(),
+		   curr_time,
+		};
+		sessions_cache.store(session_id.to_string(), *cached, generation);
 	}
 
-	resp.set_cookie("session", "", 0); // Delete cookie
-	return false;
+	session_csrf_token = cached->csrf_token;
+	session_user_id = cached->user_id;
+	session_user_type = cached->user_type;
+	session_username = cached->username;
+	session_data = cached->data;
+	// Needed to tell whether the data has to be written back
+	session_data_on_open = session_data;
+	return (session_is_open = true);
 }
 
 void Sim::session_create_and_open(StringView user_id, bool temporary_session) {
@@ -44,10 +67,6 @@ void Sim::session_create_and_open(StringView user_id, bool temporary_session) {
 
 	session_close();
 
-	// Remove obsolete sessions
-	mysql.prepare("DELETE FROM session WHERE expires<?")
-	   .bind_and_execute(mysql_date());
-
 	// Create a record in database
 	auto stmt = mysql.prepare("INSERT IGNORE session(id, csrf_token, user_id,"
 	                          " data, ip, user_agent, expires) "
@@ -88,6 +107,7 @@ void Sim::session_destroy() {
 	try {
 		mysql.prepare("DELETE FROM session WHERE id=?")
 		   .bind_and_execute(session_id);
+		sessions_cache.erase(session_id);
 	} catch (const std::exception& e) {
 		ERRLOG_CATCH(e);
 	}
@@ -104,7 +124,38 @@ void Sim::session_close() {
 		return;
 
 	session_is_open = false;
-	// TODO: add a marker of a change used to omit unnecessary updates
-	auto stmt = mysql.prepare("UPDATE session SET data=? WHERE id=?");
-	stmt.bind_and_execute(session_data, session_id);
+	if (session_data == session_data_on_open)
+		return; // Nothing changed
+
+	MySQL::statements_cache(mysql)
+	   .prepare("UPDATE session SET data=? WHERE id=?")
+	   ->bind_and_execute(session_data, session_id);
+	sessions_cache.erase(session_id);
+}
+
+void Sim::sessions_sweeper() noexcept {
+	try {
+		STACK_UNWINDING_MARK;
+
+		auto mysql = MySQL::make_conn_with_credential_file(".db.config");
+		for (;;) {
+			std::this_thread::sleep_for(
+			   std::chrono::seconds(server::SessionsCache::TTL));
+			try {
+				STACK_UNWINDING_MARK;
+
+				auto curr_time = time(nullptr);
+				sessions_cache.sweep(curr_time);
+				// Remove obsolete sessions
+				mysql.prepare("DELETE FROM session WHERE expires<?")
+				   .bind_and_execute(mysql_date(curr_time));
+
+			} catch (const std::exception& e) {
+				ERRLOG_CATCH(e);
+			}
+		}
+
+	} catch (const std::exception& e) {
+		ERRLOG_CATCH(e);
+	}
 }
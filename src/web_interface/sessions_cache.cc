@@ -0,0 +1,76 @@
+#include "sessions_cache.hh"
+
+#include <simlib/time.hh>
+
+using std::string;
+
+namespace server {
+
+size_t SessionsCache::sweep_locked(time_t curr_time) noexcept {
+	auto curr_date = mysql_date(curr_time);
+	size_t removed = 0;
+	for (auto it = sessions_.begin(); it != sessions_.end();) {
+		auto& session = it->second;
+		if (session.loaded_at + TTL <= curr_time or
+		    session.expires < curr_date) {
+			it = sessions_.erase(it);
+			++removed;
+		} else {
+			++it;
+		}
+	}
+
+	return removed;
+}
+
+std::optional<SessionsCache::Session>
+SessionsCache::find(StringView session_id, time_t curr_time) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	auto it = sessions_.find(session_id);
+	if (it == sessions_.end())
+		return std::nullopt;
+
+	auto& session = it->second;
+	if (session.loaded_at + TTL <= curr_time or
+	    session.expires < mysql_date(curr_time)) {
+		sessions_.erase(it);
+		return std::nullopt;
+	}
+
+	return session;
+}
+
+void SessionsCache::store(string session_id, Session session,
+                          uint64_t generation) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	if (generation != generation_)
+		return; // The session might have changed after it was read
+
+	if (sessions_.size() >= MAX_SESSIONS and
+	    sweep_locked(session.loaded_at) == 0) {
+		sessions_.erase(sessions_.begin());
+	}
+
+	sessions_.insert_or_assign(std::move(session_id), std::move(session));
+}
+
+void SessionsCache::erase(StringView session_id) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	++generation_;
+	auto it = sessions_.find(session_id);
+	if (it != sessions_.end())
+		sessions_.erase(it);
+}
+
+void SessionsCache::erase_user(StringView user_id) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	++generation_;
+	for (auto it = sessions_.begin(); it != sessions_.end();) {
+		if (it->second.user_id == user_id)
+			it = sessions_.erase(it);
+		else
+			++it;
+	}
+}
+
+} // namespace server
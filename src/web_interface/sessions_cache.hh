@@ -0,0 +1,86 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sim/user.hh>
+#include <simlib/string_view.hh>
+#include <string>
+
+namespace server {
+
+/**
+ * Sessions (together with their users' data) shared by all the workers, so
+ * that opening a session does not need to touch the database. An entry is
+ * trusted for TTL seconds since it was loaded; sim-server erases the entries
+ * it makes outdated right after committing the change, whereas changes made
+ * by other processes (e.g. the job server merging or deleting users) are
+ * picked up once the entry is reloaded.
+ *
+ * Every erasure bumps the generation, and an entry loaded under an older
+ * generation is not stored, so that a worker that read the database before
+ * the change cannot bring the outdated entry back.
+ */
+class SessionsCache {
+public:
+	struct Session {
+		std::string csrf_token;
+		std::string user_id;
+		sim::User::Type user_type;
+		std::string username;
+		std::string data;
+		std::string expires; // MySQL datetime
+		time_t loaded_at;
+	};
+
+	static constexpr time_t TTL = 30; // [s]
+	// When the cache is full, the stale entries are swept and if that is not
+	// enough, some entry is evicted
+	static constexpr size_t MAX_SESSIONS = 1 << 16;
+
+private:
+	std::mutex mtx_;
+	std::map<std::string, Session, std::less<>> sessions_; // By session id
+	uint64_t generation_ = 0;
+
+	// mtx_ has to be locked
+	size_t sweep_locked(time_t curr_time) noexcept;
+
+public:
+	/// Returns the current generation, it has to be taken before the session
+	/// is read from the database (see store())
+	uint64_t generation() {
+		std::lock_guard<std::mutex> lock(mtx_);
+		return generation_;
+	}
+
+	/// Returns the session @p session_id if it is cached, has not expired and
+	/// was loaded less than TTL seconds before @p curr_time
+	std::optional<Session> find(StringView session_id, time_t curr_time);
+
+	/// Caches @p session read from the database while the generation was
+	/// @p generation (otherwise, the session is not cached)
+	void store(std::string session_id, Session session, uint64_t generation);
+
+	/// Has to be called after the change of the session is committed
+	void erase(StringView session_id);
+
+	/// Erases all the sessions of the user @p user_id (e.g. after their
+	/// username or type changed). Has to be called after the change is
+	/// committed.
+	void erase_user(StringView user_id);
+
+	/// Removes the expired and stale entries, returns the number of them
+	size_t sweep(time_t curr_time) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		return sweep_locked(curr_time);
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mtx_);
+		return sessions_.size();
+	}
+};
+
+} // namespace server
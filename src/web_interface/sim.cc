@@ -10,10 +10,13 @@ using std::unique_ptr;
 using std::vector;
 
 server::HttpResponse Sim::handle(CStringView client_ip_addr,
-                                 server::HttpRequest req) {
+                                 server::HttpRequest req,
+                                 ResponseStreamer streamer) {
 	client_ip = std::move(client_ip_addr);
 	request = std::move(req);
 	resp = server::HttpResponse(server::HttpResponse::TEXT);
+	response_streamer = std::move(streamer);
+	resp_stream = nullptr;
 
 	stdlog(request.target);
 
@@ -119,6 +122,8 @@ server::HttpResponse Sim::handle(CStringView client_ip_addr,
 			// Make sure that the session is closed
 			session_close();
 
+			end_streamed_response(false);
+
 #ifdef DEBUG
 			if (notifications.size != 0)
 				THROW("There are notifications left: ", notifications);
@@ -126,12 +131,18 @@ server::HttpResponse Sim::handle(CStringView client_ip_addr,
 
 		} catch (const std::exception& e) {
 			ERRLOG_CATCH(e);
-			error500();
+			if (resp_stream)
+				end_streamed_response(true); // The head is already sent
+			else
+				error500();
 			session_close(); // Prevent session from being left open
 
 		} catch (...) {
 			ERRLOG_CATCH();
-			error500();
+			if (resp_stream)
+				end_streamed_response(true); // The head is already sent
+			else
+				error500();
 			session_close(); // Prevent session from being left open
 		}
 
@@ -139,18 +150,59 @@ server::HttpResponse Sim::handle(CStringView client_ip_addr,
 		ERRLOG_CATCH(e);
 		// We cannot use error500() because it will probably throw
 		hard_error500();
+		end_streamed_response(true);
 		session_is_open = false; // Prevent session from being left open
 
 	} catch (...) {
 		ERRLOG_CATCH();
 		// We cannot use error500() because it will probably throw
 		hard_error500();
+		end_streamed_response(true);
 		session_is_open = false; // Prevent session from being left open
 	}
 
+	// The streamer refers to the connection of this request
+	response_streamer = nullptr;
+	resp_stream = nullptr;
 	return std::move(resp);
 }
 
+bool Sim::stream_response() {
+	if (resp_stream)
+		return true;
+	if (not response_streamer)
+		return false;
+
+	resp_stream = response_streamer(resp);
+	return true;
+}
+
+bool Sim::flush_streamed_content(bool force) {
+	if (not resp_stream or
+	    (resp.content.size < STREAMED_CONTENT_CHUNK_SIZE and not force)) {
+		return true;
+	}
+
+	bool received =
+	   resp_stream->write(StringView(resp.content.data(), resp.content.size));
+	resp.content.clear();
+	return received;
+}
+
+void Sim::end_streamed_response(bool failed) {
+	if (not resp_stream)
+		return;
+
+	if (failed) {
+		resp_stream->fail();
+	} else {
+		flush_streamed_content(true);
+		resp_stream->finish();
+	}
+
+	resp.content.clear();
+}
+
 void Sim::main_page() {
 	STACK_UNWINDING_MARK;
 
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "api_list.hh"
+#include "contest_ranking.hh"
 #include "http_request.hh"
 #include "http_response.hh"
+#include "response_stream.hh"
+#include "sessions_cache.hh"
 
 #include <sim/constants.hh>
 #include <sim/contest_file_permissions.hh>
@@ -10,6 +14,8 @@
 #include <sim/mysql.hh>
 #include <sim/problem_permissions.hh>
 #include <sim/user.hh>
+#include <functional>
+#include <memory>
 #include <simlib/http/response.hh>
 #include <simlib/request_uri_parser.hh>
 #include <utime.h>
@@ -17,9 +23,17 @@
 // Every object is independent, objects can be used in multi-thread program
 // as long as one is not used by two threads simultaneously
 class Sim final {
+public:
+	/// Sends the head of a streamed response (@p head without the content)
+	/// and returns the stream to which the content is written
+	using ResponseStreamer =
+	   std::function<std::shared_ptr<server::ResponseStream>(
+	      const server::HttpResponse& head)>;
+
+private:
 	/* ============================== General ============================== */
 
-	MySQL::Connection mysql;
+	MySQL::CachedStatementsConnection mysql;
 	CStringView client_ip; // TODO: put in request?
 	server::HttpRequest request;
 	server::HttpResponse resp;
@@ -57,6 +71,34 @@ class Sim final {
 #endif
 	}
 
+	/* ========================= Streamed responses ========================= */
+
+	// Content of a streamed response is written to the stream whenever that
+	// much of it accumulates in resp.content
+	static constexpr size_t STREAMED_CONTENT_CHUNK_SIZE = 64 << 10; // 64 KiB
+
+	ResponseStreamer response_streamer;
+	// Set once the response is streamed, then resp.content holds the content
+	// that is not written to it yet
+	std::shared_ptr<server::ResponseStream> resp_stream;
+
+	/// Sends the head of the response (resp, the content appended so far
+	/// becomes the beginning of the content) and makes the rest of the content
+	/// be streamed. Returns false if the response cannot be streamed, then it
+	/// is sent as a whole, as usual.
+	bool stream_response();
+
+	/// Writes resp.content to the stream once it is at least
+	/// STREAMED_CONTENT_CHUNK_SIZE long (or if @p force is true). Returns
+	/// false if the client will not receive it, so that there is no point in
+	/// generating more content. Does nothing if the response is not streamed.
+	bool flush_streamed_content(bool force = false);
+
+	/// Writes the rest of the content and ends the streamed response (if the
+	/// response is streamed). If @p failed is true, the response is ended as
+	/// incomplete.
+	void end_streamed_response(bool failed);
+
 	/* ================================ API ================================ */
 
 	void api_error400(StringView response_body = {}) {
@@ -71,6 +113,23 @@ class Sim final {
 		set_response("404 Not Found", response_body);
 	}
 
+	using ApiList = server::api_list::List;
+	using ApiListMode = server::api_list::Mode;
+
+	/// Mode of the list API, chosen by the query of the URL. Returns
+	/// std::nullopt (and sets the error response) if the query is invalid.
+	std::optional<ApiListMode> api_list_mode();
+
+	/// Responds with the rows selected by @p list, each one appended by
+	/// @p append_row (which returns false if the whole list has to be empty,
+	/// e.g. because of missing permissions)
+	void api_list(const ApiList& list,
+	              const std::function<bool(MySQL::Result&)>& append_row);
+
+	/// Responds with a list that has no rows
+	void api_list_empty(const std::vector<std::string>& head,
+	                    bool rows_in_array = false);
+
 	// api.cc
 	void api_handle();
 
@@ -166,6 +225,8 @@ class Sim final {
 
 	void api_submission_download();
 
+	void api_submission_progress();
+
 	// contests_api.cc
 	void api_contests();
 
@@ -191,7 +252,7 @@ class Sim final {
 	void api_contest_round_clone(StringView contest_id,
 	                             sim::contest::Permissions perms);
 
-	void api_contest_round_edit(uintmax_t contest_round_id,
+	void api_contest_round_edit(uintmax_t contest_id, uintmax_t contest_round_id,
 	                            sim::contest::Permissions perms);
 
 	void api_contest_round_delete(uintmax_t contest_round_id,
@@ -208,16 +269,17 @@ class Sim final {
 	                                            sim::contest::Permissions perms,
 	                                            StringView problem_id);
 
-	void api_contest_problem_edit(StringView contest_problem_id,
+	void api_contest_problem_edit(uintmax_t contest_id,
+	                              StringView contest_problem_id,
 	                              sim::contest::Permissions perms);
 
 	void api_contest_problem_delete(StringView contest_problem_id,
 	                                sim::contest::Permissions perms);
 
-	void api_contest_ranking(
-	   sim::contest::Permissions perms,
-	   StringView submissions_query_id_name, // TODO: change to id_kind
-	   StringView query_id);
+	void api_contest_ranking(sim::contest::Permissions perms,
+	                         uintmax_t contest_id,
+	                         server::ContestRanking::Scope scope,
+	                         uintmax_t scope_id);
 
 	// contest_users_api.cc
 
@@ -276,6 +338,11 @@ class Sim final {
 	InplaceBuff<32> session_user_id;
 	decltype(sim::User::username) session_username;
 	InplaceBuff<4096> session_data;
+	// session_data as it was when the session was opened
+	InplaceBuff<4096> session_data_on_open;
+
+	// Shared by all the workers
+	static server::SessionsCache sessions_cache;
 
 	/**
 	 * @brief Creates session and opens it
@@ -294,9 +361,16 @@ class Sim final {
 	/// Opens session, returns true if opened successfully, false otherwise
 	bool session_open();
 
-	/// Closes session (even if it throws, the session is closed)
+	/// Closes session (even if it throws, the session is closed); the
+	/// session's data is written back only if it has changed
 	void session_close();
 
+public:
+	/// Periodically sweeps the sessions cache and removes the expired sessions
+	/// from the database, never returns (meant to be run in its own thread)
+	static void sessions_sweeper() noexcept;
+
+private:
 	/* =========================== Page template =========================== */
 
 	bool page_template_began = false;
@@ -705,6 +779,11 @@ public:
 	Sim& operator=(const Sim&) = delete;
 	Sim& operator=(Sim&&) = delete;
 
+	/// Statements cache of the database connection
+	const MySQL::StatementsCache& statements_cache() {
+		return MySQL::statements_cache(mysql);
+	}
+
 	/**
 	 * @brief Handles request
 	 * @details Takes requests, handle it and returns response.
@@ -712,9 +791,13 @@ public:
 	 *
 	 * @param client_ip_addr IP address of the client
 	 * @param req request
+	 * @param streamer used to stream the response if it is large, then the
+	 *   returned response is already sent
 	 *
 	 * @return response
 	 */
+	// TODO: close session
 	server::HttpResponse handle(CStringView client_ip_addr,
-	                            server::HttpRequest req); // TODO: close session
+	                            server::HttpRequest req,
+	                            ResponseStreamer streamer = {});
 };
@@ -0,0 +1,266 @@
+#include "static_files_cache.hh"
+#include "connection.hh"
+
+#include <dirent.h>
+#include <simlib/debug.hh>
+#include <simlib/file_contents.hh>
+#include <simlib/logger.hh>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using std::string;
+
+namespace server {
+
+namespace {
+
+const char* content_type_of(StringView path) noexcept {
+	static constexpr std::pair<const char*, const char*> types[] = {
+	   {".css", "text/css; charset=utf-8"},
+	   {".js", "text/javascript; charset=utf-8"},
+	   {".html", "text/html; charset=utf-8"},
+	   {".txt", "text/plain; charset=utf-8"},
+	   {".json", "application/json"},
+	   {".svg", "image/svg+xml"},
+	   {".png", "image/png"},
+	   {".gif", "image/gif"},
+	   {".jpg", "image/jpeg"},
+	   {".jpeg", "image/jpeg"},
+	   {".ico", "image/x-icon"},
+	   {".woff2", "font/woff2"},
+	};
+	for (auto [extension, type] : types) {
+		if (has_suffix(path, extension))
+			return type;
+	}
+
+	return "application/octet-stream";
+}
+
+// Editors and tools (e.g. rsync) create temporary files starting with '.'
+bool is_hidden(StringView name) noexcept {
+	return not name.empty() and name.front() == '.';
+}
+
+constexpr uint32_t WATCHED_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO |
+                                    IN_MOVED_FROM | IN_DELETE | IN_CREATE |
+                                    IN_ATTRIB | IN_ONLYDIR;
+
+} // anonymous namespace
+
+void StaticFilesCache::erase(StringView path) noexcept {
+	auto it = files_.find(path);
+	if (it == files_.end())
+		return;
+
+	for (auto& [coding, repr] : it->second.representations)
+		total_size_ -= repr.content->size();
+	files_.erase(it);
+}
+
+void StaticFilesCache::load_file(const string& path, CompressionLevel level) {
+	STACK_UNWINDING_MARK;
+
+	erase(path);
+	string fs_path = concat_tostr(root_, path);
+	struct stat64 st;
+	if (stat64(fs_path.c_str(), &st) or not S_ISREG(st.st_mode) or
+	    uint64_t(st.st_size) > MAX_FILE_SIZE or
+	    total_size_ + st.st_size > MAX_TOTAL_SIZE) {
+		return;
+	}
+
+	// The version is taken before reading the file; if the file is modified
+	// in the meantime, the change is reported and the file gets reloaded
+	File file;
+	file.version = static_file_version(st.st_mtim);
+	file.mtime = st.st_mtime;
+	file.content_type = content_type_of(path);
+	auto content =
+	   std::make_shared<const string>(get_file_contents(fs_path));
+	string etag = Connection::file_etag(st.st_ino, st.st_size, st.st_mtim);
+	size_t size = content->size();
+
+	if (is_compressible(file.content_type)) {
+		for (auto coding : {ContentCoding::GZIP, ContentCoding::BROTLI}) {
+			if (not is_supported(coding))
+				continue;
+
+			auto compressed = std::make_shared<const string>(
+			   compress(*content, coding, level));
+			// Compressing is pointless if it does not save anything
+			if (compressed->size() >= content->size())
+				continue;
+
+			// Every encoding of the file is a different representation
+			string variant_etag = etag;
+			variant_etag.insert(etag.size() - 1,
+			                    coding == ContentCoding::GZIP ? "-gz" : "-br");
+			size += compressed->size();
+			file.representations.emplace(
+			   coding,
+			   Representation {std::move(compressed), std::move(variant_etag)});
+		}
+	}
+
+	if (total_size_ + size > MAX_TOTAL_SIZE)
+		return;
+
+	file.representations.emplace(
+	   ContentCoding::IDENTITY,
+	   Representation {std::move(content), std::move(etag)});
+	total_size_ += size;
+	files_.insert_or_assign(path, std::move(file));
+}
+
+void StaticFilesCache::load_dir(const string& path, CompressionLevel level) {
+	STACK_UNWINDING_MARK;
+
+	string fs_path = concat_tostr(root_, path);
+	if (inotify_fd_ != -1) {
+		int wd = inotify_add_watch(inotify_fd_, fs_path.c_str(),
+		                           WATCHED_EVENTS);
+		if (wd == -1)
+			THROW("inotify_add_watch(", fs_path, ')', errmsg());
+
+		watched_dirs_[wd] = path;
+	}
+	dirs_.emplace(path);
+
+	DIR* dir = opendir(fs_path.c_str());
+	if (dir == nullptr)
+		THROW("opendir(", fs_path, ')', errmsg());
+
+	// Loading may throw, so the directory is read beforehand
+	std::vector<std::pair<string, bool>> entries; // (name, is directory)
+	while (dirent* entry = readdir(dir)) {
+		if (is_hidden(entry->d_name))
+			continue; // Also skips "." and ".."
+
+		bool is_dir = (entry->d_type == DT_DIR);
+		if (entry->d_type == DT_UNKNOWN) {
+			struct stat64 st;
+			is_dir = (stat64(concat_tostr(fs_path, entry->d_name).c_str(),
+			                 &st) == 0 and
+			          S_ISDIR(st.st_mode));
+		}
+		entries.emplace_back(entry->d_name, is_dir);
+	}
+	closedir(dir);
+
+	for (auto& [name, is_dir] : entries) {
+		if (is_dir)
+			load_dir(concat_tostr(path, name, '/'), level);
+		else
+			load_file(concat_tostr(path, name), level);
+	}
+}
+
+int StaticFilesCache::watch() {
+	STACK_UNWINDING_MARK;
+
+	inotify_fd_ = FileDescriptor {inotify_init1(IN_NONBLOCK | IN_CLOEXEC)};
+	if (inotify_fd_ == -1)
+		THROW("inotify_init1()", errmsg());
+
+	for (auto& path : dirs_) {
+		string fs_path = concat_tostr(root_, path);
+		int wd = inotify_add_watch(inotify_fd_, fs_path.c_str(),
+		                           WATCHED_EVENTS);
+		if (wd == -1)
+			THROW("inotify_add_watch(", fs_path, ')', errmsg());
+
+		watched_dirs_[wd] = path;
+	}
+
+	return inotify_fd_;
+}
+
+void StaticFilesCache::forget_dir(const string& path) {
+	std::vector<string> removed;
+	for (auto it = files_.lower_bound(path);
+	     it != files_.end() and has_prefix(it->first, path); ++it) {
+		removed.emplace_back(it->first);
+	}
+	for (auto& file_path : removed)
+		erase(file_path);
+
+	for (auto it = watched_dirs_.begin(); it != watched_dirs_.end();) {
+		if (has_prefix(it->second, path)) {
+			(void)inotify_rm_watch(inotify_fd_, it->first);
+			dirs_.erase(it->second);
+			it = watched_dirs_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void StaticFilesCache::handle_event(const inotify_event& event) {
+	STACK_UNWINDING_MARK;
+
+	if (event.mask & IN_Q_OVERFLOW) {
+		// Changes were lost, so everything is reloaded
+		stdlog("Static files cache: inotify queue overflowed");
+		auto dirs = dirs_;
+		for (auto& path : dirs)
+			load_dir(path, CompressionLevel::FAST);
+		return;
+	}
+
+	auto it = watched_dirs_.find(event.wd);
+	if (it == watched_dirs_.end())
+		return;
+
+	if (event.mask & IN_IGNORED) { // The directory is gone
+		dirs_.erase(it->second);
+		watched_dirs_.erase(it);
+		return;
+	}
+
+	if (event.len == 0 or is_hidden(event.name))
+		return;
+
+	string path = concat_tostr(it->second, event.name);
+	if (event.mask & IN_ISDIR) {
+		if (event.mask & (IN_CREATE | IN_MOVED_TO))
+			load_dir(path + '/', CompressionLevel::FAST);
+		else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+			forget_dir(path + '/');
+
+	} else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+		erase(path);
+		stdlog("Static files cache: removed ", path);
+
+	} else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB)) {
+		load_file(path, CompressionLevel::FAST);
+		stdlog("Static files cache: reloaded ", path);
+	}
+}
+
+void StaticFilesCache::handle_changes() {
+	alignas(inotify_event) char buff[1 << 14];
+	for (;;) {
+		ssize_t len = read(inotify_fd_, buff, sizeof(buff));
+		if (len == -1 and errno == EINTR)
+			continue;
+		if (len <= 0)
+			return; // No more events
+
+		for (char* ptr = buff; ptr < buff + len;) {
+			auto* event = reinterpret_cast<inotify_event*>(ptr);
+			ptr += sizeof(inotify_event) + event->len;
+			try {
+				handle_event(*event);
+			} catch (const std::exception& e) {
+				// E.g. the file was removed while being loaded (then the
+				// removal is handled by the next event)
+				ERRLOG_CATCH(e);
+			}
+		}
+	}
+}
+
+} // namespace server
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "compression.hh"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <simlib/file_descriptor.hh>
+#include <string>
+#include <sys/inotify.h>
+
+namespace server {
+
+/**
+ * Static files (the whole served tree) kept in memory together with their
+ * compressed variants, so that they are served without touching the
+ * filesystem. The cache is used only by the thread that owns it (the events
+ * loop), so it needs no synchronization; changes of the files are picked up
+ * through inotify(7).
+ */
+class StaticFilesCache {
+public:
+	// Larger files are served from the disk
+	static constexpr size_t MAX_FILE_SIZE = 8 << 20; // 8 MiB
+	static constexpr size_t MAX_TOTAL_SIZE = 64 << 20; // 64 MiB
+
+	struct Representation {
+		// Shared with the responses that are being sent
+		std::shared_ptr<const std::string> content;
+		std::string etag;
+	};
+
+	struct File {
+		std::string version; // See static_file_version()
+		time_t mtime;
+		const char* content_type;
+		// Always contains the IDENTITY coding
+		std::map<ContentCoding, Representation> representations;
+	};
+
+private:
+	std::string root_;
+	std::map<std::string, File, std::less<>> files_; // By the URL paths
+	size_t total_size_ = 0;
+	std::set<std::string> dirs_; // URL paths of the loaded directories
+	FileDescriptor inotify_fd_;
+	std::map<int, std::string> watched_dirs_; // watch descriptor => URL path
+
+	/// Loads (or reloads) the file with the URL path @p path; if it cannot
+	/// be cached, it is removed from the cache
+	void load_file(const std::string& path, CompressionLevel level);
+
+	/// Loads the directory with the URL path @p path (ending with '/')
+	/// recursively and watches it if the watching is enabled
+	void load_dir(const std::string& path, CompressionLevel level);
+
+	void erase(StringView path) noexcept;
+
+	/// Removes the files and watches of the directory with the URL path
+	/// @p path (ending with '/')
+	void forget_dir(const std::string& path);
+
+	void handle_event(const inotify_event& event);
+
+public:
+	/// The files are served from the directory @p root_dir, e.g. the URL path
+	/// "/kit/styles.css" corresponds to the file root_dir + "/kit/styles.css"
+	explicit StaticFilesCache(std::string root_dir)
+	   : root_(std::move(root_dir)) {}
+
+	/// Loads the directory with the URL path @p path (ending with '/')
+	/// recursively. The files are compressed at the best level, which takes a
+	/// while, so it is meant to be done at startup. Throws on error.
+	void load(const std::string& path) {
+		load_dir(path, CompressionLevel::BEST);
+	}
+
+	/// Starts watching the loaded directories for changes, returns the file
+	/// descriptor that becomes readable once there are changes to handle
+	/// (then call handle_changes()). Throws on error.
+	int watch();
+
+	/// Reloads the changed files (at the fast compression level, not to stall
+	/// the serving)
+	void handle_changes();
+
+	size_t files_no() const noexcept { return files_.size(); }
+
+	size_t total_size() const noexcept { return total_size_; }
+
+	/// Returns nullptr if the file with the URL path @p path is not cached
+	const File* find(StringView path) const noexcept {
+		auto it = files_.find(path);
+		return (it == files_.end() ? nullptr : &it->second);
+	}
+};
+
+} // namespace server
@@ -7,6 +7,7 @@
 #include <sim/inf_datetime.hh>
 #include <sim/jobs.hh>
 #include <sim/submission.hh>
+#include <sim/submission_report.hh>
 #include <sim/utilities.hh>
 #include <simlib/call_in_destructor.hh>
 #include <simlib/file_contents.hh>
@@ -27,30 +28,8 @@ void Sim::append_submission_status(SubmissionStatus initial_status,
                                    SubmissionStatus full_status,
                                    bool show_full_status) {
 	STACK_UNWINDING_MARK;
-	using SS = SubmissionStatus;
-
-	auto as_str = [](SubmissionStatus status) {
-		switch (status) {
-		case SS::OK: return "\",\"OK\"]";
-		case SS::WA: return "\",\"Wrong answer\"]";
-		case SS::TLE: return "\",\"Time limit exceeded\"]";
-		case SS::MLE: return "\",\"Memory limit exceeded\"]";
-		case SS::RTE: return "\",\"Runtime error\"]";
-		case SS::PENDING: return "\",\"Pending\"]";
-		case SS::COMPILATION_ERROR: return "\",\"Compilation failed\"]";
-		case SS::CHECKER_COMPILATION_ERROR:
-			return "\",\"Checker compilation failed\"]";
-		case SS::JUDGE_ERROR: return "\",\"Judge error\"]";
-		}
-
-		return "\",\"Unknown\"]"; // Shouldn't happen
-	};
-
-	if (show_full_status)
-		append("[\"", css_color_class(full_status), as_str(full_status));
-	else
-		append("[\"initial ", css_color_class(initial_status),
-		       as_str(initial_status));
+	server::append_submission_status_json(resp.content, initial_status,
+	                                      full_status, show_full_status);
 }
 
 void Sim::api_submissions() {
@@ -125,9 +104,9 @@ void Sim::api_submissions() {
 	bool selecting_finals = false;
 	bool may_see_problem_final = (session_user_type == User::Type::ADMIN);
 
-	auto append_column_names = [&] {
+	auto column_names = [&] {
 		// clang-format off
-		append("[\n{\"columns\":["
+		std::string names = "{\"columns\":["
 		           "\"id\","
 		           "\"type\","
 		           "\"language\","
@@ -146,23 +125,20 @@ void Sim::api_submissions() {
 		           "\"submit_time\","
 		           "{\"name\":\"status\",\"fields\":[\"class\",\"text\"]},"
 		           "\"score\","
-		           "\"actions\"");
+		           "\"actions\"";
 		// clang-format on
 
 		if (select_one) {
-			append(",\"initial_report\","
-			       "\"final_report\","
-			       "\"full_results\"");
+			names += ",\"initial_report\","
+			         "\"final_report\","
+			         "\"full_results\"";
 		}
 
-		append("]}");
+		names += "]}";
+		return names;
 	};
 
-	auto set_empty_response = [&] {
-		resp.content.clear();
-		append_column_names();
-		append("\n]");
-	};
+	auto set_empty_response = [&] { api_list_empty({column_names()}); };
 
 	// Process restrictions
 	auto rows_limit = API_FIRST_QUERY_ROWS_LIMIT;
@@ -397,13 +373,14 @@ void Sim::api_submissions() {
 		return set_empty_response();
 
 	// Execute query
-	auto res = mysql.query(intentional_unsafe_string_view(
-	   concat(qfields, qwhere, " ORDER BY s.id DESC LIMIT ", rows_limit)));
-
-	append_column_names();
+	ApiList list;
+	list.query = concat_tostr(qfields, qwhere);
+	list.key_column = "s.id";
+	list.rows_limit = rows_limit;
+	list.head = {column_names()};
 
 	auto curr_date = mysql_date();
-	while (res.next()) {
+	api_list(list, [&](MySQL::Result& res) {
 		EnumVal<SubmissionType> stype {WONT_THROW(
 		   str2num<std::underlying_type_t<SubmissionType>>(res[STYPE])
 		      .value())};
@@ -422,7 +399,7 @@ void Sim::api_submissions() {
 		            WONT_THROW(str2num<uintmax_t>(res[POWNER]).value())}));
 
 		if (perms == PERM::NONE)
-			return set_empty_response();
+			return false;
 
 		bool contest_submission = not res.is_null(CID);
 
@@ -443,7 +420,7 @@ void Sim::api_submissions() {
 		   WONT_THROW(str2num<uintmax_t>(res[CINIFINAL]).value());
 
 		// Submission id
-		append(",\n[", res[SID], ',');
+		append('[', res[SID], ',');
 
 		optional<decltype(sim::ContestProblem::score_revealing)>
 		   score_revealing;
@@ -509,7 +486,7 @@ void Sim::api_submissions() {
 					      request.target, ')');
 				}
 
-				return set_empty_response();
+				return false;
 			}
 
 			switch (subtype_to_show) {
@@ -650,17 +627,20 @@ void Sim::api_submissions() {
 		// Append
 		if (select_one) {
 			// Reports (and round full results time if full report isn't shown)
-			append(',', json_stringify(res[INIT_REPORT]));
-			if (show_full_results)
-				append(',', json_stringify(res[FINAL_REPORT]));
-			else
+			// Reports are stored dumped, so they are rendered here
+			append(',', json_stringify(
+			               sim::submission_report::to_html(res[INIT_REPORT])));
+			if (show_full_results) {
+				append(',', json_stringify(sim::submission_report::to_html(
+				               res[FINAL_REPORT])));
+			} else {
 				append(",null,\"", full_results.to_api_str(), '"');
+			}
 		}
 
 		append(']');
-	}
-
-	append("\n]");
+		return true;
+	});
 }
 
 void Sim::api_submission() {
@@ -705,6 +685,8 @@ void Sim::api_submission() {
 		return api_submission_source();
 	if (next_arg == "download")
 		return api_submission_download();
+	if (next_arg == "progress")
+		return api_submission_progress();
 
 	if (request.method != server::HttpRequest::POST)
 		return api_error400();
@@ -914,6 +896,40 @@ void Sim::api_submission_download() {
 	resp.content_type = server::HttpResponse::FILE;
 }
 
+void Sim::api_submission_progress() {
+	STACK_UNWINDING_MARK;
+
+	if (uint(~submissions_perms & SubmissionPermissions::VIEW))
+		return api_error403();
+
+	EnumVal<SubmissionStatus> full_status;
+	MySQL::Optional<InplaceBuff<20>> full_results;
+	MySQL::Optional<bool> final;
+	MySQL::Optional<InplaceBuff<4096>> record;
+	auto stmt = mysql.prepare("SELECT s.full_status, r.full_results,"
+	                          " jp.final, jp.record "
+	                          "FROM submissions s "
+	                          "LEFT JOIN contest_rounds r"
+	                          " ON r.id=s.contest_round_id "
+	                          "LEFT JOIN submission_judging_progress jp"
+	                          " ON jp.submission_id=s.id "
+	                          "WHERE s.id=?");
+	stmt.bind_and_execute(submissions_sid);
+	stmt.res_bind_all(full_status, full_results, final, record);
+	throw_assert(stmt.next());
+
+	// The progress of the final judging reveals the full results
+	if (full_status != SubmissionStatus::PENDING or not final.has_value() or
+	    (final.value() and
+	     uint(~submissions_perms & SubmissionPermissions::VIEW_FINAL_REPORT) and
+	     full_results.has_value() and
+	     mysql_date() < InfDatetime(full_results.value()))) {
+		return append("null");
+	}
+
+	append(sim::submission_report::to_json(record.value()));
+}
+
 void Sim::api_submission_rejudge() {
 	STACK_UNWINDING_MARK;
 
@@ -1,6 +1,6 @@
+#include "compression.hh"
 #include "sim.hh"
 
-#include <chrono>
 #include <simlib/file_info.hh>
 
 using sim::User;
@@ -16,10 +16,9 @@ enum StaticFile {
 } // namespace
 
 // Technique used to force browsers to always keep up-to-date version of
-// the files below
+// the files below (the same version identifies their precompressed variants)
 template<StaticFile static_file>
 static StringView get_hash_of() {
-	using namespace std::chrono;
 	static auto str = [] {
 		auto path = [] {
 			switch (static_file) {
@@ -28,7 +27,7 @@ static StringView get_hash_of() {
 			case SCRIPTS_JS: return "static/kit/scripts.js";
 			}
 		}();
-		return to_string(duration_cast<microseconds>(get_modification_time(path).time_since_epoch()).count());
+		return server::static_file_version(get_modification_time(path));
 	}();
 	return str;
 }
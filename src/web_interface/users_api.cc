@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <limits>
 #include <sim/constants.hh>
+#include <sim/contest_ranking.hh>
 #include <sim/jobs.hh>
 #include <sim/user.hh>
 #include <sim/utilities.hh>
@@ -27,17 +28,13 @@ void Sim::api_users() {
 
 	InplaceBuff<256> query;
 	query.append("SELECT id, username, first_name, last_name, email, type "
-	             "FROM users");
+	             "FROM users WHERE TRUE"); // Needed to easily append
+	                                       // constraints
 
 	enum ColumnIdx { UID, USERNAME, FNAME, LNAME, EMAIL, UTYPE };
 
-	auto query_append = [&, where_was_added = false](auto&&... args) mutable {
-		if (where_was_added)
-			query.append(" AND ", std::forward<decltype(args)>(args)...);
-		else {
-			query.append(" WHERE ", std::forward<decltype(args)>(args)...);
-			where_was_added = true;
-		}
+	auto query_append = [&](auto&&... args) {
+		query.append(" AND ", std::forward<decltype(args)>(args)...);
 	};
 
 	if (session_user_type == User::Type::TEACHER)
@@ -88,23 +85,25 @@ void Sim::api_users() {
 		}
 	}
 
-	query.append(" ORDER BY id LIMIT ", rows_limit);
-	auto res = mysql.query(query);
-
+	ApiList list;
+	list.query = query.to_string();
+	list.key_column = "id";
+	list.key_descending = false;
+	list.rows_limit = rows_limit;
 	// clang-format off
-	append("[\n{\"columns\":["
-	           "\"id\","
-	           "\"username\","
-	           "\"first_name\","
-	           "\"last_name\","
-	           "\"email\","
-	           "\"type\","
-	           "\"actions\""
-	       "]}");
+	list.head = {"{\"columns\":["
+	                 "\"id\","
+	                 "\"username\","
+	                 "\"first_name\","
+	                 "\"last_name\","
+	                 "\"email\","
+	                 "\"type\","
+	                 "\"actions\""
+	             "]}"};
 	// clang-format on
 
-	while (res.next()) {
-		append(",\n[", res[UID], ",\"", res[USERNAME], "\",",
+	api_list(list, [&](MySQL::Result& res) {
+		append('[', res[UID], ",\"", res[USERNAME], "\",",
 		       json_stringify(res[FNAME]), ',', json_stringify(res[LNAME]), ',',
 		       json_stringify(res[EMAIL]), ',');
 
@@ -140,9 +139,8 @@ void Sim::api_users() {
 			append('N');
 
 		append("\"]");
-	}
-
-	append("\n]");
+		return true;
+	});
 }
 
 void Sim::api_user() {
@@ -335,8 +333,13 @@ void Sim::api_user_edit() {
 	            "WHERE id=?")
 	   .bind_and_execute(username, fname, lname, email, uint(new_utype),
 	                     users_uid);
+	// The rankings show the user's name
+	sim::contest_ranking::invalidate_user(
+	   mysql, WONT_THROW(str2num<uint64_t>(users_uid).value()));
 
 	transaction.commit();
+	// The sessions hold the user's username and type
+	sessions_cache.erase_user(users_uid);
 }
 
 void Sim::api_user_change_password() {
@@ -379,6 +382,7 @@ void Sim::api_user_change_password() {
 	   .bind_and_execute(users_uid, session_id);
 
 	transaction.commit();
+	sessions_cache.erase_user(users_uid);
 }
 
 void Sim::api_user_delete() {
@@ -399,6 +403,12 @@ void Sim::api_user_delete() {
 	                      EnumVal(JobType::DELETE_USER), mysql_date(),
 	                      users_uid);
 
+	// The user is logged out at once, rather than once the job is done (the
+	// sessions are deleted together with the user)
+	mysql.prepare("DELETE FROM session WHERE user_id=?")
+	   .bind_and_execute(users_uid);
+	sessions_cache.erase_user(users_uid);
+
 	jobs::notify_job_server();
 	append(stmt.insert_id());
 }
@@ -0,0 +1,206 @@
+#include "../src/web_interface/api_list.hh"
+
+#include <gtest/gtest.h>
+
+using server::api_list::List;
+using server::api_list::Mode;
+using server::api_list::Status;
+using std::string;
+using std::vector;
+
+namespace {
+
+struct FakeResult {
+	vector<vector<string>> rows;
+	size_t next_row = 0;
+
+	bool next() { return next_row++ < rows.size(); }
+
+	StringView operator[](size_t column) const {
+		return rows[next_row - 1][column];
+	}
+};
+
+// Serves the rows of a table ordered by the key (the first column) to the
+// queries of the form "... [AND k<key] ORDER BY k [DESC] LIMIT n"
+struct FakeConnection {
+	vector<vector<string>> rows; // In the order of the key
+	vector<string> queries;
+
+	template <class... Args>
+	FakeResult query(Args&&... args) {
+		string sql = concat_tostr(std::forward<Args>(args)...);
+		queries.emplace_back(sql);
+
+		size_t limit = std::stoull(sql.substr(sql.rfind(' ') + 1));
+		size_t beg = 0;
+		size_t cursor = sql.find(" AND k");
+		if (cursor != string::npos) {
+			// Rows are served in the order of the key, so the cursor is just
+			// the key of the last served row
+			string key = sql.substr(cursor + 7, sql.find(' ', cursor + 7) -
+			                                       cursor - 7);
+			if (key.front() == '\'')
+				key = key.substr(1, key.size() - 2);
+			while (beg < rows.size() and rows[beg][0] != key)
+				++beg;
+			++beg;
+		}
+
+		FakeResult res;
+		for (size_t i = beg; i < rows.size() and res.rows.size() < limit; ++i)
+			res.rows.emplace_back(rows[i]);
+		return res;
+	}
+};
+
+List example_list(bool rows_in_array) {
+	List list;
+	list.query = "SELECT k, v FROM t WHERE 1";
+	list.key_column = "k";
+	list.rows_limit = 2;
+	list.batch_rows = 2;
+	list.head = {"[\"k\",\"v\"]"};
+	if (rows_in_array)
+		list.head.emplace_back("\"A\"");
+	list.rows_in_array = rows_in_array;
+	return list;
+}
+
+FakeConnection example_connection() {
+	FakeConnection conn;
+	conn.rows = {{"9", "a"}, {"7", "b"}, {"4", "c"}, {"2", "d"}, {"1", "e"}};
+	return conn;
+}
+
+// Appends the list, flushing after every row
+struct Appended {
+	Status status;
+	string content;
+	vector<string> queries;
+};
+
+Appended append(FakeConnection conn, const List& list, Mode mode,
+                size_t failing_row = 0, size_t client_gone_row = 0) {
+	string sent;
+	InplaceBuff<32> content;
+	size_t rows = 0;
+	auto status = server::api_list::append(
+	   conn, list, mode, content,
+	   [&](FakeResult& res) {
+		   if (++rows == failing_row)
+			   return false;
+
+		   content.append("[", res[0], ",\"", res[1], "\"]");
+		   return true;
+	   },
+	   [&] {
+		   if (rows == client_gone_row)
+			   return false;
+
+		   if (mode != Mode::PAGE) {
+			   sent.append(content.data(), content.size);
+			   content.clear();
+		   }
+		   return true;
+	   });
+	sent.append(content.data(), content.size);
+	return {status, std::move(sent), std::move(conn.queries)};
+}
+
+} // anonymous namespace
+
+TEST(api_list, page) {
+	auto res = append(example_connection(), example_list(false), Mode::PAGE);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.content, "[\n[\"k\",\"v\"],\n[9,\"a\"],\n[7,\"b\"]\n]");
+	EXPECT_EQ(res.queries,
+	          vector<string> {"SELECT k, v FROM t WHERE 1 ORDER BY k DESC "
+	                          "LIMIT 2"});
+
+	res = append(example_connection(), example_list(true), Mode::PAGE);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.content,
+	          "[\n[\"k\",\"v\"],\n\"A\",[\n[9,\"a\"],\n[7,\"b\"]\n]]");
+
+	res = append(FakeConnection {}, example_list(true), Mode::PAGE);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.content, "[\n[\"k\",\"v\"],\n\"A\",[\n]]");
+}
+
+TEST(api_list, stream) {
+	auto res = append(example_connection(), example_list(false), Mode::STREAM);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.content,
+	          "[\n[\"k\",\"v\"],\n[9,\"a\"],\n[7,\"b\"],\n[4,\"c\"],\n"
+	          "[2,\"d\"],\n[1,\"e\"]\n]");
+	// Batches continue after the last row of the previous one
+	EXPECT_EQ(res.queries,
+	          (vector<string> {
+	             "SELECT k, v FROM t WHERE 1 ORDER BY k DESC LIMIT 2",
+	             "SELECT k, v FROM t WHERE 1 AND k<7 ORDER BY k DESC LIMIT 2",
+	             "SELECT k, v FROM t WHERE 1 AND k<2 ORDER BY k DESC LIMIT 2",
+	          }));
+
+	// The last batch is full
+	auto conn = example_connection();
+	conn.rows.pop_back();
+	res = append(conn, example_list(true), Mode::STREAM);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.content,
+	          "[\n[\"k\",\"v\"],\n\"A\",[\n[9,\"a\"],\n[7,\"b\"],\n"
+	          "[4,\"c\"],\n[2,\"d\"]\n]]");
+	EXPECT_EQ(res.queries.size(), 3);
+	EXPECT_EQ(res.queries.back(),
+	          "SELECT k, v FROM t WHERE 1 AND k<2 ORDER BY k DESC LIMIT 2");
+}
+
+TEST(api_list, export) {
+	auto res = append(example_connection(), example_list(true), Mode::EXPORT);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.content,
+	          "[\"k\",\"v\"]\n\"A\"\n[9,\"a\"]\n[7,\"b\"]\n[4,\"c\"]\n"
+	          "[2,\"d\"]\n[1,\"e\"]\n");
+	EXPECT_EQ(res.queries.size(), 3);
+}
+
+TEST(api_list, string_keys) {
+	FakeConnection conn;
+	conn.rows = {{"abc", "a"}, {"abd", "b"}, {"x1", "c"}};
+	auto list = example_list(false);
+	list.key_descending = false;
+	list.key_is_string = true;
+	auto res = append(conn, list, Mode::STREAM);
+	EXPECT_EQ(res.status, Status::COMPLETE);
+	EXPECT_EQ(res.queries,
+	          (vector<string> {
+	             "SELECT k, v FROM t WHERE 1 ORDER BY k LIMIT 2",
+	             "SELECT k, v FROM t WHERE 1 AND k>'abd' ORDER BY k LIMIT 2",
+	          }));
+
+	// Keys are put into the query, so they cannot contain anything else
+	conn.rows = {{"a'b", "a"}};
+	EXPECT_THROW(append(conn, list, Mode::STREAM), std::exception);
+	conn.rows = {{"12a", "a"}};
+	EXPECT_THROW(append(conn, example_list(false), Mode::STREAM),
+	             std::exception);
+}
+
+TEST(api_list, refused_rows) {
+	// Nothing is sent yet, so the list can still be made empty
+	auto res = append(example_connection(), example_list(false), Mode::PAGE, 2);
+	EXPECT_EQ(res.status, Status::REFUSED);
+	res = append(example_connection(), example_list(false), Mode::STREAM, 1);
+	EXPECT_EQ(res.status, Status::REFUSED);
+
+	res = append(example_connection(), example_list(false), Mode::STREAM, 4);
+	EXPECT_EQ(res.status, Status::INCOMPLETE);
+	EXPECT_EQ(res.queries.size(), 2);
+}
+
+TEST(api_list, client_gone) {
+	auto res =
+	   append(example_connection(), example_list(false), Mode::STREAM, 0, 3);
+	EXPECT_EQ(res.status, Status::CLIENT_GONE);
+	EXPECT_EQ(res.queries.size(), 2); // No more rows are fetched
+}
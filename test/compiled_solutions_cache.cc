@@ -0,0 +1,153 @@
+#include "../src/job_server/compiled_solutions_cache.hh"
+
+#include <gtest/gtest.h>
+#include <sim/constants.hh>
+#include <simlib/file_contents.hh>
+#include <simlib/file_manip.hh>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using sim::SolutionLanguage;
+using std::string;
+using std::chrono::seconds;
+
+namespace csc = compiled_solutions_cache;
+
+namespace {
+
+// The cache lives in a directory relative to the working directory, so every
+// test runs in a fresh temporary directory
+class CompiledSolutionsCacheTest : public ::testing::Test {
+protected:
+	string dir_;
+	string old_cwd_;
+
+	void SetUp() override {
+		char tmpl[] = "/tmp/sim-compiled-solutions-test.XXXXXX";
+		ASSERT_NE(mkdtemp(tmpl), nullptr);
+		dir_ = tmpl;
+		char* cwd = getcwd(nullptr, 0);
+		ASSERT_NE(cwd, nullptr);
+		old_cwd_ = cwd;
+		free(cwd);
+		ASSERT_EQ(chdir(dir_.c_str()), 0);
+	}
+
+	void TearDown() override {
+		EXPECT_EQ(chdir(old_cwd_.c_str()), 0);
+		(void)remove_r(dir_);
+	}
+};
+
+} // anonymous namespace
+
+TEST_F(CompiledSolutionsCacheTest, key) {
+	put_file_contents("a.cpp", "int main() {}");
+	put_file_contents("b.cpp", "int main() { }");
+	auto key = csc::key("a.cpp", SolutionLanguage::CPP17);
+	EXPECT_EQ(key, csc::key("a.cpp", SolutionLanguage::CPP17));
+	EXPECT_NE(key, csc::key("a.cpp", SolutionLanguage::CPP14));
+	EXPECT_NE(key, csc::key("b.cpp", SolutionLanguage::CPP17));
+}
+
+TEST_F(CompiledSolutionsCacheTest, store_and_load_compilation_errors) {
+	sim::JudgeWorker jworker;
+	EXPECT_EQ(csc::load("abc", jworker), std::nullopt);
+
+	csc::store("abc", jworker, {"a.cpp:1:1: error: expected ';'"});
+	auto res = csc::load("abc", jworker);
+	ASSERT_TRUE(res.has_value());
+	EXPECT_EQ(res->compilation_errors, "a.cpp:1:1: error: expected ';'");
+
+	EXPECT_EQ(csc::load("abd", jworker), std::nullopt);
+}
+
+TEST_F(CompiledSolutionsCacheTest, store_and_load_compiled_solution) {
+	// A cached binary is loaded into the judge worker and saved back from it
+	ASSERT_EQ(mkdir("cache", S_IRWXU), 0);
+	ASSERT_EQ(mkdir(COMPILED_SOLUTIONS_CACHE_DIR, S_IRWXU), 0);
+	string binary = "\x7f" "ELF binary";
+	put_file_contents(concat_tostr(COMPILED_SOLUTIONS_CACHE_DIR, "abc.bin"),
+	                  binary);
+
+	sim::JudgeWorker jworker;
+	auto res = csc::load("abc", jworker);
+	ASSERT_TRUE(res.has_value());
+	EXPECT_EQ(res->compilation_errors, std::nullopt);
+
+	csc::store("xyz", jworker, {std::nullopt});
+	EXPECT_EQ(get_file_contents(
+	             concat_tostr(COMPILED_SOLUTIONS_CACHE_DIR, "xyz.bin")),
+	          binary);
+	res = csc::load("xyz", jworker);
+	ASSERT_TRUE(res.has_value());
+	EXPECT_EQ(res->compilation_errors, std::nullopt);
+}
+
+TEST_F(CompiledSolutionsCacheTest, hits_and_misses) {
+	sim::JudgeWorker jworker;
+	auto hits = csc::hits();
+	auto misses = csc::misses();
+	(void)csc::load("abc", jworker);
+	EXPECT_EQ(csc::misses(), misses + 1);
+	csc::store("abc", jworker, {"error: x"});
+	(void)csc::load("abc", jworker);
+	EXPECT_EQ(csc::hits(), hits + 1);
+	EXPECT_EQ(csc::misses(), misses + 1);
+}
+
+TEST(compiled_solutions_cache, is_compiler_diagnostic) {
+	auto is_diagnostic = [](StringView errors, seconds time) {
+		return csc::is_compiler_diagnostic(errors, time, seconds(30));
+	};
+	EXPECT_TRUE(is_diagnostic("a.cpp:1:1: error: expected ';'", seconds(1)));
+	EXPECT_TRUE(is_diagnostic("a.c:2:5: ERROR: x", seconds(1)));
+	EXPECT_TRUE(is_diagnostic("a.pas(3,1) Fatal: Syntax error, \";\" expected "
+	                          "but \"BEGIN\" found",
+	                          seconds(1)));
+	// Hitting the time limit
+	EXPECT_FALSE(is_diagnostic("a.cpp:1:1: error: expected ';'", seconds(30)));
+	EXPECT_FALSE(is_diagnostic("Compilation time limit exceeded", seconds(1)));
+	// Killed compiler
+	EXPECT_FALSE(is_diagnostic("g++: internal compiler error: Killed (program "
+	                           "cc1plus)",
+	                           seconds(5)));
+	EXPECT_FALSE(is_diagnostic("g++: fatal error: Killed signal terminated "
+	                           "program cc1plus",
+	                           seconds(5)));
+	EXPECT_FALSE(is_diagnostic("", seconds(1)));
+	// Failing to run the compiler
+	EXPECT_FALSE(is_diagnostic("g++: fatal error: cannot execute 'cc1plus': "
+	                           "execvp: No such file or directory",
+	                           seconds(1)));
+	EXPECT_FALSE(is_diagnostic("proot error: execve(\"/usr/bin/g++\"): No "
+	                           "such file or directory",
+	                           seconds(1)));
+	EXPECT_FALSE(is_diagnostic("cc1plus: out of memory allocating 65536 bytes",
+	                           seconds(1)));
+
+	EXPECT_TRUE(is_diagnostic("In file included from a.cpp:1:\n"
+	                          "b.h:7: error: 'x' was not declared",
+	                          seconds(1)));
+	EXPECT_TRUE(is_diagnostic("c:\\a b:c.cpp:12:3: fatal error: x.h: No such "
+	                          "file or directory",
+	                          seconds(1)));
+	EXPECT_TRUE(is_diagnostic("a.pas(3,10) Error: Identifier not found \"x\"\n"
+	                          "a.pas(5) Fatal: There were 1 errors compiling "
+	                          "module, stopping",
+	                          seconds(1)));
+	// Messages that merely contain "error" or "warning" are not diagnostics
+	// located in the source
+	EXPECT_FALSE(is_diagnostic("a.cpp:1:1: warning: unused variable 'x'",
+	                           seconds(1)));
+	EXPECT_FALSE(is_diagnostic("error: cannot open output file a.out",
+	                           seconds(1)));
+	EXPECT_FALSE(is_diagnostic("Error: /usr/bin/ppcx64 returned an error "
+	                           "exitcode",
+	                           seconds(1)));
+	EXPECT_FALSE(is_diagnostic("sandbox: error: 12: fatal error: x",
+	                           seconds(1)));
+	EXPECT_FALSE(is_diagnostic("a.cpp:1:1: note: the error: is here\n"
+	                           "terminate called: error: x",
+	                           seconds(1)));
+}
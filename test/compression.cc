@@ -0,0 +1,126 @@
+#include "../src/web_interface/compression.hh"
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+using server::ContentCoding;
+using std::string;
+
+namespace {
+
+string gunzip(StringView data) {
+	z_stream zs = {};
+	EXPECT_EQ(inflateInit2(&zs, 15 + 16), Z_OK);
+	zs.next_in = (Bytef*)data.data();
+	zs.avail_in = data.size();
+	string res;
+	int rc;
+	do {
+		char buff[4096];
+		zs.next_out = (Bytef*)buff;
+		zs.avail_out = sizeof(buff);
+		rc = inflate(&zs, Z_NO_FLUSH);
+		res.append(buff, sizeof(buff) - zs.avail_out);
+	} while (rc == Z_OK);
+	EXPECT_EQ(rc, Z_STREAM_END);
+	inflateEnd(&zs);
+	return res;
+}
+
+} // anonymous namespace
+
+TEST(compression, choose_content_coding) {
+	auto best = (server::is_supported(ContentCoding::BROTLI)
+	                ? ContentCoding::BROTLI
+	                : ContentCoding::GZIP);
+	EXPECT_EQ(server::choose_content_coding(""), ContentCoding::IDENTITY);
+	EXPECT_EQ(server::choose_content_coding("identity"),
+	          ContentCoding::IDENTITY);
+	EXPECT_EQ(server::choose_content_coding("deflate"),
+	          ContentCoding::IDENTITY);
+	EXPECT_EQ(server::choose_content_coding("gzip"), ContentCoding::GZIP);
+	EXPECT_EQ(server::choose_content_coding(" X-GZIP ;foo=bar"),
+	          ContentCoding::GZIP);
+	EXPECT_EQ(server::choose_content_coding("gzip, deflate, br"), best);
+	EXPECT_EQ(server::choose_content_coding("gzip;q=1.0, br;q=0.5"),
+	          ContentCoding::GZIP);
+	EXPECT_EQ(server::choose_content_coding("gzip;q=0.2, br;q=0.5"), best);
+	EXPECT_EQ(server::choose_content_coding("gzip;q=0, br;q=0"),
+	          ContentCoding::IDENTITY);
+	EXPECT_EQ(server::choose_content_coding("gzip;q=0.000"),
+	          ContentCoding::IDENTITY);
+	EXPECT_EQ(server::choose_content_coding("gzip;q=0.001"),
+	          ContentCoding::GZIP);
+	EXPECT_EQ(server::choose_content_coding("gzip;q=2"),
+	          ContentCoding::IDENTITY);
+	EXPECT_EQ(server::choose_content_coding("*"), best);
+	EXPECT_EQ(server::choose_content_coding("br;q=0, *"), ContentCoding::GZIP);
+	EXPECT_EQ(server::choose_content_coding("*;q=0, gzip"),
+	          ContentCoding::GZIP);
+}
+
+TEST(compression, is_compressible) {
+	EXPECT_TRUE(server::is_compressible("text/html; charset=utf-8"));
+	EXPECT_TRUE(server::is_compressible("text/plain; charset=utf-8"));
+	EXPECT_TRUE(server::is_compressible("Application/JSON"));
+	EXPECT_TRUE(server::is_compressible("application/ld+json"));
+	EXPECT_TRUE(server::is_compressible("image/svg+xml"));
+	EXPECT_TRUE(
+	   server::is_compressible("application/x-ndjson; charset=utf-8"));
+	EXPECT_FALSE(server::is_compressible(""));
+	EXPECT_FALSE(server::is_compressible("image/png"));
+	EXPECT_FALSE(server::is_compressible("application/zip"));
+	EXPECT_FALSE(server::is_compressible("application/octet-stream"));
+}
+
+TEST(compression, gzip_round_trip) {
+	string data;
+	for (int i = 0; data.size() < (3 << 20); ++i) {
+		back_insert(data, '[', i, ",\"user", i % 97, "\",", i * 31 % 1000,
+		            "],");
+	}
+
+	for (auto level :
+	     {server::CompressionLevel::FAST, server::CompressionLevel::BEST}) {
+		string compressed = server::compress(data, ContentCoding::GZIP, level);
+		EXPECT_LT(compressed.size(), data.size() / 3);
+		EXPECT_EQ(gunzip(compressed), data);
+	}
+
+	EXPECT_EQ(gunzip(server::compress("", ContentCoding::GZIP,
+	                                  server::CompressionLevel::FAST)),
+	          "");
+	EXPECT_THROW(server::compress("abc", ContentCoding::IDENTITY,
+	                              server::CompressionLevel::FAST),
+	             std::exception);
+}
+
+TEST(compression, stream_compressor) {
+	server::StreamCompressor compressor(ContentCoding::GZIP);
+	string data, compressed;
+	for (int i = 0; i < 1000; ++i) {
+		string piece;
+		for (int j = 0; j < 100; ++j)
+			back_insert(piece, '[', i, ",\"user", j % 97, "\"],\n");
+		size_t size = compressed.size();
+		compressor.write(piece, compressed);
+		// Every piece is flushed
+		EXPECT_GT(compressed.size(), size);
+		data += piece;
+	}
+	compressor.finish(compressed);
+	EXPECT_LT(compressed.size(), data.size() / 2);
+	EXPECT_EQ(gunzip(compressed), data);
+
+	EXPECT_THROW(server::StreamCompressor(ContentCoding::IDENTITY),
+	             std::exception);
+}
+
+TEST(compression, static_file_version) {
+	timespec mtime = {1'700'000'000, 123'456'789};
+	EXPECT_EQ(server::static_file_version(mtime), "1700000000123456");
+	// The same version as of the modification time that simlib returns
+	auto tp = std::chrono::system_clock::from_time_t(mtime.tv_sec) +
+	          std::chrono::nanoseconds(mtime.tv_nsec);
+	EXPECT_EQ(server::static_file_version(tp), "1700000000123456");
+}
@@ -0,0 +1,509 @@
+#include "../src/web_interface/connection.hh"
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <thread>
+#include <unistd.h>
+
+using server::Connection;
+using server::HttpHeaders;
+using server::HttpRequest;
+using std::string;
+
+namespace {
+
+struct Parsed {
+	HttpRequest req;
+	Connection::State state;
+	string response;
+};
+
+Parsed parse(StringView raw_request) {
+	Connection::Output out;
+	Connection conn(raw_request, out, true);
+	Parsed res;
+	res.req = conn.get_request();
+	res.state = conn.state();
+	res.response = out.data;
+	return res;
+}
+
+// Serves the file @p path in response to the GET request with the extra
+// header lines @p headers
+Connection::Output serve_file(CStringView path, StringView headers) {
+	string raw = concat_tostr("GET /file HTTP/1.1\r\n", headers, "\r\n");
+	Connection::Output out;
+	Connection conn(raw, out, true);
+	conn.get_request();
+	EXPECT_EQ(conn.state(), Connection::OK) << out.data;
+	server::HttpResponse resp(server::HttpResponse::FILE);
+	resp.headers["Content-Type"] = "text/plain";
+	resp.content.append(path);
+	conn.send_response(resp);
+	return out;
+}
+
+// Value of the header @p name of the response head in @p data
+string response_header(StringView data, StringView name) {
+	data = data.substr(0, data.find("\r\n\r\n"));
+	string prefix = concat_tostr("\r\n", name, ": ");
+	size_t beg = data.find(prefix);
+	if (beg == StringView::npos)
+		return "";
+
+	beg += prefix.size();
+	return data.substr(beg, data.find("\r\n", beg) - beg).to_string();
+}
+
+using FileParts = std::vector<std::pair<off64_t, off64_t>>;
+
+FileParts file_parts(const Connection::Output& out) {
+	FileParts res;
+	for (auto& part : out.file_parts)
+		res.emplace_back(part.offset, part.length);
+	return res;
+}
+
+class ConnectionFileTest : public ::testing::Test {
+protected:
+	string path_;
+	static constexpr char CONTENTS[] = "abcdefghijklmnopqrstuvwxyz";
+
+	void SetUp() override {
+		char tmpl[] = "/tmp/sim-connection-test.XXXXXX";
+		int fd = mkstemp(tmpl);
+		ASSERT_NE(fd, -1);
+		path_ = tmpl;
+		ASSERT_EQ(write(fd, CONTENTS, sizeof(CONTENTS) - 1),
+		          ssize_t(sizeof(CONTENTS) - 1));
+		close(fd);
+	}
+
+	void TearDown() override { (void)unlink(path_.c_str()); }
+
+	Connection::Output serve_range(StringView range) {
+		return serve_file(path_, concat_tostr("Range: ", range, "\r\n"));
+	}
+};
+
+} // anonymous namespace
+
+TEST(connection, request_line_and_headers) {
+	auto [req, state, response] =
+	   parse("\r\n\r\nGET /a/b?c=d HTTP/1.1\r\n"
+	         "Host: localhost\r\n"
+	         "User-Agent:   Agent/1.0  \r\n"
+	         "X-Empty:\r\n"
+	         "accept: text/html\r\n"
+	         "Accept: */*\r\n"
+	         "\r\n");
+	ASSERT_EQ(state, Connection::OK) << response;
+	EXPECT_EQ(req.method, HttpRequest::GET);
+	EXPECT_EQ(req.target, "/a/b?c=d");
+	EXPECT_EQ(req.http_version, "HTTP/1.1");
+	EXPECT_EQ(req.headers.get("host"), "localhost");
+	EXPECT_EQ(req.headers.get("USER-AGENT"), "Agent/1.0");
+	EXPECT_EQ(req.headers.get("User-Agent").c_str()[9], '\0');
+	EXPECT_EQ(req.headers.get("X-Empty"), "");
+	EXPECT_EQ(req.headers.get("Accept"), "*/*"); // The last one wins
+	EXPECT_EQ(req.headers.get("Content-Length"), "");
+	EXPECT_EQ(req.content, "");
+}
+
+TEST(connection, malformed_requests) {
+	for (StringView raw : {
+	        "GET / HTTP/1.1\r\nNo colon\r\n\r\n",
+	        "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n",
+	        "GET / HTTP/2.0\r\n\r\n",
+	        "PUT / HTTP/1.1\r\n\r\n",
+	        "GET x HTTP/1.1\r\n\r\n",
+	        "GET / HTTP/1.1\r\nContent-Length: x\r\n\r\n",
+	     }) {
+		auto res = parse(raw);
+		EXPECT_EQ(res.state, Connection::CLOSED) << raw;
+		EXPECT_TRUE(has_prefix(res.response, "HTTP/1.1 400 ")) << raw;
+	}
+
+	auto res = parse(concat_tostr("GET / HTTP/1.1\r\nX: ", string(70000, 'a'),
+	                              "\r\n\r\n"));
+	EXPECT_EQ(res.state, Connection::CLOSED);
+	EXPECT_TRUE(has_prefix(res.response, "HTTP/1.1 431 "));
+
+	// Incomplete head
+	res = parse("GET / HTTP/1.1\r\nHost: x\r\n");
+	EXPECT_EQ(res.state, Connection::CLOSED);
+	EXPECT_EQ(res.response, "");
+}
+
+TEST(connection, content) {
+	auto res = parse("POST /x HTTP/1.1\r\n"
+	                 "Content-Type: application/x-www-form-urlencoded\r\n"
+	                 "Content-Length: 17\r\n"
+	                 "\r\n"
+	                 "a=1&b=x%20y&c&d=e");
+	ASSERT_EQ(res.state, Connection::OK) << res.response;
+	EXPECT_EQ(res.req.method, HttpRequest::POST);
+	EXPECT_EQ(res.req.form_data.get("a"), "1");
+	EXPECT_EQ(res.req.form_data.get("b"), "x y");
+	EXPECT_TRUE(res.req.form_data.exist("c"));
+	EXPECT_EQ(res.req.form_data.get("d"), "e");
+
+	res = parse("POST /x HTTP/1.1\r\n"
+	            "Content-Type: text/plain\r\n"
+	            "Content-Length: 12\r\n"
+	            "\r\n"
+	            "a=1\r\nb=2=3\rc");
+	ASSERT_EQ(res.state, Connection::OK) << res.response;
+	EXPECT_EQ(res.req.form_data.get("a"), "1");
+	EXPECT_EQ(res.req.form_data.get("b"), "2=3");
+	EXPECT_TRUE(res.req.form_data.exist("c"));
+
+	res = parse("GET /x HTTP/1.1\r\nContent-Length: 3\r\n\r\nabcdef");
+	ASSERT_EQ(res.state, Connection::OK) << res.response;
+	EXPECT_EQ(res.req.content, "abc");
+
+	// Truncated content
+	res = parse("GET /x HTTP/1.1\r\nContent-Length: 3\r\n\r\nab");
+	EXPECT_EQ(res.state, Connection::CLOSED);
+}
+
+TEST(connection, parsed_headers_can_be_changed_and_copied) {
+	HttpHeaders headers;
+	ASSERT_TRUE(headers.parse("A: 1\r\nB: 2\r\n"));
+	headers["a"] += "0";
+	EXPECT_EQ(headers.get("A"), "10");
+	EXPECT_EQ(headers.get("b"), "2");
+
+	HttpHeaders copy = headers;
+	headers.clear();
+	HttpHeaders moved = std::move(copy);
+	EXPECT_EQ(moved.get("a"), "10");
+	EXPECT_EQ(moved.get("B"), "2");
+	EXPECT_EQ(headers.get("B"), "");
+}
+
+TEST(connection, compressed_responses) {
+	auto respond = [](StringView accept_encoding, StringView content_type,
+	                  size_t content_len) {
+		string raw = concat_tostr("GET / HTTP/1.1\r\nAccept-Encoding: ",
+		                          accept_encoding, "\r\n\r\n");
+		Connection::Output out;
+		Connection conn(raw, out);
+		conn.get_request();
+		server::HttpResponse resp;
+		resp.headers["Content-Type"] = content_type;
+		resp.content.append(string(content_len, 'a'));
+		conn.send_response(resp);
+		return out.data;
+	};
+
+	string res = respond("gzip", "text/plain; charset=utf-8", 100'000);
+	EXPECT_NE(res.find("\r\nContent-Encoding: gzip\r\n"), string::npos);
+	EXPECT_NE(res.find("\r\nVary: Accept-Encoding\r\n"), string::npos);
+	EXPECT_LT(res.size(), 1000);
+
+	res = respond("identity", "text/plain; charset=utf-8", 100'000);
+	EXPECT_EQ(res.find("Content-Encoding"), string::npos);
+	EXPECT_NE(res.find("\r\nVary: Accept-Encoding\r\n"), string::npos);
+	EXPECT_NE(res.find("\r\nContent-Length: 100000\r\n"), string::npos);
+
+	// Too small or not compressible
+	res = respond("gzip", "text/plain; charset=utf-8", 100);
+	EXPECT_EQ(res.find("Content-Encoding"), string::npos);
+	res = respond("gzip", "application/zip", 100'000);
+	EXPECT_EQ(res.find("Content-Encoding"), string::npos);
+
+	// Accept-Encoding is merged into the Vary header set by the handler
+	auto vary = [](StringView value) {
+		Connection::Output out;
+		Connection conn("GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n",
+		                out);
+		conn.get_request();
+		server::HttpResponse resp;
+		resp.headers["Content-Type"] = "text/plain; charset=utf-8";
+		resp.headers["vary"] = value.to_string();
+		resp.content.append(string(100'000, 'a'));
+		conn.send_response(resp);
+		size_t pos = out.data.find("\r\nvary: ");
+		EXPECT_EQ(out.data.find("Vary:"), string::npos) << out.data;
+		return out.data.substr(pos + 8, out.data.find('\r', pos + 2) - pos - 8);
+	};
+	EXPECT_EQ(vary("Cookie"), "Cookie, Accept-Encoding");
+	EXPECT_EQ(vary("cookie, accept-encoding"), "cookie, accept-encoding");
+	EXPECT_EQ(vary("*"), "*");
+}
+
+TEST(connection, streamed_responses) {
+	auto stream_response = [](StringView raw_request, string& head) {
+		Connection::Output out;
+		Connection conn(raw_request, out, true);
+		conn.get_request();
+		server::HttpResponse resp;
+		resp.headers["Content-Type"] = "text/plain; charset=utf-8";
+		int wake_ups = 0;
+		auto stream = conn.send_streamed_response_head(
+		   resp, [&](server::ResponseStream&) { ++wake_ups; });
+		EXPECT_EQ(out.stream, stream);
+		head = out.data;
+
+		string content;
+		EXPECT_EQ(stream->read(content), server::ResponseStream::State::OPEN);
+		EXPECT_EQ(content, "");
+		EXPECT_TRUE(stream->write("abc"));
+		EXPECT_TRUE(stream->write("")); // Empty chunk would end the content
+		EXPECT_TRUE(stream->write("0123456789abcdef"));
+		EXPECT_EQ(wake_ups, 1); // Only the reader that waits is woken up
+		stream->finish();
+		EXPECT_EQ(stream->read(content), server::ResponseStream::State::OPEN);
+		EXPECT_EQ(stream->read(content),
+		          server::ResponseStream::State::FINISHED);
+		return std::pair {content, out.keep_alive};
+	};
+
+	string head;
+	auto [content, keep_alive] =
+	   stream_response("GET / HTTP/1.1\r\n\r\n", head);
+	EXPECT_NE(head.find("\r\nTransfer-Encoding: chunked\r\n\r\n"),
+	          string::npos);
+	EXPECT_EQ(head.find("Content-Length"), string::npos);
+	EXPECT_EQ(content, "3\r\nabc\r\n10\r\n0123456789abcdef\r\n0\r\n\r\n");
+	EXPECT_TRUE(keep_alive);
+
+	// HTTP/1.0 clients learn the end of the content from the connection close
+	std::tie(content, keep_alive) = stream_response(
+	   "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n", head);
+	EXPECT_EQ(head.find("Transfer-Encoding"), string::npos);
+	EXPECT_NE(head.find("\r\nConnection: close\r\n"), string::npos);
+	EXPECT_EQ(content, "abc0123456789abcdef");
+	EXPECT_FALSE(keep_alive);
+}
+
+TEST(connection, compressed_streamed_responses) {
+	Connection::Output out;
+	Connection conn("GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n", out,
+	                true);
+	conn.get_request();
+	server::HttpResponse resp;
+	resp.headers["Content-Type"] = "application/x-ndjson; charset=utf-8";
+	auto stream =
+	   conn.send_streamed_response_head(resp, [](server::ResponseStream&) {});
+	EXPECT_NE(out.data.find("\r\nContent-Encoding: gzip\r\n"), string::npos);
+	EXPECT_NE(out.data.find("\r\nVary: Accept-Encoding\r\n"), string::npos);
+	EXPECT_NE(out.data.find("\r\nTransfer-Encoding: chunked\r\n"),
+	          string::npos);
+
+	EXPECT_TRUE(stream->write("[1]\n"));
+	string content;
+	EXPECT_EQ(stream->read(content), server::ResponseStream::State::OPEN);
+	// The write is flushed in a chunk of its own, starting the gzip stream
+	size_t chunk_size = std::stoul(content, nullptr, 16);
+	size_t data_beg = content.find("\r\n") + 2;
+	EXPECT_EQ(content.size(), data_beg + chunk_size + 2);
+	EXPECT_TRUE(has_prefix(content.substr(data_beg), "\x1f\x8b"));
+
+	stream->finish();
+	content.clear();
+	EXPECT_EQ(stream->read(content), server::ResponseStream::State::OPEN);
+	EXPECT_TRUE(has_suffix(content, "\r\n0\r\n\r\n"));
+	EXPECT_GT(content.size(), 10); // The gzip trailer
+}
+
+TEST(connection, aborted_response_stream_stops_the_writer) {
+	server::ResponseStream stream(true, [](server::ResponseStream&) {});
+	string data(server::ResponseStream::MAX_BUFFERED, 'x');
+	EXPECT_TRUE(stream.write(data));
+	std::thread writer([&] {
+		// Blocks until the reader aborts the stream
+		EXPECT_FALSE(stream.write(data));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	stream.abort();
+	writer.join();
+	EXPECT_FALSE(stream.write("abc"));
+}
+
+TEST_F(ConnectionFileTest, full_file) {
+	auto out = serve_file(path_, "");
+	EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 200 OK\r\n")) << out.data;
+	EXPECT_EQ(response_header(out.data, "Accept-Ranges"), "bytes");
+	EXPECT_EQ(response_header(out.data, "Content-Length"), "26");
+	EXPECT_NE(response_header(out.data, "ETag"), "");
+	EXPECT_NE(response_header(out.data, "Last-Modified"), "");
+	EXPECT_NE(int(out.file), -1);
+	EXPECT_EQ(file_parts(out), (FileParts {{0, 26}}));
+	EXPECT_TRUE(out.keep_alive);
+}
+
+TEST_F(ConnectionFileTest, single_range) {
+	auto check = [&](StringView range, off64_t offset, off64_t length) {
+		auto out = serve_range(range);
+		EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 206 Partial Content\r\n"))
+		   << range << '\n' << out.data;
+		EXPECT_EQ(response_header(out.data, "Content-Range"),
+		          concat_tostr("bytes ", offset, '-', offset + length - 1,
+		                       "/26"))
+		   << range;
+		EXPECT_EQ(response_header(out.data, "Content-Length"),
+		          concat_tostr(length))
+		   << range;
+		EXPECT_EQ(file_parts(out), (FileParts {{offset, length}})) << range;
+		EXPECT_EQ(out.file_parts[0].data_after, "") << range;
+	};
+	check("bytes=2-5", 2, 4);
+	check("bytes=20-", 20, 6);
+	check("bytes=20-1000", 20, 6);
+	check("bytes=25-25", 25, 1);
+	// Suffix ranges
+	check("bytes=-3", 23, 3);
+	check("bytes=-1000", 0, 26);
+	// Unsatisfiable ranges are skipped if some other is satisfiable
+	check("bytes=100-200, 3-3", 3, 1);
+}
+
+TEST_F(ConnectionFileTest, multiple_ranges) {
+	auto out = serve_range("bytes=20-21, 0-1");
+	EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 206 Partial Content\r\n"))
+	   << out.data;
+	string content_type = response_header(out.data, "Content-Type");
+	ASSERT_TRUE(has_prefix(content_type, "multipart/byteranges; boundary="))
+	   << out.data;
+	string boundary = content_type.substr(31);
+	size_t head_len = out.data.find("\r\n\r\n") + 4;
+	// The content type of the file is sent only in the parts' headers
+	EXPECT_EQ(out.data.substr(0, head_len).find("text/plain"), string::npos);
+
+	// Parts are sorted by their offsets
+	EXPECT_EQ(file_parts(out), (FileParts {{0, 2}, {20, 2}}));
+	EXPECT_EQ(out.data.substr(head_len),
+	          concat_tostr("--", boundary,
+	                       "\r\nContent-Type: text/plain"
+	                       "\r\nContent-Range: bytes 0-1/26\r\n\r\n"));
+	EXPECT_EQ(out.file_parts[0].data_after,
+	          concat_tostr("\r\n--", boundary,
+	                       "\r\nContent-Type: text/plain"
+	                       "\r\nContent-Range: bytes 20-21/26\r\n\r\n"));
+	EXPECT_EQ(out.file_parts[1].data_after,
+	          concat_tostr("\r\n--", boundary, "--\r\n"));
+
+	size_t content_length = out.data.size() - head_len;
+	for (auto& part : out.file_parts)
+		content_length += part.length + part.data_after.size();
+	EXPECT_EQ(response_header(out.data, "Content-Length"),
+	          concat_tostr(content_length));
+}
+
+TEST_F(ConnectionFileTest, overlapping_ranges_are_coalesced) {
+	string range = "bytes=0-";
+	for (int i = 1; i < 16; ++i)
+		range += ",0-";
+	auto out = serve_range(range);
+	EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 206 Partial Content\r\n"))
+	   << out.data;
+	EXPECT_EQ(response_header(out.data, "Content-Range"), "bytes 0-25/26");
+	EXPECT_EQ(file_parts(out), (FileParts {{0, 26}}));
+
+	out = serve_range("bytes=5-9, 0-5, -2, 20-23, 10-11");
+	EXPECT_EQ(file_parts(out), (FileParts {{0, 12}, {20, 6}}));
+
+	out = serve_range("bytes=3-4, 2-6, 5-5");
+	EXPECT_EQ(response_header(out.data, "Content-Range"), "bytes 2-6/26");
+	EXPECT_EQ(file_parts(out), (FileParts {{2, 5}}));
+}
+
+TEST_F(ConnectionFileTest, unsatisfiable_range) {
+	for (StringView range : {"bytes=26-", "bytes=100-200, 30-", "bytes=-0"}) {
+		auto out = serve_range(range);
+		EXPECT_TRUE(
+		   has_prefix(out.data, "HTTP/1.1 416 Range Not Satisfiable\r\n"))
+		   << range << '\n' << out.data;
+		EXPECT_EQ(response_header(out.data, "Content-Range"), "bytes */26")
+		   << range;
+		EXPECT_EQ(response_header(out.data, "Content-Length"), "0") << range;
+		EXPECT_TRUE(out.file_parts.empty()) << range;
+	}
+}
+
+TEST_F(ConnectionFileTest, ignored_range) {
+	string too_many = "bytes=0-0";
+	for (int i = 1; i <= 16; ++i)
+		back_insert(too_many, ',', 2 * i, '-', 2 * i);
+	for (StringView range : {StringView("bytes=5-2"), StringView("items=1-2"),
+	                         StringView("bytes=x-"), StringView("bytes="),
+	                         StringView(too_many)}) {
+		auto out = serve_range(range);
+		EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 200 OK\r\n"))
+		   << range << '\n' << out.data;
+		EXPECT_EQ(file_parts(out), (FileParts {{0, 26}})) << range;
+	}
+}
+
+TEST_F(ConnectionFileTest, if_range) {
+	auto full = serve_file(path_, "");
+	string etag = response_header(full.data, "ETag");
+	string last_modified = response_header(full.data, "Last-Modified");
+
+	auto serve = [&](StringView if_range) {
+		return file_parts(serve_file(
+		   path_, concat_tostr("Range: bytes=1-2\r\nIf-Range: ", if_range,
+		                       "\r\n")));
+	};
+	EXPECT_EQ(serve(etag), (FileParts {{1, 2}}));
+	EXPECT_EQ(serve(last_modified), (FileParts {{1, 2}}));
+	// The file has changed: the whole of it is sent
+	EXPECT_EQ(serve("\"other\""), (FileParts {{0, 26}}));
+	EXPECT_EQ(serve("Thu, 01 Jan 1970 00:00:00 GMT"), (FileParts {{0, 26}}));
+	// If-Range uses the strong comparison
+	EXPECT_EQ(serve(concat_tostr("W/", etag)), (FileParts {{0, 26}}));
+}
+
+TEST_F(ConnectionFileTest, not_modified) {
+	auto full = serve_file(path_, "");
+	string etag = response_header(full.data, "ETag");
+
+	auto check_not_modified = [&](StringView headers) {
+		auto out = serve_file(path_, headers);
+		EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 304 Not Modified\r\n"))
+		   << headers << '\n' << out.data;
+		EXPECT_EQ(response_header(out.data, "ETag"), etag) << headers;
+		EXPECT_EQ(response_header(out.data, "Content-Length"), "") << headers;
+		EXPECT_TRUE(out.file_parts.empty()) << headers;
+		EXPECT_TRUE(out.keep_alive) << headers;
+	};
+	check_not_modified(concat_tostr("If-None-Match: ", etag, "\r\n"));
+	check_not_modified(
+	   concat_tostr("If-None-Match: \"x\", W/", etag, "\r\n"));
+	check_not_modified("If-None-Match: *\r\n");
+	check_not_modified(
+	   concat_tostr("If-Modified-Since: ",
+	                response_header(full.data, "Last-Modified"), "\r\n"));
+	// Not-modified responses take precedence over ranges
+	check_not_modified(
+	   concat_tostr("If-None-Match: ", etag, "\r\nRange: bytes=0-1\r\n"));
+
+	// If-None-Match takes precedence over If-Modified-Since
+	auto out = serve_file(path_,
+	                      "If-None-Match: \"x\"\r\n"
+	                      "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n");
+	EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 200 OK\r\n")) << out.data;
+	out = serve_file(path_,
+	                 "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n");
+	EXPECT_TRUE(has_prefix(out.data, "HTTP/1.1 200 OK\r\n")) << out.data;
+}
+
+TEST(connection, stalled_response_stream_fails) {
+	server::ResponseStream stream(true, [](server::ResponseStream&) {},
+	                              std::chrono::milliseconds(20));
+	string data(server::ResponseStream::MAX_BUFFERED, 'x');
+	EXPECT_TRUE(stream.write(data));
+	// Nobody reads the stream, so the writer gives up instead of blocking
+	EXPECT_FALSE(stream.write(data));
+	EXPECT_FALSE(stream.write("abc"));
+
+	string content;
+	EXPECT_EQ(stream.read(content), server::ResponseStream::State::FAILED);
+	// Only the first chunk: "40000\r\n" data "\r\n"
+	EXPECT_EQ(content.size(), 7 + data.size() + 2);
+	content.clear();
+	EXPECT_EQ(stream.read(content), server::ResponseStream::State::FAILED);
+	EXPECT_EQ(content, "");
+}
@@ -0,0 +1,183 @@
+#include "../src/web_interface/contest_ranking.hh"
+
+#include <gtest/gtest.h>
+
+using server::ContestRanking;
+using server::ContestRankingCache;
+using SRM = sim::ContestProblem::ScoreRevealingMode;
+using Scope = ContestRanking::Scope;
+using std::string;
+
+namespace {
+
+constexpr char COLUMNS[] =
+   "[\n{\"columns\":[\"id\",\"name\",{\"name\":\"submissions\",\"columns\":["
+   "\"id\",\"contest_round_id\",\"contest_problem_id\",{\"name\":\"status\","
+   "\"fields\":[\"class\",\"text\"]},\"score\"]}]}";
+
+constexpr char BEFORE_RESULTS[] = "2020-01-02 00:00:00";
+constexpr char AFTER_RESULTS[] = "2020-01-05 00:00:00";
+
+// Round 1 has begun and its ranking is exposed, round 2 has not begun yet
+ContestRanking example_ranking() {
+	ContestRanking ranking;
+	ranking.version = 7;
+	ranking.rounds.emplace(
+	   1, ContestRanking::Round {sim::InfDatetime("2020-01-01 00:00:00"),
+	                             sim::InfDatetime("2020-01-03 00:00:00"),
+	                             sim::InfDatetime("2020-01-01 00:00:00")});
+	ranking.rounds.emplace(
+	   2, ContestRanking::Round {sim::InfDatetime("2020-01-04 00:00:00"),
+	                             sim::InfDatetime("2020-01-04 00:00:00"),
+	                             sim::InfDatetime("2020-01-04 00:00:00")});
+	ranking.problems.emplace(10, ContestRanking::Problem {1, SRM::NONE});
+	ranking.problems.emplace(11, ContestRanking::Problem {1, SRM::ONLY_SCORE});
+	ranking.problems.emplace(20, ContestRanking::Problem {2, SRM::NONE});
+
+	using SS = SubmissionStatus;
+	ranking.set_entry(5, "Ann Bee",
+	                  {11, 501, SS::WA, 40, 502, SS::OK}); // By id
+	ranking.set_entry(5, "Ann Bee", {10, 503, SS::OK, 100, 503, SS::OK});
+	ranking.set_entry(3, "Cid Dee", {20, 301, SS::TLE, 0, 301, SS::TLE});
+	ranking.set_entry(9, "Eve \"E\"", {10, 901, SS::RTE, 0, 902, SS::OK});
+	return ranking;
+}
+
+} // anonymous namespace
+
+TEST(contest_ranking, admin_view) {
+	auto ranking = example_ranking();
+	EXPECT_EQ(ranking.render(Scope::CONTEST, 1, true, 0, BEFORE_RESULTS),
+	          concat_tostr(COLUMNS,
+	                       ",\n"
+	                       "[3,\"Cid Dee\",[\n"
+	                       "[301,2,20,[\"yellow\",\"Time limit exceeded\"],0]"
+	                       "\n]],"
+	                       "[5,\"Ann Bee\",[\n"
+	                       "[503,1,10,[\"green\",\"OK\"],100],\n"
+	                       "[501,1,11,[\"red\",\"Wrong answer\"],40]"
+	                       "\n]],"
+	                       "[9,\"Eve \\\"E\\\"\",[\n"
+	                       "[901,1,10,[\"intense-red\",\"Runtime error\"],0]"
+	                       "\n]]]"));
+
+	EXPECT_EQ(ranking.render(Scope::CONTEST_PROBLEM, 11, true, 0,
+	                         BEFORE_RESULTS),
+	          concat_tostr(COLUMNS,
+	                       ",\n"
+	                       "[5,\"Ann Bee\",[\n"
+	                       "[501,1,11,[\"red\",\"Wrong answer\"],40]"
+	                       "\n]]]"));
+}
+
+TEST(contest_ranking, user_view) {
+	auto ranking = example_ranking();
+	// Before the full results only the initial statuses are shown, round 2
+	// has not begun
+	string anonymous = concat_tostr(
+	   COLUMNS,
+	   ",\n"
+	   "[null,\"Ann Bee\",[\n"
+	   "[null,1,10,[\"initial green\",\"OK\"],null],\n"
+	   "[null,1,11,[\"initial green\",\"OK\"],40]"
+	   "\n]],"
+	   "[null,\"Eve \\\"E\\\"\",[\n"
+	   "[null,1,10,[\"initial green\",\"OK\"],null]"
+	   "\n]]]");
+	EXPECT_EQ(ranking.render(Scope::CONTEST, 1, false, 0, BEFORE_RESULTS),
+	          anonymous);
+	EXPECT_EQ(ranking.render(Scope::CONTEST, 1, false, 3, BEFORE_RESULTS),
+	          anonymous);
+
+	// The user sees the ids in their own row
+	EXPECT_EQ(ranking.render(Scope::CONTEST, 1, false, 5, BEFORE_RESULTS),
+	          concat_tostr(COLUMNS,
+	                       ",\n"
+	                       "[5,\"Ann Bee\",[\n"
+	                       "[503,1,10,[\"initial green\",\"OK\"],null],\n"
+	                       "[502,1,11,[\"initial green\",\"OK\"],40]"
+	                       "\n]],"
+	                       "[null,\"Eve \\\"E\\\"\",[\n"
+	                       "[null,1,10,[\"initial green\",\"OK\"],null]"
+	                       "\n]]]"));
+
+	EXPECT_EQ(ranking.render(Scope::CONTEST_ROUND, 2, false, 3,
+	                         BEFORE_RESULTS),
+	          concat_tostr(COLUMNS, ']'));
+
+	// After the full results everything is shown
+	EXPECT_EQ(ranking.render(Scope::CONTEST, 1, false, 9, AFTER_RESULTS),
+	          concat_tostr(COLUMNS,
+	                       ",\n"
+	                       "[null,\"Cid Dee\",[\n"
+	                       "[null,2,20,[\"yellow\",\"Time limit exceeded\"],0]"
+	                       "\n]],"
+	                       "[null,\"Ann Bee\",[\n"
+	                       "[null,1,10,[\"green\",\"OK\"],100],\n"
+	                       "[null,1,11,[\"red\",\"Wrong answer\"],40]"
+	                       "\n]],"
+	                       "[9,\"Eve \\\"E\\\"\",[\n"
+	                       "[901,1,10,[\"intense-red\",\"Runtime error\"],0]"
+	                       "\n]]]"));
+	// The cached views are not mixed up
+	EXPECT_EQ(ranking.render(Scope::CONTEST, 1, false, 0, BEFORE_RESULTS),
+	          anonymous);
+}
+
+TEST(contest_ranking, incremental_updates) {
+	auto ranking = example_ranking();
+	EXPECT_EQ(ranking.render(Scope::CONTEST_ROUND, 1, true, 0, BEFORE_RESULTS),
+	          concat_tostr(COLUMNS,
+	                       ",\n"
+	                       "[5,\"Ann Bee\",[\n"
+	                       "[503,1,10,[\"green\",\"OK\"],100],\n"
+	                       "[501,1,11,[\"red\",\"Wrong answer\"],40]"
+	                       "\n]],"
+	                       "[9,\"Eve \\\"E\\\"\",[\n"
+	                       "[901,1,10,[\"intense-red\",\"Runtime error\"],0]"
+	                       "\n]]]"));
+
+	// A new version does not reuse the views of the old one
+	ContestRanking next = ranking;
+	next.version = 8;
+	next.set_entry(9, "Eve F", {10, 903, SubmissionStatus::OK, 100, 903,
+	                            SubmissionStatus::OK});
+	next.erase_entry(5, 10);
+	next.erase_entry(5, 12); // No such entry
+	next.problems.erase(11); // Deleted contest problem
+	EXPECT_EQ(next.render(Scope::CONTEST_ROUND, 1, true, 0, BEFORE_RESULTS),
+	          concat_tostr(COLUMNS,
+	                       ",\n"
+	                       "[9,\"Eve F\",[\n"
+	                       "[903,1,10,[\"green\",\"OK\"],100]"
+	                       "\n]]]"));
+
+	next.erase_entry(5, 11);
+	EXPECT_EQ(next.owners.count(5), 0);
+}
+
+TEST(contest_ranking, cache) {
+	ContestRankingCache cache;
+	EXPECT_EQ(cache.find(1), nullptr);
+
+	auto ranking = std::make_shared<ContestRanking>();
+	ranking->version = 5;
+	cache.store(1, ranking);
+	EXPECT_EQ(cache.find(1), ranking);
+
+	// Older versions do not replace the newer ones
+	auto older = std::make_shared<ContestRanking>();
+	older->version = 4;
+	cache.store(1, older);
+	EXPECT_EQ(cache.find(1), ranking);
+
+	auto newer = std::make_shared<ContestRanking>();
+	newer->version = 6;
+	cache.store(1, newer);
+	EXPECT_EQ(cache.find(1), newer);
+
+	for (uint64_t id = 2; id <= ContestRankingCache::MAX_CONTESTS + 1; ++id)
+		cache.store(id, ranking);
+	EXPECT_EQ(cache.find(1), nullptr); // Evicted
+	EXPECT_EQ(cache.find(ContestRankingCache::MAX_CONTESTS + 1), ranking);
+}
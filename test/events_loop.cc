@@ -0,0 +1,273 @@
+#include "../src/web_interface/events_loop.hh"
+
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using server::Connection;
+using server::EventsLoop;
+using std::string;
+using std::chrono::milliseconds;
+
+namespace {
+
+// Client side of a connection to the tested events loop
+class TestClient {
+	FileDescriptor fd_;
+	string buffered_; // Read, but not returned yet
+
+public:
+	explicit TestClient(in_port_t port)
+	   : fd_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+		EXPECT_NE(fd_, -1);
+		// Tests fail instead of hanging if the server does not respond
+		timeval timeout = {10, 0};
+		EXPECT_EQ(setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		                     sizeof(timeout)),
+		          0);
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = port;
+		EXPECT_EQ(connect(fd_, (sockaddr*)&addr, sizeof(addr)), 0);
+	}
+
+	void send(StringView data) {
+		while (not data.empty()) {
+			ssize_t rc = write(fd_, data.data(), data.size());
+			ASSERT_GT(rc, 0);
+			data.remove_prefix(rc);
+		}
+	}
+
+	/// Returns the next response (its head has to contain Content-Length) or
+	/// the data read before the connection got closed (or the read timed out)
+	string response() {
+		for (;;) {
+			size_t head_end = buffered_.find("\r\n\r\n");
+			size_t pos = buffered_.find("\r\nContent-Length: ");
+			if (head_end != string::npos and pos < head_end) {
+				size_t len =
+				   head_end + 4 + std::stoull(buffered_.substr(pos + 18));
+				if (buffered_.size() >= len) {
+					string res = buffered_.substr(0, len);
+					buffered_.erase(0, len);
+					return res;
+				}
+			}
+
+			char buff[4096];
+			ssize_t rc = read(fd_, buff, sizeof(buff));
+			if (rc <= 0)
+				return std::move(buffered_);
+
+			buffered_.append(buff, rc);
+		}
+	}
+
+	/// Whether the server has closed the connection (and sent nothing more)
+	bool closed() {
+		char c;
+		return buffered_.empty() and read(fd_, &c, 1) == 0;
+	}
+};
+
+class EventsLoopTest : public ::testing::Test {
+protected:
+	FileDescriptor socket_fd_;
+	in_port_t port_ = 0;
+	server::StaticFilesCache static_files_ {"/nonexistent"};
+	std::unique_ptr<EventsLoop> events_loop_;
+	std::thread events_loop_thread_;
+	std::thread worker_;
+
+	// Responds to every request with its target (and the value of the form
+	// field "a" if there is one)
+	void work() {
+		while (auto task = events_loop_->pop_task()) {
+			Connection::Output out;
+			Connection conn(task->request, out, task->allow_keep_alive);
+			server::HttpRequest req = conn.get_request();
+			if (conn.state() == Connection::OK) {
+				server::HttpResponse resp;
+				resp.content.append(req.target);
+				if (auto a = req.form_data.get_opt("a"))
+					resp.content.append(' ', *a);
+				conn.send_response(resp);
+			}
+
+			events_loop_->respond(*task, std::move(out));
+		}
+	}
+
+	void start(milliseconds idle_timeout = EventsLoop::IDLE_TIMEOUT,
+	           uint max_requests_per_connection =
+	              EventsLoop::MAX_REQUESTS_PER_CONNECTION) {
+		socket_fd_ = FileDescriptor(
+		   socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+		ASSERT_NE(socket_fd_, -1);
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0; // Any free port
+		socklen_t addr_len = sizeof(addr);
+		ASSERT_EQ(bind(socket_fd_, (sockaddr*)&addr, addr_len), 0);
+		ASSERT_EQ(listen(socket_fd_, SOMAXCONN), 0);
+		ASSERT_EQ(getsockname(socket_fd_, (sockaddr*)&addr, &addr_len), 0);
+		port_ = addr.sin_port;
+
+		events_loop_ = std::make_unique<EventsLoop>(
+		   socket_fd_, 64, static_files_, -1, idle_timeout,
+		   EventsLoop::IO_TIMEOUT, max_requests_per_connection);
+		events_loop_thread_ = std::thread([this] { events_loop_->run(); });
+		worker_ = std::thread([this] { work(); });
+	}
+
+	void TearDown() override {
+		if (not events_loop_)
+			return;
+
+		events_loop_->stop();
+		events_loop_thread_.join();
+		worker_.join();
+		events_loop_ = nullptr;
+	}
+};
+
+string body(StringView response) {
+	return response.substr(response.find("\r\n\r\n") + 4).to_string();
+}
+
+} // anonymous namespace
+
+TEST_F(EventsLoopTest, serves_requests) {
+	start();
+	TestClient client(port_);
+	client.send("GET /a HTTP/1.1\r\n\r\n");
+	string resp = client.response();
+	EXPECT_TRUE(has_prefix(resp, "HTTP/1.1 200 OK\r\n")) << resp;
+	EXPECT_EQ(body(resp), "/a");
+
+	// The content may take many reads
+	string value(300 << 10, 'x');
+	client.send(concat_tostr("POST /b HTTP/1.1\r\n"
+	                         "Content-Type: text/plain\r\n"
+	                         "Content-Length: ",
+	                         value.size() + 2, "\r\n\r\na=", value));
+	resp = client.response();
+	EXPECT_TRUE(has_prefix(resp, "HTTP/1.1 200 OK\r\n"))
+	   << resp.substr(0, 100);
+	EXPECT_EQ(body(resp), "/b " + value);
+}
+
+TEST_F(EventsLoopTest, transfer_encoding_not_implemented) {
+	start();
+	for (StringView header :
+	     {"Transfer-Encoding: chunked", "transfer-ENCODING: gzip"}) {
+		TestClient client(port_);
+		client.send(concat_tostr("POST /a HTTP/1.1\r\n", header,
+		                         "\r\n\r\n1\r\nx\r\n0\r\n\r\n"));
+		string resp = client.response();
+		EXPECT_TRUE(has_prefix(resp, "HTTP/1.1 501 Not Implemented\r\n"))
+		   << resp;
+		EXPECT_TRUE(client.closed());
+	}
+}
+
+TEST_F(EventsLoopTest, repeated_content_length) {
+	start();
+	for (StringView headers : {"Content-Length: 1\r\nContent-Length: 2",
+	                           "Content-Length: 1\r\ncontent-length: 1"}) {
+		TestClient client(port_);
+		client.send(concat_tostr("POST /a HTTP/1.1\r\n", headers,
+		                         "\r\n\r\nxyGET /b HTTP/1.1\r\n\r\n"));
+		string resp = client.response();
+		EXPECT_TRUE(has_prefix(resp, "HTTP/1.1 400 Bad Request\r\n")) << resp;
+		EXPECT_TRUE(client.closed());
+	}
+}
+
+TEST_F(EventsLoopTest, keep_alive) {
+	start();
+	TestClient client(port_);
+	for (StringView target : {"/a", "/b", "/c"}) {
+		client.send(concat_tostr("GET ", target, " HTTP/1.1\r\n\r\n"));
+		string resp = client.response();
+		EXPECT_NE(resp.find("\r\nConnection: keep-alive\r\n"), string::npos)
+		   << resp;
+		EXPECT_EQ(body(resp), target);
+	}
+
+	// HTTP/1.0 clients have to ask for it
+	client.send("GET /d HTTP/1.0\r\n\r\n");
+	string resp = client.response();
+	EXPECT_NE(resp.find("\r\nConnection: close\r\n"), string::npos) << resp;
+	EXPECT_EQ(body(resp), "/d");
+	EXPECT_TRUE(client.closed());
+}
+
+TEST_F(EventsLoopTest, pipelining) {
+	start();
+	TestClient client(port_);
+	// The content of the second request must not be taken for a request
+	client.send("GET /1 HTTP/1.1\r\n\r\n"
+	            "POST /2 HTTP/1.1\r\n"
+	            "Content-Type: text/plain\r\n"
+	            "Content-Length: 21\r\n\r\n"
+	            "a=GET /x HTTP/1.1\r\n\r\n"
+	            "\r\n" // Empty lines between the requests are ignored
+	            "GET /3 HTTP/1.1\r\n\r\n");
+	EXPECT_EQ(body(client.response()), "/1");
+	EXPECT_EQ(body(client.response()), "/2 GET /x HTTP/1.1");
+	EXPECT_EQ(body(client.response()), "/3");
+
+	// The next request split between the writes
+	client.send("GET /4 HTTP/1.1\r\n\r\nGET /5 HT");
+	EXPECT_EQ(body(client.response()), "/4");
+	client.send("TP/1.1\r\n\r\n");
+	EXPECT_EQ(body(client.response()), "/5");
+}
+
+TEST_F(EventsLoopTest, idle_timeout) {
+	start(milliseconds(100));
+	auto beg = std::chrono::steady_clock::now();
+	TestClient silent(port_);
+	EXPECT_TRUE(silent.closed());
+
+	// The timeout applies also between the requests
+	TestClient client(port_);
+	client.send("GET /a HTTP/1.1\r\n\r\n");
+	EXPECT_EQ(body(client.response()), "/a");
+	EXPECT_TRUE(client.closed());
+	// Not through the read timeout of the client
+	EXPECT_LT(std::chrono::steady_clock::now() - beg, std::chrono::seconds(5));
+}
+
+TEST_F(EventsLoopTest, max_requests_per_connection) {
+	start(EventsLoop::IDLE_TIMEOUT, 3);
+	TestClient client(port_);
+	client.send("GET /1 HTTP/1.1\r\n\r\n"
+	            "GET /2 HTTP/1.1\r\n\r\n"
+	            "GET /3 HTTP/1.1\r\n\r\n"
+	            "GET /4 HTTP/1.1\r\n\r\n");
+	for (StringView target : {"/1", "/2"}) {
+		string resp = client.response();
+		EXPECT_NE(resp.find("\r\nConnection: keep-alive\r\n"), string::npos)
+		   << resp;
+		EXPECT_EQ(body(resp), target);
+	}
+
+	// The last request tells the client to reconnect
+	string resp = client.response();
+	EXPECT_NE(resp.find("\r\nConnection: close\r\n"), string::npos) << resp;
+	EXPECT_EQ(body(resp), "/3");
+	EXPECT_TRUE(client.closed());
+
+	TestClient next(port_);
+	next.send("GET /4 HTTP/1.1\r\n\r\n");
+	EXPECT_EQ(body(next.response()), "/4");
+}
@@ -0,0 +1,112 @@
+#include "../src/job_server/events_queue.hh"
+
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Processes the events the way the job server's events loop does: only after
+// being woken up by the notifier. Returns false if no wake-up came in time.
+bool wait_and_process_events() {
+	pollfd pfd = {EventsQueue::get_notifier_fd(), POLLIN, 0};
+	if (poll(&pfd, 1, 10'000) != 1)
+		return false;
+
+	EventsQueue::reset_notifier();
+	EventsQueue::process_events();
+	return true;
+}
+
+void drain_events_queue() {
+	ASSERT_NE(EventsQueue::set_notifier_fd(), -1);
+	EventsQueue::reset_notifier();
+	EventsQueue::process_events();
+}
+
+} // anonymous namespace
+
+TEST(events_queue, events_registered_by_events) {
+	drain_events_queue();
+	std::vector<int> order;
+	EventsQueue::register_event([&] {
+		order.emplace_back(1);
+		EventsQueue::register_event([&] { order.emplace_back(3); });
+		order.emplace_back(2);
+	});
+	ASSERT_TRUE(wait_and_process_events());
+	EXPECT_EQ(order, (std::vector<int> {1, 2, 3}));
+}
+
+TEST(events_queue, throwing_event_rearms_notifier) {
+	drain_events_queue();
+	bool processed = false;
+	EventsQueue::register_event([] { throw std::runtime_error("x"); });
+	EventsQueue::register_event([&] { processed = true; });
+
+	pollfd pfd = {EventsQueue::get_notifier_fd(), POLLIN, 0};
+	ASSERT_EQ(poll(&pfd, 1, 10'000), 1);
+	EventsQueue::reset_notifier();
+	EXPECT_THROW(EventsQueue::process_events(), std::runtime_error);
+	EXPECT_FALSE(processed);
+	// The remaining event must not wait for a new one to be registered
+	ASSERT_TRUE(wait_and_process_events());
+	EXPECT_TRUE(processed);
+}
+
+TEST(events_queue, multiple_producers_stress) {
+	constexpr size_t PRODUCERS = 8;
+	constexpr uint64_t EVENTS_PER_PRODUCER = 50'000;
+
+	drain_events_queue();
+	auto stats_before = EventsQueue::stats();
+
+	// Touched only by the events (i.e. by the consumer)
+	std::vector<uint64_t> received(PRODUCERS, 0);
+	uint64_t received_total = 0;
+	bool out_of_order = false;
+
+	std::vector<std::thread> producers;
+	for (size_t p = 0; p < PRODUCERS; ++p) {
+		producers.emplace_back([&, p] {
+			for (uint64_t i = 0; i < EVENTS_PER_PRODUCER; ++i) {
+				EventsQueue::register_event([&, p, i] {
+					// Events of one producer are processed in order
+					if (received[p]++ != i)
+						out_of_order = true;
+					++received_total;
+				});
+				if (i % 1024 == 0)
+					std::this_thread::yield(); // Let the consumer catch up
+			}
+		});
+	}
+
+	// Every registered event has to wake up the consumer eventually
+	// (possibly together with the others), so waiting for the notifications
+	// only has to process all the events
+	while (received_total < PRODUCERS * EVENTS_PER_PRODUCER) {
+		if (not wait_and_process_events())
+			break; // Lost wake-up
+	}
+
+	for (auto& producer : producers)
+		producer.join();
+
+	EXPECT_EQ(received_total, PRODUCERS * EVENTS_PER_PRODUCER);
+	EXPECT_EQ(received, std::vector<uint64_t>(PRODUCERS, EVENTS_PER_PRODUCER));
+	EXPECT_FALSE(out_of_order);
+
+	// Nothing is left behind
+	EXPECT_FALSE(EventsQueue::process_events());
+
+	auto stats = EventsQueue::stats();
+	EXPECT_EQ(stats.events_processed - stats_before.events_processed,
+	          PRODUCERS * EVENTS_PER_PRODUCER);
+	// Wake-ups are coalesced: at most one write to the notifier per event
+	EXPECT_GE(stats.notifications - stats_before.notifications, 1);
+	EXPECT_LE(stats.notifications - stats_before.notifications,
+	          PRODUCERS * EVENTS_PER_PRODUCER);
+}
@@ -0,0 +1,262 @@
+#include "../benchmark/legacy_job_scheduler.hh"
+#include "../src/job_server/judge_jobs_policy.hh"
+
+#include <gtest/gtest.h>
+#include <random>
+
+using Job = JobScheduler::Job;
+
+TEST(job_scheduler, priority_order) {
+	JobScheduler js;
+	js.add_judge_job({3, 10}, 1);
+	js.add_judge_job({2, 10}, 2);
+	js.add_judge_job({4, 20}, 2);
+	js.add_judge_job({1, 10}, 1);
+
+	std::vector<uint64_t> order;
+	for (auto jh = js.best_judge_job(); jh.ok(); jh = js.best_judge_job()) {
+		order.emplace_back(jh.job.id);
+		jh.was_passed();
+	}
+	ASSERT_EQ(order, (std::vector<uint64_t> {4, 1, 2, 3}));
+}
+
+TEST(job_scheduler, job_equality) {
+	Job job {1, 10, false, false, 5};
+	ASSERT_EQ(job, (Job {1, 10, false, false, 5}));
+	ASSERT_FALSE(job == (Job {1, 10, false, false, 6}));
+	ASSERT_FALSE(job == (Job {1, 11, false, false, 5}));
+	ASSERT_FALSE(job == Job::least());
+	ASSERT_EQ(Job::least(), Job::least());
+}
+
+TEST(job_scheduler, locked_problem_holds_back_its_jobs) {
+	JobScheduler js;
+	js.add_problem_job({1, 30, true}, 7);
+	js.add_judge_job({2, 20}, 7);
+	js.add_judge_job({3, 10}, 8);
+
+	auto pj = js.best_problem_job();
+	ASSERT_TRUE(pj.ok());
+	ASSERT_EQ(pj.job.id, 1u);
+	pj.was_passed(); // Locks problem 7
+	ASSERT_FALSE(js.best_problem_job().ok());
+
+	auto jj = js.best_judge_job();
+	ASSERT_TRUE(jj.ok());
+	ASSERT_EQ(jj.job.id, 3u);
+	jj.was_passed();
+	ASSERT_FALSE(js.best_judge_job().ok());
+
+	js.unlock_problem(7);
+	jj = js.best_judge_job();
+	ASSERT_TRUE(jj.ok());
+	ASSERT_EQ(jj.job.id, 2u);
+	jj.was_passed();
+	ASSERT_FALSE(js.best_judge_job().ok());
+}
+
+TEST(job_scheduler, lock_of_problem_without_jobs) {
+	JobScheduler js;
+	js.lock_problem(5);
+	js.add_judge_job({1, 0}, 5);
+	ASSERT_FALSE(js.best_judge_job().ok());
+	js.unlock_problem(5);
+	ASSERT_EQ(js.best_judge_job().job.id, 1u);
+	ASSERT_THROW(js.unlock_problem(6), std::runtime_error);
+}
+
+TEST(job_scheduler, unlock_of_unlocked_problem_with_jobs) {
+	JobScheduler js;
+	js.add_judge_job({1, 0}, 5);
+	ASSERT_THROW(js.unlock_problem(5), std::runtime_error);
+
+	js.lock_problem(5);
+	js.unlock_problem(5);
+	ASSERT_THROW(js.unlock_problem(5), std::runtime_error);
+	// The scheduler is left intact
+	auto jj = js.best_judge_job();
+	ASSERT_TRUE(jj.ok());
+	ASSERT_EQ(jj.job.id, 1u);
+	jj.was_passed();
+	ASSERT_FALSE(js.best_judge_job().ok());
+}
+
+// Random operations have to give the same results as the previous
+// implementation
+TEST(job_scheduler, same_as_legacy_implementation) {
+	std::mt19937_64 gen(1234);
+	auto rand = [&](uint64_t lo, uint64_t hi) {
+		return std::uniform_int_distribution<uint64_t>(lo, hi)(gen);
+	};
+
+	JobScheduler js;
+	LegacyJobScheduler ljs;
+	std::vector<uint64_t> locked; // Problems locked by passed jobs
+	uint64_t next_id = 1;
+	for (int iter = 0; iter < 200000; ++iter) {
+		switch (rand(0, 9)) {
+		case 0:
+		case 1:
+		case 2: {
+			Job job {next_id++, uint(rand(0, 3)), false};
+			uint64_t pid = rand(0, 40);
+			js.add_judge_job(job, pid);
+			ljs.add_judge_job(job, pid);
+			break;
+		}
+		case 3: {
+			Job job {next_id++, uint(rand(0, 3)), (rand(0, 1) == 1)};
+			uint64_t pid = rand(0, 40);
+			js.add_problem_job(job, pid);
+			ljs.add_problem_job(job, pid);
+			break;
+		}
+		case 4: {
+			Job job {next_id++, uint(rand(0, 3)), false};
+			js.add_other_job(job);
+			ljs.add_other_job(job);
+			break;
+		}
+		case 5: {
+			if (locked.empty())
+				break;
+
+			size_t i = rand(0, locked.size() - 1);
+			std::swap(locked[i], locked.back());
+			js.unlock_problem(locked.back());
+			ljs.unlock_problem(locked.back());
+			locked.pop_back();
+			break;
+		}
+		default: {
+			auto check_and_pass = [&](auto&& a, auto&& b) {
+				ASSERT_EQ(a.ok(), b.ok());
+				if (not a.ok())
+					return;
+
+				ASSERT_EQ(a.job.id, b.job.id);
+				ASSERT_EQ(a.problem_id, b.problem_id);
+				a.was_passed();
+				b.was_passed();
+				if (a.job.locks_problem)
+					locked.emplace_back(a.problem_id);
+			};
+
+			switch (rand(0, 2)) {
+			case 0:
+				check_and_pass(js.best_judge_job(), ljs.best_judge_job());
+				break;
+			case 1:
+				check_and_pass(js.best_problem_job(), ljs.best_problem_job());
+				break;
+			case 2: {
+				auto a = js.best_other_job();
+				auto b = ljs.best_other_job();
+				ASSERT_EQ(a.ok(), b.ok());
+				if (a.ok()) {
+					ASSERT_EQ(a.job.id, b.job.id);
+					a.was_passed();
+					b.was_passed();
+				}
+				break;
+			}
+			}
+		}
+		}
+
+		if (HasFatalFailure())
+			return;
+	}
+}
+
+namespace {
+
+struct JudgeJobsQueue {
+	JobScheduler js;
+	JudgeJobsPolicy policy;
+	uint64_t next_id = 1;
+
+	uint64_t add(uint priority, JudgeJobsPolicy::Class cls, uint64_t contest_id,
+	             uint64_t user_id) {
+		uint64_t id = next_id++;
+		uint64_t tag = policy.job_noticed(id, cls, contest_id, user_id);
+		js.add_judge_job({id, priority, false, true, tag}, id % 7);
+		return id;
+	}
+
+	std::vector<uint64_t> dispatch_all() {
+		std::vector<uint64_t> order;
+		for (auto jh = js.best_judge_job(); jh.ok(); jh = js.best_judge_job()) {
+			order.emplace_back(jh.job.id);
+			jh.was_passed();
+			policy.job_passed(jh.job.id);
+		}
+		return order;
+	}
+};
+
+} // anonymous namespace
+
+TEST(judge_jobs_policy, running_rounds_go_first) {
+	using JJP = JudgeJobsPolicy;
+	JudgeJobsQueue q;
+	q.add(4, JJP::Class::REJUDGE, 1, 1);
+	q.add(5, JJP::Class::JUDGE, 0, 2);
+	q.add(4, JJP::Class::LIVE_REJUDGE, 3, 3);
+	q.add(5, JJP::Class::LIVE_JUDGE, 3, 4);
+	ASSERT_EQ(q.dispatch_all(), (std::vector<uint64_t> {4, 2, 3, 1}));
+}
+
+TEST(judge_jobs_policy, contests_share_fairly) {
+	using JJP = JudgeJobsPolicy;
+	JudgeJobsQueue q;
+	std::vector<uint64_t> rejudge, other_contest;
+	for (int i = 0; i < 100; ++i)
+		rejudge.emplace_back(q.add(4, JJP::Class::REJUDGE, 1, i));
+	for (int i = 0; i < 3; ++i)
+		other_contest.emplace_back(q.add(4, JJP::Class::REJUDGE, 2, 7));
+
+	auto order = q.dispatch_all();
+	ASSERT_EQ(order.size(), 103u);
+	// Jobs of the other contest are not held back by the mass rejudge
+	auto pos = [&](uint64_t id) {
+		return std::find(order.begin(), order.end(), id) - order.begin();
+	};
+	ASSERT_LT(pos(other_contest.back()), 10);
+}
+
+TEST(judge_jobs_policy, users_share_contest_fairly) {
+	using JJP = JudgeJobsPolicy;
+	JudgeJobsQueue q;
+	std::vector<uint64_t> spammer, other_user;
+	for (int i = 0; i < 50; ++i)
+		spammer.emplace_back(q.add(5, JJP::Class::LIVE_JUDGE, 1, 1));
+	for (int i = 0; i < 2; ++i)
+		other_user.emplace_back(q.add(5, JJP::Class::LIVE_JUDGE, 1, 2));
+
+	auto order = q.dispatch_all();
+	auto pos = [&](uint64_t id) {
+		return std::find(order.begin(), order.end(), id) - order.begin();
+	};
+	ASSERT_LT(pos(other_user.back()), 10);
+	// The spammer's jobs are still judged in the order of submitting
+	ASSERT_TRUE(std::is_sorted(spammer.begin(), spammer.end(),
+	                           [&](uint64_t a, uint64_t b) {
+		                           return pos(a) < pos(b);
+	                           }));
+}
+
+TEST(judge_jobs_policy, wait_stats) {
+	using JJP = JudgeJobsPolicy;
+	JudgeJobsQueue q;
+	q.add(5, JJP::Class::JUDGE, 0, 1);
+	q.add(5, JJP::Class::JUDGE, 0, 2);
+	q.add(4, JJP::Class::REJUDGE, 0, 2);
+	q.dispatch_all();
+	ASSERT_EQ(q.policy.wait_stats(JJP::Class::JUDGE).jobs, 2u);
+	ASSERT_EQ(q.policy.wait_stats(JJP::Class::REJUDGE).jobs, 1u);
+	ASSERT_EQ(q.policy.wait_stats(JJP::Class::LIVE_JUDGE).jobs, 0u);
+	q.policy.reset_wait_stats();
+	ASSERT_EQ(q.policy.wait_stats(JJP::Class::JUDGE).jobs, 0u);
+}
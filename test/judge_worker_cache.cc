@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <sim/judge_worker_cache.hh>
+
+using std::make_shared;
+
+TEST(judge_worker_cache, get_and_put) {
+	JudgeWorkerCache cache(4);
+	EXPECT_EQ(cache.get(1, "v1"), nullptr);
+
+	auto jworker = make_shared<sim::JudgeWorker>();
+	cache.put(1, "v1", jworker);
+	EXPECT_EQ(cache.get(1, "v1"), jworker);
+	EXPECT_EQ(cache.get(2, "v1"), nullptr);
+	EXPECT_EQ(cache.hits(), 1);
+	EXPECT_EQ(cache.misses(), 2);
+
+	// Putting the package again replaces its entry
+	auto other = make_shared<sim::JudgeWorker>();
+	cache.put(1, "v1", other);
+	EXPECT_EQ(cache.get(1, "v1"), other);
+
+	JudgeWorkerCache disabled(0);
+	disabled.put(1, "v1", jworker);
+	EXPECT_EQ(disabled.get(1, "v1"), nullptr);
+}
+
+TEST(judge_worker_cache, lru_eviction) {
+	JudgeWorkerCache cache(2);
+	auto a = make_shared<sim::JudgeWorker>();
+	auto b = make_shared<sim::JudgeWorker>();
+	auto c = make_shared<sim::JudgeWorker>();
+	cache.put(1, "v", a);
+	cache.put(2, "v", b);
+	EXPECT_EQ(cache.get(1, "v"), a); // 2 becomes the least recently used
+	cache.put(3, "v", c);
+	EXPECT_EQ(cache.get(2, "v"), nullptr);
+	EXPECT_EQ(cache.get(1, "v"), a);
+	EXPECT_EQ(cache.get(3, "v"), c);
+
+	// Looking up the shards does not count as a use
+	cache.shard_jworkers(1, "v");
+	cache.put(2, "v", b);
+	EXPECT_EQ(cache.get(1, "v"), nullptr);
+	EXPECT_EQ(cache.get(3, "v"), c);
+	EXPECT_EQ(cache.get(2, "v"), b);
+}
+
+TEST(judge_worker_cache, version_invalidation) {
+	JudgeWorkerCache cache(4);
+	auto jworker = make_shared<sim::JudgeWorker>();
+	cache.put(1, "v1", jworker);
+	cache.set_shard_jworkers(1, "v1", {make_shared<sim::JudgeWorker>()});
+	EXPECT_TRUE(cache.shard_jworkers(1, "v2").empty());
+	EXPECT_EQ(cache.shard_jworkers(1, "v1").size(), 1);
+
+	// The stale entry is dropped
+	EXPECT_EQ(cache.get(1, "v2"), nullptr);
+	EXPECT_EQ(cache.get(1, "v1"), nullptr);
+	EXPECT_TRUE(cache.shard_jworkers(1, "v1").empty());
+
+	cache.put(1, "v2", jworker);
+	EXPECT_EQ(cache.get(1, "v2"), jworker);
+	EXPECT_TRUE(cache.shard_jworkers(1, "v2").empty());
+}
+
+TEST(judge_worker_cache, shard_jworkers) {
+	JudgeWorkerCache cache(4);
+	std::vector<std::shared_ptr<sim::JudgeWorker>> shards = {
+	   make_shared<sim::JudgeWorker>(), make_shared<sim::JudgeWorker>()};
+	// The package is not cached
+	cache.set_shard_jworkers(1, "v", shards);
+	EXPECT_TRUE(cache.shard_jworkers(1, "v").empty());
+
+	cache.put(1, "v", make_shared<sim::JudgeWorker>());
+	cache.set_shard_jworkers(1, "v", shards);
+	EXPECT_EQ(cache.shard_jworkers(1, "v"), shards);
+	EXPECT_EQ(cache.hits(), 0);
+	EXPECT_EQ(cache.misses(), 0);
+
+	// Putting the package again drops its shards
+	cache.put(1, "v", make_shared<sim::JudgeWorker>());
+	EXPECT_TRUE(cache.shard_jworkers(1, "v").empty());
+}
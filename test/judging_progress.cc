@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include <sim/judging_progress.hh>
+
+using sim::JudgeReport;
+using std::chrono::milliseconds;
+
+namespace {
+
+JudgeReport example_report() {
+	using Test = JudgeReport::Test;
+
+	JudgeReport report;
+	report.judge_log = "log\nlines";
+	auto& group1 = report.groups.emplace_back();
+	group1.score = 12;
+	group1.max_score = 50;
+	group1.tests.emplace_back("1a", Test::OK, milliseconds(120),
+	                          milliseconds(1000), 1 << 20, 64 << 20, "");
+	group1.tests.emplace_back("1b", Test::WA, milliseconds(10),
+	                          milliseconds(1000), 4 << 10, 64 << 20,
+	                          "Line 1: read 'a', expected 'b'");
+	auto& group2 = report.groups.emplace_back();
+	group2.score = 0;
+	group2.max_score = -50;
+	group2.tests.emplace_back("2a", Test::TLE, milliseconds(2000),
+	                          milliseconds(2000), 1 << 20, 64 << 20, "");
+	group2.tests.emplace_back("2b", Test::SKIPPED, milliseconds(0),
+	                          milliseconds(2000), 0, 64 << 20, "");
+	return report;
+}
+
+} // namespace
+
+TEST(judging_progress, judged_groups) {
+	auto report = example_report();
+	EXPECT_EQ(sim::judging_progress::judged_groups(report), 1);
+
+	report.groups[1].tests[1].status = JudgeReport::Test::OK;
+	EXPECT_EQ(sim::judging_progress::judged_groups(report), 2);
+
+	report.groups[0].tests[0].status = JudgeReport::Test::SKIPPED;
+	EXPECT_EQ(sim::judging_progress::judged_groups(report), 1);
+
+	EXPECT_EQ(sim::judging_progress::judged_groups(JudgeReport {}), 0);
+}
@@ -0,0 +1,184 @@
+#include "../src/web_interface/multipart_form_data_parser.hh"
+
+#include <gtest/gtest.h>
+#include <simlib/file_contents.hh>
+#include <simlib/file_manip.hh>
+
+using server::HttpRequest;
+using server::MultipartFormDataParser;
+using Status = MultipartFormDataParser::Status;
+using std::string;
+
+namespace {
+
+class MultipartFormDataParserTest : public ::testing::Test {
+protected:
+	string dir_;
+
+	void SetUp() override {
+		char tmpl[] = "/tmp/sim-multipart-test.XXXXXX";
+		ASSERT_NE(mkdtemp(tmpl), nullptr);
+		dir_ = concat_tostr(tmpl, '/');
+	}
+
+	void TearDown() override { (void)remove_r(dir_); }
+
+	// Feeds @p body split at @p splits (sorted positions)
+	Status parse(StringView body, HttpRequest::Form& form,
+	             const std::vector<size_t>& splits = {},
+	             size_t max_header_len = 1024, size_t max_field_len = 1024) {
+		MultipartFormDataParser parser("xyz", form, dir_, max_header_len,
+		                               max_field_len);
+		size_t beg = 0;
+		for (size_t split : splits) {
+			parser.feed(body.substr(beg, split - beg));
+			beg = split;
+		}
+		parser.feed(body.substr(beg));
+		return parser.finish();
+	}
+};
+
+constexpr char BODY[] =
+   "preamble\r\n"
+   "--xyz\r\n"
+   "Content-Disposition: form-data; name=\"text\"\r\n"
+   "\r\n"
+   "a\r\n-b\r\n--xy\r\n"
+   "--xyz  \r\n"
+   "content-disposition: form-data; name=\"file\"; "
+   "filename=\"a \\\"b\\\".txt\"\r\n"
+   "Content-Type: application/octet-stream\r\n"
+   "\r\n"
+   "\r\r\n--x\r\n--xy\rz--xyz\r"
+   "\r\n--xyz\r\n"
+   "Content-Disposition: form-data; name=empty\r\n"
+   "\r\n"
+   "\r\n--xyz--\r\n"
+   "epilogue\r\n--xyz\r\n";
+
+void expect_body_parsed(const HttpRequest::Form& form) {
+	EXPECT_EQ(form.get("text"), "a\r\n-b\r\n--xy");
+	EXPECT_EQ(form.get("file"), "a \"b\".txt");
+	EXPECT_TRUE(form.exist("empty"));
+	EXPECT_EQ(form.get("empty"), "");
+	ASSERT_EQ(form.files.size(), 1u);
+	EXPECT_EQ(get_file_contents(form.file_path("file").to_string()),
+	          "\r\r\n--x\r\n--xy\rz--xyz\r");
+}
+
+} // anonymous namespace
+
+TEST_F(MultipartFormDataParserTest, whole_content) {
+	HttpRequest::Form form;
+	ASSERT_EQ(parse(BODY, form), Status::FINISHED);
+	expect_body_parsed(form);
+	EXPECT_TRUE(has_prefix(form.file_path("file"), dir_));
+}
+
+TEST_F(MultipartFormDataParserTest, every_split_point) {
+	StringView body = BODY;
+	for (size_t i = 0; i <= body.size(); ++i) {
+		HttpRequest::Form form;
+		ASSERT_EQ(parse(body, form, {i}), Status::FINISHED) << i;
+		expect_body_parsed(form);
+	}
+}
+
+TEST_F(MultipartFormDataParserTest, byte_at_a_time) {
+	StringView body = BODY;
+	std::vector<size_t> splits;
+	for (size_t i = 1; i < body.size(); ++i)
+		splits.emplace_back(i);
+
+	HttpRequest::Form form;
+	ASSERT_EQ(parse(body, form, splits), Status::FINISHED);
+	expect_body_parsed(form);
+}
+
+TEST_F(MultipartFormDataParserTest, delimiter_at_the_beginning) {
+	HttpRequest::Form form;
+	ASSERT_EQ(parse("--xyz\r\n"
+	                "Content-Disposition: form-data; name=\"a\"\r\n"
+	                "\r\n"
+	                "x\r\n--xyz--",
+	                form),
+	          Status::FINISHED);
+	EXPECT_EQ(form.get("a"), "x");
+}
+
+TEST_F(MultipartFormDataParserTest, files_are_removed_with_the_form) {
+	string path;
+	{
+		HttpRequest::Form form;
+		ASSERT_EQ(parse(BODY, form), Status::FINISHED);
+		path = form.file_path("file").to_string();
+		ASSERT_EQ(access(path.c_str(), F_OK), 0);
+	}
+	EXPECT_NE(access(path.c_str(), F_OK), 0);
+}
+
+TEST_F(MultipartFormDataParserTest, repeated_file_field_replaces_file) {
+	HttpRequest::Form form;
+	ASSERT_EQ(parse("--xyz\r\n"
+	                "Content-Disposition: form-data; name=f; filename=a\r\n"
+	                "\r\n"
+	                "first\r\n--xyz\r\n"
+	                "Content-Disposition: form-data; name=f; filename=b\r\n"
+	                "\r\n"
+	                "second\r\n--xyz--\r\n",
+	                form),
+	          Status::FINISHED);
+	EXPECT_EQ(form.get("f"), "b");
+	ASSERT_EQ(form.files.size(), 1u);
+	EXPECT_EQ(get_file_contents(form.file_path("f").to_string()), "second");
+}
+
+TEST_F(MultipartFormDataParserTest, unterminated_content) {
+	HttpRequest::Form form;
+	EXPECT_EQ(parse("--xyz\r\n"
+	                "Content-Disposition: form-data; name=a\r\n"
+	                "\r\n"
+	                "x\r\n--xy",
+	                form),
+	          Status::MALFORMED);
+	EXPECT_EQ(parse("", form), Status::MALFORMED);
+	EXPECT_EQ(parse("no delimiter at all", form), Status::MALFORMED);
+}
+
+TEST_F(MultipartFormDataParserTest, malformed_content) {
+	HttpRequest::Form form;
+	// Garbage after the delimiter
+	EXPECT_EQ(parse("--xyzabc\r\n\r\nx\r\n--xyz--", form), Status::MALFORMED);
+	// Header without a colon
+	EXPECT_EQ(parse("--xyz\r\nContent-Disposition\r\n\r\nx\r\n--xyz--", form),
+	          Status::MALFORMED);
+}
+
+TEST_F(MultipartFormDataParserTest, limits) {
+	HttpRequest::Form form;
+	string header = concat_tostr("X: ", string(100, 'a'), "\r\n");
+	string body = concat_tostr("--xyz\r\n", header,
+	                           "Content-Disposition: form-data; name=a\r\n"
+	                           "\r\n",
+	                           string(100, 'b'), "\r\n--xyz--");
+	EXPECT_EQ(parse(body, form, {}, 150, 100), Status::FINISHED);
+	EXPECT_EQ(parse(body, form, {}, 100, 100), Status::HEADER_TOO_LONG);
+	EXPECT_EQ(parse(body, form, {}, 150, 99), Status::FIELD_TOO_LONG);
+	EXPECT_EQ(parse(body, form, {20, 40, 60, 80, 100, 120}, 100, 100),
+	          Status::HEADER_TOO_LONG);
+}
+
+TEST_F(MultipartFormDataParserTest, unwritable_files_dir) {
+	HttpRequest::Form form;
+	MultipartFormDataParser parser("xyz", form, dir_ + "nonexistent/", 1024,
+	                               1024);
+	EXPECT_EQ(
+	   parser.feed("--xyz\r\n"
+	               "Content-Disposition: form-data; name=f; filename=a\r\n"
+	               "\r\n"
+	               "data\r\n--xyz--"),
+	   Status::FILE_ERROR);
+	EXPECT_EQ(parser.finish(), Status::FILE_ERROR);
+	EXPECT_TRUE(form.files.empty());
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <sim/mysql.hh>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+class FakeStatement {
+	vector<string>* closed_;
+
+public:
+	string sql;
+
+	FakeStatement(vector<string>* closed, string sql_text)
+	   : closed_(closed), sql(std::move(sql_text)) {}
+
+	FakeStatement(FakeStatement&& other) noexcept
+	   : closed_(std::exchange(other.closed_, nullptr)),
+	     sql(std::move(other.sql)) {}
+
+	FakeStatement& operator=(FakeStatement&&) = delete;
+
+	~FakeStatement() {
+		if (closed_)
+			closed_->emplace_back(sql);
+	}
+};
+
+struct FakeConnection {
+	vector<string> prepared;
+	vector<string> closed;
+
+	FakeStatement prepare(StringView sql) {
+		prepared.emplace_back(sql.to_string());
+		return FakeStatement(&closed, sql.to_string());
+	}
+};
+
+using StatementsCache = MySQL::BasicStatementsCache<FakeConnection>;
+
+} // anonymous namespace
+
+TEST(mysql, statements_cache_reuses_statements) {
+	FakeConnection conn;
+	StatementsCache cache(conn);
+	for (int i = 0; i < 3; ++i) {
+		auto stmt = cache.prepare("SELECT 1");
+		EXPECT_EQ(stmt->sql, "SELECT 1");
+		EXPECT_TRUE(stmt.is_cached());
+		EXPECT_EQ(cache.prepare("SELECT 2")->sql, "SELECT 2");
+	}
+
+	EXPECT_EQ(conn.prepared, (vector<string> {"SELECT 1", "SELECT 2"}));
+	EXPECT_EQ(conn.closed, vector<string> {});
+	EXPECT_EQ(cache.size(), 2);
+	EXPECT_EQ(cache.hits(), 4);
+	EXPECT_EQ(cache.misses(), 2);
+}
+
+TEST(mysql, statements_cache_statement_in_use) {
+	FakeConnection conn;
+	StatementsCache cache(conn);
+	auto stmt = cache.prepare("SELECT 1");
+	{
+		// E.g. a recursive call
+		auto nested = cache.prepare("SELECT 1");
+		EXPECT_FALSE(nested.is_cached());
+		EXPECT_EQ(nested->sql, "SELECT 1");
+	}
+	EXPECT_EQ(conn.closed, vector<string> {"SELECT 1"});
+	EXPECT_TRUE(stmt.is_cached());
+	EXPECT_EQ(cache.size(), 1);
+
+	// Moving the handle keeps the statement reserved
+	auto moved = std::move(stmt);
+	EXPECT_FALSE(cache.prepare("SELECT 1").is_cached());
+	stmt = std::move(moved);
+	EXPECT_FALSE(cache.prepare("SELECT 1").is_cached());
+
+	stmt = cache.prepare("SELECT 2"); // Releases SELECT 1
+	EXPECT_TRUE(cache.prepare("SELECT 1").is_cached());
+	EXPECT_EQ(cache.hits(), 1);
+	EXPECT_EQ(cache.misses(), 5);
+}
+
+TEST(mysql, statements_cache_bounded_size) {
+	FakeConnection conn;
+	StatementsCache cache(conn, 2);
+	{
+		auto a = cache.prepare("a");
+		auto b = cache.prepare("b");
+		// Both cached statements are in use
+		EXPECT_FALSE(cache.prepare("c").is_cached());
+	}
+	EXPECT_EQ(conn.closed, vector<string> {"c"});
+
+	cache.prepare("a"); // Now b is the least recently used
+	cache.prepare("c");
+	EXPECT_EQ(conn.closed, (vector<string> {"c", "b"}));
+	EXPECT_EQ(cache.size(), 2);
+	EXPECT_TRUE(cache.prepare("a").is_cached());
+	EXPECT_TRUE(cache.prepare("c").is_cached());
+
+	{
+		auto a = cache.prepare("a");
+		cache.clear();
+		EXPECT_EQ(cache.size(), 1);
+	}
+	EXPECT_EQ(conn.closed, (vector<string> {"c", "b", "c"}));
+}
+
+TEST(mysql, statements_cache_drops_statements_on_failure) {
+	FakeConnection conn;
+	StatementsCache cache(conn);
+	cache.prepare("a");
+	cache.prepare("b");
+	try {
+		auto stmt = cache.prepare("a");
+		throw std::runtime_error("Lost connection to MySQL server");
+	} catch (const std::runtime_error&) {
+	}
+	EXPECT_EQ(conn.closed, (vector<string> {"a", "b"}));
+	EXPECT_EQ(cache.size(), 0);
+	EXPECT_TRUE(cache.prepare("a").is_cached());
+	EXPECT_EQ(conn.prepared, (vector<string> {"a", "b", "a"}));
+
+	// Handles used during stack unwinding (e.g. in a destructor) are not
+	// affected by the exception in flight
+	try {
+		struct Guard {
+			StatementsCache& cache;
+			~Guard() { EXPECT_TRUE(cache.prepare("a").is_cached()); }
+		} guard {cache};
+		throw std::runtime_error("unrelated");
+	} catch (const std::runtime_error&) {
+	}
+	EXPECT_EQ(cache.size(), 1);
+	EXPECT_EQ(conn.closed, (vector<string> {"a", "b"}));
+}
@@ -0,0 +1,307 @@
+#include "../src/job_server/remote_judge_connection.hh"
+
+#include <gtest/gtest.h>
+#include <sim/remote_judge.hh>
+#include <simlib/file_descriptor.hh>
+#include <sys/socket.h>
+#include <thread>
+
+using namespace remote_judge;
+using std::string;
+
+TEST(remote_judge, job_description_dump) {
+	JobDescription jd(42, 1337, 7, 9, sim::SolutionLanguage::CPP17, false);
+	JobDescription res(jd.dump());
+	EXPECT_EQ(res.job_id, 42);
+	EXPECT_EQ(res.submission_id, 1337);
+	EXPECT_EQ(res.solution_file_id, 7);
+	EXPECT_EQ(res.problem_file_id, 9);
+	EXPECT_EQ(res.language, sim::SolutionLanguage::CPP17);
+	EXPECT_FALSE(res.stop_group_on_failure);
+}
+
+TEST(remote_judge, job_description_stop_group_on_failure) {
+	// The remote judge worker has to apply the problem's policy too
+	JobDescription jd(1, 2, 3, 4, sim::SolutionLanguage::C11, true);
+	JobDescription res(jd.dump());
+	EXPECT_TRUE(res.stop_group_on_failure);
+	EXPECT_EQ(res.language, sim::SolutionLanguage::C11);
+	EXPECT_EQ(res.problem_file_id, 4);
+
+	// The flag is a part of the message, so a payload without it is invalid
+	auto dumped = jd.dump();
+	dumped.pop_back();
+	EXPECT_THROW(JobDescription {dumped}, ProtocolError);
+}
+
+TEST(remote_judge, judge_report_dump) {
+	using Test = sim::JudgeReport::Test;
+	using std::chrono::milliseconds;
+
+	sim::JudgeReport report;
+	report.judge_log = "log\nlines";
+	auto& group = report.groups.emplace_back();
+	group.score = 12;
+	group.max_score = 50;
+	group.tests.emplace_back("1a", Test::OK, milliseconds(120),
+	                         milliseconds(1000), 1 << 20, 64 << 20, "");
+	group.tests.emplace_back("1b", Test::WA, milliseconds(10),
+	                         milliseconds(1000), 4 << 10, 64 << 20,
+	                         "Line 1: read 'a', expected 'b'");
+	report.groups.emplace_back().max_score = 0;
+
+	string buff;
+	append_dumped(buff, report);
+	StringView dumped = buff;
+	sim::JudgeReport res;
+	extract_dumped(res, dumped);
+	EXPECT_EQ(dumped.size(), 0);
+
+	EXPECT_EQ(res.judge_log, report.judge_log);
+	ASSERT_EQ(res.groups.size(), 2);
+	EXPECT_EQ(res.groups[0].score, 12);
+	EXPECT_EQ(res.groups[0].max_score, 50);
+	ASSERT_EQ(res.groups[0].tests.size(), 2);
+	EXPECT_TRUE(res.groups[1].tests.empty());
+	for (size_t i = 0; i < 2; ++i) {
+		auto& a = report.groups[0].tests[i];
+		auto& b = res.groups[0].tests[i];
+		EXPECT_EQ(a.name, b.name);
+		EXPECT_EQ(a.status, b.status);
+		EXPECT_EQ(a.runtime, b.runtime);
+		EXPECT_EQ(a.time_limit, b.time_limit);
+		EXPECT_EQ(a.memory_consumed, b.memory_consumed);
+		EXPECT_EQ(a.memory_limit, b.memory_limit);
+		EXPECT_EQ(a.comment, b.comment);
+	}
+}
+
+TEST(remote_judge, send_and_receive_message) {
+	int fds[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+	FileDescriptor a(fds[0]), b(fds[1]);
+
+	using std::chrono::milliseconds;
+	EXPECT_FALSE(receive_message(b, milliseconds(10)).has_value());
+
+	send_message(a, MessageType::HEARTBEAT, "abc");
+	send_message(a, MessageType::FILE_CHUNK, "");
+	auto msg = receive_message(b, milliseconds(1000));
+	ASSERT_TRUE(msg.has_value());
+	EXPECT_EQ(msg->type, MessageType::HEARTBEAT);
+	EXPECT_EQ(msg->payload, "abc");
+	msg = receive_message(b, milliseconds(1000));
+	ASSERT_TRUE(msg.has_value());
+	EXPECT_EQ(msg->type, MessageType::FILE_CHUNK);
+	EXPECT_EQ(msg->payload, "");
+
+	(void)a.close();
+	EXPECT_THROW(receive_message(b, milliseconds(1000)), ConnectionLost);
+}
+
+TEST(remote_judge, tokens_equal) {
+	EXPECT_TRUE(tokens_equal("s3cr3t", "s3cr3t"));
+	EXPECT_TRUE(tokens_equal("", ""));
+	EXPECT_FALSE(tokens_equal("s3cr3T", "s3cr3t"));
+	EXPECT_FALSE(tokens_equal("x3cr3t", "s3cr3t"));
+	EXPECT_FALSE(tokens_equal("s3cr3", "s3cr3t"));
+	EXPECT_FALSE(tokens_equal("s3cr3tx", "s3cr3t"));
+	EXPECT_FALSE(tokens_equal("", "s3cr3t"));
+	EXPECT_FALSE(tokens_equal("s3cr3t", ""));
+}
+
+TEST(remote_judge, parse_address) {
+	auto addr = parse_address("127.0.0.1:8079");
+	EXPECT_EQ(addr.sin_family, AF_INET);
+	EXPECT_EQ(ntohs(addr.sin_port), 8079);
+	EXPECT_EQ(ntohl(addr.sin_addr.s_addr), 0x7f000001);
+
+	EXPECT_EQ(parse_address("*:80").sin_addr.s_addr, htonl(INADDR_ANY));
+	EXPECT_THROW(parse_address("127.0.0.1"), std::runtime_error);
+	EXPECT_THROW(parse_address("127.0.0.1:x"), std::runtime_error);
+	EXPECT_THROW(parse_address(":80"), std::runtime_error);
+}
+
+namespace {
+
+template <class... Args>
+string dumped(Args&&... args) {
+	using jobs::append_dumped;
+	using remote_judge::append_dumped;
+	string res;
+	(append_dumped(res, std::forward<Args>(args)), ...);
+	return res;
+}
+
+// Connects the job server's end of a connection with the end of a fake remote
+// judge worker
+std::unique_ptr<RemoteJudgeConnection> connect(FileDescriptor& worker_fd) {
+	int fds[2];
+	throw_assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	worker_fd = FileDescriptor(fds[1]);
+	return std::make_unique<RemoteJudgeConnection>(FileDescriptor(fds[0]),
+	                                               "fake worker");
+}
+
+Message receive(int fd) {
+	auto msg = receive_message(fd, std::chrono::seconds(10));
+	throw_assert(msg.has_value());
+	return std::move(*msg);
+}
+
+sim::JudgeReport report_with_log(string log) {
+	sim::JudgeReport report;
+	report.judge_log = std::move(log);
+	return report;
+}
+
+// Judges the received job the way sim-judge-worker does, with the judge log
+// of every report identifying the job
+void fake_worker(int fd) {
+	auto msg = receive(fd);
+	throw_assert(msg.type == MessageType::JOB);
+	JobDescription job(msg.payload);
+
+	// A late message of the previous job is ignored
+	send_message(fd, MessageType::COMPILATION_RESULT,
+	             dumped(job.job_id + 1000, std::optional<string>("x")));
+	// Only the files of the current job are served
+	send_message(fd, MessageType::FILE_REQUEST,
+	             dumped(job.job_id, job.problem_file_id + 1000));
+	msg = receive(fd);
+	throw_assert(msg.type == MessageType::FILE_UNAVAILABLE);
+
+	send_message(fd, MessageType::HEARTBEAT, dumped(job.job_id));
+	send_message(fd, MessageType::COMPILATION_RESULT,
+	             dumped(job.job_id, std::optional<string>()));
+	send_message(fd, MessageType::CHECKER_COMPILATION_RESULT,
+	             dumped(job.job_id, std::optional<string>()));
+	for (bool final : {false, true}) {
+		auto log = concat_tostr("job ", job.job_id, final ? " final" : "");
+		for (bool partial : {true, false}) {
+			send_message(fd, MessageType::JUDGE_REPORT,
+			             dumped(job.job_id, final, partial,
+			                    report_with_log(log)));
+		}
+	}
+}
+
+} // anonymous namespace
+
+TEST(remote_judge, several_workers_at_once) {
+	constexpr uint64_t WORKERS = 4;
+	std::vector<FileDescriptor> worker_fds(WORKERS);
+	std::vector<std::unique_ptr<RemoteJudgeConnection>> conns;
+	for (auto& fd : worker_fds)
+		conns.emplace_back(connect(fd));
+
+	std::vector<std::thread> threads;
+	for (uint64_t i = 0; i < WORKERS; ++i) {
+		threads.emplace_back([&, i] {
+			try {
+				fake_worker(worker_fds[i]);
+			} catch (const std::exception& e) {
+				ADD_FAILURE() << "worker " << i << ": " << e.what();
+			}
+		});
+		// Every connection is served by its own thread, as in the job server
+		threads.emplace_back([&, i] {
+			try {
+				auto& conn = *conns[i];
+				uint64_t job_id = i + 1;
+				conn.start_job({job_id, 100 + i, 200 + i, 300 + i,
+				                sim::SolutionLanguage::CPP17, false});
+				EXPECT_EQ(conn.await_compilation_result(), std::nullopt);
+				EXPECT_EQ(conn.await_checker_compilation_result(),
+				          std::nullopt);
+				for (bool final : {false, true}) {
+					auto log =
+					   concat_tostr("job ", job_id, final ? " final" : "");
+					size_t partial_reports = 0;
+					auto report = conn.await_judge_report(
+					   final, [&](const sim::JudgeReport& partial) {
+						   EXPECT_EQ(partial.judge_log, log);
+						   ++partial_reports;
+					   });
+					EXPECT_EQ(report.judge_log, log);
+					EXPECT_EQ(partial_reports, 1);
+				}
+			} catch (const std::exception& e) {
+				ADD_FAILURE() << "connection " << i << ": " << e.what();
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+TEST(remote_judge, worker_dropped_mid_job) {
+	FileDescriptor worker_fd;
+	auto conn = connect(worker_fd);
+	conn->start_job({7, 1, 2, 3, sim::SolutionLanguage::C11, false});
+	EXPECT_EQ(receive(worker_fd).type, MessageType::JOB);
+
+	send_message(worker_fd, MessageType::COMPILATION_RESULT,
+	             dumped(uint64_t(7), std::optional<string>()));
+	send_message(worker_fd, MessageType::CHECKER_COMPILATION_RESULT,
+	             dumped(uint64_t(7), std::optional<string>()));
+	send_message(worker_fd, MessageType::JUDGE_REPORT,
+	             dumped(uint64_t(7), false, true, report_with_log("partial")));
+	(void)worker_fd.close();
+
+	EXPECT_EQ(conn->await_compilation_result(), std::nullopt);
+	EXPECT_EQ(conn->await_checker_compilation_result(), std::nullopt);
+	size_t partial_reports = 0;
+	// The job has to be returned to the queue, not failed with a judge error
+	EXPECT_THROW(conn->await_judge_report(
+	                false, [&](const sim::JudgeReport&) { ++partial_reports; }),
+	             ConnectionLost);
+	EXPECT_EQ(partial_reports, 1);
+}
+
+TEST(remote_judge, malformed_messages) {
+	auto expect_protocol_error = [](MessageType type, const string& payload) {
+		FileDescriptor worker_fd;
+		auto conn = connect(worker_fd);
+		conn->start_job({7, 1, 2, 3, sim::SolutionLanguage::C11, false});
+		send_message(worker_fd, type, payload);
+		// ProtocolError is a ConnectionLost, so the job is returned to the
+		// queue
+		EXPECT_THROW(conn->await_compilation_result(), ProtocolError)
+		   << "message type: " << (int)type;
+	};
+
+	// Too short for the job id
+	expect_protocol_error(MessageType::COMPILATION_RESULT, "abc");
+	// Truncated compilation errors
+	auto payload = dumped(uint64_t(7), std::optional<string>("errors"));
+	payload.pop_back();
+	expect_protocol_error(MessageType::COMPILATION_RESULT, payload);
+	expect_protocol_error(MessageType::JUDGE_ERROR, dumped(uint64_t(7)));
+	expect_protocol_error(MessageType::FILE_REQUEST, dumped(uint64_t(7)));
+
+	// Truncated judge report
+	FileDescriptor worker_fd;
+	auto conn = connect(worker_fd);
+	conn->start_job({7, 1, 2, 3, sim::SolutionLanguage::C11, false});
+	payload = dumped(uint64_t(7), false, false, report_with_log("log"));
+	payload.resize(payload.size() - 2);
+	send_message(worker_fd, MessageType::JUDGE_REPORT, payload);
+	EXPECT_THROW(conn->await_judge_report(false, {}), ProtocolError);
+
+	// A well-formed judge error fails the job
+	conn = connect(worker_fd);
+	conn->start_job({7, 1, 2, 3, sim::SolutionLanguage::C11, false});
+	send_message(worker_fd, MessageType::JUDGE_ERROR,
+	             dumped(uint64_t(7), "sandbox failed"));
+	try {
+		conn->await_compilation_result();
+		ADD_FAILURE() << "no exception thrown";
+	} catch (const ConnectionLost& e) {
+		ADD_FAILURE() << "judge error taken for a lost connection: "
+		              << e.what();
+	} catch (const std::runtime_error& e) {
+		EXPECT_NE(string(e.what()).find("sandbox failed"), string::npos);
+	}
+}
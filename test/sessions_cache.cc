@@ -0,0 +1,108 @@
+#include "../src/web_interface/sessions_cache.hh"
+
+#include <gtest/gtest.h>
+#include <simlib/time.hh>
+
+using server::SessionsCache;
+using std::string;
+
+namespace {
+
+constexpr time_t CURR_TIME = 1'600'000'000;
+
+SessionsCache::Session example_session(string user_id, time_t loaded_at) {
+	return {"csrf_token", std::move(user_id), sim::User::Type::NORMAL,
+	        "username",   "data",             mysql_date(CURR_TIME + 3600),
+	        loaded_at};
+}
+
+} // anonymous namespace
+
+TEST(sessions_cache, find_and_store) {
+	SessionsCache cache;
+	EXPECT_EQ(cache.find("abc", CURR_TIME), std::nullopt);
+
+	cache.store("abc", example_session("7", CURR_TIME), cache.generation());
+	auto session = cache.find("abc", CURR_TIME + 1);
+	ASSERT_TRUE(session.has_value());
+	EXPECT_EQ(session->csrf_token, "csrf_token");
+	EXPECT_EQ(session->user_id, "7");
+	EXPECT_EQ(session->user_type, sim::User::Type::NORMAL);
+	EXPECT_EQ(session->username, "username");
+	EXPECT_EQ(session->data, "data");
+	EXPECT_EQ(cache.find("abd", CURR_TIME + 1), std::nullopt);
+
+	// Stale entries are reloaded
+	EXPECT_EQ(cache.find("abc", CURR_TIME + SessionsCache::TTL), std::nullopt);
+	EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(sessions_cache, expiration) {
+	SessionsCache cache;
+	auto session = example_session("7", CURR_TIME);
+	session.expires = mysql_date(CURR_TIME + 1);
+	cache.store("abc", session, cache.generation());
+	EXPECT_NE(cache.find("abc", CURR_TIME + 1), std::nullopt);
+	EXPECT_EQ(cache.find("abc", CURR_TIME + 2), std::nullopt);
+}
+
+TEST(sessions_cache, erasing) {
+	SessionsCache cache;
+	cache.store("a", example_session("7", CURR_TIME), cache.generation());
+	cache.store("b", example_session("7", CURR_TIME), cache.generation());
+	cache.store("c", example_session("8", CURR_TIME), cache.generation());
+
+	cache.erase("a");
+	EXPECT_EQ(cache.find("a", CURR_TIME), std::nullopt);
+	EXPECT_NE(cache.find("b", CURR_TIME), std::nullopt);
+
+	cache.erase_user("7");
+	EXPECT_EQ(cache.find("b", CURR_TIME), std::nullopt);
+	EXPECT_NE(cache.find("c", CURR_TIME), std::nullopt);
+}
+
+TEST(sessions_cache, outdated_load_is_not_stored) {
+	SessionsCache cache;
+	// A worker reads the session from the database...
+	auto generation = cache.generation();
+	// ...meanwhile another one changes the user and erases their sessions
+	cache.erase_user("7");
+	cache.store("a", example_session("7", CURR_TIME), generation);
+	EXPECT_EQ(cache.find("a", CURR_TIME), std::nullopt);
+
+	cache.store("a", example_session("7", CURR_TIME), cache.generation());
+	EXPECT_NE(cache.find("a", CURR_TIME), std::nullopt);
+}
+
+TEST(sessions_cache, sweep) {
+	SessionsCache cache;
+	cache.store("a", example_session("7", CURR_TIME), cache.generation());
+	cache.store("b", example_session("7", CURR_TIME + 10), cache.generation());
+	auto expiring = example_session("8", CURR_TIME + 10);
+	expiring.expires = mysql_date(CURR_TIME + 15);
+	cache.store("c", expiring, cache.generation());
+
+	EXPECT_EQ(cache.sweep(CURR_TIME + 10), 0);
+	EXPECT_EQ(cache.sweep(CURR_TIME + SessionsCache::TTL), 2);
+	EXPECT_EQ(cache.size(), 1);
+	EXPECT_NE(cache.find("b", CURR_TIME + SessionsCache::TTL), std::nullopt);
+}
+
+TEST(sessions_cache, bounded_size) {
+	SessionsCache cache;
+	for (size_t i = 0; i < SessionsCache::MAX_SESSIONS; ++i) {
+		cache.store(std::to_string(i), example_session("7", CURR_TIME),
+		            cache.generation());
+	}
+	EXPECT_EQ(cache.size(), SessionsCache::MAX_SESSIONS);
+
+	// Nothing is stale, so some entry is evicted
+	cache.store("x", example_session("7", CURR_TIME), cache.generation());
+	EXPECT_EQ(cache.size(), SessionsCache::MAX_SESSIONS);
+	EXPECT_NE(cache.find("x", CURR_TIME), std::nullopt);
+
+	// The stale entries are swept
+	cache.store("y", example_session("7", CURR_TIME + SessionsCache::TTL),
+	            cache.generation());
+	EXPECT_EQ(cache.size(), 1);
+}
@@ -0,0 +1,165 @@
+#include "../src/web_interface/connection.hh"
+#include "../src/web_interface/static_files_cache.hh"
+
+#include <gtest/gtest.h>
+#include <simlib/file_contents.hh>
+#include <simlib/file_manip.hh>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using server::Connection;
+using server::ContentCoding;
+using server::StaticFilesCache;
+using std::string;
+
+namespace {
+
+class StaticFilesCacheTest : public ::testing::Test {
+protected:
+	string root_;
+	string css_;
+
+	void SetUp() override {
+		char dir_template[] = "/tmp/sim-static-files-test.XXXXXX";
+		ASSERT_NE(mkdtemp(dir_template), nullptr);
+		root_ = dir_template;
+		ASSERT_EQ(mkdir((root_ + "/kit").c_str(), 0700), 0);
+		ASSERT_EQ(mkdir((root_ + "/kit/img").c_str(), 0700), 0);
+
+		for (int i = 0; i < 1000; ++i)
+			back_insert(css_, ".class", i, " { margin: ", i, "px; }\n");
+		put_file_contents(root_ + "/kit/styles.css", css_);
+		put_file_contents(root_ + "/kit/img/logo.png", "\x89PNG...");
+		put_file_contents(root_ + "/kit/.styles.css.swp", "x");
+	}
+
+	void TearDown() override { (void)remove_r(root_); }
+
+	// Serves @p file to the GET request with the additional headers
+	// @p headers
+	string respond(const StaticFilesCache::File& file, StringView headers,
+	               bool fingerprinted = false) {
+		string raw =
+		   concat_tostr("GET /kit/x HTTP/1.1\r\n", headers, "\r\n");
+		Connection::Output out;
+		Connection conn(raw, out, true);
+		conn.get_request();
+		if (not conn.send_cached_file(file, fingerprinted))
+			return "(not sent)";
+
+		EXPECT_TRUE(out.keep_alive);
+		return out.data + (out.shared_data ? *out.shared_data : "");
+	}
+};
+
+} // anonymous namespace
+
+TEST_F(StaticFilesCacheTest, loading) {
+	StaticFilesCache cache(root_);
+	cache.load("/kit/");
+	EXPECT_EQ(cache.files_no(), 2);
+	EXPECT_EQ(cache.find("/kit/.styles.css.swp"), nullptr);
+	EXPECT_EQ(cache.find("/kit/img"), nullptr);
+
+	auto* css = cache.find("/kit/styles.css");
+	ASSERT_NE(css, nullptr);
+	struct stat st;
+	ASSERT_EQ(stat((root_ + "/kit/styles.css").c_str(), &st), 0);
+	EXPECT_EQ(css->version, server::static_file_version(st.st_mtim));
+	EXPECT_STREQ(css->content_type, "text/css; charset=utf-8");
+	EXPECT_EQ(*css->representations.at(ContentCoding::IDENTITY).content,
+	          css_);
+	EXPECT_EQ(css->representations.size(),
+	          server::is_supported(ContentCoding::BROTLI) ? 3 : 2);
+	auto& gzip = css->representations.at(ContentCoding::GZIP);
+	EXPECT_LT(gzip.content->size(), css_.size() / 3);
+	EXPECT_TRUE(has_suffix(gzip.etag, "-gz\""));
+
+	// Images are not compressed
+	auto* png = cache.find("/kit/img/logo.png");
+	ASSERT_NE(png, nullptr);
+	EXPECT_STREQ(png->content_type, "image/png");
+	EXPECT_EQ(png->representations.size(), 1);
+
+	EXPECT_THROW(cache.load("/nonexistent/"), std::exception);
+}
+
+TEST_F(StaticFilesCacheTest, responses) {
+	StaticFilesCache cache(root_);
+	cache.load("/kit/");
+	auto& css = *cache.find("/kit/styles.css");
+	auto& identity = css.representations.at(ContentCoding::IDENTITY);
+	auto& gzip = css.representations.at(ContentCoding::GZIP);
+
+	string res = respond(css, "");
+	EXPECT_TRUE(has_prefix(res, "HTTP/1.1 200 OK\r\n"));
+	EXPECT_NE(res.find("\r\nVary: Accept-Encoding\r\n"), string::npos);
+	EXPECT_NE(res.find(concat_tostr("\r\nETag: ", identity.etag, "\r\n")),
+	          string::npos);
+	EXPECT_EQ(res.find("immutable"), string::npos);
+	EXPECT_TRUE(has_suffix(res, concat_tostr("\r\n\r\n", css_)));
+
+	res = respond(css, "Accept-Encoding: gzip\r\n", true);
+	EXPECT_NE(res.find("\r\nContent-Encoding: gzip\r\n"), string::npos);
+	EXPECT_NE(res.find("\r\nCache-Control: public, max-age=31536000, "
+	                   "immutable\r\n"),
+	          string::npos);
+	EXPECT_NE(res.find(concat_tostr("\r\nETag: ", gzip.etag, "\r\n")),
+	          string::npos);
+	EXPECT_TRUE(has_suffix(res, *gzip.content));
+
+	// Revalidation
+	res = respond(css, concat_tostr("Accept-Encoding: gzip\r\nIf-None-Match: ",
+	                                gzip.etag, "\r\n"));
+	EXPECT_TRUE(has_prefix(res, "HTTP/1.1 304 Not Modified\r\n"));
+	EXPECT_TRUE(has_suffix(res, "\r\n\r\n"));
+	res = respond(css, concat_tostr("If-None-Match: ", gzip.etag, "\r\n"));
+	EXPECT_TRUE(has_prefix(res, "HTTP/1.1 200 OK\r\n"));
+	res = respond(css, "If-Modified-Since: Fri, 31 Dec 9999 23:59:59 GMT\r\n");
+	EXPECT_TRUE(has_prefix(res, "HTTP/1.1 304 Not Modified\r\n"));
+
+	// Ranges are served from the disk
+	EXPECT_EQ(respond(css, "Range: bytes=0-9\r\n"), "(not sent)");
+}
+
+TEST_F(StaticFilesCacheTest, refreshing) {
+	StaticFilesCache cache(root_);
+	cache.load("/kit/");
+	int fd = cache.watch();
+	ASSERT_GE(fd, 0);
+	size_t initial_size = cache.total_size();
+
+	// Modification
+	put_file_contents(root_ + "/kit/styles.css", "a { }");
+	cache.handle_changes();
+	auto* css = cache.find("/kit/styles.css");
+	ASSERT_NE(css, nullptr);
+	EXPECT_EQ(*css->representations.at(ContentCoding::IDENTITY).content,
+	          "a { }");
+	EXPECT_EQ(css->representations.size(), 1); // Too small to compress
+	EXPECT_LT(cache.total_size(), initial_size);
+
+	// Files and directories created and removed
+	ASSERT_EQ(mkdir((root_ + "/kit/new").c_str(), 0700), 0);
+	put_file_contents(root_ + "/kit/new/a.js", "alert(1);");
+	cache.handle_changes();
+	EXPECT_NE(cache.find("/kit/new/a.js"), nullptr);
+	put_file_contents(root_ + "/kit/new/b.js", "alert(2);");
+	cache.handle_changes();
+	EXPECT_NE(cache.find("/kit/new/b.js"), nullptr);
+
+	ASSERT_EQ(rename((root_ + "/kit/new").c_str(), (root_ + "/moved").c_str()),
+	          0);
+	cache.handle_changes();
+	EXPECT_EQ(cache.find("/kit/new/a.js"), nullptr);
+	EXPECT_EQ(cache.find("/kit/new/b.js"), nullptr);
+	// The moved directory is not watched anymore
+	put_file_contents(root_ + "/moved/c.js", "alert(3);");
+	cache.handle_changes();
+	EXPECT_EQ(cache.files_no(), 2);
+
+	ASSERT_EQ(unlink((root_ + "/kit/styles.css").c_str()), 0);
+	cache.handle_changes();
+	EXPECT_EQ(cache.find("/kit/styles.css"), nullptr);
+	EXPECT_EQ(cache.files_no(), 1);
+}
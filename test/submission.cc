@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <sim/submission.hh>
+
+using submission::ContestFinals;
+using submission::FinalCandidate;
+using submission::select_contest_finals;
+using submission::select_problem_final;
+using FSSM = sim::ContestProblem::FinalSubmissionSelectingMethod;
+using SRM = sim::ContestProblem::ScoreRevealingMode;
+using SS = SubmissionStatus;
+using std::vector;
+
+namespace {
+
+// Compared as pairs (final_id, initial_final_id)
+std::optional<std::pair<uint64_t, uint64_t>>
+finals(const vector<FinalCandidate>& candidates, FSSM method, SRM revealing) {
+	auto res = select_contest_finals(candidates, method, revealing);
+	if (not res)
+		return std::nullopt;
+
+	return std::pair {res->final_id, res->initial_final_id};
+}
+
+// The highest score has 2, 3 and 6, of which 3 and 6 have the best full
+// status; the best initial status has 1, 4 and 5
+const vector<FinalCandidate> candidates = {
+   {1, 40, SS::OK, SS::WA},  {2, 100, SS::WA, SS::TLE},
+   {3, 100, SS::WA, SS::OK}, {4, 30, SS::OK, SS::RTE},
+   {5, 40, SS::OK, SS::WA},  {6, 100, SS::TLE, SS::OK},
+};
+
+} // anonymous namespace
+
+TEST(submission, select_problem_final) {
+	EXPECT_EQ(select_problem_final({}), std::nullopt);
+	EXPECT_EQ(select_problem_final({{7, 0, SS::OK, SS::WA}}), 7);
+	// The highest score, then the best full status, then the latest one
+	EXPECT_EQ(select_problem_final(candidates), 6);
+	EXPECT_EQ(select_problem_final({candidates.begin(), candidates.end() - 1}),
+	          3);
+	EXPECT_EQ(
+	   select_problem_final({candidates.begin(), candidates.begin() + 2}), 2);
+}
+
+TEST(submission, select_contest_finals_last_compiling) {
+	for (auto revealing :
+	     {SRM::NONE, SRM::ONLY_SCORE, SRM::SCORE_AND_FULL_STATUS}) {
+		EXPECT_EQ(finals({}, FSSM::LAST_COMPILING, revealing), std::nullopt);
+		EXPECT_EQ(finals(candidates, FSSM::LAST_COMPILING, revealing),
+		          std::pair(6ul, 6ul));
+		EXPECT_EQ(finals({candidates[3], candidates[0]}, FSSM::LAST_COMPILING,
+		                 revealing),
+		          std::pair(4ul, 4ul));
+	}
+}
+
+TEST(submission, select_contest_finals_with_highest_score) {
+	EXPECT_EQ(finals({}, FSSM::WITH_HIGHEST_SCORE, SRM::NONE), std::nullopt);
+
+	// Nothing is revealed: the latest one with the best initial status
+	EXPECT_EQ(finals(candidates, FSSM::WITH_HIGHEST_SCORE, SRM::NONE),
+	          std::pair(6ul, 5ul));
+	// The score is revealed: the latest one with the best initial status among
+	// the ones with the highest score
+	EXPECT_EQ(finals(candidates, FSSM::WITH_HIGHEST_SCORE, SRM::ONLY_SCORE),
+	          std::pair(6ul, 3ul));
+	// Everything is revealed
+	EXPECT_EQ(finals(candidates, FSSM::WITH_HIGHEST_SCORE,
+	                 SRM::SCORE_AND_FULL_STATUS),
+	          std::pair(6ul, 6ul));
+
+	vector<FinalCandidate> one_best = {candidates[0], candidates[4],
+	                                   candidates[3]};
+	EXPECT_EQ(finals(one_best, FSSM::WITH_HIGHEST_SCORE, SRM::NONE),
+	          std::pair(5ul, 5ul));
+	EXPECT_EQ(finals(one_best, FSSM::WITH_HIGHEST_SCORE, SRM::ONLY_SCORE),
+	          std::pair(5ul, 5ul));
+}
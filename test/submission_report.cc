@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <sim/submission_report.hh>
+
+using sim::JudgeReport;
+using std::string;
+using std::chrono::milliseconds;
+
+namespace sr = sim::submission_report;
+
+namespace {
+
+JudgeReport example_report() {
+	using Test = JudgeReport::Test;
+
+	JudgeReport report;
+	report.judge_log = "log\nlines";
+	auto& group1 = report.groups.emplace_back();
+	group1.score = 12;
+	group1.max_score = 50;
+	group1.tests.emplace_back("1a", Test::OK, milliseconds(120),
+	                          milliseconds(1000), 1 << 20, 64 << 20, "");
+	group1.tests.emplace_back("1b", Test::WA, milliseconds(10),
+	                          milliseconds(1000), 4 << 10, 64 << 20,
+	                          "Line 1: read 'a', expected \"<b>\" & more");
+	auto& group2 = report.groups.emplace_back();
+	group2.score = 0;
+	group2.max_score = -50;
+	group2.tests.emplace_back("2<a>", Test::TLE, milliseconds(2000),
+	                          milliseconds(2000), 1 << 20, 64 << 20,
+	                          "Line 1: read 'a', expected \"<b>\" & more");
+	group2.tests.emplace_back("2b", Test::SKIPPED, milliseconds(0),
+	                          milliseconds(2000), 0, 64 << 20, "");
+	return report;
+}
+
+void expect_equal(const JudgeReport& a, const JudgeReport& b) {
+	ASSERT_EQ(a.groups.size(), b.groups.size());
+	for (size_t i = 0; i < a.groups.size(); ++i) {
+		auto& g1 = a.groups[i];
+		auto& g2 = b.groups[i];
+		EXPECT_EQ(g1.score, g2.score);
+		EXPECT_EQ(g1.max_score, g2.max_score);
+		ASSERT_EQ(g1.tests.size(), g2.tests.size());
+		for (size_t j = 0; j < g1.tests.size(); ++j) {
+			auto& t1 = g1.tests[j];
+			auto& t2 = g2.tests[j];
+			EXPECT_EQ(t1.name, t2.name);
+			EXPECT_EQ(t1.status, t2.status);
+			EXPECT_EQ(t1.runtime, t2.runtime);
+			EXPECT_EQ(t1.time_limit, t2.time_limit);
+			EXPECT_EQ(t1.memory_consumed, t2.memory_consumed);
+			EXPECT_EQ(t1.memory_limit, t2.memory_limit);
+			EXPECT_EQ(t1.comment, t2.comment);
+		}
+	}
+}
+
+} // namespace
+
+TEST(submission_report, dump_and_extract) {
+	auto report = example_report();
+	for (bool final : {false, true}) {
+		for (bool partial : {false, true}) {
+			auto dumped = sr::dump(report, final, partial);
+			EXPECT_TRUE(sr::is_dumped(dumped));
+
+			auto res = sr::extract(dumped);
+			EXPECT_EQ(res.final, final);
+			EXPECT_EQ(res.partial, partial);
+			EXPECT_FALSE(res.compilation_errors.has_value());
+			EXPECT_EQ(res.judge_report.judge_log, "");
+			expect_equal(res.judge_report, report);
+		}
+	}
+}
+
+TEST(submission_report, dump_is_compact) {
+	// Header, groups, names (with their 4-byte sizes), 17 bytes of the fixed
+	// size columns per test, the two distinct comments and the indexes
+	string comment = "Line 1: read 'a', expected \"<b>\" & more";
+	EXPECT_EQ(sr::dump(example_report(), false, false).size(),
+	          4 + 1 + 4 + 2 * (8 + 8 + 4) + (4 + 2) * 3 + (4 + 4) + 4 * 17 +
+	             4 + 4 + (4 + comment.size()) + 4 * 4);
+}
+
+TEST(submission_report, compilation_errors) {
+	auto dumped = sr::dump_compilation_errors("a.cpp:1: error: <expected>");
+	EXPECT_TRUE(sr::is_dumped(dumped));
+	auto res = sr::extract(dumped);
+	EXPECT_EQ(res.compilation_errors, "a.cpp:1: error: <expected>");
+	EXPECT_EQ(sr::to_html(dumped),
+	          "<pre class=\"compilation-errors\">a.cpp:1: error: "
+	          "&lt;expected&gt;</pre>");
+	EXPECT_EQ(sr::to_json(dumped),
+	          concat_tostr("{\"compilation_errors\":",
+	                       json_stringify("a.cpp:1: error: <expected>"), '}'));
+}
+
+TEST(submission_report, no_report) {
+	EXPECT_FALSE(sr::is_dumped(""));
+	EXPECT_EQ(sr::to_html(""), "");
+	EXPECT_EQ(sr::to_json(""), "null");
+}
+
+TEST(submission_report, legacy_html_is_rendered_unchanged) {
+	string html = "<h2>Initial testing report</h2><p>old format</p>";
+	EXPECT_FALSE(sr::is_dumped(html));
+	EXPECT_EQ(sr::to_html(html), html);
+	EXPECT_EQ(sr::to_json(html),
+	          concat_tostr("{\"html\":", json_stringify(html), '}'));
+	EXPECT_EQ(sr::from_legacy_html(html), std::nullopt);
+}
+
+TEST(submission_report, from_legacy_html) {
+	auto report = example_report();
+	for (bool final : {false, true}) {
+		for (bool partial : {false, true}) {
+			auto dumped = sr::dump(report, final, partial);
+			auto html = sr::to_html(dumped);
+			auto converted = sr::from_legacy_html(html);
+			ASSERT_TRUE(converted.has_value());
+			EXPECT_EQ(sr::to_html(*converted), html);
+
+			auto res = sr::extract(*converted);
+			EXPECT_EQ(res.final, final);
+			EXPECT_EQ(res.partial, partial);
+			expect_equal(res.judge_report, report);
+		}
+	}
+
+	auto compilation_errors = sr::dump_compilation_errors("x < y && 'z'");
+	EXPECT_EQ(sr::from_legacy_html(sr::to_html(compilation_errors)),
+	          compilation_errors);
+
+	auto html = sr::to_html(sr::dump(report, true, false));
+	EXPECT_EQ(sr::from_legacy_html(html.substr(0, html.size() - 5)),
+	          std::nullopt);
+	EXPECT_EQ(sr::from_legacy_html(html + "<p>"), std::nullopt);
+}
+
+TEST(submission_report, to_json) {
+	using Test = JudgeReport::Test;
+
+	JudgeReport report;
+	auto& group = report.groups.emplace_back();
+	group.score = 3;
+	group.max_score = 10;
+	group.tests.emplace_back("1a", Test::OK, milliseconds(120),
+	                         milliseconds(1000), 1 << 20, 64 << 20, "");
+	group.tests.emplace_back("1b", Test::SKIPPED, milliseconds(0),
+	                         milliseconds(1000), 0, 64 << 20, "\"x\"");
+
+	EXPECT_EQ(sr::to_json(sr::dump(report, true, true)),
+	          "{\"final\":true,\"partial\":true,\"groups\":[[3,10,["
+	          "[\"1a\",\"OK\",120,1000,1024,65536,\"\"],"
+	          "[\"1b\",\"PENDING\",0,1000,0,65536,\"\\\"x\\\"\"]]]]}");
+	EXPECT_EQ(sr::to_json(sr::dump(report, false, false)),
+	          "{\"final\":false,\"partial\":false,\"groups\":[[3,10,["
+	          "[\"1a\",\"OK\",120,1000,1024,65536,\"\"],"
+	          "[\"1b\",\"SKIPPED\",0,1000,0,65536,\"\\\"x\\\"\"]]]]}");
+}
@@ -0,0 +1,87 @@
+#include "../src/job_server/workers_pool.hh"
+
+#include <condition_variable>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <set>
+
+using std::deque;
+
+namespace {
+
+// Processes the events the way the job server's events loop does, until
+// @p pred holds
+template <class Pred>
+void process_events_until(Pred&& pred) {
+	ASSERT_NE(EventsQueue::set_notifier_fd(), -1);
+	while (not pred()) {
+		pollfd pfd = {EventsQueue::get_notifier_fd(), POLLIN, 0};
+		ASSERT_EQ(poll(&pfd, 1, 10'000), 1);
+		EventsQueue::reset_notifier();
+		EventsQueue::process_events();
+	}
+}
+
+} // anonymous namespace
+
+TEST(workers_pool, recent_problems) {
+	WorkersPool::WorkerInfo wi;
+	for (int64_t problem_id : {1, 2, 3, 4})
+		wi.handles(problem_id);
+	EXPECT_EQ(wi.recent_problems, (deque<int64_t> {1, 2, 3, 4}));
+
+	// Handling a problem again makes it the most recent one
+	wi.handles(1);
+	EXPECT_EQ(wi.recent_problems, (deque<int64_t> {2, 3, 4, 1}));
+	wi.handles(5);
+	EXPECT_EQ(wi.recent_problems, (deque<int64_t> {3, 4, 1, 5}));
+	EXPECT_TRUE(wi.handled_recently(1));
+	EXPECT_FALSE(wi.handled_recently(2));
+}
+
+TEST(workers_pool, prefers_worker_that_handled_the_problem_recently) {
+	std::mutex mtx;
+	std::condition_variable released_cv;
+	std::set<uint64_t> released_jobs;
+	std::map<uint64_t, std::thread::id> job_workers;
+	int idle_events = 0;
+
+	// Workers never exit, so the pool has to outlive the test
+	auto* wp = new WorkersPool(
+	   [&](WorkersPool::NextJob job) {
+		   std::unique_lock<std::mutex> lock(mtx);
+		   job_workers[job.id] = std::this_thread::get_id();
+		   released_cv.wait(lock, [&] { return released_jobs.count(job.id); });
+	   },
+	   [&] { ++idle_events; }, nullptr);
+	auto release = [&](uint64_t job_id, int idle_events_after) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			released_jobs.emplace(job_id);
+		}
+		released_cv.notify_all();
+		process_events_until([&] { return idle_events == idle_events_after; });
+	};
+
+	wp->spawn_worker();
+	wp->spawn_worker();
+	process_events_until([&] { return idle_events == 2; });
+
+	ASSERT_TRUE(wp->pass_job(1, 7));
+	ASSERT_TRUE(wp->pass_job(2, 8));
+	EXPECT_FALSE(wp->pass_job(3, 8)); // No idle worker
+	// The worker of job 2 becomes idle first, so it would not be the default
+	// choice
+	release(2, 3);
+	release(1, 4);
+
+	ASSERT_TRUE(wp->pass_job(3, 8));
+	ASSERT_TRUE(wp->pass_job(4, 7));
+	release(3, 5);
+	release(4, 6);
+
+	std::lock_guard<std::mutex> lock(mtx);
+	EXPECT_NE(job_workers[1], job_workers[2]);
+	EXPECT_EQ(job_workers[3], job_workers[2]);
+	EXPECT_EQ(job_workers[4], job_workers[1]);
+}